@@ -0,0 +1,858 @@
+#include "Archive.h"
+#include "Trace.h"
+#include "WorkerPool.h"
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace KinectOsvr {
+
+	namespace {
+		const char Magic[4] = { 'K', 'S', 'A', 'R' };
+		const uint32_t Version = 1;
+
+		struct Header {
+			char magic[4];
+			uint32_t version;
+			int32_t jointCount;
+			int32_t chunkFrames;
+		};
+
+		// Each chunk is this, then each column's min and max over its tracked frames, then where each block starts
+		// after the table, then the blocks: timestamps, states and a column per joint and field
+		struct ChunkHeader {
+			int64_t start, end;
+			uint32_t frames;
+			uint32_t stateFrames[ArchiveState::Count];
+			uint32_t bytes;
+		};
+
+		struct IndexEntry {
+			int64_t start, end;
+			uint64_t offset;
+		};
+
+		struct Trailer {
+			uint64_t indexOffset;
+			uint32_t count;
+			char magic[4];
+		};
+
+		// Blocks before the first column's
+		const int TimestampBlock = 0;
+		const int StateBlock = 1;
+		const int FirstColumnBlock = 2;
+
+		// A gap longer than this, or time going back, starts a new chunk so deltas fit in 32 bits
+		const int64_t MaxDelta = 0x7fffffff;
+
+		// Frames count until the next one, but no longer than this after a pause
+		const int64_t MaxGap = 100000;
+
+		// Positions to a tenth of a millimetre, rotations and confidence to what their range allows
+		const double Scales[ArchiveField::Count] = { 10000, 10000, 10000, 32767, 32767, 32767, 32767, 255 };
+
+		bool seek(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+			return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+			return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+		}
+
+		uint64_t fileSize(FILE* file) {
+#ifdef _WIN32
+			if (_fseeki64(file, 0, SEEK_END) != 0) return 0;
+			return (uint64_t)_ftelli64(file);
+#else
+			if (fseeko(file, 0, SEEK_END) != 0) return 0;
+			return (uint64_t)ftello(file);
+#endif
+		}
+
+		int32_t quantize(double value, ArchiveField::Type field) {
+			double scaled = value * Scales[field];
+			if (scaled != scaled) return 0;
+			// Ten kilometres either way, far past anything a sensor reports, keeps every delta in 32 bits
+			scaled = std::min(std::max(scaled, -1e8), 1e8);
+			return (int32_t)floor(scaled + 0.5);
+		}
+
+		double fieldOf(const OSVR_PoseState& pose, double confidence, ArchiveField::Type field) {
+			// q and -q are the same rotation, keeping w positive keeps the columns from flipping
+			double sign = osvrQuatGetW(&pose.rotation) < 0 ? -1 : 1;
+			switch (field) {
+			case ArchiveField::X: return osvrVec3GetX(&pose.translation);
+			case ArchiveField::Y: return osvrVec3GetY(&pose.translation);
+			case ArchiveField::Z: return osvrVec3GetZ(&pose.translation);
+			case ArchiveField::QW: return sign * osvrQuatGetW(&pose.rotation);
+			case ArchiveField::QX: return sign * osvrQuatGetX(&pose.rotation);
+			case ArchiveField::QY: return sign * osvrQuatGetY(&pose.rotation);
+			case ArchiveField::QZ: return sign * osvrQuatGetZ(&pose.rotation);
+			default: return confidence;
+			}
+		}
+
+		uint32_t zigzag(int32_t value) {
+			return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+		}
+
+		int32_t unzigzag(uint32_t value) {
+			return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+		}
+
+		int bitsFor(uint32_t value) {
+			int bits = 0;
+			while (value != 0) {
+				bits++;
+				value >>= 1;
+			}
+			return bits;
+		}
+
+		template <typename T>
+		void put(std::vector<uint8_t>& out, const T& value) {
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+			out.insert(out.end(), bytes, bytes + sizeof(T));
+		}
+
+		template <typename T>
+		bool get(const uint8_t*& data, const uint8_t* end, T& value) {
+			if ((size_t)(end - data) < sizeof(T)) return false;
+			memcpy(&value, data, sizeof(T));
+			data += sizeof(T);
+			return true;
+		}
+
+		// Each value in the low bits bits, back to back
+		void pack(const uint32_t* values, size_t count, int bits, std::vector<uint8_t>& out) {
+			uint64_t pending = 0;
+			int used = 0;
+			for (size_t i = 0; i < count; i++) {
+				pending |= (uint64_t)values[i] << used;
+				used += bits;
+				while (used >= 8) {
+					out.push_back((uint8_t)pending);
+					pending >>= 8;
+					used -= 8;
+				}
+			}
+			if (used > 0) out.push_back((uint8_t)pending);
+		}
+
+		bool unpack(const uint8_t*& data, const uint8_t* end, size_t count, int bits, uint32_t* values) {
+			if (bits < 0 || bits > 32) return false;
+			size_t bytes = (count * bits + 7) / 8;
+			if ((size_t)(end - data) < bytes) return false;
+
+			uint32_t mask = bits == 32 ? 0xffffffffu : (1u << bits) - 1;
+			size_t i = 0;
+			uint64_t bit = 0;
+			// Eight bytes at a time while there are eight left, so there's no branching on what's in them
+			for (; i < count && bit / 8 + 8 <= bytes; i++, bit += bits) {
+				uint64_t word;
+				memcpy(&word, data + bit / 8, sizeof(word));
+				values[i] = (uint32_t)(word >> (bit & 7)) & mask;
+			}
+			for (; i < count; i++, bit += bits) {
+				uint64_t word = 0;
+				for (size_t b = bit / 8, shift = 0; b < bytes && shift < 64; b++, shift += 8) {
+					word |= (uint64_t)data[b] << shift;
+				}
+				values[i] = (uint32_t)(word >> (bit & 7)) & mask;
+			}
+			data += bytes;
+			return true;
+		}
+
+		// The first value, then the others as zigzagged differences
+		void encodeColumn(const int32_t* values, int count, std::vector<uint32_t>& scratch, std::vector<uint8_t>& out) {
+			put(out, values[0]);
+			uint32_t all = 0;
+			scratch.resize(count);
+			for (int i = 1; i < count; i++) {
+				scratch[i] = zigzag((int32_t)((uint32_t)values[i] - (uint32_t)values[i - 1]));
+				all |= scratch[i];
+			}
+			int bits = bitsFor(all);
+			put(out, (uint8_t)bits);
+			pack(&scratch[0] + 1, count - 1, bits, out);
+		}
+
+		bool decodeColumn(const uint8_t* data, const uint8_t* end, size_t count, float scale, std::vector<uint32_t>& scratch, std::vector<float>& values) {
+			int32_t value;
+			uint8_t bits;
+			if (count == 0 || !get(data, end, value) || !get(data, end, bits)) return false;
+			scratch.resize(count);
+			if (!unpack(data, end, count - 1, bits, &scratch[0])) return false;
+
+			values.resize(count);
+			values[0] = value * scale;
+			for (size_t i = 1; i < count; i++) {
+				value = (int32_t)((uint32_t)value + (uint32_t)unzigzag(scratch[i - 1]));
+				values[i] = value * scale;
+			}
+			return true;
+		}
+
+		bool overlaps(const ArchiveChunk& chunk, const ArchiveQuery& query) {
+			return chunk.end >= query.from && chunk.start < query.to;
+		}
+
+		bool covered(const ArchiveChunk& chunk, const ArchiveQuery& query) {
+			return chunk.start >= query.from && chunk.end < query.to;
+		}
+
+		uint32_t framesWith(const ArchiveChunk& chunk, ArchiveState::Type minState) {
+			uint32_t frames = 0;
+			for (int s = minState; s < ArchiveState::Count; s++) frames += chunk.stateFrames[s];
+			return frames;
+		}
+
+		// Whether the summary leaves any chance of the condition holding in the chunk
+		bool possible(const ArchiveChunk& chunk, const ArchiveCondition& condition) {
+			int column = condition.joint * ArchiveField::Count + condition.field;
+			float low = condition.value, high = condition.value;
+			if (condition.otherJoint >= 0) {
+				int other = condition.otherJoint * ArchiveField::Count + condition.field;
+				low += chunk.min[other];
+				high += chunk.max[other];
+			}
+			return condition.above ? chunk.max[column] > low : chunk.min[column] < high;
+		}
+	}
+
+	ArchiveWriter::ArchiveWriter(int chunkFrames, int buffers)
+		: m_chunkFrames(std::max(2, chunkFrames)), m_jointCount(0), m_columns(0), m_chunks(std::max(2, buffers)), m_current(-1), m_stopping(false), m_file(NULL), m_offset(0), m_failed(false) {}
+
+	ArchiveWriter::~ArchiveWriter() {
+		close();
+	}
+
+	bool ArchiveWriter::open(const std::string& path, int jointCount) {
+		close();
+		if (jointCount <= 0) return false;
+
+		m_file = fopen(path.c_str(), "wb");
+		if (m_file == NULL) return false;
+
+		Header header;
+		memcpy(header.magic, Magic, sizeof(Magic));
+		header.version = Version;
+		header.jointCount = jointCount;
+		header.chunkFrames = m_chunkFrames;
+		if (fwrite(&header, sizeof(header), 1, m_file) != 1) {
+			fclose(m_file);
+			m_file = NULL;
+			return false;
+		}
+
+		m_jointCount = jointCount;
+		m_columns = jointCount * ArchiveField::Count;
+		m_offset = sizeof(header);
+		m_failed = false;
+		m_index.clear();
+
+		// Sized once here, writing a frame only ever stores into them
+		m_free.clear();
+		m_pending.clear();
+		for (size_t i = 0; i < m_chunks.size(); i++) {
+			Chunk& chunk = m_chunks[i];
+			chunk.frames = 0;
+			chunk.timestamps.resize(m_chunkFrames);
+			chunk.states.resize(m_chunkFrames);
+			chunk.poses.resize((size_t)m_chunkFrames * jointCount);
+			chunk.confidence.resize((size_t)m_chunkFrames * jointCount);
+			m_free.push_back((int)i);
+		}
+		OSVR_PoseState identity;
+		osvrPose3SetIdentity(&identity);
+		m_lastPoses.assign(jointCount, identity);
+		m_lastConfidence.assign(jointCount, 0.0);
+		m_current = -1;
+		m_stats = Stats();
+		m_stopping = false;
+
+		// Falling behind drops frames rather than taking time from tracking
+		m_thread = std::thread(&ArchiveWriter::run, this);
+		lowerPriority(m_thread);
+		return true;
+	}
+
+	bool ArchiveWriter::isOpen() const {
+		return m_file != NULL;
+	}
+
+	void ArchiveWriter::write(int64_t timestamp, ArchiveState::Type state, const OSVR_PoseState* poses, const double* confidence) {
+		if (m_file == NULL) return;
+
+		if (m_current >= 0) {
+			Chunk& chunk = m_chunks[m_current];
+			int64_t delta = timestamp - chunk.timestamps[chunk.frames - 1];
+			if (delta < 0 || delta > MaxDelta) queue();
+		}
+		if (m_current < 0) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_free.empty()) {
+				m_stats.droppedFrames++;
+				return;
+			}
+			m_current = m_free.back();
+			m_free.pop_back();
+		}
+
+		// Nobody else touches the chunk until it's queued
+		Chunk& chunk = m_chunks[m_current];
+		int frame = chunk.frames;
+		chunk.timestamps[frame] = timestamp;
+		chunk.states[frame] = (uint8_t)state;
+
+		// Only copied here, quantizing is left to the writer's thread
+		size_t row = (size_t)frame * m_jointCount;
+		if (poses != NULL) memcpy(&m_lastPoses[0], poses, m_jointCount * sizeof(OSVR_PoseState));
+		if (confidence != NULL) memcpy(&m_lastConfidence[0], confidence, m_jointCount * sizeof(double));
+		memcpy(&chunk.poses[row], &m_lastPoses[0], m_jointCount * sizeof(OSVR_PoseState));
+		memcpy(&chunk.confidence[row], &m_lastConfidence[0], m_jointCount * sizeof(double));
+
+		if (++chunk.frames == m_chunkFrames) queue();
+	}
+
+	void ArchiveWriter::queue() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending.push_back(m_current);
+		}
+		m_current = -1;
+		m_ready.notify_one();
+	}
+
+	void ArchiveWriter::run() {
+		Trace::setThreadName("archive writer");
+
+		for (;;) {
+			int index;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_ready.wait(lock, [this] { return m_stopping || !m_pending.empty(); });
+				if (m_pending.empty()) return;
+				index = m_pending.front();
+				m_pending.pop_front();
+			}
+
+			Chunk& chunk = m_chunks[index];
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			encode(chunk);
+			double encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			bool written = false;
+			if (!m_failed) {
+				ChunkHeader header;
+				memcpy(&header, &chunk.encoded[0], sizeof(header));
+				if (fwrite(&chunk.encoded[0], 1, chunk.encoded.size(), m_file) == chunk.encoded.size()) {
+					IndexEntry entry = { header.start, header.end, m_offset };
+					m_index.push_back(entry);
+					m_offset += chunk.encoded.size();
+					written = true;
+				}
+				else {
+					// A full disk ends the archive, the chunks already written can still be read without the index
+					m_failed = true;
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stats.encodeSeconds += encodeSeconds;
+			if (written) {
+				m_stats.frames += chunk.frames;
+				m_stats.chunks++;
+				m_stats.rawBytes += (size_t)chunk.frames * (sizeof(int64_t) + 1 + (size_t)m_columns * sizeof(float));
+				m_stats.compressedBytes += chunk.encoded.size();
+			}
+			else {
+				m_stats.droppedFrames += chunk.frames;
+			}
+			chunk.frames = 0;
+			m_free.push_back(index);
+		}
+	}
+
+	void ArchiveWriter::encode(Chunk& chunk) {
+		KINECT_TRACE("encode archive chunk");
+
+		int frames = chunk.frames;
+		std::vector<uint8_t>& out = chunk.encoded;
+		out.clear();
+
+		ChunkHeader header;
+		header.start = chunk.timestamps[0];
+		header.end = chunk.timestamps[frames - 1];
+		header.frames = (uint32_t)frames;
+		for (int s = 0; s < ArchiveState::Count; s++) header.stateFrames[s] = 0;
+		for (int i = 0; i < frames; i++) header.stateFrames[chunk.states[i]]++;
+		header.bytes = 0;
+		put(out, header);
+
+		// Filled in with the columns
+		size_t summary = out.size();
+		out.resize(summary + (size_t)m_columns * 2 * sizeof(float));
+
+		int blocks = FirstColumnBlock + m_columns;
+		size_t table = out.size();
+		out.resize(table + (blocks + 1) * sizeof(uint32_t));
+		size_t data = out.size();
+		std::vector<uint32_t> offsets(blocks + 1);
+		std::vector<uint32_t> scratch(frames);
+
+		// The smallest gap comes off every delta, leaving only the jitter to store
+		offsets[TimestampBlock] = 0;
+		int64_t minDelta = MaxDelta;
+		for (int i = 1; i < frames; i++) minDelta = std::min(minDelta, chunk.timestamps[i] - chunk.timestamps[i - 1]);
+		if (frames < 2) minDelta = 0;
+		uint32_t all = 0;
+		for (int i = 1; i < frames; i++) {
+			scratch[i] = (uint32_t)(chunk.timestamps[i] - chunk.timestamps[i - 1] - minDelta);
+			all |= scratch[i];
+		}
+		int bits = bitsFor(all);
+		put(out, chunk.timestamps[0]);
+		put(out, (uint32_t)minDelta);
+		put(out, (uint8_t)bits);
+		pack(&scratch[0] + 1, frames - 1, bits, out);
+
+		offsets[StateBlock] = (uint32_t)(out.size() - data);
+		for (int i = 0; i < frames; i++) scratch[i] = chunk.states[i];
+		pack(&scratch[0], frames, 2, out);
+
+		std::vector<int32_t> column(frames);
+		for (int c = 0; c < m_columns; c++) {
+			int joint = c / ArchiveField::Count;
+			ArchiveField::Type field = (ArchiveField::Type)(c % ArchiveField::Count);
+			for (int i = 0; i < frames; i++) {
+				size_t at = (size_t)i * m_jointCount + joint;
+				column[i] = quantize(fieldOf(chunk.poses[at], chunk.confidence[at], field), field);
+			}
+
+			// Summaries only cover frames with the whole body, the rest repeat whatever came before
+			int32_t low = std::numeric_limits<int32_t>::max(), high = std::numeric_limits<int32_t>::min();
+			for (int i = 0; i < frames; i++) {
+				if (chunk.states[i] != ArchiveState::Tracked) continue;
+				low = std::min(low, column[i]);
+				high = std::max(high, column[i]);
+			}
+			float scale = (float)(1 / Scales[c % ArchiveField::Count]);
+			float min = low <= high ? low * scale : std::numeric_limits<float>::max();
+			float max = low <= high ? high * scale : -std::numeric_limits<float>::max();
+			memcpy(&out[summary + c * sizeof(float)], &min, sizeof(float));
+			memcpy(&out[summary + (m_columns + c) * sizeof(float)], &max, sizeof(float));
+
+			offsets[FirstColumnBlock + c] = (uint32_t)(out.size() - data);
+			encodeColumn(&column[0], frames, scratch, out);
+		}
+		offsets[blocks] = (uint32_t)(out.size() - data);
+
+		memcpy(&out[table], &offsets[0], offsets.size() * sizeof(uint32_t));
+		header.bytes = (uint32_t)(out.size() - sizeof(header));
+		memcpy(&out[0], &header, sizeof(header));
+	}
+
+	void ArchiveWriter::close() {
+		if (m_file == NULL) return;
+
+		if (m_current >= 0) {
+			if (m_chunks[m_current].frames > 0) {
+				queue();
+			}
+			else {
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_free.push_back(m_current);
+				m_current = -1;
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_ready.notify_all();
+		m_thread.join();
+
+		if (!m_failed) {
+			Trailer trailer;
+			trailer.indexOffset = m_offset;
+			trailer.count = (uint32_t)m_index.size();
+			memcpy(trailer.magic, Magic, sizeof(Magic));
+			if (!m_index.empty()) fwrite(&m_index[0], sizeof(IndexEntry), m_index.size(), m_file);
+			fwrite(&trailer, sizeof(trailer), 1, m_file);
+		}
+
+		fclose(m_file);
+		m_file = NULL;
+	}
+
+	ArchiveWriter::Stats ArchiveWriter::stats() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_stats;
+	}
+
+	ArchiveReader::ArchiveReader() : m_file(NULL), m_jointCount(0), m_blockChunk((size_t)-1), m_bytesRead(0) {}
+
+	ArchiveReader::~ArchiveReader() {
+		close();
+	}
+
+	bool ArchiveReader::open(const std::string& path) {
+		close();
+
+		m_file = fopen(path.c_str(), "rb");
+		if (m_file == NULL) return false;
+
+		Header header;
+		bool valid = fread(&header, sizeof(header), 1, m_file) == 1 &&
+			memcmp(header.magic, Magic, sizeof(Magic)) == 0 &&
+			header.version == Version &&
+			header.jointCount > 0 && header.jointCount <= 64 && header.chunkFrames > 1;
+		if (valid) {
+			m_jointCount = header.jointCount;
+			valid = readIndex() || scan();
+		}
+
+		if (!valid) close();
+		return valid;
+	}
+
+	bool ArchiveReader::readIndex() {
+		uint64_t size = fileSize(m_file);
+		if (size < sizeof(Header) + sizeof(Trailer)) return false;
+
+		Trailer trailer;
+		if (!seek(m_file, size - sizeof(Trailer)) || fread(&trailer, sizeof(trailer), 1, m_file) != 1) return false;
+		if (memcmp(trailer.magic, Magic, sizeof(Magic)) != 0 ||
+			trailer.indexOffset < sizeof(Header) ||
+			trailer.indexOffset + (uint64_t)trailer.count * sizeof(IndexEntry) + sizeof(Trailer) != size) {
+			return false;
+		}
+
+		std::vector<IndexEntry> index(trailer.count);
+		if (trailer.count > 0 &&
+			(!seek(m_file, trailer.indexOffset) || fread(&index[0], sizeof(IndexEntry), index.size(), m_file) != index.size())) {
+			return false;
+		}
+
+		m_chunks.resize(index.size());
+		for (size_t i = 0; i < index.size(); i++) {
+			if (index[i].offset < sizeof(Header) || !readSummary(index[i].offset, m_chunks[i]) ||
+				m_chunks[i].offset + m_chunks[i].bytes > trailer.indexOffset) {
+				m_chunks.clear();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Walks the chunks from the start, keeping every one that's all there
+	bool ArchiveReader::scan() {
+		uint64_t size = fileSize(m_file);
+		uint64_t offset = sizeof(Header);
+		m_chunks.clear();
+
+		ArchiveChunk chunk;
+		while (readSummary(offset, chunk) && chunk.offset + chunk.bytes <= size) {
+			m_chunks.push_back(chunk);
+			offset = chunk.offset + chunk.bytes;
+		}
+		return true;
+	}
+
+	bool ArchiveReader::readSummary(uint64_t offset, ArchiveChunk& chunk) {
+		ChunkHeader header;
+		if (!seek(m_file, offset) || fread(&header, sizeof(header), 1, m_file) != 1) return false;
+
+		size_t columns = (size_t)m_jointCount * ArchiveField::Count;
+		size_t table = (FirstColumnBlock + columns + 1) * sizeof(uint32_t);
+		if (header.frames == 0 || header.end < header.start || header.bytes < columns * 2 * sizeof(float) + table) return false;
+
+		chunk.start = header.start;
+		chunk.end = header.end;
+		chunk.frames = header.frames;
+		for (int s = 0; s < ArchiveState::Count; s++) chunk.stateFrames[s] = header.stateFrames[s];
+		chunk.offset = offset;
+		chunk.bytes = (uint32_t)sizeof(header) + header.bytes;
+		chunk.min.resize(columns);
+		chunk.max.resize(columns);
+		return fread(&chunk.min[0], sizeof(float), columns, m_file) == columns &&
+			fread(&chunk.max[0], sizeof(float), columns, m_file) == columns;
+	}
+
+	void ArchiveReader::close() {
+		if (m_file != NULL) {
+			fclose(m_file);
+			m_file = NULL;
+		}
+		m_chunks.clear();
+		m_blockChunk = (size_t)-1;
+		m_bytesRead = 0;
+	}
+
+	int ArchiveReader::jointCount() const {
+		return m_jointCount;
+	}
+
+	size_t ArchiveReader::chunks() const {
+		return m_chunks.size();
+	}
+
+	const ArchiveChunk& ArchiveReader::chunk(size_t i) const {
+		return m_chunks[i];
+	}
+
+	uint64_t ArchiveReader::bytesRead() const {
+		return m_bytesRead;
+	}
+
+	// Reads one block of a chunk into the buffer, the block table only once per chunk
+	bool ArchiveReader::readBlock(size_t chunk, int block) {
+		if (m_file == NULL || chunk >= m_chunks.size()) return false;
+		const ArchiveChunk& c = m_chunks[chunk];
+		size_t columns = (size_t)m_jointCount * ArchiveField::Count;
+		if (block < 0 || (size_t)block >= FirstColumnBlock + columns) return false;
+
+		uint64_t table = c.offset + sizeof(ChunkHeader) + columns * 2 * sizeof(float);
+		uint64_t data = table + (FirstColumnBlock + columns + 1) * sizeof(uint32_t);
+		if (m_blockChunk != chunk) {
+			m_blockChunk = (size_t)-1;
+			m_blockOffsets.resize(FirstColumnBlock + columns + 1);
+			if (!seek(m_file, table) || fread(&m_blockOffsets[0], sizeof(uint32_t), m_blockOffsets.size(), m_file) != m_blockOffsets.size()) {
+				return false;
+			}
+			for (size_t i = 1; i < m_blockOffsets.size(); i++) {
+				if (m_blockOffsets[i] < m_blockOffsets[i - 1]) return false;
+			}
+			if (data + m_blockOffsets.back() > c.offset + c.bytes) return false;
+			m_blockChunk = chunk;
+			m_bytesRead += m_blockOffsets.size() * sizeof(uint32_t);
+		}
+
+		m_buffer.resize(m_blockOffsets[block + 1] - m_blockOffsets[block]);
+		if (!m_buffer.empty() &&
+			(!seek(m_file, data + m_blockOffsets[block]) || fread(&m_buffer[0], 1, m_buffer.size(), m_file) != m_buffer.size())) {
+			return false;
+		}
+		m_bytesRead += m_buffer.size();
+		return true;
+	}
+
+	bool ArchiveReader::readTimestamps(size_t chunk, std::vector<int64_t>& timestamps) {
+		if (!readBlock(chunk, TimestampBlock)) return false;
+
+		size_t frames = m_chunks[chunk].frames;
+		const uint8_t* data = m_buffer.empty() ? NULL : &m_buffer[0];
+		const uint8_t* end = data + m_buffer.size();
+		int64_t timestamp;
+		uint32_t minDelta;
+		uint8_t bits;
+		if (!get(data, end, timestamp) || !get(data, end, minDelta) || !get(data, end, bits)) return false;
+		m_scratch.resize(frames);
+		if (!unpack(data, end, frames - 1, bits, &m_scratch[0])) return false;
+
+		timestamps.resize(frames);
+		timestamps[0] = timestamp;
+		for (size_t i = 1; i < frames; i++) {
+			timestamp += (int64_t)minDelta + m_scratch[i - 1];
+			timestamps[i] = timestamp;
+		}
+		return true;
+	}
+
+	bool ArchiveReader::readStates(size_t chunk, std::vector<uint8_t>& states) {
+		if (!readBlock(chunk, StateBlock)) return false;
+
+		size_t frames = m_chunks[chunk].frames;
+		const uint8_t* data = m_buffer.empty() ? NULL : &m_buffer[0];
+		m_scratch.resize(frames);
+		if (!unpack(data, data + m_buffer.size(), frames, 2, &m_scratch[0])) return false;
+
+		states.resize(frames);
+		for (size_t i = 0; i < frames; i++) states[i] = (uint8_t)std::min<uint32_t>(m_scratch[i], ArchiveState::Tracked);
+		return true;
+	}
+
+	bool ArchiveReader::readColumn(size_t chunk, int joint, ArchiveField::Type field, std::vector<float>& values) {
+		if (joint < 0 || joint >= m_jointCount || field < 0 || field >= ArchiveField::Count) return false;
+		if (!readBlock(chunk, FirstColumnBlock + joint * ArchiveField::Count + field)) return false;
+
+		const uint8_t* data = m_buffer.empty() ? NULL : &m_buffer[0];
+		return decodeColumn(data, data + m_buffer.size(), m_chunks[chunk].frames, (float)(1 / Scales[field]), m_scratch, values);
+	}
+
+	ArchiveCondition::ArchiveCondition(int joint, ArchiveField::Type field, bool above, float value)
+		: joint(joint), field(field), above(above), otherJoint(-1), value(value) {}
+
+	ArchiveCondition::ArchiveCondition(int joint, ArchiveField::Type field, bool above, int otherJoint, float margin)
+		: joint(joint), field(field), above(above), otherJoint(otherJoint), value(margin) {}
+
+	ArchiveQuery::ArchiveQuery()
+		: from(std::numeric_limits<int64_t>::min()), to(std::numeric_limits<int64_t>::max()), minState(ArchiveState::Tracked), useSummaries(true) {}
+
+	std::string archivePath(const std::string& prefix) {
+		time_t now = time(NULL);
+		struct tm local;
+#ifdef _WIN32
+		localtime_s(&local, &now);
+#else
+		localtime_r(&now, &local);
+#endif
+		char text[32];
+		strftime(text, sizeof(text), "-%Y%m%d-%H%M%S.ksa", &local);
+		return prefix + text;
+	}
+
+	bool archiveDuration(ArchiveReader& reader, const ArchiveQuery& query, ArchiveResult& result) {
+		result = ArchiveResult();
+
+		int jointCount = reader.jointCount();
+		for (size_t i = 0; i < query.anyOf.size(); i++) {
+			const ArchiveCondition& condition = query.anyOf[i];
+			if (condition.joint < 0 || condition.joint >= jointCount || condition.otherJoint >= jointCount ||
+				condition.field < 0 || condition.field >= ArchiveField::Count) {
+				return false;
+			}
+		}
+
+		// Each column a query needs is decoded once per chunk however many conditions use it
+		std::vector<int> columns;
+		for (size_t i = 0; i < query.anyOf.size(); i++) {
+			const ArchiveCondition& condition = query.anyOf[i];
+			columns.push_back(condition.joint * ArchiveField::Count + condition.field);
+			if (condition.otherJoint >= 0) columns.push_back(condition.otherJoint * ArchiveField::Count + condition.field);
+		}
+		std::sort(columns.begin(), columns.end());
+		columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+
+		std::vector<std::vector<float> > values(columns.size());
+		std::vector<int64_t> timestamps;
+		std::vector<uint8_t> states;
+		std::vector<uint8_t> hit;
+		int64_t lastGap = 0;
+
+		for (size_t c = 0; c < reader.chunks(); c++) {
+			const ArchiveChunk& chunk = reader.chunk(c);
+			if (!overlaps(chunk, query)) continue;
+
+			if (query.useSummaries) {
+				bool skip = framesWith(chunk, query.minState) == 0;
+				// The summaries say nothing about frames without the whole body
+				if (!skip && query.minState == ArchiveState::Tracked && !query.anyOf.empty()) {
+					skip = true;
+					for (size_t i = 0; i < query.anyOf.size() && skip; i++) {
+						if (possible(chunk, query.anyOf[i])) skip = false;
+					}
+				}
+				if (skip) {
+					result.chunksSkipped++;
+					continue;
+				}
+			}
+
+			if (!reader.readTimestamps(c, timestamps) || !reader.readStates(c, states)) return false;
+			for (size_t i = 0; i < columns.size(); i++) {
+				int column = columns[i];
+				if (!reader.readColumn(c, column / ArchiveField::Count, (ArchiveField::Type)(column % ArchiveField::Count), values[i])) return false;
+			}
+			result.chunksRead++;
+
+			size_t frames = chunk.frames;
+			hit.assign(frames, query.anyOf.empty() ? 1 : 0);
+			for (size_t q = 0; q < query.anyOf.size(); q++) {
+				const ArchiveCondition& condition = query.anyOf[q];
+				const float* a = &values[std::lower_bound(columns.begin(), columns.end(), condition.joint * ArchiveField::Count + condition.field) - columns.begin()][0];
+				uint8_t* h = &hit[0];
+				float value = condition.value;
+				// Plain loops over whole columns, which the compiler turns into vector compares
+				if (condition.otherJoint >= 0) {
+					const float* b = &values[std::lower_bound(columns.begin(), columns.end(), condition.otherJoint * ArchiveField::Count + condition.field) - columns.begin()][0];
+					if (condition.above) {
+						for (size_t i = 0; i < frames; i++) h[i] |= (uint8_t)(a[i] > b[i] + value);
+					}
+					else {
+						for (size_t i = 0; i < frames; i++) h[i] |= (uint8_t)(a[i] < b[i] + value);
+					}
+				}
+				else if (condition.above) {
+					for (size_t i = 0; i < frames; i++) h[i] |= (uint8_t)(a[i] > value);
+				}
+				else {
+					for (size_t i = 0; i < frames; i++) h[i] |= (uint8_t)(a[i] < value);
+				}
+			}
+
+			// A frame lasts until the next, which for the chunk's last is the next chunk's first
+			int64_t next = c + 1 < reader.chunks() ? reader.chunk(c + 1).start : -1;
+			uint64_t matched = 0, counted = 0;
+			int64_t micros = 0;
+			for (size_t i = 0; i < frames; i++) {
+				int64_t gap;
+				if (i + 1 < frames) gap = timestamps[i + 1] - timestamps[i];
+				else gap = next >= timestamps[i] ? next - timestamps[i] : lastGap;
+				gap = std::min(gap, MaxGap);
+				lastGap = gap;
+
+				uint8_t in = (uint8_t)(states[i] >= query.minState && timestamps[i] >= query.from && timestamps[i] < query.to);
+				uint8_t match = in & hit[i];
+				counted += in;
+				matched += match;
+				micros += match * gap;
+			}
+			result.frames += counted;
+			result.matched += matched;
+			result.seconds += micros * 1e-6;
+		}
+		return true;
+	}
+
+	bool archiveExtent(ArchiveReader& reader, const ArchiveQuery& query, int joint, ArchiveField::Type field, ArchiveResult& result) {
+		result = ArchiveResult();
+		if (joint < 0 || joint >= reader.jointCount() || field < 0 || field >= ArchiveField::Count) return false;
+
+		int column = joint * ArchiveField::Count + field;
+		float low = std::numeric_limits<float>::max(), high = -std::numeric_limits<float>::max();
+		std::vector<int64_t> timestamps;
+		std::vector<uint8_t> states;
+		std::vector<float> values;
+
+		for (size_t c = 0; c < reader.chunks(); c++) {
+			const ArchiveChunk& chunk = reader.chunk(c);
+			if (!overlaps(chunk, query)) continue;
+			uint32_t frames = framesWith(chunk, query.minState);
+			if (frames == 0) {
+				result.chunksSkipped++;
+				continue;
+			}
+
+			if (query.useSummaries && query.minState == ArchiveState::Tracked && covered(chunk, query)) {
+				low = std::min(low, chunk.min[column]);
+				high = std::max(high, chunk.max[column]);
+				result.frames += frames;
+				result.chunksSkipped++;
+				continue;
+			}
+
+			if (!reader.readTimestamps(c, timestamps) || !reader.readStates(c, states) || !reader.readColumn(c, joint, field, values)) return false;
+			result.chunksRead++;
+			for (size_t i = 0; i < chunk.frames; i++) {
+				if (states[i] < query.minState || timestamps[i] < query.from || timestamps[i] >= query.to) continue;
+				low = std::min(low, values[i]);
+				high = std::max(high, values[i]);
+				result.frames++;
+			}
+		}
+
+		result.matched = result.frames;
+		result.min = result.frames > 0 ? low : 0;
+		result.max = result.frames > 0 ? high : 0;
+		return true;
+	}
+};
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <osvr/Util/Pose3C.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace KinectOsvr {
+	// What's stored for each joint, one column apiece
+	namespace ArchiveField {
+		enum Type {
+			X, Y, Z,
+			QW, QX, QY, QZ,
+			Confidence,
+			Count
+		};
+	}
+
+	// How much of the reported body there was in a frame
+	namespace ArchiveState {
+		enum Type {
+			// Nobody reported, the joints repeat the last frame's
+			None,
+			// Only the body's position, the joints repeat the last frame's
+			PositionOnly,
+			Tracked,
+			Count
+		};
+	}
+
+	// One chunk's worth of frames as the reader sees it, summed up so queries can pass over it unread
+	struct ArchiveChunk {
+		int64_t start, end;
+		uint32_t frames;
+		uint32_t stateFrames[ArchiveState::Count];
+		// Of each joint's fields over the tracked frames, min above max when there were none
+		std::vector<float> min, max;
+		uint64_t offset;
+		uint32_t bytes;
+	};
+
+	// Keeps the reported body's joints for the long term, a column per joint and field, in chunks of a few tens of
+	// seconds. The update thread only copies each frame into the open chunk, full chunks are quantized, compressed
+	// and written on the writer's own thread; while it's busy with every buffer, frames are dropped and counted instead.
+	class ArchiveWriter {
+	public:
+		static const int DefaultChunkFrames = 1024;
+
+		struct Stats {
+			Stats() : frames(0), chunks(0), droppedFrames(0), rawBytes(0), compressedBytes(0), encodeSeconds(0) {}
+
+			uint64_t frames, chunks, droppedFrames;
+			// Raw as a timestamp, a state and a float for each joint's fields
+			uint64_t rawBytes, compressedBytes;
+			// Spent compressing on the writer's thread
+			double encodeSeconds;
+		};
+
+		explicit ArchiveWriter(int chunkFrames = DefaultChunkFrames, int buffers = 3);
+		~ArchiveWriter();
+
+		bool open(const std::string& path, int jointCount);
+		bool isOpen() const;
+
+		// Timestamps in microseconds, never going back. poses and confidence may be NULL unless the body's tracked.
+		void write(int64_t timestamp, ArchiveState::Type state, const OSVR_PoseState* poses, const double* confidence);
+
+		// Writes the part-filled chunk and the index
+		void close();
+
+		Stats stats() const;
+
+	private:
+		struct Chunk {
+			int frames;
+			std::vector<int64_t> timestamps;
+			std::vector<uint8_t> states;
+			// Frame by frame as written, they're quantized and turned into columns when encoding
+			std::vector<OSVR_PoseState> poses;
+			std::vector<double> confidence;
+			std::vector<uint8_t> encoded;
+		};
+
+		struct IndexEntry {
+			int64_t start, end;
+			uint64_t offset;
+		};
+
+		void run();
+		void encode(Chunk& chunk);
+		void queue();
+
+		int m_chunkFrames;
+		int m_jointCount;
+		int m_columns;
+
+		std::vector<Chunk> m_chunks;
+		// The chunk being filled, -1 while every buffer is busy
+		int m_current;
+		// The last frame's joints, repeated while there's no body
+		std::vector<OSVR_PoseState> m_lastPoses;
+		std::vector<double> m_lastConfidence;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_ready;
+		std::vector<int> m_free;
+		std::deque<int> m_pending;
+		bool m_stopping;
+		Stats m_stats;
+		std::thread m_thread;
+
+		FILE* m_file;
+		uint64_t m_offset;
+		bool m_failed;
+		std::vector<IndexEntry> m_index;
+	};
+
+	// Reads archives chunk by chunk and column by column, so queries only touch what they need
+	class ArchiveReader {
+	public:
+		ArchiveReader();
+		~ArchiveReader();
+
+		// Archives cut short without their index are read by walking the chunks
+		bool open(const std::string& path);
+		void close();
+
+		int jointCount() const;
+		size_t chunks() const;
+		const ArchiveChunk& chunk(size_t i) const;
+
+		// Each decodes one column of one chunk
+		bool readTimestamps(size_t chunk, std::vector<int64_t>& timestamps);
+		bool readStates(size_t chunk, std::vector<uint8_t>& states);
+		bool readColumn(size_t chunk, int joint, ArchiveField::Type field, std::vector<float>& values);
+
+		// Bytes read so far, for measuring how much a query skipped
+		uint64_t bytesRead() const;
+
+	private:
+		bool readIndex();
+		bool scan();
+		bool readSummary(uint64_t offset, ArchiveChunk& chunk);
+		bool readBlock(size_t chunk, int block);
+
+		FILE* m_file;
+		int m_jointCount;
+		std::vector<ArchiveChunk> m_chunks;
+		std::vector<uint8_t> m_buffer;
+		std::vector<uint32_t> m_scratch;
+		// Where each block starts in the chunk last read from
+		size_t m_blockChunk;
+		std::vector<uint32_t> m_blockOffsets;
+		uint64_t m_bytesRead;
+	};
+
+	// One side of a query: a joint's field above or below another joint's, or a fixed value
+	struct ArchiveCondition {
+		ArchiveCondition(int joint, ArchiveField::Type field, bool above, float value);
+		ArchiveCondition(int joint, ArchiveField::Type field, bool above, int otherJoint, float margin = 0);
+
+		int joint;
+		ArchiveField::Type field;
+		bool above;
+		// -1 to compare with value alone, otherwise with the other joint's field plus value
+		int otherJoint;
+		float value;
+	};
+
+	struct ArchiveQuery {
+		ArchiveQuery();
+
+		// Frames where any of these hold count
+		std::vector<ArchiveCondition> anyOf;
+		// Microseconds, the whole archive by default
+		int64_t from, to;
+		// Frames with less of the body are never counted
+		ArchiveState::Type minState;
+		// Read every chunk whatever its summary says, to measure what skipping saves
+		bool useSummaries;
+	};
+
+	struct ArchiveResult {
+		ArchiveResult() : seconds(0), frames(0), matched(0), chunksRead(0), chunksSkipped(0), min(0), max(0) {}
+
+		// How long the query held, each frame counting until the next at most a few frames on
+		double seconds;
+		uint64_t frames, matched;
+		size_t chunksRead, chunksSkipped;
+		float min, max;
+	};
+
+	// prefix-YYYYMMDD-HHMMSS.ksa in local time, so each run of the server starts its own archive
+	std::string archivePath(const std::string& prefix);
+
+	// Time spent where the query holds, such as hands above the head
+	bool archiveDuration(ArchiveReader& reader, const ArchiveQuery& query, ArchiveResult& result);
+
+	// Lowest and highest a joint's field went over frames with at least the query's state, from the summaries
+	// alone for chunks wholly inside its time range. Its conditions are ignored.
+	bool archiveExtent(ArchiveReader& reader, const ArchiveQuery& query, int joint, ArchiveField::Type field, ArchiveResult& result);
+}
@@ -0,0 +1,335 @@
+#include "BodyIdentifier.h"
+
+#include <math.h>
+
+namespace KinectOsvr {
+
+	namespace {
+		// Joint indices are the same in the V1 and V2 joint sets up to the feet
+		struct Bone {
+			int measure;
+			int from, to;
+		};
+
+		const Bone Bones[] = {
+			{ BodySignature::LowerSpine, V2Joint::SpineBase, V2Joint::SpineMid },
+			{ BodySignature::UpperSpine, V2Joint::SpineMid, V2Joint::Neck },
+			{ BodySignature::Neck, V2Joint::Neck, V2Joint::Head },
+			{ BodySignature::Shoulders, V2Joint::ShoulderLeft, V2Joint::ShoulderRight },
+			{ BodySignature::Hips, V2Joint::HipLeft, V2Joint::HipRight },
+			{ BodySignature::UpperArm, V2Joint::ShoulderLeft, V2Joint::ElbowLeft },
+			{ BodySignature::UpperArm, V2Joint::ShoulderRight, V2Joint::ElbowRight },
+			{ BodySignature::Forearm, V2Joint::ElbowLeft, V2Joint::WristLeft },
+			{ BodySignature::Forearm, V2Joint::ElbowRight, V2Joint::WristRight },
+			{ BodySignature::Thigh, V2Joint::HipLeft, V2Joint::KneeLeft },
+			{ BodySignature::Thigh, V2Joint::HipRight, V2Joint::KneeRight },
+			{ BodySignature::Shin, V2Joint::KneeLeft, V2Joint::AnkleLeft },
+			{ BodySignature::Shin, V2Joint::KneeRight, V2Joint::AnkleRight }
+		};
+		const int BoneCount = sizeof(Bones) / sizeof(Bones[0]);
+
+		// Averages over about this many frames, so a signature keeps up if the sensor's view of someone changes
+		const int SignatureFrames = 300;
+		// Bones two signatures must share before they're compared
+		const int MinSharedMeasures = 4;
+		// Frames of the tracked person needed before their build is trusted to pick them out again
+		const int MinSignatureSamples = 15;
+	}
+
+	TrackingParams::TrackingParams() : acquireThreshold(0.75), playspaceSize(7.0), reacquireTime(15000.0), signatureTolerance(0.03) {}
+
+	BodySignature::BodySignature() {
+		clear();
+	}
+
+	void BodySignature::clear() {
+		for (int m = 0; m < MeasureCount; m++) {
+			m_length[m] = 0;
+			m_count[m] = 0;
+		}
+		m_samples = 0;
+	}
+
+	void BodySignature::add(const Skeleton& skeleton) {
+		if (skeleton.tracking != BodyTracked) return;
+
+		// Left and right sides are averaged, they're the same bone as far as telling people apart goes
+		float sum[MeasureCount] = {};
+		int sides[MeasureCount] = {};
+		for (int b = 0; b < BoneCount; b++) {
+			const Bone& bone = Bones[b];
+			if (skeleton.jointTracking[bone.from] != JointTracked || skeleton.jointTracking[bone.to] != JointTracked) continue;
+
+			float dx = skeleton.x[bone.to] - skeleton.x[bone.from];
+			float dy = skeleton.y[bone.to] - skeleton.y[bone.from];
+			float dz = skeleton.z[bone.to] - skeleton.z[bone.from];
+			sum[bone.measure] += sqrtf(dx * dx + dy * dy + dz * dz);
+			sides[bone.measure]++;
+		}
+
+		bool added = false;
+		for (int m = 0; m < MeasureCount; m++) {
+			if (sides[m] == 0) continue;
+			int n = m_count[m] < SignatureFrames ? m_count[m] : SignatureFrames;
+			m_length[m] += (sum[m] / sides[m] - m_length[m]) / (n + 1);
+			m_count[m]++;
+			added = true;
+		}
+		if (added) m_samples++;
+	}
+
+	int BodySignature::samples() const {
+		return m_samples;
+	}
+
+	float BodySignature::height() const {
+		const int chain[] = { Shin, Thigh, LowerSpine, UpperSpine, Neck };
+		float height = 0;
+		for (int i = 0; i < 5; i++) {
+			if (m_count[chain[i]] == 0) return 0;
+			height += m_length[chain[i]];
+		}
+		return height;
+	}
+
+	// Relative to the overall size rather than bone by bone, so the short bones' noise doesn't swamp the long ones
+	double BodySignature::difference(const BodySignature& other) const {
+		double error = 0, size = 0;
+		int shared = 0;
+		for (int m = 0; m < MeasureCount; m++) {
+			if (m_count[m] == 0 || other.m_count[m] == 0) continue;
+			double d = m_length[m] - other.m_length[m];
+			error += d * d;
+			size += other.m_length[m] * other.m_length[m];
+			shared++;
+		}
+		if (shared < MinSharedMeasures || size <= 0) return -1;
+
+		float a = height(), b = other.height();
+		if (a > 0 && b > 0) {
+			error += (a - b) * (a - b);
+			size += b * b;
+		}
+		return sqrt(error / size);
+	}
+
+	BodyIdentifier::BodyIdentifier(const TrackingParams& params) : m_params(params) {
+		m_trackingId = (uint64_t)-1;
+		m_trackedBody = -1;
+		m_trackedBodyChanged = false;
+		m_hasTracked = false;
+		m_lastTrackedPosition[0] = m_lastTrackedPosition[1] = m_lastTrackedPosition[2] = 0;
+		m_lastTrackedTime = 0;
+		m_resumed = false;
+
+		for (int i = 0; i < MaxBodies; i++) {
+			m_body_states[i] = CannotBeTracked;
+			m_slotIds[i] = (uint64_t)-1;
+		}
+	}
+
+	int BodyIdentifier::trackedBody() const {
+		return m_trackedBody;
+	}
+
+	BodyIdentifier::BodyTrackingState* BodyIdentifier::getBodyStates() {
+		return m_body_states;
+	}
+
+	void BodyIdentifier::setTrackedBody(int body) {
+		m_trackedBody = body;
+		m_trackedBodyChanged = true;
+	}
+
+	bool BodyIdentifier::lastTracked(BodySignature& signature, float position[3]) const {
+		if (!m_hasTracked) return false;
+		signature = m_signature;
+		position[0] = m_lastTrackedPosition[0];
+		position[1] = m_lastTrackedPosition[1];
+		position[2] = m_lastTrackedPosition[2];
+		return true;
+	}
+
+	void BodyIdentifier::resume(const BodySignature& signature, const float position[3]) {
+		m_signature = signature;
+		m_lastTrackedPosition[0] = position[0];
+		m_lastTrackedPosition[1] = position[1];
+		m_lastTrackedPosition[2] = position[2];
+		m_hasTracked = true;
+		m_resumed = true;
+	}
+
+	int BodyIdentifier::identify(const SkeletonFrame& frame) {
+		updateSignatures(frame);
+		if (m_resumed) {
+			m_lastTrackedTime = frame.timestamp;
+			m_resumed = false;
+		}
+
+		if (m_trackedBody >= 0) { // We're tracking a body
+			bool chosen = m_trackedBodyChanged;
+			if (m_trackedBodyChanged) {
+				m_trackingId = frame.bodies[m_trackedBody].trackingId;
+				m_signature = m_slotSignatures[m_trackedBody];
+				m_trackedBodyChanged = false;
+			}
+			else {
+				for (int i = 0; i < MaxBodies; ++i) {
+					if (frame.bodies[i].tracking != BodyNotTracked && frame.bodies[i].trackingId == m_trackingId) {
+						m_trackedBody = i;
+						break;
+					}
+				}
+			}
+
+			// Someone else in the slot is a lost body, not one to carry on with or learn the build of
+			const Skeleton& tracked = frame.bodies[m_trackedBody];
+			if (tracked.tracking != BodyNotTracked && tracked.trackingId == m_trackingId) { // Keep tracking same body, discount other bodies
+				for (int i = 0; i < MaxBodies; ++i) {
+					if (i == m_trackedBody) continue;
+					m_body_states[i] = frame.bodies[i].tracking == BodyNotTracked ? CannotBeTracked : ShouldNotBeTracked;
+				}
+
+				m_lastTrackedPosition[0] = tracked.position[0];
+				m_lastTrackedPosition[1] = tracked.position[1];
+				m_lastTrackedPosition[2] = tracked.position[2];
+				m_lastTrackedTime = frame.timestamp;
+				m_hasTracked = true;
+				if (!chosen) m_signature.add(tracked);
+				return m_trackedBody;
+			}
+
+			// We've lost tracking
+			m_body_states[m_trackedBody] = CannotBeTracked;
+		}
+
+		// Lost tracking or haven't started yet
+		acquire(frame);
+		return m_trackedBody;
+	}
+
+	void BodyIdentifier::acquire(const SkeletonFrame& frame) {
+		m_trackedBody = -1;
+		m_trackingId = (uint64_t)-1;
+
+		int candidates = 0;
+		double confidence[MaxBodies];
+		double timeConfidence = (frame.timestamp - m_lastTrackedTime) / 1000.0 / m_params.reacquireTime; // If we lose tracking for a few seconds, just pick whoever's visible
+
+		for (int i = 0; i < MaxBodies; ++i)
+		{
+			const Skeleton& skeleton = frame.bodies[i];
+			confidence[i] = 0.0;
+
+			if (skeleton.tracking == BodyNotTracked) {
+				m_body_states[i] = CannotBeTracked;
+				continue;
+			}
+
+			switch (m_body_states[i]) {
+			case CannotBeTracked:
+			case CanBeTracked: {
+				m_body_states[i] = CanBeTracked;
+				candidates++;
+
+				float dx = skeleton.position[0] - m_lastTrackedPosition[0];
+				float dy = skeleton.position[1] - m_lastTrackedPosition[1];
+				float dz = skeleton.position[2] - m_lastTrackedPosition[2];
+				double distanceFromLastPosition = sqrt(dx * dx + dy * dy + dz * dz);
+				double distanceConfidence = 1.0 - distanceFromLastPosition / m_params.playspaceSize;
+				confidence[i] = distanceConfidence + timeConfidence;
+				break;
+			}
+			case ShouldNotBeTracked: // Ignore bodies we've previously ruled out
+				break;
+			case ShouldBeTracked: // Shouldn't be possible at this point
+				break;
+			}
+		}
+
+		if (candidates == 0) return; // No bodies found
+
+		// Someone with the tracked person's build is taken straight away, as long as nobody else has it too. A single
+		// frame has to be a closer match. Anyone else whose build is known only counts once tracking has been lost a while.
+		if (m_params.signatureTolerance > 0 && m_signature.samples() >= MinSignatureSamples) {
+			int match = -1;
+			int matches = 0;
+			for (int i = 0; i < MaxBodies; ++i) {
+				if (m_body_states[i] != CanBeTracked) continue;
+
+				const BodySignature& signature = m_slotSignatures[i];
+				double difference = signature.difference(m_signature);
+				if (difference < 0) continue;
+				double tolerance = signature.samples() > 1 ? m_params.signatureTolerance : m_params.signatureTolerance * 0.5;
+				if (difference < tolerance) {
+					match = i;
+					matches++;
+				}
+				else {
+					confidence[i] = timeConfidence;
+				}
+			}
+
+			if (matches == 1) {
+				lock(frame, match);
+				return;
+			}
+		}
+
+		// Even a single candidate waits until confidence is good enough, with several choose based on last known position
+		double bestConfidence = 0.0;
+		int best = -1;
+		for (int i = 0; i < MaxBodies; ++i) {
+			if (m_body_states[i] == CanBeTracked && confidence[i] > bestConfidence) {
+				bestConfidence = confidence[i];
+				best = i;
+			}
+		}
+
+		if (bestConfidence > m_params.acquireThreshold) {
+			lock(frame, best);
+		}
+	}
+
+	void BodyIdentifier::lock(const SkeletonFrame& frame, int body) {
+		m_trackedBody = body;
+		m_trackingId = frame.bodies[body].trackingId;
+		for (int i = 0; i < MaxBodies; ++i) {
+			if (i == body) {
+				m_body_states[i] = ShouldBeTracked;
+			}
+			else if (m_body_states[i] == CanBeTracked) {
+				m_body_states[i] = ShouldNotBeTracked;
+			}
+		}
+
+		// Someone new starts their own signature, the same person keeps adding to theirs
+		const BodySignature& signature = m_slotSignatures[body];
+		double difference = signature.difference(m_signature);
+		if (difference < 0 ? m_signature.samples() == 0 : difference >= m_params.signatureTolerance) {
+			m_signature = signature;
+		}
+
+		const Skeleton& skeleton = frame.bodies[body];
+		m_lastTrackedPosition[0] = skeleton.position[0];
+		m_lastTrackedPosition[1] = skeleton.position[1];
+		m_lastTrackedPosition[2] = skeleton.position[2];
+		m_lastTrackedTime = frame.timestamp;
+		m_hasTracked = true;
+	}
+
+	// A new ID in a slot is someone who hasn't been ruled out yet, with a build still to be learned
+	void BodyIdentifier::updateSignatures(const SkeletonFrame& frame) {
+		for (int i = 0; i < MaxBodies; ++i) {
+			const Skeleton& skeleton = frame.bodies[i];
+			if (skeleton.tracking == BodyNotTracked) continue;
+
+			if (skeleton.trackingId != m_slotIds[i]) {
+				m_slotIds[i] = skeleton.trackingId;
+				m_slotSignatures[i].clear();
+				if (m_body_states[i] == ShouldNotBeTracked) m_body_states[i] = CannotBeTracked;
+			}
+			m_slotSignatures[i].add(skeleton);
+		}
+	}
+};
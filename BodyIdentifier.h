@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Skeleton.h"
+
+namespace KinectOsvr {
+	// How readily a new body is picked up once the tracked one is lost
+	struct TrackingParams {
+		TrackingParams();
+
+		// Confidence a body needs before it's picked
+		double acquireThreshold;
+		// Approx largest possible distance in playspace, in metres, position stops counting beyond it
+		double playspaceSize;
+		// Time without tracking that adds 1 to every body's confidence, in milliseconds
+		double reacquireTime;
+		// Average difference in bone lengths still taken as the same person, as a fraction, 0 to go by position alone
+		double signatureTolerance;
+	};
+
+	// Someone's build, from running averages of bone lengths that stay the same however they move
+	class BodySignature {
+	public:
+		enum Measure {
+			LowerSpine, UpperSpine, Neck, Shoulders, Hips, UpperArm, Forearm, Thigh, Shin,
+			MeasureCount
+		};
+
+		BodySignature();
+
+		void clear();
+
+		// Adds the bones with both ends tracked, the first two joint sets share the same ones
+		void add(const Skeleton& skeleton);
+
+		// Frames added so far
+		int samples() const;
+
+		// Standing height from the legs, spine and neck, in metres, 0 until they've all been seen
+		float height() const;
+
+		// RMS relative difference of the bones and height both have seen, -1 if they share too few to tell
+		double difference(const BodySignature& other) const;
+
+	private:
+		float m_length[MeasureCount];
+		int m_count[MeasureCount];
+		int m_samples;
+	};
+
+	// Chooses the one body to report and keeps following it as the sensor shuffles body slots
+	class BodyIdentifier {
+	public:
+		enum BodyTrackingState {
+			CannotBeTracked,
+			CanBeTracked,
+			ShouldNotBeTracked,
+			ShouldBeTracked
+		};
+
+		explicit BodyIdentifier(const TrackingParams& params = TrackingParams());
+
+		// Returns the slot of the body to report, or -1
+		int identify(const SkeletonFrame& frame);
+
+		int trackedBody() const;
+		BodyTrackingState* getBodyStates();
+
+		// Switches to the body in a slot from the next frame on
+		void setTrackedBody(int body);
+
+		// Who was tracked last and where, false if nobody has been
+		bool lastTracked(BodySignature& signature, float position[3]) const;
+		// Looks for them first, as after a restart, the same as if they had only just been lost
+		void resume(const BodySignature& signature, const float position[3]);
+
+	private:
+		void acquire(const SkeletonFrame& frame);
+		void updateSignatures(const SkeletonFrame& frame);
+		void lock(const SkeletonFrame& frame, int body);
+
+		TrackingParams m_params;
+
+		BodyTrackingState m_body_states[MaxBodies];
+		uint64_t m_trackingId;
+		int m_trackedBody;
+		bool m_trackedBodyChanged;
+		bool m_hasTracked;
+		float m_lastTrackedPosition[3];
+		int64_t m_lastTrackedTime;
+		// Resumed, the next frame's time stands in for when they were lost
+		bool m_resumed;
+
+		// The tracked person's build, and that of whoever is in each slot since their ID appeared
+		BodySignature m_signature;
+		BodySignature m_slotSignatures[MaxBodies];
+		uint64_t m_slotIds[MaxBodies];
+	};
+}
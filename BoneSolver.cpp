@@ -0,0 +1,285 @@
+#include "BoneSolver.h"
+
+#include <math.h>
+
+namespace KinectOsvr {
+
+	const BoneHierarchy KinectV1Hierarchy = {
+		V1Joint::Count,
+		V1Joint::HipCenter,
+		V1Joint::Spine,
+		{
+			-1, V1Joint::HipCenter, V1Joint::Spine, V1Joint::ShoulderCenter,
+			V1Joint::ShoulderCenter, V1Joint::ShoulderLeft, V1Joint::ElbowLeft, V1Joint::WristLeft,
+			V1Joint::ShoulderCenter, V1Joint::ShoulderRight, V1Joint::ElbowRight, V1Joint::WristRight,
+			V1Joint::HipCenter, V1Joint::HipLeft, V1Joint::KneeLeft, V1Joint::AnkleLeft,
+			V1Joint::HipCenter, V1Joint::HipRight, V1Joint::KneeRight, V1Joint::AnkleRight
+		},
+		// The torso twists with the hips below the spine and with the shoulders above it
+		{
+			V1Joint::HipLeft, V1Joint::HipLeft, V1Joint::ShoulderLeft, V1Joint::ShoulderLeft,
+			-1, -1, -1, -1,
+			-1, -1, -1, -1,
+			-1, -1, -1, -1,
+			-1, -1, -1, -1
+		},
+		{
+			V1Joint::HipRight, V1Joint::HipRight, V1Joint::ShoulderRight, V1Joint::ShoulderRight,
+			-1, -1, -1, -1,
+			-1, -1, -1, -1,
+			-1, -1, -1, -1,
+			-1, -1, -1, -1
+		}
+	};
+
+	const BoneHierarchy KinectV2Hierarchy = {
+		V2Joint::Count,
+		V2Joint::SpineBase,
+		V2Joint::SpineMid,
+		{
+			-1, V2Joint::SpineBase, V2Joint::SpineShoulder, V2Joint::Neck,
+			V2Joint::SpineShoulder, V2Joint::ShoulderLeft, V2Joint::ElbowLeft, V2Joint::WristLeft,
+			V2Joint::SpineShoulder, V2Joint::ShoulderRight, V2Joint::ElbowRight, V2Joint::WristRight,
+			V2Joint::SpineBase, V2Joint::HipLeft, V2Joint::KneeLeft, V2Joint::AnkleLeft,
+			V2Joint::SpineBase, V2Joint::HipRight, V2Joint::KneeRight, V2Joint::AnkleRight,
+			V2Joint::SpineMid, V2Joint::HandLeft, V2Joint::WristLeft, V2Joint::HandRight, V2Joint::WristRight
+		},
+		// As V1, plus the hands twist with the thumbs
+		{
+			V2Joint::HipLeft, V2Joint::HipLeft, V2Joint::ShoulderLeft, V2Joint::ShoulderLeft,
+			-1, -1, -1, V2Joint::HandLeft,
+			-1, -1, -1, V2Joint::ThumbRight,
+			-1, -1, -1, -1,
+			-1, -1, -1, -1,
+			V2Joint::ShoulderLeft, -1, -1, -1, -1
+		},
+		{
+			V2Joint::HipRight, V2Joint::HipRight, V2Joint::ShoulderRight, V2Joint::ShoulderRight,
+			-1, -1, -1, V2Joint::ThumbLeft,
+			-1, -1, -1, V2Joint::HandRight,
+			-1, -1, -1, -1,
+			-1, -1, -1, -1,
+			V2Joint::ShoulderRight, -1, -1, -1, -1
+		}
+	};
+
+	namespace {
+		const float Epsilon = 1e-6f;
+
+		struct Quat {
+			float w, x, y, z;
+		};
+
+		Quat multiply(const Quat& a, const Quat& b) {
+			Quat q;
+			q.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+			q.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+			q.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+			q.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+			return q;
+		}
+
+		Quat conjugate(const Quat& a) {
+			Quat q = { a.w, -a.x, -a.y, -a.z };
+			return q;
+		}
+
+		Quat normalize(const Quat& a) {
+			float n = 1.0f / sqrtf(a.w * a.w + a.x * a.x + a.y * a.y + a.z * a.z);
+			Quat q = { a.w * n, a.x * n, a.y * n, a.z * n };
+			return q;
+		}
+
+		// Shortest rotation taking unit vector a onto unit vector b
+		Quat arc(const float a[3], const float b[3]) {
+			float d = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+			Quat q;
+			if (d < -1.0f + Epsilon) {
+				// Half turn about any axis perpendicular to a
+				float ax = fabsf(a[0]) < 0.9f ? 1.0f : 0.0f;
+				float ay = 1.0f - ax;
+				q.w = 0;
+				q.x = ay * a[2];
+				q.y = -ax * a[2];
+				q.z = ax * a[1] - ay * a[0];
+				return normalize(q);
+			}
+			q.w = 1.0f + d;
+			q.x = a[1] * b[2] - a[2] * b[1];
+			q.y = a[2] * b[0] - a[0] * b[2];
+			q.z = a[0] * b[1] - a[1] * b[0];
+			return normalize(q);
+		}
+
+		// Rotation whose columns are the given orthonormal axes
+		Quat fromBasis(const float x[3], const float y[3], const float z[3]) {
+			Quat q;
+			float trace = x[0] + y[1] + z[2];
+			if (trace > 0) {
+				float s = 0.5f / sqrtf(trace + 1.0f);
+				q.w = 0.25f / s;
+				q.x = (y[2] - z[1]) * s;
+				q.y = (z[0] - x[2]) * s;
+				q.z = (x[1] - y[0]) * s;
+			}
+			else if (x[0] > y[1] && x[0] > z[2]) {
+				float s = 2.0f * sqrtf(1.0f + x[0] - y[1] - z[2]);
+				q.w = (y[2] - z[1]) / s;
+				q.x = 0.25f * s;
+				q.y = (y[0] + x[1]) / s;
+				q.z = (z[0] + x[2]) / s;
+			}
+			else if (y[1] > z[2]) {
+				float s = 2.0f * sqrtf(1.0f + y[1] - x[0] - z[2]);
+				q.w = (z[0] - x[2]) / s;
+				q.x = (y[0] + x[1]) / s;
+				q.y = 0.25f * s;
+				q.z = (z[1] + y[2]) / s;
+			}
+			else {
+				float s = 2.0f * sqrtf(1.0f + z[2] - x[0] - y[1]);
+				q.w = (x[1] - y[0]) / s;
+				q.x = (z[0] + x[2]) / s;
+				q.y = (z[1] + y[2]) / s;
+				q.z = 0.25f * s;
+			}
+			return normalize(q);
+		}
+	}
+
+	BoneSolver::BoneSolver(const BoneHierarchy& hierarchy) : m_hierarchy(hierarchy) {
+		for (int j = 0; j < m_hierarchy.jointCount; j++) {
+			int parent = m_hierarchy.parent[j];
+			m_from[j] = parent >= 0 ? parent : j;
+			m_to[j] = parent >= 0 ? j : m_hierarchy.rootChild;
+		}
+
+		// Breadth first from the root
+		int count = 0;
+		m_order[count++] = m_hierarchy.root;
+		for (int i = 0; i < count; i++) {
+			for (int j = 0; j < m_hierarchy.jointCount; j++) {
+				if (m_hierarchy.parent[j] == m_order[i]) {
+					m_order[count++] = j;
+				}
+			}
+		}
+	}
+
+	const BoneHierarchy& BoneSolver::hierarchy() const {
+		return m_hierarchy;
+	}
+
+	void BoneSolver::solve(Skeleton& skeleton, BoneOrientations* hierarchical) const {
+		const int count = m_hierarchy.jointCount;
+
+		// Bone directions for every joint at once, straight-line code over the joint arrays
+		float dx[MaxJoints], dy[MaxJoints], dz[MaxJoints], length[MaxJoints];
+		for (int j = 0; j < count; j++) {
+			dx[j] = skeleton.x[m_to[j]] - skeleton.x[m_from[j]];
+			dy[j] = skeleton.y[m_to[j]] - skeleton.y[m_from[j]];
+			dz[j] = skeleton.z[m_to[j]] - skeleton.z[m_from[j]];
+		}
+		for (int j = 0; j < count; j++) {
+			length[j] = sqrtf(dx[j] * dx[j] + dy[j] * dy[j] + dz[j] * dz[j]);
+		}
+		for (int j = 0; j < count; j++) {
+			float scale = length[j] > Epsilon ? 1.0f / length[j] : 0.0f;
+			dx[j] *= scale;
+			dy[j] *= scale;
+			dz[j] *= scale;
+		}
+
+		// Then down the hierarchy, each bone starts from its parent's frame
+		Quat absolute[MaxJoints];
+		float boneY[MaxJoints][3];
+
+		for (int i = 0; i < count; i++) {
+			int j = m_order[i];
+			int parent = m_hierarchy.parent[j];
+
+			Quat parentQ = { 1, 0, 0, 0 };
+			float parentY[3] = { 0, 1, 0 };
+			if (parent >= 0) {
+				parentQ = absolute[parent];
+				parentY[0] = boneY[parent][0];
+				parentY[1] = boneY[parent][1];
+				parentY[2] = boneY[parent][2];
+			}
+
+			// Joints on top of each other have no direction, keep the parent's frame
+			if (length[j] <= Epsilon) {
+				absolute[j] = parentQ;
+				boneY[j][0] = parentY[0];
+				boneY[j][1] = parentY[1];
+				boneY[j][2] = parentY[2];
+				continue;
+			}
+
+			float y[3] = { dx[j], dy[j], dz[j] };
+			boneY[j][0] = y[0];
+			boneY[j][1] = y[1];
+			boneY[j][2] = y[2];
+
+			bool twisted = false;
+			int from = m_hierarchy.twistFrom[j];
+			int to = m_hierarchy.twistTo[j];
+			if (from >= 0 && to >= 0) {
+				float t[3] = {
+					skeleton.x[to] - skeleton.x[from],
+					skeleton.y[to] - skeleton.y[from],
+					skeleton.z[to] - skeleton.z[from]
+				};
+				// X is the twist direction with the bone direction taken out
+				float along = t[0] * y[0] + t[1] * y[1] + t[2] * y[2];
+				float x[3] = { t[0] - along * y[0], t[1] - along * y[1], t[2] - along * y[2] };
+				float xLength = sqrtf(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+				float tLength = sqrtf(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]);
+
+				// Unusable when the twist pair lines up with the bone
+				if (xLength > 0.1f * tLength && xLength > Epsilon) {
+					x[0] /= xLength;
+					x[1] /= xLength;
+					x[2] /= xLength;
+					float z[3] = {
+						x[1] * y[2] - x[2] * y[1],
+						x[2] * y[0] - x[0] * y[2],
+						x[0] * y[1] - x[1] * y[0]
+					};
+					absolute[j] = fromBasis(x, y, z);
+					twisted = true;
+				}
+			}
+
+			if (!twisted) {
+				absolute[j] = normalize(multiply(arc(parentY, y), parentQ));
+			}
+		}
+
+		for (int j = 0; j < count; j++) {
+			skeleton.qw[j] = absolute[j].w;
+			skeleton.qx[j] = absolute[j].x;
+			skeleton.qy[j] = absolute[j].y;
+			skeleton.qz[j] = absolute[j].z;
+		}
+
+		if (hierarchical != NULL) {
+			for (int j = 0; j < count; j++) {
+				int parent = m_hierarchy.parent[j];
+				Quat relative = parent >= 0 ? multiply(conjugate(absolute[parent]), absolute[j]) : absolute[j];
+				hierarchical->qw[j] = relative.w;
+				hierarchical->qx[j] = relative.x;
+				hierarchical->qy[j] = relative.y;
+				hierarchical->qz[j] = relative.z;
+			}
+		}
+	}
+
+	void BoneSolver::solve(SkeletonFrame& frame) const {
+		for (int b = 0; b < MaxBodies; b++) {
+			if (frame.bodies[b].tracking == BodyTracked) {
+				solve(frame.bodies[b]);
+			}
+		}
+	}
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Skeleton.h"
+
+#include <stddef.h>
+
+namespace KinectOsvr {
+	// Parent of each joint and what fixes the twist of each bone
+	struct BoneHierarchy {
+		int jointCount;
+		int root;
+		// The root has no parent, its bone points from it to this joint
+		int rootChild;
+		// -1 for the root
+		int parent[MaxJoints];
+		// Joint pair whose direction sets a bone's X axis, -1 to carry the parent's twist down the bone
+		int twistFrom[MaxJoints];
+		int twistTo[MaxJoints];
+	};
+
+	extern const BoneHierarchy KinectV1Hierarchy;
+	extern const BoneHierarchy KinectV2Hierarchy;
+
+	// Orientations relative to the parent bone, in the same layout as Skeleton
+	struct BoneOrientations {
+		float qw[MaxJoints], qx[MaxJoints], qy[MaxJoints], qz[MaxJoints];
+	};
+
+	// Joint orientations from joint positions alone. Each joint gets the orientation of the bone
+	// ending at it, Y along the bone, as NuiSkeletonCalculateBoneOrientations does.
+	class BoneSolver {
+	public:
+		explicit BoneSolver(const BoneHierarchy& hierarchy);
+
+		// Writes absolute orientations into the skeleton, and relative ones if asked. Safe to call for
+		// several bodies at once.
+		void solve(Skeleton& skeleton, BoneOrientations* hierarchical = NULL) const;
+
+		// Every tracked body in the frame
+		void solve(SkeletonFrame& frame) const;
+
+		const BoneHierarchy& hierarchy() const;
+
+	private:
+		BoneHierarchy m_hierarchy;
+
+		// Bone ends, so directions can be taken for every joint in one pass
+		int m_from[MaxJoints];
+		int m_to[MaxJoints];
+		// Parents before children
+		int m_order[MaxJoints];
+	};
+}
@@ -0,0 +1,86 @@
+#include "Config.h"
+
+#include <cstdlib>
+#include <sstream>
+
+namespace KinectOsvr {
+
+	namespace {
+		int intFromEnvironment(const char* name, int fallback) {
+			const char* value = std::getenv(name);
+			if (value == NULL || *value == '\0') return fallback;
+
+			char* end;
+			long parsed = std::strtol(value, &end, 10);
+			return *end == '\0' ? (int)parsed : fallback;
+		}
+
+		double doubleFromEnvironment(const char* name, double fallback) {
+			const char* value = std::getenv(name);
+			if (value == NULL || *value == '\0') return fallback;
+
+			char* end;
+			double parsed = std::strtod(value, &end);
+			return *end == '\0' ? parsed : fallback;
+		}
+
+		std::string stringFromEnvironment(const char* name, const std::string& fallback) {
+			const char* value = std::getenv(name);
+			return value == NULL || *value == '\0' ? fallback : std::string(value);
+		}
+	}
+
+	Config::Config() : workerThreads(0), frameBudget(5.0), solveV1Orientations(false), solveV2Orientations(false), projectJoints(false), depthHeadFallback(false), estimateLatency(0), recordDepth(false), snapshotMaxAge(168), attachDaemon(false), logSize(1024) {}
+
+	Config Config::fromEnvironment() {
+		Config config;
+		config.workerThreads = intFromEnvironment("OSVR_KINECT_WORKER_THREADS", config.workerThreads);
+		config.frameBudget = doubleFromEnvironment("OSVR_KINECT_FRAME_BUDGET", config.frameBudget);
+		config.solveV1Orientations = intFromEnvironment("OSVR_KINECT_V1_SOLVE_ORIENTATIONS", config.solveV1Orientations) != 0;
+		config.solveV2Orientations = intFromEnvironment("OSVR_KINECT_V2_SOLVE_ORIENTATIONS", config.solveV2Orientations) != 0;
+		config.projectJoints = intFromEnvironment("OSVR_KINECT_PROJECT_JOINTS", config.projectJoints) != 0;
+		config.depthHeadFallback = intFromEnvironment("OSVR_KINECT_DEPTH_HEAD", config.depthHeadFallback) != 0;
+
+		config.tracking.acquireThreshold = doubleFromEnvironment("OSVR_KINECT_ACQUIRE_THRESHOLD", config.tracking.acquireThreshold);
+		config.tracking.playspaceSize = doubleFromEnvironment("OSVR_KINECT_PLAYSPACE_SIZE", config.tracking.playspaceSize);
+		config.tracking.reacquireTime = doubleFromEnvironment("OSVR_KINECT_REACQUIRE_TIME", config.tracking.reacquireTime);
+		config.tracking.signatureTolerance = doubleFromEnvironment("OSVR_KINECT_SIGNATURE_TOLERANCE", config.tracking.signatureTolerance);
+
+		config.filter.smoothing = (float)doubleFromEnvironment("OSVR_KINECT_SMOOTHING", config.filter.smoothing);
+		config.filter.correction = (float)doubleFromEnvironment("OSVR_KINECT_CORRECTION", config.filter.correction);
+		config.filter.prediction = (float)doubleFromEnvironment("OSVR_KINECT_PREDICTION", config.filter.prediction);
+		config.filter.jitterRadius = (float)doubleFromEnvironment("OSVR_KINECT_JITTER_RADIUS", config.filter.jitterRadius);
+		config.filter.maxDeviationRadius = (float)doubleFromEnvironment("OSVR_KINECT_MAX_DEVIATION_RADIUS", config.filter.maxDeviationRadius);
+
+		config.fusionPath = stringFromEnvironment("OSVR_KINECT_FUSE_ORIENTATION", config.fusionPath);
+		config.fusion.kinectLatency = doubleFromEnvironment("OSVR_KINECT_FUSION_LATENCY", config.fusion.kinectLatency);
+		config.fusion.yawTime = doubleFromEnvironment("OSVR_KINECT_FUSION_YAW_TIME", config.fusion.yawTime);
+		config.estimateLatency = intFromEnvironment("OSVR_KINECT_ESTIMATE_LATENCY", config.estimateLatency);
+
+		config.gesturePath = stringFromEnvironment("OSVR_KINECT_GESTURES", config.gesturePath);
+		config.recordPath = stringFromEnvironment("OSVR_KINECT_RECORD", config.recordPath);
+		config.recordDepth = intFromEnvironment("OSVR_KINECT_RECORD_DEPTH", config.recordDepth) != 0;
+		config.archivePath = stringFromEnvironment("OSVR_KINECT_ARCHIVE", config.archivePath);
+		config.snapshotPath = stringFromEnvironment("OSVR_KINECT_SNAPSHOT", config.snapshotPath);
+		config.snapshotMaxAge = doubleFromEnvironment("OSVR_KINECT_SNAPSHOT_MAX_AGE", config.snapshotMaxAge);
+		config.attachDaemon = intFromEnvironment("OSVR_KINECT_DAEMON", config.attachDaemon) != 0;
+		config.logPath = stringFromEnvironment("OSVR_KINECT_LOG", config.logPath);
+		config.logSize = intFromEnvironment("OSVR_KINECT_LOG_SIZE", config.logSize);
+		config.tracePath = stringFromEnvironment("OSVR_KINECT_TRACE", config.tracePath);
+		return config;
+	}
+
+	std::string Config::toEnvironment() const {
+		std::ostringstream out;
+		out << "OSVR_KINECT_ACQUIRE_THRESHOLD=" << tracking.acquireThreshold << "\n";
+		out << "OSVR_KINECT_PLAYSPACE_SIZE=" << tracking.playspaceSize << "\n";
+		out << "OSVR_KINECT_REACQUIRE_TIME=" << tracking.reacquireTime << "\n";
+		out << "OSVR_KINECT_SIGNATURE_TOLERANCE=" << tracking.signatureTolerance << "\n";
+		out << "OSVR_KINECT_SMOOTHING=" << filter.smoothing << "\n";
+		out << "OSVR_KINECT_CORRECTION=" << filter.correction << "\n";
+		out << "OSVR_KINECT_PREDICTION=" << filter.prediction << "\n";
+		out << "OSVR_KINECT_JITTER_RADIUS=" << filter.jitterRadius << "\n";
+		out << "OSVR_KINECT_MAX_DEVIATION_RADIUS=" << filter.maxDeviationRadius << "\n";
+		return out.str();
+	}
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "BodyIdentifier.h"
+#include "HeadFusion.h"
+#include "JointFilter.h"
+
+#include <string>
+
+namespace KinectOsvr {
+	// Plugin settings, read once when the plugin loads
+	struct Config {
+		Config();
+
+		// Worker threads for per-body processing, 0 for none and -1 to size the pool to the machine (OSVR_KINECT_WORKER_THREADS)
+		int workerThreads;
+
+		// Longest a frame's processing should take in milliseconds before optional work is skipped, 0 for no limit
+		// (OSVR_KINECT_FRAME_BUDGET)
+		double frameBudget;
+
+		// Solve the Kinect V1's joint orientations from joint positions rather than with the SDK's
+		// NuiSkeletonCalculateBoneOrientations (OSVR_KINECT_V1_SOLVE_ORIENTATIONS)
+		bool solveV1Orientations;
+
+		// Replace the Kinect V2's joint orientations with ones solved from joint positions (OSVR_KINECT_V2_SOLVE_ORIENTATIONS)
+		bool solveV2Orientations;
+
+		// Report where the Kinect V2's joints appear in its color and depth images (OSVR_KINECT_PROJECT_JOINTS)
+		bool projectJoints;
+
+		// Follow the head in the Kinect V2's depth image while the skeleton is lost (OSVR_KINECT_DEPTH_HEAD)
+		bool depthHeadFallback;
+
+		// Body acquisition (OSVR_KINECT_ACQUIRE_THRESHOLD, OSVR_KINECT_PLAYSPACE_SIZE, OSVR_KINECT_REACQUIRE_TIME,
+		// OSVR_KINECT_SIGNATURE_TOLERANCE)
+		TrackingParams tracking;
+
+		// Joint smoothing, off unless OSVR_KINECT_SMOOTHING is set (OSVR_KINECT_CORRECTION, OSVR_KINECT_PREDICTION,
+		// OSVR_KINECT_JITTER_RADIUS, OSVR_KINECT_MAX_DEVIATION_RADIUS)
+		FilterParams filter;
+
+		// Orientation tracker to fuse with the head, such as /me/head, none if empty (OSVR_KINECT_FUSE_ORIENTATION)
+		std::string fusionPath;
+
+		// Head fusion (OSVR_KINECT_FUSION_LATENCY, OSVR_KINECT_FUSION_YAW_TIME)
+		FusionParams fusion;
+
+		// Measure the skeleton's latency against the orientation tracker: 0 not at all, 1 to print it, 2 to also line
+		// the fused head up by it (OSVR_KINECT_ESTIMATE_LATENCY)
+		int estimateLatency;
+
+		// Gesture library to recognize, recorded with kinect_gesture (OSVR_KINECT_GESTURES)
+		std::string gesturePath;
+
+		// Record every frame to this file for offline tuning (OSVR_KINECT_RECORD)
+		std::string recordPath;
+
+		// Also capture the Kinect V2's depth and body-index images, compressed, next to the recording (OSVR_KINECT_RECORD_DEPTH)
+		bool recordDepth;
+
+		// Keep the reported body's joints in a compressed archive for querying long sessions (OSVR_KINECT_ARCHIVE)
+		std::string archivePath;
+
+		// Keep calibration and what's been learned about the user here across restarts, to track calibrated from the
+		// first frame (OSVR_KINECT_SNAPSHOT)
+		std::string snapshotPath;
+		// Hours after which a snapshot is too old to trust, 0 for no limit (OSVR_KINECT_SNAPSHOT_MAX_AGE)
+		double snapshotMaxAge;
+
+		// Attach to kinect_daemon for frames rather than opening the sensors, so the server restarts without them
+		// starting over (OSVR_KINECT_DAEMON)
+		bool attachDaemon;
+
+		// Write diagnostics here rather than to the console, moving it aside to .1, .2 and .3 once it's logSize KB
+		// (OSVR_KINECT_LOG, OSVR_KINECT_LOG_SIZE)
+		std::string logPath;
+		int logSize;
+
+		// Write a Chrome trace of each thread's recent work here on shutdown or from the config window (OSVR_KINECT_TRACE)
+		std::string tracePath;
+
+		static Config fromEnvironment();
+
+		// The tunable settings as NAME=value lines, the form fromEnvironment reads
+		std::string toEnvironment() const;
+	};
+}
@@ -0,0 +1,51 @@
+#include "ControlQueue.h"
+
+namespace KinectOsvr {
+
+	ControlQueue::ControlQueue(int capacity) : m_tail(0), m_head(0) {
+		uint64_t size = 1;
+		while (size < (uint64_t)(capacity > 1 ? capacity : 1)) size <<= 1;
+		m_mask = size - 1;
+
+		// A slot is free for position p when its sequence is p, and holds p's command when it's p + 1
+		m_slots.reset(new Slot[size]);
+		for (uint64_t i = 0; i < size; i++) {
+			m_slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	bool ControlQueue::push(const ControlCommand& command) {
+		uint64_t position = m_tail.load(std::memory_order_relaxed);
+		for (;;) {
+			Slot& slot = m_slots[position & m_mask];
+			uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+			int64_t lap = (int64_t)(sequence - position);
+
+			if (lap == 0) {
+				if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					slot.command = command;
+					slot.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (lap < 0) {
+				// The consumer hasn't got to this slot's last command yet
+				return false;
+			}
+			else {
+				// Another producer claimed it first
+				position = m_tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool ControlQueue::pop(ControlCommand& command) {
+		Slot& slot = m_slots[m_head & m_mask];
+		if (slot.sequence.load(std::memory_order_acquire) != m_head + 1) return false;
+
+		command = slot.command;
+		slot.sequence.store(m_head + m_mask + 1, std::memory_order_release);
+		m_head++;
+		return true;
+	}
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace KinectOsvr {
+	// A change asked for from outside the update thread, such as the config window
+	struct ControlCommand {
+		enum Type {
+			SetTrackedBody,
+			Recenter,
+			ToggleSeatedMode
+		};
+
+		Type type;
+		// Body slot for SetTrackedBody
+		int body;
+	};
+
+	// Carries commands from any number of threads to the update thread, which applies them between frames so
+	// nothing changes under a frame being processed. Bounded and lock-free on both sides: each slot's sequence
+	// says whether it's free for the lap a producer has claimed or holds a command for the consumer.
+	class ControlQueue {
+	public:
+		static const int DefaultCapacity = 64;
+
+		// Rounded up to a power of two
+		explicit ControlQueue(int capacity = DefaultCapacity);
+
+		// Any thread. False, dropping the command, when the queue is full.
+		bool push(const ControlCommand& command);
+
+		// Update thread only. False when there's nothing queued.
+		bool pop(ControlCommand& command);
+
+	private:
+		struct Slot {
+			std::atomic<uint64_t> sequence;
+			ControlCommand command;
+		};
+
+		uint64_t m_mask;
+		std::unique_ptr<Slot[]> m_slots;
+		std::atomic<uint64_t> m_tail;
+		uint64_t m_head;
+	};
+}
@@ -0,0 +1,377 @@
+#include "DepthCapture.h"
+#include "DepthCodec.h"
+#include "Trace.h"
+#include "WorkerPool.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace KinectOsvr {
+
+	namespace {
+		const char Magic[4] = { 'K', 'D', 'C', 'P' };
+		const uint32_t Version = 1;
+
+		struct Header {
+			char magic[4];
+			uint32_t version;
+			int32_t width, height;
+		};
+
+		// Each image is this, then its compressed depth and body index
+		struct ChunkHeader {
+			int64_t timestamp;
+			uint32_t depthBytes, indexBytes;
+		};
+
+		// The index, by timestamp, comes after the last image and this after it
+		struct Trailer {
+			uint64_t indexOffset;
+			uint32_t count;
+			char magic[4];
+		};
+
+		bool seek(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+			return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+			return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+		}
+
+		uint64_t fileSize(FILE* file) {
+#ifdef _WIN32
+			if (_fseeki64(file, 0, SEEK_END) != 0) return 0;
+			return (uint64_t)_ftelli64(file);
+#else
+			if (fseeko(file, 0, SEEK_END) != 0) return 0;
+			return (uint64_t)ftello(file);
+#endif
+		}
+
+		template <typename Entry>
+		bool earlier(const Entry& a, const Entry& b) {
+			return a.timestamp < b.timestamp;
+		}
+	}
+
+	DepthCaptureWriter::DepthCaptureWriter(int encoders, int buffers)
+		: m_encoderCount(std::max(1, encoders)), m_width(0), m_height(0), m_slots(std::max(1, buffers)), m_stopping(false), m_file(NULL), m_offset(0), m_failed(false) {}
+
+	DepthCaptureWriter::~DepthCaptureWriter() {
+		close();
+	}
+
+	bool DepthCaptureWriter::open(const std::string& path, int width, int height) {
+		close();
+		if (width <= 0 || height <= 0) return false;
+
+		m_file = fopen(path.c_str(), "wb");
+		if (m_file == NULL) return false;
+
+		Header header;
+		memcpy(header.magic, Magic, sizeof(Magic));
+		header.version = Version;
+		header.width = width;
+		header.height = height;
+		if (fwrite(&header, sizeof(header), 1, m_file) != 1) {
+			fclose(m_file);
+			m_file = NULL;
+			return false;
+		}
+
+		m_width = width;
+		m_height = height;
+		m_offset = sizeof(header);
+		m_failed = false;
+		m_index.clear();
+
+		// Buffers are sized once here, nothing is allocated per image afterwards but the compressed output's growth
+		size_t pixels = (size_t)width * height;
+		m_free.clear();
+		m_pending.clear();
+		for (size_t i = 0; i < m_slots.size(); i++) {
+			m_slots[i].depth.resize(pixels);
+			m_slots[i].bodyIndex.resize(pixels);
+			m_slots[i].encoded.reserve(pixels);
+			m_free.push_back((int)i);
+		}
+		m_stats = Stats();
+		m_stopping = false;
+
+		for (int i = 0; i < m_encoderCount; i++) {
+			// Falling behind drops images rather than taking time from tracking
+			m_encoders.push_back(std::thread(&DepthCaptureWriter::encode, this));
+			lowerPriority(m_encoders.back());
+		}
+		return true;
+	}
+
+	bool DepthCaptureWriter::isOpen() const {
+		return m_file != NULL;
+	}
+
+	bool DepthCaptureWriter::submit(int64_t timestamp, const uint16_t* depth, const uint8_t* bodyIndex) {
+		if (m_file == NULL) return false;
+
+		int slot;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stats.submitted++;
+			if (m_free.empty() || m_failed) {
+				m_stats.dropped++;
+				return false;
+			}
+			slot = m_free.back();
+			m_free.pop_back();
+		}
+
+		// Nobody else touches a slot between taking it from the free list and queueing it
+		Slot& s = m_slots[slot];
+		s.timestamp = timestamp;
+		s.hasBodyIndex = bodyIndex != NULL;
+		memcpy(&s.depth[0], depth, s.depth.size() * sizeof(uint16_t));
+		if (bodyIndex != NULL) memcpy(&s.bodyIndex[0], bodyIndex, s.bodyIndex.size());
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending.push_back(slot);
+		}
+		m_ready.notify_one();
+		return true;
+	}
+
+	void DepthCaptureWriter::encode() {
+		Trace::setThreadName("depth encoder");
+
+		for (;;) {
+			int slot;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_ready.wait(lock, [this] { return m_stopping || !m_pending.empty(); });
+				if (m_pending.empty()) return;
+				slot = m_pending.front();
+				m_pending.pop_front();
+			}
+
+			Slot& s = m_slots[slot];
+			size_t rawBytes = s.depth.size() * sizeof(uint16_t) + (s.hasBodyIndex ? s.bodyIndex.size() : 0);
+			size_t depthBytes;
+			{
+				KINECT_TRACE("encode depth");
+				s.encoded.clear();
+				DepthCodec::encodeDepth(&s.depth[0], m_width, m_height, s.encoded);
+				depthBytes = s.encoded.size();
+				if (s.hasBodyIndex) DepthCodec::encodeBodyIndex(&s.bodyIndex[0], (int)s.bodyIndex.size(), s.encoded);
+			}
+			append(s, depthBytes);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_failed) {
+				m_stats.dropped++;
+			}
+			else {
+				m_stats.written++;
+				m_stats.rawBytes += rawBytes;
+				m_stats.compressedBytes += s.encoded.size();
+			}
+			m_free.push_back(slot);
+		}
+	}
+
+	void DepthCaptureWriter::append(Slot& slot, size_t depthBytes) {
+		std::lock_guard<std::mutex> lock(m_fileMutex);
+		if (m_failed) return;
+
+		ChunkHeader chunk;
+		chunk.timestamp = slot.timestamp;
+		chunk.depthBytes = (uint32_t)depthBytes;
+		chunk.indexBytes = (uint32_t)(slot.encoded.size() - depthBytes);
+		if (fwrite(&chunk, sizeof(chunk), 1, m_file) != 1 ||
+			fwrite(&slot.encoded[0], 1, slot.encoded.size(), m_file) != slot.encoded.size()) {
+			// A full disk ends the capture, the images already written can still be read without the index
+			m_failed = true;
+			return;
+		}
+
+		IndexEntry entry = { slot.timestamp, m_offset };
+		m_index.push_back(entry);
+		m_offset += sizeof(chunk) + slot.encoded.size();
+	}
+
+	void DepthCaptureWriter::close() {
+		if (m_file == NULL) return;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_ready.notify_all();
+		for (size_t i = 0; i < m_encoders.size(); i++) {
+			m_encoders[i].join();
+		}
+		m_encoders.clear();
+
+		// Encoders finish out of order, the index puts images back in time order
+		if (!m_failed) {
+			std::stable_sort(m_index.begin(), m_index.end(), earlier<IndexEntry>);
+			Trailer trailer;
+			trailer.indexOffset = m_offset;
+			trailer.count = (uint32_t)m_index.size();
+			memcpy(trailer.magic, Magic, sizeof(Magic));
+			if (!m_index.empty()) fwrite(&m_index[0], sizeof(IndexEntry), m_index.size(), m_file);
+			fwrite(&trailer, sizeof(trailer), 1, m_file);
+		}
+
+		fclose(m_file);
+		m_file = NULL;
+	}
+
+	DepthCaptureWriter::Stats DepthCaptureWriter::stats() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_stats;
+	}
+
+	DepthCaptureReader::DepthCaptureReader() : m_file(NULL), m_width(0), m_height(0) {}
+
+	DepthCaptureReader::~DepthCaptureReader() {
+		close();
+	}
+
+	bool DepthCaptureReader::open(const std::string& path) {
+		close();
+
+		m_file = fopen(path.c_str(), "rb");
+		if (m_file == NULL) return false;
+
+		Header header;
+		bool valid = fread(&header, sizeof(header), 1, m_file) == 1 &&
+			memcmp(header.magic, Magic, sizeof(Magic)) == 0 &&
+			header.version == Version &&
+			header.width > 0 && header.width <= 4096 && header.height > 0 && header.height <= 4096;
+		if (valid) {
+			m_width = header.width;
+			m_height = header.height;
+			valid = readIndex() || scan();
+		}
+
+		if (!valid) close();
+		return valid;
+	}
+
+	bool DepthCaptureReader::readIndex() {
+		uint64_t size = fileSize(m_file);
+		if (size < sizeof(Header) + sizeof(Trailer)) return false;
+
+		Trailer trailer;
+		if (!seek(m_file, size - sizeof(Trailer)) || fread(&trailer, sizeof(trailer), 1, m_file) != 1) return false;
+		if (memcmp(trailer.magic, Magic, sizeof(Magic)) != 0 ||
+			trailer.indexOffset < sizeof(Header) ||
+			trailer.indexOffset + (uint64_t)trailer.count * sizeof(IndexEntry) + sizeof(Trailer) != size) {
+			return false;
+		}
+
+		m_index.resize(trailer.count);
+		if (trailer.count > 0 &&
+			(!seek(m_file, trailer.indexOffset) || fread(&m_index[0], sizeof(IndexEntry), m_index.size(), m_file) != m_index.size())) {
+			m_index.clear();
+			return false;
+		}
+		for (size_t i = 0; i < m_index.size(); i++) {
+			if (m_index[i].offset < sizeof(Header) || m_index[i].offset + sizeof(ChunkHeader) > trailer.indexOffset) {
+				m_index.clear();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Walks the images from the start, keeping every one that's all there
+	bool DepthCaptureReader::scan() {
+		uint64_t size = fileSize(m_file);
+		uint64_t offset = sizeof(Header);
+		m_index.clear();
+
+		ChunkHeader chunk;
+		while (seek(m_file, offset) && fread(&chunk, sizeof(chunk), 1, m_file) == 1) {
+			uint64_t end = offset + sizeof(chunk) + chunk.depthBytes + chunk.indexBytes;
+			if (end > size) break;
+			IndexEntry entry = { chunk.timestamp, offset };
+			m_index.push_back(entry);
+			offset = end;
+		}
+
+		std::stable_sort(m_index.begin(), m_index.end(), earlier<IndexEntry>);
+		return true;
+	}
+
+	void DepthCaptureReader::close() {
+		if (m_file != NULL) {
+			fclose(m_file);
+			m_file = NULL;
+		}
+		m_index.clear();
+	}
+
+	int DepthCaptureReader::width() const {
+		return m_width;
+	}
+
+	int DepthCaptureReader::height() const {
+		return m_height;
+	}
+
+	size_t DepthCaptureReader::frames() const {
+		return m_index.size();
+	}
+
+	int64_t DepthCaptureReader::timestamp(size_t frame) const {
+		return m_index[frame].timestamp;
+	}
+
+	long DepthCaptureReader::find(int64_t timestamp) const {
+		IndexEntry key = { timestamp, 0 };
+		std::vector<IndexEntry>::const_iterator after = std::upper_bound(m_index.begin(), m_index.end(), key, earlier<IndexEntry>);
+		return (long)(after - m_index.begin()) - 1;
+	}
+
+	bool DepthCaptureReader::read(size_t frame, DepthImage& image, std::vector<uint8_t>* bodyIndex) {
+		if (m_file == NULL || frame >= m_index.size()) return false;
+
+		ChunkHeader chunk;
+		if (!seek(m_file, m_index[frame].offset) || fread(&chunk, sizeof(chunk), 1, m_file) != 1 ||
+			chunk.timestamp != m_index[frame].timestamp) {
+			return false;
+		}
+
+		m_buffer.resize((size_t)chunk.depthBytes + chunk.indexBytes);
+		if (!m_buffer.empty() && fread(&m_buffer[0], 1, m_buffer.size(), m_file) != m_buffer.size()) return false;
+
+		size_t pixels = (size_t)m_width * m_height;
+		image.timestamp = chunk.timestamp;
+		image.width = m_width;
+		image.height = m_height;
+		image.depth.resize(pixels);
+		if (!DepthCodec::decodeDepth(m_buffer.empty() ? NULL : &m_buffer[0], chunk.depthBytes, m_width, m_height, &image.depth[0])) return false;
+
+		if (bodyIndex != NULL) {
+			bodyIndex->clear();
+			if (chunk.indexBytes > 0) {
+				bodyIndex->resize(pixels);
+				if (!DepthCodec::decodeBodyIndex(&m_buffer[chunk.depthBytes], chunk.indexBytes, (int)pixels, &(*bodyIndex)[0])) return false;
+			}
+		}
+		return true;
+	}
+
+	bool isDepthCapture(const std::string& path) {
+		FILE* file = fopen(path.c_str(), "rb");
+		if (file == NULL) return false;
+
+		char magic[4];
+		bool capture = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, Magic, sizeof(Magic)) == 0;
+		fclose(file);
+		return capture;
+	}
+};
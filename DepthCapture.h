@@ -0,0 +1,118 @@
+#pragma once
+
+#include "DepthRecording.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace KinectOsvr {
+	// Writes compressed depth and body-index images from the sensor thread without ever waiting on the disk or
+	// the encoders. Images are copied into one of a fixed set of buffers and compressed on the writer's own
+	// threads; when every buffer is still waiting, the image is dropped and counted instead.
+	class DepthCaptureWriter {
+	public:
+		struct Stats {
+			Stats() : submitted(0), written(0), dropped(0), rawBytes(0), compressedBytes(0) {}
+
+			uint64_t submitted, written, dropped;
+			uint64_t rawBytes, compressedBytes;
+		};
+
+		DepthCaptureWriter(int encoders = 2, int buffers = 8);
+		~DepthCaptureWriter();
+
+		bool open(const std::string& path, int width, int height);
+		bool isOpen() const;
+
+		// Copies the images to be written, bodyIndex may be NULL. False if the image was dropped.
+		bool submit(int64_t timestamp, const uint16_t* depth, const uint8_t* bodyIndex);
+
+		// Writes what's still waiting, then the index
+		void close();
+
+		Stats stats() const;
+
+	private:
+		struct Slot {
+			int64_t timestamp;
+			bool hasBodyIndex;
+			std::vector<uint16_t> depth;
+			std::vector<uint8_t> bodyIndex;
+			std::vector<uint8_t> encoded;
+		};
+
+		struct IndexEntry {
+			int64_t timestamp;
+			uint64_t offset;
+		};
+
+		void encode();
+		void append(Slot& slot, size_t depthBytes);
+
+		int m_encoderCount;
+		int m_width, m_height;
+
+		std::vector<Slot> m_slots;
+		std::vector<std::thread> m_encoders;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_ready;
+		std::vector<int> m_free;
+		std::deque<int> m_pending;
+		bool m_stopping;
+		Stats m_stats;
+
+		// Encoders take turns appending
+		std::mutex m_fileMutex;
+		FILE* m_file;
+		uint64_t m_offset;
+		bool m_failed;
+		std::vector<IndexEntry> m_index;
+	};
+
+	// Reads single images from a capture by position or by time
+	class DepthCaptureReader {
+	public:
+		DepthCaptureReader();
+		~DepthCaptureReader();
+
+		// Captures cut short without their index are read by walking the images
+		bool open(const std::string& path);
+		void close();
+
+		int width() const;
+		int height() const;
+		size_t frames() const;
+		int64_t timestamp(size_t frame) const;
+
+		// The newest image at or before the timestamp, -1 if they're all later
+		long find(int64_t timestamp) const;
+
+		// bodyIndex, when given, is left empty if the image was captured without one
+		bool read(size_t frame, DepthImage& image, std::vector<uint8_t>* bodyIndex);
+
+	private:
+		struct IndexEntry {
+			int64_t timestamp;
+			uint64_t offset;
+		};
+
+		bool readIndex();
+		bool scan();
+
+		FILE* m_file;
+		int m_width, m_height;
+		std::vector<IndexEntry> m_index;
+		std::vector<uint8_t> m_buffer;
+	};
+
+	// True if the file starts like a capture, for telling it apart from raw depth recordings
+	bool isDepthCapture(const std::string& path);
+}
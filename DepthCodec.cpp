@@ -0,0 +1,237 @@
+#include "DepthCodec.h"
+
+namespace KinectOsvr {
+	namespace DepthCodec {
+
+		namespace {
+			// Pixels sharing a Rice parameter, which costs ParameterBits each
+			const int BlockSize = 32;
+			const int ParameterBits = 5;
+			// Parameter value marking a block the prediction got exactly right throughout
+			const uint32_t ExactBlock = 31;
+			const uint32_t MaxParameter = 16;
+			// Quotients this large are written out in full instead
+			const uint32_t Escape = 20;
+			const int ResidualBits = 17;
+
+			// Bits are packed from the least significant end of each byte
+			class BitWriter {
+			public:
+				explicit BitWriter(std::vector<uint8_t>& out) : m_out(out), m_bits(0), m_count(0) {}
+
+				void put(uint64_t value, int count) {
+					m_bits |= value << m_count;
+					m_count += count;
+					while (m_count >= 8) {
+						m_out.push_back((uint8_t)m_bits);
+						m_bits >>= 8;
+						m_count -= 8;
+					}
+				}
+
+				void flush() {
+					if (m_count > 0) m_out.push_back((uint8_t)m_bits);
+					m_bits = 0;
+					m_count = 0;
+				}
+
+			private:
+				std::vector<uint8_t>& m_out;
+				uint64_t m_bits;
+				int m_count;
+			};
+
+			class BitReader {
+			public:
+				BitReader(const uint8_t* data, size_t size) : m_data(data), m_end(data + size), m_bits(0), m_count(0), m_overrun(false) {}
+
+				uint32_t get(int count) {
+					refill();
+					if (m_count < count) {
+						m_overrun = true;
+						return 0;
+					}
+					uint32_t value = (uint32_t)(m_bits & ((1ULL << count) - 1));
+					m_bits >>= count;
+					m_count -= count;
+					return value;
+				}
+
+				// Ones up to the first zero, which is used up too, or Escape ones with no zero after them
+				uint32_t unary() {
+					refill();
+					uint32_t ones = 0;
+					while (ones < Escape && m_count > 0 && (m_bits & 1)) {
+						m_bits >>= 1;
+						m_count--;
+						ones++;
+					}
+					if (ones < Escape) get(1);
+					return ones;
+				}
+
+				bool overrun() const {
+					return m_overrun;
+				}
+
+			private:
+				void refill() {
+					while (m_count <= 56 && m_data < m_end) {
+						m_bits |= (uint64_t)*m_data++ << m_count;
+						m_count += 8;
+					}
+				}
+
+				const uint8_t* m_data;
+				const uint8_t* m_end;
+				uint64_t m_bits;
+				int m_count;
+				bool m_overrun;
+			};
+
+			// LOCO-I's median edge detector: the left or above neighbour across an edge, a plane fit otherwise
+			inline int predict(const uint16_t* pixel, int x, int y, int width) {
+				if (y == 0) return x > 0 ? pixel[-1] : 0;
+				int above = pixel[-width];
+				if (x == 0) return above;
+
+				int left = pixel[-1];
+				int corner = pixel[-width - 1];
+				int low = left < above ? left : above;
+				int high = left < above ? above : left;
+				if (corner >= high) return low;
+				if (corner <= low) return high;
+				return left + above - corner;
+			}
+
+			inline uint32_t zigzag(int value) {
+				return value >= 0 ? (uint32_t)value << 1 : ((uint32_t)(-value) << 1) - 1;
+			}
+
+			inline int unzigzag(uint32_t value) {
+				return value & 1 ? -(int)((value + 1) >> 1) : (int)(value >> 1);
+			}
+
+			void putVarint(uint32_t value, std::vector<uint8_t>& out) {
+				while (value >= 0x80) {
+					out.push_back((uint8_t)(value | 0x80));
+					value >>= 7;
+				}
+				out.push_back((uint8_t)value);
+			}
+		}
+
+		void encodeDepth(const uint16_t* depth, int width, int height, std::vector<uint8_t>& out) {
+			BitWriter writer(out);
+			int pixels = width * height;
+			uint32_t residuals[BlockSize];
+
+			int x = 0, y = 0;
+			for (int start = 0; start < pixels; start += BlockSize) {
+				int count = pixels - start < BlockSize ? pixels - start : BlockSize;
+				uint32_t sum = 0;
+				for (int i = 0; i < count; i++) {
+					int index = start + i;
+					residuals[i] = zigzag(depth[index] - predict(depth + index, x, y, width));
+					sum += residuals[i];
+					if (++x == width) {
+						x = 0;
+						y++;
+					}
+				}
+
+				if (sum == 0) {
+					writer.put(ExactBlock, ParameterBits);
+					continue;
+				}
+
+				// The smallest parameter whose spacing covers the block's average residual
+				uint32_t k = 0;
+				while (k < MaxParameter && ((uint32_t)count << k) < sum) k++;
+				writer.put(k, ParameterBits);
+
+				for (int i = 0; i < count; i++) {
+					uint32_t quotient = residuals[i] >> k;
+					if (quotient >= Escape) {
+						writer.put((1u << Escape) - 1, Escape);
+						writer.put(residuals[i], ResidualBits);
+					}
+					else {
+						// Unary quotient then the low bits, at most 36 bits so one put does it
+						uint64_t remainder = residuals[i] & ((1u << k) - 1);
+						writer.put(((1ULL << quotient) - 1) | remainder << (quotient + 1), quotient + 1 + k);
+					}
+				}
+			}
+			writer.flush();
+		}
+
+		bool decodeDepth(const uint8_t* data, size_t size, int width, int height, uint16_t* depth) {
+			BitReader reader(data, size);
+			int pixels = width * height;
+
+			int x = 0, y = 0;
+			for (int start = 0; start < pixels; start += BlockSize) {
+				int count = pixels - start < BlockSize ? pixels - start : BlockSize;
+				uint32_t k = reader.get(ParameterBits);
+				if (k > MaxParameter && k != ExactBlock) return false;
+
+				for (int i = 0; i < count; i++) {
+					uint32_t residual = 0;
+					if (k != ExactBlock) {
+						uint32_t quotient = reader.unary();
+						if (quotient == Escape) residual = reader.get(ResidualBits);
+						else residual = (quotient << k) | (k > 0 ? reader.get(k) : 0);
+					}
+
+					int index = start + i;
+					int value = predict(depth + index, x, y, width) + unzigzag(residual);
+					if (value < 0 || value > 0xFFFF) return false;
+					depth[index] = (uint16_t)value;
+					if (++x == width) {
+						x = 0;
+						y++;
+					}
+				}
+				if (reader.overrun()) return false;
+			}
+			return true;
+		}
+
+		// Runs of the same value: the value, then the run's length less one as a varint
+		void encodeBodyIndex(const uint8_t* bodyIndex, int pixels, std::vector<uint8_t>& out) {
+			int i = 0;
+			while (i < pixels) {
+				uint8_t value = bodyIndex[i];
+				int run = 1;
+				while (i + run < pixels && bodyIndex[i + run] == value) run++;
+				out.push_back(value);
+				putVarint((uint32_t)(run - 1), out);
+				i += run;
+			}
+		}
+
+		bool decodeBodyIndex(const uint8_t* data, size_t size, int pixels, uint8_t* bodyIndex) {
+			const uint8_t* end = data + size;
+			int i = 0;
+			while (i < pixels) {
+				if (data >= end) return false;
+				uint8_t value = *data++;
+
+				uint32_t run = 0;
+				int shift = 0;
+				for (;;) {
+					if (data >= end || shift > 28) return false;
+					uint8_t byte = *data++;
+					run |= (uint32_t)(byte & 0x7F) << shift;
+					shift += 7;
+					if (!(byte & 0x80)) break;
+				}
+
+				if (run >= (uint32_t)(pixels - i)) return false;
+				for (uint32_t r = 0; r <= run; r++) bodyIndex[i++] = value;
+			}
+			return data == end;
+		}
+	}
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace KinectOsvr {
+	// Lossless compression for depth and body-index images. Depth is predicted from the neighbouring pixels
+	// already coded, and what the prediction misses is Rice coded with a parameter fitted to each short run of
+	// pixels, so flat walls and holes cost about a bit a pixel. Body indices are run-length coded.
+	namespace DepthCodec {
+		// Appends the compressed image to out
+		void encodeDepth(const uint16_t* depth, int width, int height, std::vector<uint8_t>& out);
+		// False if the data is cut short or isn't a depth image of this size
+		bool decodeDepth(const uint8_t* data, size_t size, int width, int height, uint16_t* depth);
+
+		void encodeBodyIndex(const uint8_t* bodyIndex, int pixels, std::vector<uint8_t>& out);
+		bool decodeBodyIndex(const uint8_t* data, size_t size, int pixels, uint8_t* bodyIndex);
+	}
+}
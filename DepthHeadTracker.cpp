@@ -0,0 +1,163 @@
+#include "DepthHeadTracker.h"
+
+#include <Eigen/Core>
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace KinectOsvr {
+
+	namespace {
+		// Region searched around where the head last was, in metres
+		const float SearchSide = 0.15f;
+		const float SearchAbove = 0.3f;
+		const float SearchBelow = 0.2f;
+
+		// Pixels count less the further their depth is from the head's, and not at all past this, in millimetres
+		const float DepthBand = 250.0f;
+
+		const float HeadRadius = 0.1f;
+		// From the face or back of the head, which is what the camera sees, to the skeleton's head joint
+		const float SurfaceToJoint = 0.07f;
+
+		// Share of a head-sized box that has to be filled, for the top of the head and then the head as a whole
+		const float TopCoverage = 0.3f;
+		const float MinCoverage = 0.3f;
+		// A head filling this much of its box is as sure as it gets
+		const float FullCoverage = 0.6f;
+
+		// Further than this between frames is something else, in metres. Depth is held tighter, it's where
+		// someone walking in front shows up.
+		const float MaxStep = 0.25f;
+		const float MaxDepthStep = 0.12f;
+		const float MinDepth = 0.3f;
+
+		const float InferredConfidence = 0.5f;
+	}
+
+	DepthHeadTracker::DepthHeadTracker(const PinholeIntrinsics& camera) : m_camera(camera), m_tracking(false) {
+		m_head[0] = m_head[1] = m_head[2] = 0;
+	}
+
+	void DepthHeadTracker::setCamera(const PinholeIntrinsics& camera) {
+		m_camera = camera;
+	}
+
+	void DepthHeadTracker::seed(const float head[3]) {
+		m_head[0] = head[0];
+		m_head[1] = head[1];
+		m_head[2] = head[2];
+		m_tracking = head[2] - m_camera.offsetZ > MinDepth;
+	}
+
+	void DepthHeadTracker::reset() {
+		m_tracking = false;
+	}
+
+	bool DepthHeadTracker::tracking() const {
+		return m_tracking;
+	}
+
+	// Each row reduces to three sums over a tent weighting of its pixels' depths, done a SIMD register at a time
+	void DepthHeadTracker::sumRows(const uint16_t* depth, int width, const Rows& rows, float z) {
+		typedef Eigen::Array<uint16_t, Eigen::Dynamic, 1> RawRow;
+		int count = rows.right - rows.left;
+		Eigen::Map<const Eigen::ArrayXf> columns(&m_columns[rows.left], count);
+		Eigen::Map<Eigen::ArrayXf> pixels(&m_pixels[0], count);
+		Eigen::Map<Eigen::ArrayXf> weights(&m_pixels[width], count);
+
+		for (int r = rows.top; r < rows.bottom; r++) {
+			pixels = Eigen::Map<const RawRow>(depth + (size_t)r * width + rows.left, count).cast<float>();
+			weights = (DepthBand - (pixels - z).abs()).max(0.0f);
+
+			m_rowWeight[r] = weights.sum();
+			m_rowColumn[r] = (weights * columns).sum();
+			m_rowDepth[r] = (weights * pixels).sum();
+		}
+	}
+
+	bool DepthHeadTracker::track(const uint16_t* depth, int width, int height, float head[3], float& confidence) {
+		if (!m_tracking || depth == NULL || width <= 0 || height <= 0) return false;
+		m_tracking = false;
+
+		if ((int)m_columns.size() != width) {
+			m_columns.resize(width);
+			for (int c = 0; c < width; c++) m_columns[c] = (float)c;
+			m_pixels.resize(width * 2);
+		}
+		if ((int)m_rowWeight.size() != height) {
+			m_rowWeight.resize(height);
+			m_rowColumn.resize(height);
+			m_rowDepth.resize(height);
+		}
+
+		float z = m_head[2] - m_camera.offsetZ;
+		if (z <= MinDepth) return false;
+
+		float u, v;
+		PinholeProjector::project(m_camera, &m_head[0], &m_head[1], &m_head[2], 1, &u, &v);
+		float scale = m_camera.focalLengthX / z;
+		float headSize = 2 * HeadRadius * scale;
+
+		Rows search;
+		search.top = std::max(0, (int)(v - SearchAbove * scale));
+		search.bottom = std::min(height, (int)(v + SearchBelow * scale));
+		search.left = std::max(0, (int)(u - SearchSide * scale));
+		search.right = std::min(width, (int)(u + SearchSide * scale));
+		if (search.top >= search.bottom || search.left >= search.right) return false;
+
+		// The head is the topmost thing at about its depth
+		float surface = (z - SurfaceToJoint) * 1000.0f;
+		sumRows(depth, width, search, surface);
+
+		int top = search.top;
+		while (top < search.bottom && m_rowWeight[top] < TopCoverage * DepthBand * headSize) top++;
+		if (top == search.bottom) return false;
+
+		// Centred on the rows a head's height down from there, then again on just the columns around that
+		Rows headRows = search;
+		headRows.top = top;
+		headRows.bottom = std::min(height, top + std::max(1, (int)headSize));
+
+		float weight = 0, column = 0;
+		for (int r = headRows.top; r < headRows.bottom; r++) {
+			weight += m_rowWeight[r];
+			column += m_rowColumn[r];
+		}
+		if (weight <= 0) return false;
+		float centre = column / weight;
+
+		headRows.left = std::max(0, (int)(centre - 0.75f * headSize));
+		headRows.right = std::min(width, (int)(centre + 0.75f * headSize) + 1);
+		sumRows(depth, width, headRows, surface);
+
+		float depthSum = 0;
+		weight = column = 0;
+		for (int r = headRows.top; r < headRows.bottom; r++) {
+			weight += m_rowWeight[r];
+			column += m_rowColumn[r];
+			depthSum += m_rowDepth[r];
+		}
+		float coverage = weight / (DepthBand * headSize * (headRows.bottom - headRows.top));
+		if (weight <= 0 || coverage < MinCoverage) return false;
+
+		// Back through the pinhole model to sensor space
+		float found[3];
+		float foundZ = depthSum / weight / 1000.0f + SurfaceToJoint;
+		float foundV = top + headSize * 0.5f;
+		found[0] = (column / weight - m_camera.principalPointX) * foundZ / m_camera.focalLengthX + m_camera.offsetX;
+		found[1] = (m_camera.principalPointY - foundV) * foundZ / m_camera.focalLengthY + m_camera.offsetY;
+		found[2] = foundZ + m_camera.offsetZ;
+
+		float dx = found[0] - m_head[0], dy = found[1] - m_head[1], dz = found[2] - m_head[2];
+		if (dx * dx + dy * dy + dz * dz > MaxStep * MaxStep || fabsf(dz) > MaxDepthStep) return false;
+
+		m_head[0] = head[0] = found[0];
+		m_head[1] = head[1] = found[1];
+		m_head[2] = head[2] = found[2];
+		confidence = InferredConfidence * std::min(1.0f, coverage / FullCoverage);
+		m_tracking = true;
+		return true;
+	}
+};
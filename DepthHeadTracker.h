@@ -0,0 +1,47 @@
+#pragma once
+
+#include "JointProjection.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace KinectOsvr {
+	// Keeps the head going from the depth image alone when the skeleton tracker loses the user, as it does when
+	// they sit close, turn side on or are partly hidden. Starts from where the skeleton last had the head and
+	// searches a small region around it each frame, so it costs a fraction of a full-image pass.
+	class DepthHeadTracker {
+	public:
+		explicit DepthHeadTracker(const PinholeIntrinsics& camera = KinectV2DepthCamera);
+
+		// The depth camera's own calibration, when the sensor has one
+		void setCamera(const PinholeIntrinsics& camera);
+
+		// Where the skeleton has the head, in metres in sensor space
+		void seed(const float head[3]);
+		void reset();
+
+		// From a seed until the head can no longer be found in the depth image
+		bool tracking() const;
+
+		// Finds the head near where it last was, in a depth image of millimetres with 0 for no reading. Gives its
+		// position in sensor space and a confidence no higher than an inferred joint's, false once it's lost.
+		bool track(const uint16_t* depth, int width, int height, float head[3], float& confidence);
+
+	private:
+		struct Rows {
+			int top, bottom;
+			int left, right;
+		};
+
+		// Weight, weighted column and weighted depth of each row's pixels near the head's depth
+		void sumRows(const uint16_t* depth, int width, const Rows& rows, float z);
+
+		PinholeIntrinsics m_camera;
+		bool m_tracking;
+		float m_head[3];
+
+		std::vector<float> m_columns;
+		std::vector<float> m_pixels;
+		std::vector<float> m_rowWeight, m_rowColumn, m_rowDepth;
+	};
+}
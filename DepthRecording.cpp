@@ -0,0 +1,102 @@
+#include "DepthRecording.h"
+#include "DepthCapture.h"
+
+#include <string.h>
+
+namespace KinectOsvr {
+
+	namespace {
+		const char Magic[4] = { 'K', 'D', 'P', 'R' };
+		const uint32_t Version = 1;
+
+		struct Header {
+			char magic[4];
+			uint32_t version;
+			int32_t width, height;
+		};
+	}
+
+	DepthRecorder::DepthRecorder() : m_file(NULL), m_width(0), m_height(0) {}
+
+	DepthRecorder::~DepthRecorder() {
+		close();
+	}
+
+	bool DepthRecorder::open(const std::string& path, int width, int height) {
+		close();
+		if (width <= 0 || height <= 0) return false;
+
+		m_file = fopen(path.c_str(), "wb");
+		if (m_file == NULL) return false;
+
+		Header header;
+		memcpy(header.magic, Magic, sizeof(Magic));
+		header.version = Version;
+		header.width = width;
+		header.height = height;
+
+		if (fwrite(&header, sizeof(header), 1, m_file) != 1) {
+			close();
+			return false;
+		}
+		m_width = width;
+		m_height = height;
+		return true;
+	}
+
+	bool DepthRecorder::isOpen() const {
+		return m_file != NULL;
+	}
+
+	// Each image is its timestamp followed by the pixels row by row
+	void DepthRecorder::write(int64_t timestamp, const uint16_t* depth) {
+		if (m_file == NULL) return;
+
+		size_t pixels = (size_t)m_width * m_height;
+		if (fwrite(&timestamp, sizeof(timestamp), 1, m_file) != 1 || fwrite(depth, sizeof(uint16_t), pixels, m_file) != pixels) {
+			close();
+		}
+	}
+
+	void DepthRecorder::close() {
+		if (m_file != NULL) {
+			fclose(m_file);
+			m_file = NULL;
+		}
+	}
+
+	bool loadDepthRecording(const std::string& path, std::vector<DepthImage>& images) {
+		if (isDepthCapture(path)) {
+			DepthCaptureReader reader;
+			if (!reader.open(path)) return false;
+			DepthImage image;
+			for (size_t i = 0; i < reader.frames(); i++) {
+				if (reader.read(i, image, NULL)) images.push_back(image);
+			}
+			return true;
+		}
+
+		FILE* file = fopen(path.c_str(), "rb");
+		if (file == NULL) return false;
+
+		Header header;
+		bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+			memcmp(header.magic, Magic, sizeof(Magic)) == 0 &&
+			header.version == Version &&
+			header.width > 0 && header.width <= 4096 && header.height > 0 && header.height <= 4096;
+
+		if (valid) {
+			DepthImage image;
+			image.width = header.width;
+			image.height = header.height;
+			image.depth.resize((size_t)header.width * header.height);
+			while (fread(&image.timestamp, sizeof(image.timestamp), 1, file) == 1 &&
+				fread(&image.depth[0], sizeof(uint16_t), image.depth.size(), file) == image.depth.size()) {
+				images.push_back(image);
+			}
+		}
+
+		fclose(file);
+		return valid;
+	}
+};
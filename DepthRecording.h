@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace KinectOsvr {
+	// One depth image, in millimetres with 0 for no reading
+	struct DepthImage {
+		// Sensor clock, in microseconds, as for SkeletonFrame
+		int64_t timestamp;
+		int width, height;
+		std::vector<uint16_t> depth;
+	};
+
+	// Writes depth images uncompressed after a short header, to replay alongside a skeleton recording
+	class DepthRecorder {
+	public:
+		DepthRecorder();
+		~DepthRecorder();
+
+		bool open(const std::string& path, int width, int height);
+		bool isOpen() const;
+		void write(int64_t timestamp, const uint16_t* depth);
+		void close();
+
+	private:
+		FILE* m_file;
+		int m_width, m_height;
+	};
+
+	// Reads a whole depth recording or compressed capture, false if it's missing or neither
+	bool loadDepthRecording(const std::string& path, std::vector<DepthImage>& images);
+}
@@ -0,0 +1,52 @@
+#include "FramePipeline.h"
+
+namespace KinectOsvr {
+
+	FramePipeline::FramePipeline(WorkerPool& pool) : m_pool(pool), m_lastTimestamp(0), m_started(false) {}
+
+	bool FramePipeline::beginFrame(int64_t timestamp) {
+		if (m_started && timestamp <= m_lastTimestamp) {
+			return false;
+		}
+		// The first frame arrives on the server's update thread, which gets a core of its own
+		if (!m_started) {
+			m_pool.reserveCurrentCore();
+		}
+		m_started = true;
+		m_lastTimestamp = timestamp;
+		return true;
+	}
+
+	void FramePipeline::run(const bool* active, int bodies, const BodyStage* stages, int stageCount) {
+		int tasks = 0;
+		for (int b = 0; b < bodies; b++) {
+			if (active[b]) tasks += stageCount;
+		}
+		if (tasks == 0) return;
+
+		// Not worth waking anyone for a single task
+		if (tasks == 1 || m_pool.size() == 0) {
+			for (int b = 0; b < bodies; b++) {
+				if (!active[b]) continue;
+				for (int s = 0; s < stageCount; s++) {
+					stages[s](b);
+				}
+			}
+			return;
+		}
+
+		WorkerPool::TaskGroup group;
+		for (int b = 0; b < bodies; b++) {
+			if (!active[b]) continue;
+			for (int s = 0; s < stageCount; s++) {
+				const BodyStage* stage = &stages[s];
+				m_pool.submit(group, [stage, b]() { (*stage)(b); });
+			}
+		}
+		m_pool.wait(group);
+	}
+
+	void FramePipeline::run(const bool* active, int bodies, const BodyStage& stage) {
+		run(active, bodies, &stage, 1);
+	}
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "WorkerPool.h"
+
+#include <cstdint>
+
+namespace KinectOsvr {
+	class FramePipeline {
+	public:
+		typedef std::function<void(int body)> BodyStage;
+
+		explicit FramePipeline(WorkerPool& pool);
+
+		// Returns false for a frame that isn't newer than the last one, so reported timestamps stay monotonic.
+		// The first frame also reserves the calling thread's core, away from the pool's workers.
+		bool beginFrame(int64_t timestamp);
+
+		// Runs every stage for every active body as an independent task and joins before returning
+		void run(const bool* active, int bodies, const BodyStage* stages, int stageCount);
+		void run(const bool* active, int bodies, const BodyStage& stage);
+
+	private:
+		WorkerPool& m_pool;
+		int64_t m_lastTimestamp;
+		bool m_started;
+	};
+}
@@ -0,0 +1,176 @@
+#include "FrameScheduler.h"
+
+#include <algorithm>
+
+namespace KinectOsvr {
+
+	namespace {
+		const char* StageNames[FrameScheduler::StageCount] = {
+			"secondary bodies", "projection", "orientations", "filtering", "gestures", "secondary joints"
+		};
+
+		// Frames before a stage given up is tried again, doubling up to the limit while retries overrun
+		const int FirstRetry = 30;
+		const int LastRetry = 30 * 8;
+	}
+
+	FrameScheduler::FrameScheduler(double budgetMicroseconds)
+		: m_budget(budgetMicroseconds), m_bodies(0), m_planned(0), m_shed(0), m_ran(0), m_recorded(0), m_retrying(0),
+		m_frames(0), m_overruns(0), m_degraded(0), m_lastShed(0), m_lastFrame(0), m_worstFrame(0) {
+
+		for (int s = 0; s <= StageCount; s++) {
+			m_estimate[s] = 0;
+			m_lastCost[s] = 0;
+			m_frameCost[s] = 0;
+		}
+		for (int s = 0; s < StageCount; s++) {
+			m_shedFrames[s] = 0;
+			m_retryAfter[s] = FirstRetry;
+			m_shedCounts[s] = 0;
+		}
+	}
+
+	void FrameScheduler::setBudget(double budgetMicroseconds) {
+		m_budget = budgetMicroseconds;
+	}
+
+	double FrameScheduler::budget() const {
+		return m_budget;
+	}
+
+	double FrameScheduler::elapsed() const {
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_start).count();
+	}
+
+	double FrameScheduler::predicted(int stage) const {
+		if (m_retrying & (1u << stage)) return 0;
+		if (stage == SecondaryBodies) {
+			return m_estimate[stage] * (m_bodies > 1 ? m_bodies - 1 : 0);
+		}
+		return m_estimate[stage];
+	}
+
+	void FrameScheduler::beginFrame(int bodies) {
+		m_start = std::chrono::steady_clock::now();
+		m_bodies = bodies;
+		m_shed = 0;
+		m_ran = 0;
+		m_recorded = 0;
+		for (int s = 0; s <= StageCount; s++) {
+			m_frameCost[s] = 0;
+		}
+		m_planned = 0;
+		m_retrying = 0;
+		if (m_budget <= 0) return;
+
+		for (int s = 0; s < StageCount; s++) {
+			if (m_shedFrames[s] >= m_retryAfter[s]) m_retrying |= 1u << s;
+		}
+
+		// Give up stages in order until what's left fits
+		double total = m_estimate[Essential];
+		for (int s = 0; s < StageCount; s++) {
+			total += predicted(s);
+		}
+		while (m_planned < StageCount && total > m_budget) {
+			total -= predicted(m_planned);
+			m_planned++;
+		}
+	}
+
+	bool FrameScheduler::admit(Stage stage) {
+		if (m_budget <= 0) {
+			m_ran |= 1u << stage;
+			return true;
+		}
+
+		// Planned away, or would leave too little time for what has to go out
+		double essentialLeft = m_estimate[Essential] - m_frameCost[Essential];
+		if (essentialLeft < 0) essentialLeft = 0;
+		bool planned = stage < m_planned && !(m_retrying & (1u << stage));
+		if (planned || elapsed() + predicted(stage) + essentialLeft > m_budget) {
+			m_shed |= 1u << stage;
+			return false;
+		}
+		m_ran |= 1u << stage;
+		return true;
+	}
+
+	void FrameScheduler::record(int stage, double microseconds) {
+		if (stage < 0 || stage > StageCount) return;
+		m_frameCost[stage] += microseconds;
+		m_recorded |= 1u << stage;
+	}
+
+	void FrameScheduler::learn(int stage, double microseconds) {
+		// Rises as soon as two frames in a row cost more, so a single preempted frame doesn't give things up.
+		// A retry replaces what the stage cost back when it was given up.
+		double& estimate = m_estimate[stage];
+		double sustained = std::min(microseconds, m_lastCost[stage]);
+		m_lastCost[stage] = microseconds;
+		if (stage < StageCount && (m_retrying & (1u << stage))) estimate = microseconds;
+		else if (sustained > estimate) estimate = sustained;
+		else estimate = estimate * 0.9 + microseconds * 0.1;
+	}
+
+	unsigned FrameScheduler::endFrame() {
+		double frame = elapsed();
+
+		for (int s = 0; s <= StageCount; s++) {
+			if (m_recorded & (1u << s)) learn(s, m_frameCost[s]);
+		}
+
+		bool overran = m_budget > 0 && frame > m_budget;
+		for (int s = 0; s < StageCount; s++) {
+			unsigned bit = 1u << s;
+			if (m_shed & bit) {
+				m_shedFrames[s]++;
+			}
+			else if (m_ran & bit) {
+				m_shedFrames[s] = 0;
+			}
+			if ((m_retrying & bit) && (m_ran & bit)) {
+				m_retryAfter[s] = overran ? std::min(m_retryAfter[s] * 2, LastRetry) : FirstRetry;
+			}
+		}
+
+		if (overran) m_overruns.fetch_add(1, std::memory_order_relaxed);
+		if (m_shed) m_degraded.fetch_add(1, std::memory_order_relaxed);
+		for (int s = 0; s < StageCount; s++) {
+			if (m_shed & (1u << s)) m_shedCounts[s].fetch_add(1, std::memory_order_relaxed);
+		}
+		m_lastShed.store(m_shed, std::memory_order_relaxed);
+		m_lastFrame.store(frame, std::memory_order_relaxed);
+		if (frame > m_worstFrame.load(std::memory_order_relaxed)) m_worstFrame.store(frame, std::memory_order_relaxed);
+		m_frames.fetch_add(1, std::memory_order_relaxed);
+		return m_shed;
+	}
+
+	FrameScheduler::Metrics FrameScheduler::metrics() const {
+		Metrics metrics;
+		metrics.frames = m_frames.load(std::memory_order_relaxed);
+		metrics.overruns = m_overruns.load(std::memory_order_relaxed);
+		metrics.degraded = m_degraded.load(std::memory_order_relaxed);
+		for (int s = 0; s < StageCount; s++) {
+			metrics.shed[s] = m_shedCounts[s].load(std::memory_order_relaxed);
+		}
+		metrics.lastShed = m_lastShed.load(std::memory_order_relaxed);
+		metrics.lastFrameMicroseconds = m_lastFrame.load(std::memory_order_relaxed);
+		metrics.worstFrameMicroseconds = m_worstFrame.load(std::memory_order_relaxed);
+		return metrics;
+	}
+
+	const char* FrameScheduler::stageName(Stage stage) {
+		return stage >= 0 && stage < StageCount ? StageNames[stage] : "unknown";
+	}
+
+	std::string FrameScheduler::describe(unsigned shed) {
+		std::string names;
+		for (int s = 0; s < StageCount; s++) {
+			if (!(shed & (1u << s))) continue;
+			if (!names.empty()) names += ", ";
+			names += StageNames[s];
+		}
+		return names.empty() ? "nothing" : names;
+	}
+};
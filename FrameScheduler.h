@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace KinectOsvr {
+	// Keeps a frame's processing within a time budget, since every device on the server waits for it. Learns
+	// what each stage costs as frames go by, and gives up optional stages in a fixed order when the frame is
+	// predicted to overrun, or is running late. The reported body's head and hands always go out.
+	class FrameScheduler {
+	public:
+		// Optional work, in the order it's given up
+		enum Stage {
+			SecondaryBodies,
+			Projection,
+			Orientations,
+			Filtering,
+			Gestures,
+			// Every joint but the head and hands
+			SecondaryJoints,
+			StageCount
+		};
+		// What can't be given up, for record()
+		static const int Essential = StageCount;
+
+		struct Metrics {
+			uint64_t frames;
+			// Frames that took longer than the budget regardless
+			uint64_t overruns;
+			// Frames that gave anything up, and how often each stage was given up
+			uint64_t degraded;
+			uint64_t shed[StageCount];
+			// Stages given up on the last frame, one bit per Stage
+			unsigned lastShed;
+			double lastFrameMicroseconds;
+			double worstFrameMicroseconds;
+		};
+
+		// A budget of 0 or less runs everything
+		explicit FrameScheduler(double budgetMicroseconds);
+
+		void setBudget(double budgetMicroseconds);
+		double budget() const;
+
+		// Plans the frame from recent costs, bodies being how many will be processed with secondary bodies included
+		void beginFrame(int bodies);
+
+		// Whether to run an optional stage now, given the plan and the time left
+		bool admit(Stage stage);
+
+		// What work cost this frame, in microseconds, adding up whatever's recorded against a stage until
+		// endFrame. SecondaryBodies is recorded per body.
+		void record(int stage, double microseconds);
+
+		// Learns from what each stage cost this frame. Returns the stages given up, one bit per Stage.
+		unsigned endFrame();
+
+		// Safe from any thread; each value is read on its own, so they can be a frame apart
+		Metrics metrics() const;
+
+		// Stages given up, as a readable list
+		static std::string describe(unsigned shed);
+		static const char* stageName(Stage stage);
+
+		double elapsed() const;
+
+	private:
+		double predicted(int stage) const;
+		void learn(int stage, double microseconds);
+
+		double m_budget;
+		int m_bodies;
+		int m_planned;
+		unsigned m_shed;
+		unsigned m_ran;
+		std::chrono::steady_clock::time_point m_start;
+
+		// What each stage has cost so far this frame, and which were recorded, one bit per stage and Essential
+		double m_frameCost[StageCount + 1];
+		unsigned m_recorded;
+
+		// Recent cost of each stage then of the essential work, quick to rise and slow to fall
+		double m_estimate[StageCount + 1];
+		double m_lastCost[StageCount + 1];
+
+		// A stage given up is tried again after a while, in case the pressure is off, and after longer each time
+		// that overruns the frame
+		int m_shedFrames[StageCount];
+		int m_retryAfter[StageCount];
+		unsigned m_retrying;
+
+		// Written by the frame's thread alone, read by whoever asks for metrics
+		std::atomic<uint64_t> m_frames;
+		std::atomic<uint64_t> m_overruns;
+		std::atomic<uint64_t> m_degraded;
+		std::atomic<uint64_t> m_shedCounts[StageCount];
+		std::atomic<unsigned> m_lastShed;
+		std::atomic<double> m_lastFrame;
+		std::atomic<double> m_worstFrame;
+	};
+}
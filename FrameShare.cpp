@@ -0,0 +1,400 @@
+#include "FrameShare.h"
+#include "Log.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <stddef.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+
+namespace KinectOsvr {
+
+	static_assert(std::is_trivially_copyable<SharedFrame>::value, "Frames are copied in and out of shared memory as they are");
+	static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Atomics in shared memory have to be lock-free to work across processes");
+
+	namespace {
+		const char Magic[4] = { 'K', 'S', 'H', 'M' };
+		const uint32_t Version = 1;
+
+		// The reader copies the newest frame while the daemon fills the next ones, it only has to retry if it's held
+		// up for this many frames mid-copy
+		const int FrameSlots = 8;
+		const int CommandSlots = 64;
+
+		// A daemon whose heartbeat is older than this has died, and another may take its segment over
+		const int64_t StaleHeartbeat = 1000000;
+
+		std::string shareName(const std::string& sensor) {
+#ifdef _WIN32
+			return "Local\\osvr-kinect-" + sensor;
+#else
+			return "/osvr-kinect-" + sensor;
+#endif
+		}
+	}
+
+	struct FrameSegment {
+		char magic[4];
+		uint32_t version;
+		// Both sides have to agree on the frame layout
+		uint32_t frameBytes;
+		int32_t jointCount;
+
+		// Set once the rest is ready, 0 while a daemon is setting the segment up or after it's shut down
+		std::atomic<uint64_t> instance;
+		std::atomic<int64_t> heartbeat;
+		std::atomic<uint32_t> state;
+		std::atomic<uint32_t> generation;
+		std::atomic<int32_t> bodyStates[MaxBodies];
+
+		// Frame n goes in slot n % FrameSlots, whose sequence is odd while it's written and 2n + 2 once it's in
+		std::atomic<uint64_t> published;
+		struct FrameSlot {
+			std::atomic<uint64_t> sequence;
+			SharedFrame frame;
+		} frames[FrameSlots];
+
+		// The same scheme as ControlQueue, with the daemon's head kept on its side
+		std::atomic<uint64_t> commandTail;
+		struct CommandSlot {
+			std::atomic<uint64_t> sequence;
+			int32_t type;
+			int32_t body;
+		} commands[CommandSlots];
+	};
+
+	// Plugins and the daemon are separate builds mapping the same memory, so a layout change has to bump Version
+	static_assert(std::is_standard_layout<SharedFrame>::value && std::is_standard_layout<FrameSegment>::value, "Shared memory has to be plain data");
+	static_assert(sizeof(Skeleton) == 752 && offsetof(Skeleton, tracking) == 8 && offsetof(Skeleton, x) == 24 &&
+		offsetof(Skeleton, jointTracking) == 724 && offsetof(Skeleton, handRight) == 750, "Skeleton layout changed");
+	static_assert(sizeof(SkeletonFrame) == 4528 && offsetof(SkeletonFrame, jointCount) == 8 && offsetof(SkeletonFrame, bodies) == 16, "SkeletonFrame layout changed");
+	static_assert(sizeof(SharedFrame) == 4560 && offsetof(SharedFrame, trackedBody) == 4528 && offsetof(SharedFrame, floor) == 4536 &&
+		offsetof(SharedFrame, publishedAt) == 4552, "SharedFrame layout changed");
+	static_assert(offsetof(FrameSegment, instance) == 16 && offsetof(FrameSegment, bodyStates) == 40 && offsetof(FrameSegment, published) == 64 &&
+		offsetof(FrameSegment, frames) == 72 && offsetof(FrameSegment, commandTail) == 36616 && sizeof(FrameSegment) == 37648, "FrameSegment layout changed");
+
+	int64_t steadyMicroseconds() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	namespace {
+		// Maps the named segment, creating it if asked to. handle is the mapping on Windows, unused elsewhere.
+		FrameSegment* mapSegment(const std::string& name, bool create, void*& handle, bool& existed) {
+			handle = NULL;
+			existed = false;
+#ifdef _WIN32
+			HANDLE mapping;
+			if (create) {
+				mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)sizeof(FrameSegment), name.c_str());
+				existed = mapping != NULL && GetLastError() == ERROR_ALREADY_EXISTS;
+			}
+			else {
+				mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+				existed = mapping != NULL;
+			}
+			if (mapping == NULL) return NULL;
+
+			// Fails if a segment left by another build is smaller
+			void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(FrameSegment));
+			if (view == NULL) {
+				CloseHandle(mapping);
+				return NULL;
+			}
+			handle = mapping;
+			return (FrameSegment*)view;
+#else
+			int file = shm_open(name.c_str(), O_RDWR, 0);
+			if (file >= 0) {
+				existed = true;
+			}
+			else if (create) {
+				file = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+				if (file >= 0 && ftruncate(file, sizeof(FrameSegment)) != 0) {
+					::close(file);
+					shm_unlink(name.c_str());
+					return NULL;
+				}
+			}
+			if (file < 0) return NULL;
+
+			struct stat info;
+			if (fstat(file, &info) != 0 || (size_t)info.st_size != sizeof(FrameSegment)) {
+				::close(file);
+				return NULL;
+			}
+			void* view = mmap(NULL, sizeof(FrameSegment), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+			::close(file);
+			return view == MAP_FAILED ? NULL : (FrameSegment*)view;
+#endif
+		}
+
+		void unmapSegment(FrameSegment* segment, void* handle) {
+#ifdef _WIN32
+			UnmapViewOfFile(segment);
+			CloseHandle((HANDLE)handle);
+#else
+			(void)handle;
+			munmap(segment, sizeof(FrameSegment));
+#endif
+		}
+
+		bool live(const FrameSegment* segment) {
+			return memcmp(segment->magic, Magic, sizeof(Magic)) == 0 && segment->instance.load(std::memory_order_acquire) != 0 &&
+				steadyMicroseconds() - segment->heartbeat.load(std::memory_order_acquire) < StaleHeartbeat;
+		}
+	}
+
+	FramePublisher::FramePublisher() : m_segment(NULL), m_handle(NULL), m_head(0) {}
+
+	FramePublisher::~FramePublisher() {
+		close();
+	}
+
+	bool FramePublisher::create(const std::string& sensor, int jointCount) {
+		close();
+		m_name = shareName(sensor);
+
+		bool existed;
+		m_segment = mapSegment(m_name, true, m_handle, existed);
+		if (m_segment != NULL && existed && live(m_segment)) {
+			KINECT_LOG(Error, "Another daemon is already publishing {}", sensor);
+			unmapSegment(m_segment, m_handle);
+			m_segment = NULL;
+			return false;
+		}
+
+#ifndef _WIN32
+		// A dead daemon's segment, or one from another build, is left to the plugins still attached to it. They'll
+		// notice its heartbeat stopped.
+		if (existed) {
+			if (m_segment != NULL) unmapSegment(m_segment, m_handle);
+			shm_unlink(m_name.c_str());
+			m_segment = mapSegment(m_name, true, m_handle, existed);
+		}
+#endif
+		if (m_segment == NULL) {
+			KINECT_LOG(Error, "Failed to create the shared memory for {}", sensor);
+			return false;
+		}
+
+		// On Windows a dead daemon's segment is reused while plugins still hold it, they see the new instance
+		FrameSegment& segment = *m_segment;
+		segment.instance.store(0, std::memory_order_release);
+		memcpy(segment.magic, Magic, sizeof(Magic));
+		segment.version = Version;
+		segment.frameBytes = sizeof(SharedFrame);
+		segment.jointCount = jointCount;
+		segment.heartbeat.store(steadyMicroseconds(), std::memory_order_relaxed);
+		segment.state.store(0, std::memory_order_relaxed);
+		segment.generation.store(0, std::memory_order_relaxed);
+		for (int i = 0; i < MaxBodies; i++) {
+			segment.bodyStates[i].store(BodyIdentifier::CannotBeTracked, std::memory_order_relaxed);
+		}
+		segment.published.store(0, std::memory_order_relaxed);
+		for (int i = 0; i < FrameSlots; i++) {
+			segment.frames[i].sequence.store(0, std::memory_order_relaxed);
+		}
+		segment.commandTail.store(0, std::memory_order_relaxed);
+		for (int i = 0; i < CommandSlots; i++) {
+			segment.commands[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		m_head = 0;
+
+		// Never 0, and different from whichever daemon had the segment last
+		segment.instance.store((uint64_t)steadyMicroseconds() | 1, std::memory_order_release);
+		return true;
+	}
+
+	void FramePublisher::close() {
+		if (m_segment == NULL) return;
+
+		// Attached plugins find out straight away rather than when the heartbeat goes stale
+		m_segment->instance.store(0, std::memory_order_release);
+		unmapSegment(m_segment, m_handle);
+		m_segment = NULL;
+		m_handle = NULL;
+#ifndef _WIN32
+		shm_unlink(m_name.c_str());
+#endif
+	}
+
+	bool FramePublisher::isOpen() const {
+		return m_segment != NULL;
+	}
+
+	void FramePublisher::publish(const SkeletonFrame& frame, int trackedBody, const float* floor) {
+		uint64_t n = m_segment->published.load(std::memory_order_relaxed);
+		FrameSegment::FrameSlot& slot = m_segment->frames[n % FrameSlots];
+
+		slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		SharedFrame& shared = slot.frame;
+		memcpy(&shared.frame, &frame, sizeof(SkeletonFrame));
+		shared.trackedBody = trackedBody;
+		shared.hasFloor = floor != NULL;
+		for (int i = 0; i < 4; i++) shared.floor[i] = floor != NULL ? floor[i] : 0.0f;
+		shared.publishedAt = steadyMicroseconds();
+
+		slot.sequence.store(2 * n + 2, std::memory_order_release);
+		m_segment->published.store(n + 1, std::memory_order_release);
+	}
+
+	void FramePublisher::setBodyStates(const BodyIdentifier::BodyTrackingState* states) {
+		for (int i = 0; i < MaxBodies; i++) {
+			m_segment->bodyStates[i].store(states[i], std::memory_order_relaxed);
+		}
+	}
+
+	void FramePublisher::setSensor(int state, unsigned generation) {
+		m_segment->generation.store(generation, std::memory_order_relaxed);
+		m_segment->state.store((uint32_t)state, std::memory_order_release);
+	}
+
+	void FramePublisher::heartbeat() {
+		m_segment->heartbeat.store(steadyMicroseconds(), std::memory_order_release);
+	}
+
+	bool FramePublisher::pop(ControlCommand& command) {
+		FrameSegment::CommandSlot& slot = m_segment->commands[m_head % CommandSlots];
+		if (slot.sequence.load(std::memory_order_acquire) != m_head + 1) return false;
+
+		command.type = (ControlCommand::Type)slot.type;
+		command.body = slot.body;
+		slot.sequence.store(m_head + CommandSlots, std::memory_order_release);
+		m_head++;
+		return true;
+	}
+
+	uint64_t FramePublisher::published() const {
+		return m_segment != NULL ? m_segment->published.load(std::memory_order_relaxed) : 0;
+	}
+
+	FrameSubscriber::FrameSubscriber() : m_segment(NULL), m_handle(NULL), m_instance(0), m_seen(0), m_received(0), m_skipped(0) {}
+
+	FrameSubscriber::~FrameSubscriber() {
+		detach();
+	}
+
+	bool FrameSubscriber::attach(const std::string& sensor, int jointCount) {
+		detach();
+
+		bool existed;
+		m_segment = mapSegment(shareName(sensor), false, m_handle, existed);
+		if (m_segment == NULL) return false;
+
+		const FrameSegment& segment = *m_segment;
+		m_instance = segment.instance.load(std::memory_order_acquire);
+		if (m_instance == 0 || memcmp(segment.magic, Magic, sizeof(Magic)) != 0 || segment.version != Version ||
+			segment.frameBytes != sizeof(SharedFrame) || segment.jointCount != jointCount) {
+			detach();
+			return false;
+		}
+
+		// Only frames from here on, the newest one already there could be from before the sensor went away
+		m_seen = segment.published.load(std::memory_order_acquire);
+		m_received = 0;
+		m_skipped = 0;
+		return true;
+	}
+
+	void FrameSubscriber::detach() {
+		if (m_segment == NULL) return;
+
+		unmapSegment(m_segment, m_handle);
+		m_segment = NULL;
+		m_handle = NULL;
+	}
+
+	bool FrameSubscriber::isAttached() const {
+		return m_segment != NULL;
+	}
+
+	bool FrameSubscriber::alive(int64_t timeoutMicroseconds) const {
+		return m_segment != NULL &&
+			m_segment->instance.load(std::memory_order_acquire) == m_instance &&
+			steadyMicroseconds() - m_segment->heartbeat.load(std::memory_order_acquire) < timeoutMicroseconds;
+	}
+
+	int FrameSubscriber::sensorState() const {
+		return (int)m_segment->state.load(std::memory_order_acquire);
+	}
+
+	unsigned FrameSubscriber::sensorGeneration() const {
+		return m_segment->generation.load(std::memory_order_acquire);
+	}
+
+	bool FrameSubscriber::next(SharedFrame& frame) {
+		if (m_segment->instance.load(std::memory_order_acquire) != m_instance) return false;
+
+		// Only retries if the daemon got round the whole ring while the frame was being copied
+		for (int attempt = 0; attempt < 4; attempt++) {
+			uint64_t latest = m_segment->published.load(std::memory_order_acquire);
+			if (latest <= m_seen) return false;
+
+			uint64_t n = latest - 1;
+			const FrameSegment::FrameSlot& slot = m_segment->frames[n % FrameSlots];
+			uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+			if (sequence != 2 * n + 2) continue;
+
+			memcpy(&frame, &slot.frame, sizeof(SharedFrame));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) != sequence) continue;
+
+			m_skipped += n - m_seen;
+			m_received++;
+			m_seen = latest;
+			return true;
+		}
+		return false;
+	}
+
+	bool FrameSubscriber::send(const ControlCommand& command) {
+		std::atomic<uint64_t>& tail = m_segment->commandTail;
+		uint64_t position = tail.load(std::memory_order_relaxed);
+		for (;;) {
+			FrameSegment::CommandSlot& slot = m_segment->commands[position % CommandSlots];
+			uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+			int64_t lap = (int64_t)(sequence - position);
+
+			if (lap == 0) {
+				if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					slot.type = (int32_t)command.type;
+					slot.body = command.body;
+					slot.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (lap < 0) {
+				return false;
+			}
+			else {
+				position = tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void FrameSubscriber::bodyStates(BodyIdentifier::BodyTrackingState* states) const {
+		for (int i = 0; i < MaxBodies; i++) {
+			states[i] = (BodyIdentifier::BodyTrackingState)m_segment->bodyStates[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	uint64_t FrameSubscriber::received() const {
+		return m_received;
+	}
+
+	uint64_t FrameSubscriber::skipped() const {
+		return m_skipped;
+	}
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "BodyIdentifier.h"
+#include "ControlQueue.h"
+#include "Skeleton.h"
+
+#include <stdint.h>
+
+#include <string>
+
+namespace KinectOsvr {
+	// One processed sensor frame as the daemon hands it over
+	struct SharedFrame {
+		// Timestamps already in server time, in microseconds
+		SkeletonFrame frame;
+		// Body slot the daemon's identifier picked, -1 for none
+		int32_t trackedBody;
+		int32_t hasFloor;
+		float floor[4];
+		// Steady clock microseconds when it was published, for measuring the hand-off
+		int64_t publishedAt;
+	};
+
+	// Laid out the same for 32 and 64 bit builds, so a 32 bit server can attach to a 64 bit daemon
+	struct FrameSegment;
+
+	// Microseconds on a clock that every process on the machine agrees on
+	int64_t steadyMicroseconds();
+
+	// Daemon side of a named shared memory segment per sensor: a ring of the latest frames, each slot guarded by a
+	// sequence number the reader checks before and after copying, the sensor's state and body states, a heartbeat,
+	// and a command ring back from the plugin. Nothing on either side ever waits for the other.
+	class FramePublisher {
+	public:
+		FramePublisher();
+		~FramePublisher();
+
+		// False if the segment can't be created, or another daemon is still publishing to it
+		bool create(const std::string& sensor, int jointCount);
+		void close();
+		bool isOpen() const;
+
+		void publish(const SkeletonFrame& frame, int trackedBody, const float* floor);
+		void setBodyStates(const BodyIdentifier::BodyTrackingState* states);
+		// SensorLifecycle::State and generation, so plugins can tell a sensor that's still coming up from a dead daemon
+		void setSensor(int state, unsigned generation);
+		// Called at least every few hundred milliseconds, or plugins take the daemon for dead
+		void heartbeat();
+
+		// Commands the plugins have sent, in order
+		bool pop(ControlCommand& command);
+
+		uint64_t published() const;
+
+	private:
+		FrameSegment* m_segment;
+		void* m_handle;
+		std::string m_name;
+		uint64_t m_head;
+	};
+
+	// Plugin side, attaches to a running daemon's segment and reads the newest frame whenever it's asked
+	class FrameSubscriber {
+	public:
+		FrameSubscriber();
+		~FrameSubscriber();
+
+		// False if there's no daemon for the sensor, or it was built for a different frame layout or joint set
+		bool attach(const std::string& sensor, int jointCount);
+		void detach();
+		bool isAttached() const;
+
+		// Whether the daemon's heartbeat is recent and it's still the daemon attached to
+		bool alive(int64_t timeoutMicroseconds = 1000000) const;
+		// SensorLifecycle::State of the daemon's sensor
+		int sensorState() const;
+		unsigned sensorGeneration() const;
+
+		// The newest frame not yet read, if any; frames that came and went in between are counted as skipped
+		bool next(SharedFrame& frame);
+		// False, dropping the command, when the daemon hasn't kept up with earlier ones
+		bool send(const ControlCommand& command);
+		void bodyStates(BodyIdentifier::BodyTrackingState* states) const;
+
+		uint64_t received() const;
+		uint64_t skipped() const;
+
+	private:
+		FrameSegment* m_segment;
+		void* m_handle;
+		uint64_t m_instance;
+		uint64_t m_seen;
+		uint64_t m_received, m_skipped;
+	};
+}
@@ -0,0 +1,388 @@
+#include "GestureRecognizer.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace KinectOsvr {
+
+	namespace {
+		const float Unreachable = std::numeric_limits<float>::infinity();
+		const char Header[] = "# Kinect gesture library";
+
+		// Every template is advanced on every frame, so a bigger library than that is cut down: each gesture keeps
+		// an even share, spread from its quickest performance to its slowest
+		std::vector<size_t> spreadTemplates(const std::vector<GestureTemplate>& templates, int maxTemplates) {
+			std::vector<std::vector<size_t> > gestures;
+			for (size_t t = 0; t < templates.size(); t++) {
+				size_t g = 0;
+				while (g < gestures.size() && templates[gestures[g][0]].name != templates[t].name) g++;
+				if (g == gestures.size()) gestures.push_back(std::vector<size_t>());
+				gestures[g].push_back(t);
+			}
+
+			std::vector<int> shares(gestures.size(), 0);
+			for (int left = maxTemplates, given = 1; left > 0 && given > 0;) {
+				given = 0;
+				for (size_t g = 0; g < gestures.size() && left > 0; g++) {
+					if (shares[g] < (int)gestures[g].size()) {
+						shares[g]++;
+						left--;
+						given++;
+					}
+				}
+			}
+
+			std::vector<size_t> kept;
+			for (size_t g = 0; g < gestures.size(); g++) {
+				std::vector<size_t>& performances = gestures[g];
+				std::stable_sort(performances.begin(), performances.end(), [&templates](size_t a, size_t b) {
+					return templates[a].frames() < templates[b].frames();
+				});
+				int n = (int)performances.size();
+				for (int k = 0; k < shares[g]; k++) {
+					int pick = shares[g] == 1 ? n / 2 : (int)((double)k * (n - 1) / (shares[g] - 1) + 0.5);
+					kept.push_back(performances[pick]);
+				}
+			}
+			std::sort(kept.begin(), kept.end());
+			return kept;
+		}
+	}
+
+	GestureTemplate::GestureTemplate() : button(0), threshold(0.5f) {}
+
+	int GestureTemplate::frames() const {
+		return (int)(features.size() / GestureRecognizer::FeatureCount);
+	}
+
+	// Text, so libraries can be read, tweaked and shared:
+	//   gesture <name> <button> <threshold> <frames>
+	// then a line of FeatureCount values per frame
+	bool loadGestures(const std::string& path, std::vector<GestureTemplate>& templates) {
+		std::ifstream in(path.c_str());
+		if (!in) return false;
+
+		std::string line;
+		while (std::getline(in, line)) {
+			if (line.empty() || line[0] == '#') continue;
+
+			std::istringstream fields(line);
+			std::string keyword;
+			GestureTemplate gesture;
+			int frames = 0;
+			if (!(fields >> keyword >> gesture.name >> gesture.button >> gesture.threshold >> frames) ||
+				keyword != "gesture" || frames <= 0) {
+				return false;
+			}
+
+			gesture.features.resize(frames * GestureRecognizer::FeatureCount);
+			for (size_t i = 0; i < gesture.features.size(); i++) {
+				if (!(in >> gesture.features[i])) return false;
+			}
+			templates.push_back(gesture);
+		}
+		return true;
+	}
+
+	bool saveGestures(const std::string& path, const std::vector<GestureTemplate>& templates) {
+		std::ofstream out(path.c_str());
+		if (!out) return false;
+
+		out << Header << "\n";
+		for (size_t t = 0; t < templates.size(); t++) {
+			const GestureTemplate& gesture = templates[t];
+			out << "gesture " << gesture.name << " " << gesture.button << " " << gesture.threshold << " " << gesture.frames() << "\n";
+			for (int f = 0; f < gesture.frames(); f++) {
+				for (int i = 0; i < GestureRecognizer::FeatureCount; i++) {
+					out << (i ? " " : "") << gesture.features[f * GestureRecognizer::FeatureCount + i];
+				}
+				out << "\n";
+			}
+		}
+		return (bool)out;
+	}
+
+	GestureRecognizer::GestureRecognizer(int jointCount, float band, int confirmFrames, int maxTemplates)
+		: m_band(band), m_confirmFrames(confirmFrames), m_maxTemplates(maxTemplates), m_frame(0) {
+
+		if (jointCount == V1Joint::Count) {
+			m_root = V1Joint::HipCenter;
+			m_chest = V1Joint::ShoulderCenter;
+			m_shoulderLeft = V1Joint::ShoulderLeft;
+			m_shoulderRight = V1Joint::ShoulderRight;
+			int joints[] = { V1Joint::Head, V1Joint::ElbowLeft, V1Joint::HandLeft, V1Joint::ElbowRight, V1Joint::HandRight };
+			memcpy(m_joints, joints, sizeof(m_joints));
+		}
+		else {
+			m_root = V2Joint::SpineBase;
+			m_chest = V2Joint::SpineShoulder;
+			m_shoulderLeft = V2Joint::ShoulderLeft;
+			m_shoulderRight = V2Joint::ShoulderRight;
+			int joints[] = { V2Joint::Head, V2Joint::ElbowLeft, V2Joint::HandLeft, V2Joint::ElbowRight, V2Joint::HandRight };
+			memcpy(m_joints, joints, sizeof(m_joints));
+		}
+	}
+
+	void GestureRecognizer::setTemplates(const std::vector<GestureTemplate>& templates) {
+		m_templates.clear();
+		for (size_t t = 0; t < templates.size(); t++) {
+			if (templates[t].frames() >= 2) m_templates.push_back(templates[t]);
+		}
+
+		// Weighed from every performance, even those that don't make the cut
+		const int Joints = FeatureCount / 3;
+		std::vector<std::array<float, Joints> > weights(m_templates.size());
+		for (size_t t = 0; t < m_templates.size(); t++) {
+			gestureWeights(m_templates[t].name, weights[t].data());
+		}
+		if (m_maxTemplates > 0 && (int)m_templates.size() > m_maxTemplates) {
+			std::vector<size_t> kept = spreadTemplates(m_templates, m_maxTemplates);
+			std::vector<GestureTemplate> templatesKept;
+			std::vector<std::array<float, Joints> > weightsKept;
+			for (size_t k = 0; k < kept.size(); k++) {
+				templatesKept.push_back(m_templates[kept[k]]);
+				weightsKept.push_back(weights[kept[k]]);
+			}
+			m_templates.swap(templatesKept);
+			weights.swap(weightsKept);
+		}
+
+		int columns = 0;
+		m_offsets.resize(m_templates.size());
+		m_minDuration.resize(m_templates.size());
+		m_maxDuration.resize(m_templates.size());
+		for (size_t t = 0; t < m_templates.size(); t++) {
+			int frames = m_templates[t].frames();
+			m_offsets[t] = columns;
+			m_minDuration[t] = (int)(frames / (1.0f + m_band));
+			m_maxDuration[t] = (int)ceil(frames * (1.0f + m_band));
+			columns += frames;
+		}
+
+		m_frames.setZero(FeatureSize, columns);
+		m_weights.setZero(FeatureSize, columns);
+		for (size_t t = 0; t < m_templates.size(); t++) {
+			int frames = m_templates[t].frames();
+			for (int f = 0; f < frames; f++) {
+				for (int i = 0; i < FeatureCount; i++) {
+					m_frames(i, m_offsets[t] + f) = m_templates[t].features[f * FeatureCount + i];
+				}
+			}
+			for (int j = 0; j < Joints; j++) {
+				m_weights.block(j * 3, m_offsets[t], 3, frames).setConstant(weights[t][j]);
+			}
+		}
+		m_distances.resize(1, columns);
+		m_cost.resize(columns);
+		m_previousCost.resize(columns);
+		m_start.resize(columns);
+		m_previousStart.resize(columns);
+		m_matches.resize(m_templates.size());
+		reset();
+	}
+
+	// With several performances of a gesture, only what they have in common counts. Each is stretched to the
+	// same length and averaged, so an arm swinging along in a different phase each time averages out, and a
+	// joint held somewhere different each time is hardly counted at all.
+	void GestureRecognizer::gestureWeights(const std::string& name, float* weights) const {
+		const int Joints = FeatureCount / 3;
+		const int Samples = 32;
+		// Squared spread in torso lengths at which a joint counts half
+		const float Spread = 0.01f;
+
+		Eigen::Matrix<float, FeatureCount, Samples> mean = Eigen::Matrix<float, FeatureCount, Samples>::Zero();
+		Eigen::Matrix<float, FeatureCount, 1> heldSum = Eigen::Matrix<float, FeatureCount, 1>::Zero();
+		Eigen::Matrix<float, FeatureCount, 1> heldSquares = Eigen::Matrix<float, FeatureCount, 1>::Zero();
+		int performances = 0;
+		for (size_t t = 0; t < m_templates.size(); t++) {
+			const GestureTemplate& gesture = m_templates[t];
+			if (gesture.name != name) continue;
+			int frames = gesture.frames();
+			Eigen::Matrix<float, FeatureCount, Samples> stretched;
+			for (int s = 0; s < Samples; s++) {
+				float at = (float)s * (frames - 1) / (Samples - 1);
+				int f = std::min((int)at, frames - 2);
+				float blend = at - f;
+				for (int i = 0; i < FeatureCount; i++) {
+					stretched(i, s) = gesture.features[f * FeatureCount + i] * (1 - blend) + gesture.features[(f + 1) * FeatureCount + i] * blend;
+				}
+			}
+			Eigen::Matrix<float, FeatureCount, 1> held = stretched.rowwise().mean();
+			mean += stretched;
+			heldSum += held;
+			heldSquares += held.cwiseProduct(held);
+			performances++;
+		}
+		mean /= (float)performances;
+		heldSum /= (float)performances;
+		Eigen::Matrix<float, FeatureCount, 1> heldSpread = heldSquares / (float)performances - heldSum.cwiseProduct(heldSum);
+
+		float movement[Joints];
+		float total = 0;
+		for (int j = 0; j < Joints; j++) {
+			Eigen::Matrix<float, 3, Samples> joint = mean.block<3, Samples>(j * 3, 0);
+			movement[j] = (joint.colwise() - joint.rowwise().mean()).squaredNorm() / Samples;
+			total += movement[j];
+		}
+
+		// Joints count by how much they move in the gesture, so a raised hand isn't drowned out by what
+		// the rest of the body happens to be doing. Still joints keep a little weight so that, say,
+		// raising both hands doesn't match raising one. Weights add up to the same whatever the gesture, so
+		// thresholds mean the same.
+		float sum = 0;
+		for (int j = 0; j < Joints; j++) {
+			float weight = total > 0 ? 0.9f * movement[j] / total + 0.1f / Joints : 1.0f;
+			weights[j] = weight * Spread / (Spread + std::max(0.0f, heldSpread.segment<3>(j * 3).sum()));
+			sum += weights[j];
+		}
+		for (int j = 0; j < Joints; j++) weights[j] *= Joints / sum;
+	}
+
+	const std::vector<GestureTemplate>& GestureRecognizer::templates() const {
+		return m_templates;
+	}
+
+	bool GestureRecognizer::empty() const {
+		return m_templates.empty();
+	}
+
+	void GestureRecognizer::reset() {
+		std::fill(m_cost.begin(), m_cost.end(), Unreachable);
+		for (size_t t = 0; t < m_matches.size(); t++) {
+			m_matches[t].score = Unreachable;
+		}
+	}
+
+	bool GestureRecognizer::extract(const Skeleton& skeleton, float* features) const {
+		const int reference[] = { m_root, m_chest, m_shoulderLeft, m_shoulderRight };
+		for (int i = 0; i < 4; i++) {
+			if (skeleton.jointTracking[reference[i]] == JointNotTracked) return false;
+		}
+		for (int i = 0; i < FeatureCount / 3; i++) {
+			if (skeleton.jointTracking[m_joints[i]] == JointNotTracked) return false;
+		}
+
+		float rootX = skeleton.x[m_root], rootY = skeleton.y[m_root], rootZ = skeleton.z[m_root];
+		float tx = skeleton.x[m_chest] - rootX, ty = skeleton.y[m_chest] - rootY, tz = skeleton.z[m_chest] - rootZ;
+		float torso = sqrtf(tx * tx + ty * ty + tz * tz);
+		if (torso < 0.05f) return false;
+		float scale = 1.0f / torso;
+
+		// Turn the body to face the sensor, by its shoulders
+		float sx = skeleton.x[m_shoulderRight] - skeleton.x[m_shoulderLeft];
+		float sz = skeleton.z[m_shoulderRight] - skeleton.z[m_shoulderLeft];
+		float yaw = atan2f(-sz, sx);
+		float c = cosf(yaw), s = sinf(yaw);
+
+		for (int i = 0; i < FeatureCount / 3; i++) {
+			int j = m_joints[i];
+			float x = skeleton.x[j] - rootX, y = skeleton.y[j] - rootY, z = skeleton.z[j] - rootZ;
+			features[i * 3] = (x * c - z * s) * scale;
+			features[i * 3 + 1] = y * scale;
+			features[i * 3 + 2] = (x * s + z * c) * scale;
+		}
+		return true;
+	}
+
+	int GestureRecognizer::update(const Skeleton& skeleton) {
+		if (m_templates.empty()) return -1;
+
+		// Frames without the joints needed are skipped, they neither help nor break a match
+		Eigen::Matrix<float, FeatureSize, 1> feature = Eigen::Matrix<float, FeatureSize, 1>::Zero();
+		if (!extract(skeleton, feature.data())) return -1;
+		int64_t frame = ++m_frame;
+
+		// Distance from this frame to every frame of every template in one pass
+		m_distances.noalias() = ((m_frames.colwise() - feature).array().square() * m_weights.array()).matrix().colwise().sum();
+
+		m_cost.swap(m_previousCost);
+		m_start.swap(m_previousStart);
+
+		for (size_t t = 0; t < m_templates.size(); t++) {
+			int offset = m_offsets[t];
+			int frames = m_templates[t].frames();
+			const float* distance = m_distances.data() + offset;
+			const float* previous = &m_previousCost[offset];
+			const int64_t* previousStart = &m_previousStart[offset];
+			float* cost = &m_cost[offset];
+			int64_t* start = &m_start[offset];
+
+			// A match can start on any frame
+			cost[0] = distance[0];
+			start[0] = frame;
+
+			for (int i = 1; i < frames; i++) {
+				float best = cost[i - 1];
+				int64_t from = start[i - 1];
+				if (previous[i] < best) {
+					best = previous[i];
+					from = previousStart[i];
+				}
+				if (previous[i - 1] < best) {
+					best = previous[i - 1];
+					from = previousStart[i - 1];
+				}
+				// Band: paths taking much longer than the template are dropped
+				if (frame - from >= m_maxDuration[t]) best = Unreachable;
+				cost[i] = distance[i] + best;
+				start[i] = from;
+			}
+
+			float score = cost[frames - 1] / frames / m_templates[t].threshold;
+			Match& match = m_matches[t];
+			if (score < 1.0f && frame - start[frames - 1] + 1 >= m_minDuration[t] && score < match.score) {
+				match.score = score;
+				match.start = start[frames - 1];
+				match.end = frame;
+			}
+
+			// Costs only grow along a path, so one that overlaps the match and is still cheaper may yet end
+			// better: the gesture's still being performed
+			match.pending = false;
+			if (match.score < 1.0f) {
+				float limit = match.score * frames * m_templates[t].threshold;
+				for (int i = 0; i < frames - 1 && !match.pending; i++) {
+					match.pending = cost[i] < limit && start[i] <= match.end;
+				}
+			}
+		}
+
+		// Report a match once it's stayed the best for a few frames with nothing pending, and no overlapping match of another
+		// gesture is better
+		int recognized = -1;
+		for (size_t t = 0; t < m_matches.size(); t++) {
+			const Match& match = m_matches[t];
+			if (match.score >= 1.0f || match.pending || frame - match.end < m_confirmFrames) continue;
+
+			bool beaten = false;
+			for (size_t o = 0; o < m_matches.size() && !beaten; o++) {
+				const Match& other = m_matches[o];
+				beaten = o != t && other.score < match.score && other.start <= match.end && other.end >= match.start;
+			}
+			if (!beaten && (recognized < 0 || match.score < m_matches[recognized].score)) {
+				recognized = (int)t;
+			}
+		}
+
+		if (recognized >= 0) {
+			consume(m_matches[recognized].end);
+		}
+		return recognized;
+	}
+
+	// The movement up to the end of a recognized gesture can't be part of another one
+	void GestureRecognizer::consume(int64_t end) {
+		for (size_t i = 0; i < m_cost.size(); i++) {
+			if (m_start[i] <= end) m_cost[i] = Unreachable;
+		}
+		for (size_t t = 0; t < m_matches.size(); t++) {
+			if (m_matches[t].start <= end) m_matches[t].score = Unreachable;
+		}
+	}
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Skeleton.h"
+
+#include <Eigen/Core>
+
+#include <string>
+#include <vector>
+
+namespace KinectOsvr {
+	// One recorded performance of a gesture, as a feature vector per frame
+	struct GestureTemplate {
+		GestureTemplate();
+
+		std::string name;
+		// Which of the device's gesture buttons it presses
+		int button;
+		// Highest mean squared feature distance per template frame that still counts as a match
+		float threshold;
+		// GestureRecognizer::FeatureCount values per frame
+		std::vector<float> features;
+
+		int frames() const;
+	};
+
+	// Reads a library written by saveGestures, appending its templates. False if it's missing or malformed.
+	bool loadGestures(const std::string& path, std::vector<GestureTemplate>& templates);
+	bool saveGestures(const std::string& path, const std::vector<GestureTemplate>& templates);
+
+	// Spots gestures in the tracked body's movement as it happens, with subsequence dynamic time warping:
+	// every template is matched against every possible start in one incremental pass per frame, so there's
+	// no window to slide and rescan.
+	class GestureRecognizer {
+	public:
+		// Head, elbows and hands relative to the hips, turned to face forward and scaled by torso length
+		static const int FeatureCount = 15;
+		// Padded so distances vectorize
+		static const int FeatureSize = 16;
+
+		// band: how far a match's duration may stray from its template's, as a fraction of the template's.
+		// confirmFrames: frames a match has to stay the best before it's reported, the recognition latency.
+		// maxTemplates: most templates kept, which bounds the work per frame; 0 keeps them all.
+		explicit GestureRecognizer(int jointCount, float band = 0.5f, int confirmFrames = 3, int maxTemplates = 64);
+
+		void setTemplates(const std::vector<GestureTemplate>& templates);
+		const std::vector<GestureTemplate>& templates() const;
+		bool empty() const;
+
+		// False if a joint it needs isn't tracked
+		bool extract(const Skeleton& skeleton, float* features) const;
+
+		// Feeds the next frame of the tracked body, returns the template recognized or -1
+		int update(const Skeleton& skeleton);
+
+		// Forgets partial matches, for when the tracked body changes
+		void reset();
+
+	private:
+		struct Match {
+			// Cost over the template's threshold, below 1 for a match
+			float score;
+			int64_t start, end;
+			// A partial match overlapping it could still end better
+			bool pending;
+		};
+
+		void consume(int64_t end);
+		// How much each feature joint counts, from every performance of a gesture
+		void gestureWeights(const std::string& name, float* weights) const;
+
+		int m_root, m_chest, m_shoulderLeft, m_shoulderRight;
+		int m_joints[FeatureCount / 3];
+		float m_band;
+		int m_confirmFrames;
+		int m_maxTemplates;
+
+		std::vector<GestureTemplate> m_templates;
+		// Every template's frames side by side, one column per frame, and how much each feature counts
+		Eigen::Matrix<float, FeatureSize, Eigen::Dynamic> m_frames;
+		Eigen::Matrix<float, FeatureSize, Eigen::Dynamic> m_weights;
+		Eigen::Matrix<float, 1, Eigen::Dynamic> m_distances;
+		std::vector<int> m_offsets;
+		std::vector<int> m_minDuration, m_maxDuration;
+
+		// Cheapest warping path ending at each template frame, and the frame it started on, for this frame and the last
+		std::vector<float> m_cost, m_previousCost;
+		std::vector<int64_t> m_start, m_previousStart;
+		std::vector<Match> m_matches;
+		int64_t m_frame;
+	};
+}
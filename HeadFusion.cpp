@@ -0,0 +1,187 @@
+#include "HeadFusion.h"
+
+#include <math.h>
+
+namespace KinectOsvr {
+
+	namespace {
+		// Over a second of a fast tracker, well past any skeleton latency
+		const size_t HistorySize = 1024;
+
+		// How far each skeleton frame moves the neck and its velocity towards what it shows
+		const double PivotGain = 0.5;
+		const double VelocityGain = 0.1;
+		// Gaps longer than this between skeleton frames, in seconds, restart the velocity
+		const double MaxVelocityGap = 0.2;
+
+		const double DefaultNeckLength = 0.1;
+		const int NeckFrames = 300;
+		// Weight of a length learned before, in frames
+		const int RestoredNeckFrames = 30;
+		// Looking nearly straight up or down leaves too little of the forward direction to tell a heading from
+		const double MinHeadingLength = 0.5;
+
+		// Turn about +Y from -Z, the way a head faces with no rotation
+		double heading(const Eigen::Vector3d& forward) {
+			return atan2(-forward.x(), -forward.z());
+		}
+
+		double wrap(double angle) {
+			return atan2(sin(angle), cos(angle));
+		}
+	}
+
+	FusionParams::FusionParams() : kinectLatency(0.0), yawTime(30.0), maxPrediction(150.0) {}
+
+	HeadFusion::HeadFusion(const FusionParams& params) : m_params(params), m_history(HistorySize) {
+		reset();
+	}
+
+	void HeadFusion::reset() {
+		m_next = 0;
+		m_count = 0;
+		m_aligned = false;
+		m_yaw = 0;
+		m_yawTime = 0;
+		m_neckLength = DefaultNeckLength;
+		m_neckSamples = 0;
+		resetPosition();
+	}
+
+	void HeadFusion::resetPosition() {
+		m_hasPivot = false;
+		m_pivot.setZero();
+		m_velocity.setZero();
+		m_pivotTime = 0;
+	}
+
+	void HeadFusion::setLatency(double milliseconds) {
+		m_params.kinectLatency = milliseconds;
+	}
+
+	double HeadFusion::neckLength() const {
+		return m_neckSamples > 0 ? m_neckLength : 0.0;
+	}
+
+	void HeadFusion::setNeckLength(double length) {
+		m_neckLength = length;
+		m_neckSamples = RestoredNeckFrames;
+	}
+
+	bool HeadFusion::aligned() const {
+		return m_aligned;
+	}
+
+	double HeadFusion::yaw() const {
+		return m_yaw;
+	}
+
+	Eigen::Quaterniond HeadFusion::toSkeleton(const Eigen::Quaterniond& orientation) const {
+		return Eigen::Quaterniond(Eigen::AngleAxisd(m_yaw, Eigen::Vector3d::UnitY())) * orientation;
+	}
+
+	// Interpolated between the samples either side, or the nearest end of the history
+	bool HeadFusion::orientationAt(int64_t timestamp, Eigen::Quaterniond& orientation) const {
+		if (m_count == 0) return false;
+
+		size_t oldest = (m_next + HistorySize - m_count) % HistorySize;
+		size_t low = 0, high = m_count;
+		while (low < high) {
+			size_t middle = (low + high) / 2;
+			if (m_history[(oldest + middle) % HistorySize].timestamp <= timestamp) low = middle + 1;
+			else high = middle;
+		}
+
+		if (low == 0) {
+			orientation = osvr::util::fromQuat(m_history[oldest].orientation);
+			return true;
+		}
+		const Sample& before = m_history[(oldest + low - 1) % HistorySize];
+		if (low == m_count) {
+			orientation = osvr::util::fromQuat(before.orientation);
+			return true;
+		}
+		const Sample& after = m_history[(oldest + low) % HistorySize];
+		double t = (double)(timestamp - before.timestamp) / (double)(after.timestamp - before.timestamp);
+		orientation = osvr::util::fromQuat(before.orientation).slerp(t, osvr::util::fromQuat(after.orientation));
+		return true;
+	}
+
+	void HeadFusion::observe(int64_t timestamp, const OSVR_Vec3& head, const OSVR_Vec3* neck, const OSVR_Vec3* shoulderLeft, const OSVR_Vec3* shoulderRight) {
+		int64_t shown = timestamp - (int64_t)(m_params.kinectLatency * 1000.0);
+		Eigen::Quaterniond orientation;
+		if (!orientationAt(shown, orientation)) return;
+
+		Eigen::Vector3d headPosition = osvr::util::vecMap(head);
+		if (neck != NULL) {
+			double length = (headPosition - osvr::util::vecMap(*neck)).norm();
+			int n = m_neckSamples < NeckFrames ? m_neckSamples : NeckFrames;
+			m_neckLength += (length - m_neckLength) / (n + 1);
+			m_neckSamples++;
+		}
+
+		// The head is taken to face the same way as the shoulders on average
+		if (shoulderLeft != NULL && shoulderRight != NULL) {
+			Eigen::Vector3d across = osvr::util::vecMap(*shoulderRight) - osvr::util::vecMap(*shoulderLeft);
+			Eigen::Vector3d facing(across.z(), 0, -across.x());
+			Eigen::Vector3d forward = orientation * -Eigen::Vector3d::UnitZ();
+			forward.y() = 0;
+
+			if (facing.norm() > 0 && forward.norm() > MinHeadingLength) {
+				double target = wrap(heading(facing) - heading(forward));
+				if (!m_aligned) {
+					m_yaw = target;
+					m_aligned = true;
+				}
+				else if (shown > m_yawTime) {
+					double dt = (shown - m_yawTime) / 1e6;
+					if (dt > 1.0) dt = 1.0;
+					m_yaw = wrap(m_yaw + wrap(target - m_yaw) * dt / (m_params.yawTime + dt));
+				}
+				m_yawTime = shown;
+			}
+		}
+		if (!m_aligned) return;
+
+		// Where the neck must be for the head to be here, turned as the tracker says it was then
+		Eigen::Vector3d pivot = headPosition - toSkeleton(orientation) * Eigen::Vector3d(0, m_neckLength, 0);
+		if (!m_hasPivot) {
+			m_pivot = pivot;
+			m_velocity.setZero();
+			m_pivotTime = shown;
+			m_hasPivot = true;
+			return;
+		}
+		if (shown <= m_pivotTime) return;
+
+		double dt = (shown - m_pivotTime) / 1e6;
+		Eigen::Vector3d predicted = m_pivot + m_velocity * dt;
+		Eigen::Vector3d residual = pivot - predicted;
+		m_pivot = predicted + PivotGain * residual;
+		if (dt < MaxVelocityGap) m_velocity += VelocityGain * residual / dt;
+		else m_velocity.setZero();
+		m_pivotTime = shown;
+	}
+
+	bool HeadFusion::fuse(int64_t timestamp, const OSVR_Quaternion& orientation, OSVR_PoseState& pose) {
+		if (m_count > 0 && timestamp < m_history[(m_next + HistorySize - 1) % HistorySize].timestamp) return false;
+
+		Sample& sample = m_history[m_next];
+		sample.timestamp = timestamp;
+		sample.orientation = orientation;
+		m_next = (m_next + 1) % HistorySize;
+		if (m_count < HistorySize) m_count++;
+
+		if (!m_aligned || !m_hasPivot) return false;
+
+		double ahead = (timestamp - m_pivotTime) / 1e6;
+		double limit = m_params.maxPrediction / 1000.0;
+		ahead = ahead < 0 ? 0 : ahead > limit ? limit : ahead;
+
+		Eigen::Quaterniond rotation = toSkeleton(osvr::util::fromQuat(orientation));
+		Eigen::Vector3d position = m_pivot + m_velocity * ahead + rotation * Eigen::Vector3d(0, m_neckLength, 0);
+		osvr::util::vecMap(pose.translation) = position;
+		osvr::util::toQuat(rotation, pose.rotation);
+		return true;
+	}
+};
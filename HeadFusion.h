@@ -0,0 +1,83 @@
+#pragma once
+
+#include <osvr/Util/Pose3C.h>
+#include <osvr/Util/EigenInterop.h>
+
+#include <stdint.h>
+#include <vector>
+
+namespace KinectOsvr {
+	struct FusionParams {
+		FusionParams();
+
+		// How much later than the moment they show the skeleton's timestamps are, in milliseconds
+		double kinectLatency;
+		// Seconds over which the orientation tracker's heading is pulled onto the way the body faces. Longer
+		// trusts the tracker more while looking aside, shorter corrects its drift sooner.
+		double yawTime;
+		// Furthest past the last skeleton the head's movement is carried on, in milliseconds
+		double maxPrediction;
+	};
+
+	// Combines the skeleton's head position with an orientation tracker, such as a HMD's, into one head pose at
+	// the tracker's rate. The head is modelled as turning about the neck: the tracker moves it between skeleton
+	// frames and the skeleton corrects where the neck is. The tracker's heading is kept aligned with the way the
+	// shoulders face, so its yaw drift is corrected too. Timestamps are microseconds, as for SkeletonFrame.
+	class HeadFusion {
+	public:
+		explicit HeadFusion(const FusionParams& params = FusionParams());
+
+		void reset();
+		// Forgets where the head is but keeps the alignment, for when reported positions jump
+		void resetPosition();
+
+		// The tracked body's head, and its neck and shoulders when the skeleton has them (NULL otherwise),
+		// in the space joints are reported in
+		void observe(int64_t timestamp, const OSVR_Vec3& head, const OSVR_Vec3* neck, const OSVR_Vec3* shoulderLeft, const OSVR_Vec3* shoulderRight);
+
+		// Each orientation from the tracker as it arrives. False until the skeleton has given a position and
+		// the shoulders a heading.
+		bool fuse(int64_t timestamp, const OSVR_Quaternion& orientation, OSVR_PoseState& pose);
+
+		// Replaces FusionParams::kinectLatency, as when it's been measured
+		void setLatency(double milliseconds);
+
+		// Neck to head in metres, 0 until the skeleton has shown it
+		double neckLength() const;
+		// Starts from a length learned before, as good as a second of frames
+		void setNeckLength(double length);
+
+		bool aligned() const;
+		// Turn about the vertical from the tracker's frame to the skeleton's, in radians
+		double yaw() const;
+
+	private:
+		struct Sample {
+			int64_t timestamp;
+			OSVR_Quaternion orientation;
+		};
+
+		bool orientationAt(int64_t timestamp, Eigen::Quaterniond& orientation) const;
+		Eigen::Quaterniond toSkeleton(const Eigen::Quaterniond& orientation) const;
+
+		FusionParams m_params;
+
+		// Recent tracker orientations, to line up with skeleton frames that show the past
+		std::vector<Sample> m_history;
+		size_t m_next;
+		size_t m_count;
+
+		bool m_aligned;
+		double m_yaw;
+		int64_t m_yawTime;
+
+		// Neck to head, learned from the skeleton
+		double m_neckLength;
+		int m_neckSamples;
+
+		bool m_hasPivot;
+		Eigen::Vector3d m_pivot;
+		Eigen::Vector3d m_velocity;
+		int64_t m_pivotTime;
+	};
+}
@@ -0,0 +1,113 @@
+#include "JointFilter.h"
+
+#include <math.h>
+
+namespace KinectOsvr {
+
+	FilterParams::FilterParams() : smoothing(0.0f), correction(0.5f), prediction(0.5f), jitterRadius(0.05f), maxDeviationRadius(0.04f) {}
+
+	bool FilterParams::enabled() const {
+		return smoothing > 0.0f;
+	}
+
+	JointFilter::JointFilter() {
+		reset();
+	}
+
+	void JointFilter::reset() {
+		m_trackingId = 0;
+		for (int j = 0; j < MaxJoints; j++) {
+			m_frameCount[j] = 0;
+			m_trendX[j] = m_trendY[j] = m_trendZ[j] = 0;
+		}
+	}
+
+	void JointFilter::apply(Skeleton& skeleton, int jointCount, const FilterParams& params) {
+		if (skeleton.trackingId != m_trackingId) {
+			reset();
+			m_trackingId = skeleton.trackingId;
+		}
+
+		float jitterRadius = params.jitterRadius > 0 ? params.jitterRadius : 1e-6f;
+		float maxDeviation = params.maxDeviationRadius;
+
+		for (int j = 0; j < jointCount; j++) {
+			float rawX = skeleton.x[j], rawY = skeleton.y[j], rawZ = skeleton.z[j];
+
+			if (skeleton.jointTracking[j] == JointNotTracked) {
+				m_frameCount[j] = 0;
+				continue;
+			}
+
+			// Inferred joints are jumpier, so damp them harder
+			float jitter = skeleton.jointTracking[j] == JointInferred ? jitterRadius * 0.5f : jitterRadius;
+			float deviation = skeleton.jointTracking[j] == JointInferred ? maxDeviation * 0.5f : maxDeviation;
+
+			float filteredX, filteredY, filteredZ;
+			float trendX, trendY, trendZ;
+
+			if (m_frameCount[j] == 0) {
+				filteredX = rawX;
+				filteredY = rawY;
+				filteredZ = rawZ;
+				trendX = trendY = trendZ = 0;
+			}
+			else if (m_frameCount[j] == 1) {
+				filteredX = (rawX + m_rawX[j]) * 0.5f;
+				filteredY = (rawY + m_rawY[j]) * 0.5f;
+				filteredZ = (rawZ + m_rawZ[j]) * 0.5f;
+				trendX = (filteredX - m_filteredX[j]) * params.correction + m_trendX[j] * (1.0f - params.correction);
+				trendY = (filteredY - m_filteredY[j]) * params.correction + m_trendY[j] * (1.0f - params.correction);
+				trendZ = (filteredZ - m_filteredZ[j]) * params.correction + m_trendZ[j] * (1.0f - params.correction);
+			}
+			else {
+				// Pull small movements back towards the last filtered position
+				float dx = rawX - m_filteredX[j], dy = rawY - m_filteredY[j], dz = rawZ - m_filteredZ[j];
+				float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+				float inputX = rawX, inputY = rawY, inputZ = rawZ;
+				if (distance <= jitter) {
+					float blend = distance / jitter;
+					inputX = rawX * blend + m_filteredX[j] * (1.0f - blend);
+					inputY = rawY * blend + m_filteredY[j] * (1.0f - blend);
+					inputZ = rawZ * blend + m_filteredZ[j] * (1.0f - blend);
+				}
+
+				filteredX = inputX * (1.0f - params.smoothing) + (m_filteredX[j] + m_trendX[j]) * params.smoothing;
+				filteredY = inputY * (1.0f - params.smoothing) + (m_filteredY[j] + m_trendY[j]) * params.smoothing;
+				filteredZ = inputZ * (1.0f - params.smoothing) + (m_filteredZ[j] + m_trendZ[j]) * params.smoothing;
+				trendX = (filteredX - m_filteredX[j]) * params.correction + m_trendX[j] * (1.0f - params.correction);
+				trendY = (filteredY - m_filteredY[j]) * params.correction + m_trendY[j] * (1.0f - params.correction);
+				trendZ = (filteredZ - m_filteredZ[j]) * params.correction + m_trendZ[j] * (1.0f - params.correction);
+			}
+
+			m_rawX[j] = rawX;
+			m_rawY[j] = rawY;
+			m_rawZ[j] = rawZ;
+			m_filteredX[j] = filteredX;
+			m_filteredY[j] = filteredY;
+			m_filteredZ[j] = filteredZ;
+			m_trendX[j] = trendX;
+			m_trendY[j] = trendY;
+			m_trendZ[j] = trendZ;
+			m_frameCount[j]++;
+
+			// Predict ahead, but never too far from the raw position
+			float predictedX = filteredX + trendX * params.prediction;
+			float predictedY = filteredY + trendY * params.prediction;
+			float predictedZ = filteredZ + trendZ * params.prediction;
+
+			float ox = predictedX - rawX, oy = predictedY - rawY, oz = predictedZ - rawZ;
+			float offset = sqrtf(ox * ox + oy * oy + oz * oz);
+			if (offset > deviation && offset > 0) {
+				float scale = deviation / offset;
+				predictedX = rawX + ox * scale;
+				predictedY = rawY + oy * scale;
+				predictedZ = rawZ + oz * scale;
+			}
+
+			skeleton.x[j] = predictedX;
+			skeleton.y[j] = predictedY;
+			skeleton.z[j] = predictedZ;
+		}
+	}
+};
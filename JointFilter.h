@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Skeleton.h"
+
+namespace KinectOsvr {
+	// Holt double exponential smoothing, with the same parameters as NuiTransformSmooth
+	struct FilterParams {
+		FilterParams();
+
+		// 0 turns the filter off, towards 1 is smoother with more lag
+		float smoothing;
+		// How quickly the trend follows the raw data
+		float correction;
+		// Frames of trend to predict ahead
+		float prediction;
+		// Movements within this radius in metres are damped as jitter
+		float jitterRadius;
+		// Largest distance in metres a filtered joint may stray from the raw one
+		float maxDeviationRadius;
+
+		bool enabled() const;
+	};
+
+	// Filter state for one body slot, starts over when a different body moves into the slot
+	class JointFilter {
+	public:
+		JointFilter();
+
+		void reset();
+		void apply(Skeleton& skeleton, int jointCount, const FilterParams& params);
+
+	private:
+		uint64_t m_trackingId;
+		int m_frameCount[MaxJoints];
+
+		float m_rawX[MaxJoints], m_rawY[MaxJoints], m_rawZ[MaxJoints];
+		float m_filteredX[MaxJoints], m_filteredY[MaxJoints], m_filteredZ[MaxJoints];
+		float m_trendX[MaxJoints], m_trendY[MaxJoints], m_trendZ[MaxJoints];
+	};
+}
@@ -0,0 +1,55 @@
+#include "JointProjection.h"
+
+namespace KinectOsvr {
+
+	const PinholeIntrinsics KinectV2DepthCamera = {
+		365.5f, 365.5f,
+		257.0f, 210.0f,
+		0.0f, 0.0f, 0.0f,
+		512, 424
+	};
+
+	const PinholeIntrinsics KinectV2ColorCamera = {
+		1060.7f, 1060.7f,
+		960.0f, 540.0f,
+		-0.052f, 0.0f, 0.0f,
+		1920, 1080
+	};
+
+	PinholeProjector::PinholeProjector(const PinholeIntrinsics& depth, const PinholeIntrinsics& color)
+		: m_depth(depth), m_color(color) {}
+
+	void PinholeProjector::setDepthCamera(const PinholeIntrinsics& depth) {
+		m_depth = depth;
+	}
+
+	void PinholeProjector::setColorCamera(const PinholeIntrinsics& color) {
+		m_color = color;
+	}
+
+	void PinholeProjector::project(const PinholeIntrinsics& camera, const float* x, const float* y, const float* z, int count, float* u, float* v) {
+		for (int i = 0; i < count; i++) {
+			float depth = z[i] - camera.offsetZ;
+			float inverse = depth > 0.0f ? 1.0f / depth : 0.0f;
+			// The images are mirrored, so image X follows sensor X, but image Y runs down
+			float pu = camera.principalPointX + camera.focalLengthX * (x[i] - camera.offsetX) * inverse;
+			float pv = camera.principalPointY - camera.focalLengthY * (y[i] - camera.offsetY) * inverse;
+			u[i] = depth > 0.0f ? pu : UnmappedPixel;
+			v[i] = depth > 0.0f ? pv : UnmappedPixel;
+		}
+	}
+
+	void PinholeProjector::project(const SkeletonFrame& frame, const bool* bodies, FrameProjection& projection) const {
+		for (int b = 0; b < MaxBodies; b++) {
+			if (!bodies[b]) continue;
+
+			const Skeleton& skeleton = frame.bodies[b];
+			project(m_color, skeleton.x, skeleton.y, skeleton.z, frame.jointCount, projection.colorX[b], projection.colorY[b]);
+			project(m_depth, skeleton.x, skeleton.y, skeleton.z, frame.jointCount, projection.depthX[b], projection.depthY[b]);
+			for (int j = 0; j < frame.jointCount; j++) {
+				keepInImage(projection.colorX[b][j], projection.colorY[b][j], m_color.width, m_color.height);
+				keepInImage(projection.depthX[b][j], projection.depthY[b][j], m_depth.width, m_depth.height);
+			}
+		}
+	}
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Skeleton.h"
+
+namespace KinectOsvr {
+	// Pinhole camera in sensor space, X left, Y up, Z out from the sensor
+	struct PinholeIntrinsics {
+		float focalLengthX, focalLengthY;
+		float principalPointX, principalPointY;
+		// Where the camera sits relative to the sensor's origin, in metres
+		float offsetX, offsetY, offsetZ;
+		// Image size in pixels
+		int width, height;
+	};
+
+	// Sent for both of a joint's coordinates when it doesn't land in the image, behind the camera or past an edge
+	const float UnmappedPixel = -1.0f;
+
+	// Leaves a pixel inside the image as it is and sets one outside it, or not a number, to UnmappedPixel
+	inline void keepInImage(float& u, float& v, int width, int height) {
+		if (!(u >= 0.0f && u < width && v >= 0.0f && v < height)) {
+			u = v = UnmappedPixel;
+		}
+	}
+
+	// Typical factory calibration, each sensor differs by a few pixels
+	extern const PinholeIntrinsics KinectV2DepthCamera;
+	extern const PinholeIntrinsics KinectV2ColorCamera;
+
+	// Where each body's joints land in the color and depth images, in pixels, UnmappedPixel for joints that don't
+	struct FrameProjection {
+		float colorX[MaxBodies][MaxJoints], colorY[MaxBodies][MaxJoints];
+		float depthX[MaxBodies][MaxJoints], depthY[MaxBodies][MaxJoints];
+	};
+
+	// Projection without the sensor, for replays, other platforms, or when the mapper fails
+	class PinholeProjector {
+	public:
+		PinholeProjector(const PinholeIntrinsics& depth, const PinholeIntrinsics& color);
+
+		// Replaces the defaults with a sensor's own calibration
+		void setDepthCamera(const PinholeIntrinsics& depth);
+		void setColorCamera(const PinholeIntrinsics& color);
+
+		// Every joint of the flagged bodies
+		void project(const SkeletonFrame& frame, const bool* bodies, FrameProjection& projection) const;
+
+		// Points as they land on the image plane, even past its edges. Points behind the camera get UnmappedPixel.
+		static void project(const PinholeIntrinsics& camera, const float* x, const float* y, const float* z, int count, float* u, float* v);
+
+	private:
+		PinholeIntrinsics m_depth;
+		PinholeIntrinsics m_color;
+	};
+}
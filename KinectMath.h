@@ -1,5 +1,11 @@
-#include "stdafx.h"
+#pragma once
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include <osvr/Util/Pose3C.h>
+#include <osvr/Util/EigenInterop.h>
 
 void boneSpaceToWorldSpace(OSVR_Quaternion* q);
 void offsetTranslation(OSVR_Vec3* translation_offset, OSVR_Vec3* translation);
-void applyOffset(OSVR_PoseState* offset, OSVR_PoseState* poseState);
\ No newline at end of file
+void applyOffset(OSVR_PoseState* offset, OSVR_PoseState* poseState);
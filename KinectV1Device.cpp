@@ -1,35 +1,97 @@
 #include "KinectV1Device.h"
 #include "KinectMath.h"
+#include "Log.h"
+#include "Trace.h"
 
 // Generated JSON header file
 #include "je_nourish_kinectv1_json.h"
 
-#include <iostream>
+#include <ctime>
 
 namespace KinectOsvr {
 
 	std::map<HWND, KinectV1Device*> windowMap;
 
-	typedef HRESULT(_stdcall *NuiGetSensorCountType)(int*);
-	typedef HRESULT(_stdcall *NuiCreateSensorByIndexType)(int, INuiSensor**);
-	typedef HRESULT(_stdcall *NuiSkeletonCalculateBoneOrientationsType)(NUI_SKELETON_DATA*, NUI_SKELETON_BONE_ORIENTATION*);
+	KinectV1Device::KinectV1Device(OSVR_PluginRegContext ctx, WorkerPool& pool, const Config& config)
+		: m_device(ctx, "KinectV1", KinectV1Layout, je_nourish_kinectv1_json, pool), m_solver(KinectV1Hierarchy), m_identifier(config.tracking), m_pNuiSensor(NULL), m_hNextSkeletonEvent(NULL), m_lifecycle(*this) {
+		m_initializeOffset = 0;
+		m_sensorGeneration = 0;
+		m_seatedMode = false;
 
-	NuiGetSensorCountType NuiGetSensorCount;
-	NuiCreateSensorByIndexType NuiCreateSensorByIndex;
-	NuiSkeletonCalculateBoneOrientationsType NuiSkeletonCalculateBoneOrientations;
-
-	KinectV1Device::KinectV1Device(OSVR_PluginRegContext ctx, INuiSensor* pNuiSensor) : m_pNuiSensor(pNuiSensor) {
-		m_trackingId = m_trackedBody = -1;
-		m_lastTrackedPosition.x = m_lastTrackedPosition.y = m_lastTrackedPosition.z = 0;
-		m_lastTrackedTime = 0;
-		m_firstUpdate = true;
-		m_trackedBodyChanged = false;
+		m_device.setFilter(config.filter);
+		m_device.setFrameBudget(config.frameBudget);
+		if (!config.recordPath.empty()) {
+			m_device.record(config.recordPath + "-KinectV1.skr");
+		}
+		if (!config.archivePath.empty()) {
+			std::string path = archivePath(config.archivePath + "-KinectV1");
+			if (!m_device.archive(path)) KINECT_LOG(Warning, "Failed to open archive {}", path);
+		}
+		if (!config.gesturePath.empty() && !m_device.loadGestures(config.gesturePath)) {
+			KINECT_LOG(Warning, "Failed to load gestures from {}", config.gesturePath);
+		}
+		if (!config.fusionPath.empty()) {
+			m_device.setHeadFusion(config.fusion);
+			if (config.estimateLatency > 0) m_device.setLatencyEstimation(LatencyParams(), config.estimateLatency > 1);
+			m_orientation.reset(new OrientationClient(config.fusionPath));
+		}
+		if (config.attachDaemon) {
+			m_attached.reset(new AttachedSensor("KinectV1", KinectV1Layout.jointCount));
+			for (int i = 0; i < MaxBodies; i++) m_attachedStates[i] = BodyIdentifier::CannotBeTracked;
+		}
+		if (!config.snapshotPath.empty()) {
+			m_warmStart.open(config.snapshotPath + "-KinectV1.kws", KinectV1Layout.jointCount, config.snapshotMaxAge * 3600.0);
+			restoreSnapshot();
+		}
 
-		for (int i = 0; i < NUI_SKELETON_COUNT; i++) {
-			m_body_states[i] = CannotBeTracked;
+		// The V1 SDK only gives positions, orientations come from its own bone solver unless ours is asked for
+		if (config.solveV1Orientations) {
+			m_device.setOrientationStage([this](int body, Skeleton& skeleton) {
+				m_solver.solve(skeleton);
+				return true;
+			});
+		}
+		else {
+			m_device.setOrientationStage([](int body, Skeleton& skeleton) { return calculateKinectV1Orientations(skeleton); });
 		}
 
-		HRESULT hr;
+		mThreadData.kinect = this;
+		mThread = NULL;
+
+		/// Register update callback
+		m_device.registerUpdateCallback(this);
+
+		// Find and open the sensor in the background, the device reports nothing until it's ready
+		m_lifecycle.start();
+	};
+
+	bool KinectV1Device::load() {
+		return m_attached ? m_attached->load() : loadKinectV1Runtime();
+	}
+
+	bool KinectV1Device::open() {
+		if (m_attached) return m_attached->open();
+
+		int iSensorCount = 0;
+		HRESULT hr = NuiGetSensorCount(&iSensorCount);
+		if (FAILED(hr)) return false;
+
+		for (int i = 0; i < iSensorCount; i++) {
+			hr = NuiCreateSensorByIndex(i, &m_pNuiSensor);
+			if (FAILED(hr))
+			{
+				continue;
+			}
+
+			hr = m_pNuiSensor->NuiStatus();
+			if (S_OK == hr)
+			{
+				break;
+			}
+
+			SafeRelease(m_pNuiSensor);
+		}
+		if (m_pNuiSensor == NULL) return false;
 
 		// Initialize the Kinect and specify that we'll be using skeleton
 		hr = m_pNuiSensor->NuiInitialize(NUI_INITIALIZE_FLAG_USES_SKELETON);
@@ -37,40 +99,88 @@ namespace KinectOsvr {
 		if (SUCCEEDED(hr))
 		{
 			// Create an event that will be signaled when skeleton data is available
-			m_hNextSkeletonEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+			if (m_hNextSkeletonEvent == NULL) {
+				m_hNextSkeletonEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+			}
 
 			// Open a skeleton stream to receive skeleton data
-			hr = m_pNuiSensor->NuiSkeletonTrackingEnable(m_hNextSkeletonEvent, 0);
+			hr = m_pNuiSensor->NuiSkeletonTrackingEnable(m_hNextSkeletonEvent, m_seatedMode ? NUI_SKELETON_TRACKING_FLAG_ENABLE_SEATED_SUPPORT : 0);
+		}
 
-			m_pNuiSensor->NuiSkeletonTrackingEnable(m_hNextSkeletonEvent, 0);
+		if (FAILED(hr)) {
+			close();
+			return false;
 		}
+		return true;
+	}
 
-		mThreadData.kinect = this;
-		mThread = new std::thread(KinectV1Device::ui_thread, std::ref(mThreadData));
+	bool KinectV1Device::isConnected() {
+		if (m_attached) return m_attached->isConnected();
+		return m_pNuiSensor != NULL && m_pNuiSensor->NuiStatus() == S_OK;
+	}
+
+	void KinectV1Device::close() {
+		if (m_attached) m_attached->close();
+		if (m_pNuiSensor)
+		{
+			m_pNuiSensor->NuiShutdown();
+			SafeRelease(m_pNuiSensor);
+		}
+	}
 
-		/// Create the initialization options
-		OSVR_DeviceInitOptions opts = osvrDeviceCreateInitOptions(ctx);
+	OSVR_ReturnCode KinectV1Device::update() {
+		KINECT_TRACE("update");
 
-		osvrDeviceTrackerConfigure(opts, &m_tracker);
-		osvrDeviceAnalogConfigure(opts, &m_analog, 20);
+		// Clients can tell a sensor still being looked for from one with nobody in front of it
+		OSVR_TimeValue now;
+		osvrTimeValueGetNow(&now);
+		m_device.reportStatus(m_lifecycle.state(), now);
 
-		/// Create the device token with the options
-		m_dev.initAsync(ctx, "KinectV1", opts);
+		// Skip the frame rather than wait if the sensor is being opened or torn down
+		std::unique_lock<std::mutex> lock(m_lifecycle.sensorMutex(), std::try_to_lock);
+		if (!lock.owns_lock()) {
+			return OSVR_RETURN_SUCCESS;
+		}
 
-		/// Send JSON descriptor
-		m_dev.sendJsonDescriptor(je_nourish_kinectv1_json);
+		applyCommands();
+		if (m_lifecycle.state() != SensorLifecycle::Ready) {
+			return OSVR_RETURN_SUCCESS;
+		}
 
-		/// Register update callback
-		m_dev.registerUpdateCallback(this);
-	};
+		// The config window waits for a sensor, so a runtime installed without one doesn't open a window of its own
+		if (mThread == NULL) {
+			mThread = new std::thread(KinectV1Device::ui_thread, std::ref(mThreadData));
+		}
 
-	OSVR_ReturnCode KinectV1Device::update() {
+		// Orientations arrive many times a frame, each goes out fused as soon as it does
+		if (m_orientation) {
+			m_orientation->poll([this](const OSVR_Quaternion& orientation, const OSVR_TimeValue& timeValue) {
+				m_device.fuseOrientation(orientation, timeValue);
+			});
+		}
 
-		NUI_SKELETON_FRAME skeletonFrame = { 0 };
+		// The daemon has already read the skeletons and picked one out
+		if (m_attached) {
+			ProcessAttached();
+			return OSVR_RETURN_SUCCESS;
+		}
 
-		HRESULT hr = m_pNuiSensor->NuiSkeletonGetNextFrame(0, &skeletonFrame);
+		// Sensor timestamps restart after a reconnect
+		if (m_sensorGeneration != m_lifecycle.generation()) {
+			m_sensorGeneration = m_lifecycle.generation();
+			m_initializeOffset = 0;
+		}
+
+		NUI_SKELETON_FRAME skeletonFrame = { 0 };
+		HRESULT hr;
+		{
+			KINECT_TRACE("acquire frame");
+			hr = m_pNuiSensor->NuiSkeletonGetNextFrame(0, &skeletonFrame);
+		}
 		if (FAILED(hr))
 		{
+			// No data just means there's no new frame yet
+			if (hr != E_NUI_FRAME_NO_DATA) KINECT_LOG(Warning, "KinectV1: failed to get a skeleton frame (error {x})", (long)hr);
 			return OSVR_RETURN_SUCCESS;
 		}
 
@@ -83,23 +193,78 @@ namespace KinectOsvr {
 	};
 
 	void KinectV1Device::toggleSeatedMode() {
-		m_seatedMode = !m_seatedMode;
-		m_pNuiSensor->NuiSkeletonTrackingEnable(m_hNextSkeletonEvent, m_seatedMode ? NUI_SKELETON_TRACKING_FLAG_ENABLE_SEATED_SUPPORT : 0);
+		ControlCommand command = { ControlCommand::ToggleSeatedMode, 0 };
+		m_commands.push(command);
 	}
 
 	KinectV1Device::BodyTrackingState* KinectV1Device::getBodyStates() {
-		return m_body_states;
+		return m_attached ? m_attachedStates : m_identifier.getBodyStates();
 	}
 
 	void KinectV1Device::setTrackedBody(int i)
 	{
-		m_trackedBody = i;
-		m_trackedBodyChanged = true;
+		ControlCommand command = { ControlCommand::SetTrackedBody, i };
+		m_commands.push(command);
 	}
 
 	void KinectV1Device::recenter()
 	{
-		m_firstUpdate = true;
+		ControlCommand command = { ControlCommand::Recenter, 0 };
+		m_commands.push(command);
+	}
+
+	// Picks up where the last session left off, tracking is calibrated from the first frame
+	void KinectV1Device::restoreSnapshot() {
+		WarmStartState state;
+		WarmStart::LoadResult result = m_warmStart.load(state, (int64_t)time(NULL));
+		if (result == WarmStart::Loaded) {
+			m_device.restoreState(state);
+			if (state.hasPerson) m_identifier.resume(state.signature, state.lastPosition);
+			KINECT_LOG(Info, "KinectV1: resuming from {}", m_warmStart.path());
+		}
+		else if (result != WarmStart::Missing) {
+			KINECT_LOG(Info, "KinectV1: ignoring {} snapshot {}", WarmStart::describe(result), m_warmStart.path());
+		}
+	}
+
+	// After each frame, only written when something has changed
+	void KinectV1Device::saveSnapshot(bool now) {
+		if (!m_warmStart.isOpen()) return;
+
+		KINECT_TRACE("save snapshot");
+		WarmStartState state;
+		m_device.saveState(state);
+		state.hasPerson = m_identifier.lastTracked(state.signature, state.lastPosition);
+		if (now) m_warmStart.flush(state, (int64_t)time(NULL));
+		else m_warmStart.update(state, (int64_t)time(NULL));
+	}
+
+	// Called with the sensor mutex held, between frames
+	void KinectV1Device::applyCommands() {
+		ControlCommand command;
+		while (m_commands.pop(command)) {
+			switch (command.type) {
+			case ControlCommand::SetTrackedBody:
+				if (m_attached) m_attached->send(command);
+				else if (command.body >= 0 && command.body < MaxBodies) m_identifier.setTrackedBody(command.body);
+				break;
+			case ControlCommand::Recenter:
+				m_device.recenter();
+				break;
+			case ControlCommand::ToggleSeatedMode:
+				m_seatedMode = !m_seatedMode;
+				if (m_attached) m_attached->send(command);
+				else applySeatedMode();
+				break;
+			}
+		}
+	}
+
+	void KinectV1Device::applySeatedMode() {
+		// Otherwise applied when the sensor is next opened
+		if (m_lifecycle.state() == SensorLifecycle::Ready) {
+			m_pNuiSensor->NuiSkeletonTrackingEnable(m_hNextSkeletonEvent, m_seatedMode ? NUI_SKELETON_TRACKING_FLAG_ENABLE_SEATED_SUPPORT : 0);
+		}
 	}
 
 	void KinectV1Device::ui_thread(ui_thread_data& data)
@@ -109,9 +274,12 @@ namespace KinectOsvr {
 		HWND hDlg;
 		HINSTANCE hInst;
 
+		Trace::setThreadName("ui");
+
 		hInst = GetModuleHandle("je_nourish_kinect.dll");
 		hDlg = CreateDialogParam(hInst, MAKEINTRESOURCE(IDD_DIALOG1), 0, DialogProc, 0);
 		ShowWindow(hDlg, SW_RESTORE);
+		EnableWindow(GetDlgItem(hDlg, IDC_BUTTON2), Trace::enabled());
 		UpdateWindow(hDlg);
 
 		windowMap[hDlg] = data.kinect;
@@ -137,22 +305,23 @@ namespace KinectOsvr {
 			int bodies = 0;
 
 			for (int i = 0; i < NUI_SKELETON_COUNT; i++) {
-				if (bodyStates[i] == ShouldBeTracked) {
+				if (bodyStates[i] == BodyIdentifier::ShouldBeTracked) {
 					foundBody = true;
 				}
-				if (bodyStates[i] != CannotBeTracked) {
+				if (bodyStates[i] != BodyIdentifier::CannotBeTracked) {
 					bodies++;
 				}
 				if (bodyStates[i] != previousStates[i]) {
 					redraw = true;
-					EnableWindow(GetDlgItem(hDlg, IDC_RADIO1 + i), bodyStates[i] != CannotBeTracked);
-					if (bodyStates[i] == ShouldBeTracked) {
+					EnableWindow(GetDlgItem(hDlg, IDC_RADIO1 + i), bodyStates[i] != BodyIdentifier::CannotBeTracked);
+					if (bodyStates[i] == BodyIdentifier::ShouldBeTracked) {
 						CheckRadioButton(hDlg, IDC_RADIO1, IDC_RADIO6, IDC_RADIO1 + i);
 					}
 					previousStates[i] = bodyStates[i];
 				}
 			}
 			if (redraw) {
+				KINECT_TRACE("ui redraw");
 				if (!foundBody) {
 					CheckRadioButton(hDlg, IDC_RADIO1, IDC_RADIO6, 0);
 				}
@@ -182,6 +351,9 @@ namespace KinectOsvr {
 			case IDC_BUTTON1:
 				windowMap[hDlg]->recenter();
 				break;
+			case IDC_BUTTON2:
+				Trace::dump();
+				break;
 			case IDC_CHECK1:
 				if (BN_CLICKED == HIWORD(wParam)) {
 					windowMap[hDlg]->toggleSeatedMode();
@@ -212,22 +384,6 @@ namespace KinectOsvr {
 		return FALSE;
 	}
 
-	void setupOffset(OSVR_PoseState* offset, Vector4* joint, NUI_SKELETON_BONE_ORIENTATION* jointOrientation) {
-		osvrVec3SetX(&(offset->translation), joint->x);
-		osvrVec3SetY(&(offset->translation), joint->y);
-		osvrVec3SetZ(&(offset->translation), joint->z);
-
-		Vector4 orientation = jointOrientation->absoluteRotation.rotationQuaternion;
-
-		osvrQuatSetX(&(offset->rotation), orientation.x);
-		osvrQuatSetY(&(offset->rotation), orientation.y);
-		osvrQuatSetZ(&(offset->rotation), orientation.z);
-		osvrQuatSetW(&(offset->rotation), orientation.w);
-
-		Eigen::Quaterniond q = osvr::util::fromQuat(offset->rotation);
-		osvr::util::toQuat(q.inverse(), offset->rotation);
-	}
-
 	void KinectV1Device::ProcessBody(NUI_SKELETON_FRAME* pSkeletons) {
 
 		LONGLONG timestamp = pSkeletons->liTimeStamp.QuadPart;
@@ -242,256 +398,55 @@ namespace KinectOsvr {
 		timeValue.microseconds = (timestamp % 1000) * 1000;
 		osvrTimeValueSum(&timeValue, &m_initializeTime);
 
-		IdentifyBodies(pSkeletons);
-
-		if (m_trackedBody >= 0)
+		clearFrame(m_frame, KinectV1Layout.jointCount);
+		m_frame.timestamp = timeValue.seconds * 1000000LL + timeValue.microseconds;
 		{
-			NUI_SKELETON_DATA skeleton = pSkeletons->SkeletonData[m_trackedBody];
-			m_lastTrackedPosition = skeleton.Position;
-			m_lastTrackedTime = pSkeletons->liTimeStamp.QuadPart;
-
-			if (skeleton.eTrackingState != NUI_SKELETON_TRACKED) return;
-
-			Vector4* joints = skeleton.SkeletonPositions;
-			NUI_SKELETON_BONE_ORIENTATION jointOrientations[NUI_SKELETON_POSITION_COUNT];
-
-			HRESULT hr = NuiSkeletonCalculateBoneOrientations(&skeleton, jointOrientations);
-
-			if (SUCCEEDED(hr)) {
-
-				OSVR_PoseState poseState;
-				OSVR_Vec3 translation;
-				OSVR_Quaternion rotation;
-
-				osvrVec3Zero(&translation);
-				osvrQuatSetIdentity(&rotation);
-
-				if (m_firstUpdate) {
-					m_firstUpdate = false;
-
-					setupOffset(&m_offset, &joints[NUI_SKELETON_POSITION_HEAD], &jointOrientations[NUI_SKELETON_POSITION_HEAD]);
-
-					osvrVec3SetX(&(m_kinectPose.translation), -joints[NUI_SKELETON_POSITION_HEAD].x);
-					osvrVec3SetY(&(m_kinectPose.translation), -joints[NUI_SKELETON_POSITION_HEAD].y);
-					osvrVec3SetZ(&(m_kinectPose.translation), -joints[NUI_SKELETON_POSITION_HEAD].z);
-
-					Eigen::Quaterniond quaternion(Eigen::AngleAxisd(0, Eigen::Vector3d::UnitY()));
-					osvr::util::toQuat(quaternion, m_kinectPose.rotation);
-				}
-
-				osvrDeviceTrackerSendPoseTimestamped(m_dev, m_tracker, &m_kinectPose, 21, &timeValue);
-
-				for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
-				{
-					osvrVec3SetX(&translation, joints[j].x);
-					osvrVec3SetY(&translation, joints[j].y);
-					osvrVec3SetZ(&translation, joints[j].z);
-
-					Vector4 orientation = jointOrientations[j].absoluteRotation.rotationQuaternion;
-
-					osvrQuatSetX(&rotation, orientation.x);
-					osvrQuatSetY(&rotation, orientation.y);
-					osvrQuatSetZ(&rotation, orientation.z);
-					osvrQuatSetW(&rotation, orientation.w);
-
-					// Rotate hand orientation to something more useful for OSVR
-					if (j == NUI_SKELETON_POSITION_HAND_LEFT || j == NUI_SKELETON_POSITION_HAND_RIGHT) {
-						boneSpaceToWorldSpace(&rotation);
-					}
-
-					poseState.translation = translation;
-					poseState.rotation = rotation;
-					applyOffset(&m_offset, &poseState);
-					// Send pose
-					osvrDeviceTrackerSendPoseTimestamped(m_dev, m_tracker, &poseState, j, &timeValue);
-
-					OSVR_AnalogState confidence = 0;
-					switch (skeleton.eSkeletonPositionTrackingState[j]) {
-					case NUI_SKELETON_POSITION_TRACKED:
-						confidence = 1;
-						break;
-					case NUI_SKELETON_POSITION_INFERRED:
-						confidence = 0.5;
-						break;
-					default:
-					case NUI_SKELETON_POSITION_NOT_TRACKED:
-						confidence = 0;
-						break;
-					}
-					// Tracking confidence for use in smoothing plugins
-					osvrDeviceAnalogSetValueTimestamped(m_dev, m_analog, confidence, j, &timeValue);
-				}
-			}
-		}
-	};
-
-	void KinectV1Device::IdentifyBodies(NUI_SKELETON_FRAME* pSkeletons) {
-		if (m_trackedBody >= 0) { // We're tracking a body
-			if (m_trackedBodyChanged) {
-				m_trackingId = pSkeletons->SkeletonData[m_trackedBody].dwTrackingID;
-				m_trackedBodyChanged = false;
-			}
-			else {
-				for (int i = 0; i < NUI_SKELETON_COUNT; ++i) {
-					if (pSkeletons->SkeletonData[i].dwTrackingID == m_trackingId) {
-						m_trackedBody = i;
-						break;
-					}
-				}
-			}
-
-			DWORD trackingId;
-
-			switch (pSkeletons->SkeletonData[m_trackedBody].eTrackingState) {
-			case NUI_SKELETON_POSITION_ONLY: // Keep tracking same body, discount other bodies
-			case NUI_SKELETON_TRACKED:
-				for (int i = 0; i < NUI_SKELETON_COUNT; ++i) {
-					trackingId = pSkeletons->SkeletonData[i].dwTrackingID;
-					if (trackingId == m_trackingId) continue;
-
-					switch (pSkeletons->SkeletonData[i].eTrackingState) {
-					case NUI_SKELETON_NOT_TRACKED:
-						m_body_states[i] = CannotBeTracked;
-						break;
-					case NUI_SKELETON_POSITION_ONLY:
-					case NUI_SKELETON_TRACKED:
-						m_body_states[i] = ShouldNotBeTracked;
-						break;
-					}
-				}
-				return;
-			case NUI_SKELETON_NOT_TRACKED: // We've lost tracking
-				m_body_states[m_trackedBody] = CannotBeTracked;
-				m_trackedBody = -1;
-				m_trackingId = -1;
-				break;
+			KINECT_TRACE("read bodies");
+			for (int i = 0; i < NUI_SKELETON_COUNT; ++i) {
+				readKinectV1Skeleton(pSkeletons->SkeletonData[i], m_frame.bodies[i]);
 			}
 		}
 
-		// Lost tracking or haven't started yet
-		m_trackedBody = m_trackingId = -1;
-		int candidates = 0;
-		double confidence[NUI_SKELETON_COUNT];
-		double timeConfidence = (pSkeletons->liTimeStamp.QuadPart - m_lastTrackedTime) / 15000.0; // If we lose tracking for a few seconds, just pick whoever's visible
+		const Vector4& floor = pSkeletons->vFloorClipPlane;
+		float plane[4] = { floor.x, floor.y, floor.z, floor.w };
+		m_device.setFloor(plane);
 
-		Vector4 position;
-		float distanceFromLastPosition;
-		float distanceConfidence;
-		for (int i = 0; i < NUI_SKELETON_COUNT; ++i)
+		int trackedBody;
 		{
-			DWORD trackingId = pSkeletons->SkeletonData[i].dwTrackingID;
-			NUI_SKELETON_TRACKING_STATE trackingState = pSkeletons->SkeletonData[i].eTrackingState;
-			BodyTrackingState myTrackingState = m_body_states[i];
-
-			confidence[i] = 0.0f;
-
-			switch (trackingState) {
-			case NUI_SKELETON_NOT_TRACKED:
-				m_body_states[i] = CannotBeTracked;
-				break;
-			case NUI_SKELETON_POSITION_ONLY:
-			case NUI_SKELETON_TRACKED:
-				switch (myTrackingState) {
-				case CannotBeTracked:
-				case CanBeTracked:
-					m_body_states[i] = CanBeTracked;
-					candidates++;
-
-					position = pSkeletons->SkeletonData[i].Position;
-					distanceFromLastPosition = sqrt(pow(position.x - m_lastTrackedPosition.x, 2) +
-						pow(position.y - m_lastTrackedPosition.y, 2) + pow(position.z - m_lastTrackedPosition.z, 2));
-					distanceConfidence = 1.0f - distanceFromLastPosition / 7.0f; // Approx largest possible distance in playspace
-					confidence[i] = distanceConfidence + timeConfidence;
-
-					break;
-				case ShouldNotBeTracked: // Ignore bodies we've previously ruled out
-					break;
-				case ShouldBeTracked: // Shouldn't be possible at this point
-					break;
-				}
-				break;
-			}
+			KINECT_TRACE("identify bodies");
+			trackedBody = m_identifier.identify(m_frame);
 		}
+		m_device.process(m_frame, trackedBody, timeValue);
+		saveSnapshot(false);
+	};
 
-		switch (candidates) {
-		case 0: // No bodies found
-			break;
-		case 1: // Only 1 candidate (lets still wait until confidence is good enough)
-		default: // Multiple possible bodies, choose based on last known position
-			double bestConfidence = 0.0;
-			for (int i = 0; i < NUI_SKELETON_COUNT; ++i) {
-				if (m_body_states[i] == CanBeTracked) {
-					if (confidence[i] > bestConfidence) {
-						bestConfidence = confidence[i];
-						m_trackedBody = i;
-						m_trackingId = pSkeletons->SkeletonData[i].dwTrackingID;
-					}
-				}
-			}
-			if (bestConfidence > 0.75) {
-				for (int i = 0; i < NUI_SKELETON_COUNT; ++i) {
-					if (i == m_trackedBody) {
-						m_body_states[i] = ShouldBeTracked;
-					}
-					else if (m_body_states[i] == CanBeTracked) {
-						m_body_states[i] = ShouldNotBeTracked;
-					}
-				}
-			}
-			else {
-				m_trackedBody = m_trackingId = -1;
-			}
-			break;
-		}
-	}
-
-	bool KinectV1Device::Detect(INuiSensor** ppNuiSensor) {
-
-		HINSTANCE hinstLib = LoadLibrary(TEXT("Kinect10.dll"));
-		if (hinstLib == NULL) return false;
-
-		NuiGetSensorCount = (NuiGetSensorCountType)GetProcAddress(hinstLib, "NuiGetSensorCount");
-		NuiCreateSensorByIndex = (NuiCreateSensorByIndexType)GetProcAddress(hinstLib, "NuiCreateSensorByIndex");
-		NuiSkeletonCalculateBoneOrientations = (NuiSkeletonCalculateBoneOrientationsType)GetProcAddress(hinstLib, "NuiSkeletonCalculateBoneOrientations");
-
-		if (NuiGetSensorCount == NULL || NuiCreateSensorByIndex == NULL || NuiSkeletonCalculateBoneOrientations == NULL) return false;
-
-		int iSensorCount = 0;
-		HRESULT hr = NuiGetSensorCount(&iSensorCount);
-
-		if (FAILED(hr)) {
-			return OSVR_RETURN_SUCCESS;
+	// Timestamps from the daemon are already in server time
+	void KinectV1Device::ProcessAttached() {
+		FrameSubscriber& daemon = m_attached->subscriber();
+		daemon.bodyStates(m_attachedStates);
+		{
+			KINECT_TRACE("acquire frame");
+			if (!daemon.next(m_shared)) return;
 		}
 
-		bool bSensorFound = false;
-		for (int i = 0; i < iSensorCount; i++) {
-			hr = NuiCreateSensorByIndex(i, ppNuiSensor);
-			if (FAILED(hr))
-			{
-				continue;
-			}
+		if (m_shared.hasFloor) m_device.setFloor(m_shared.floor);
 
-			hr = (*ppNuiSensor)->NuiStatus();
-			if (S_OK == hr)
-			{
-				bSensorFound = true;
-				break;
-			}
-
-			(*ppNuiSensor)->Release();
-		}
-
-		return bSensorFound;
+		OSVR_TimeValue timeValue;
+		timeValue.seconds = m_shared.frame.timestamp / 1000000;
+		timeValue.microseconds = m_shared.frame.timestamp % 1000000;
+		m_device.process(m_shared.frame, m_shared.trackedBody, timeValue);
+		saveSnapshot(false);
+	}
 
+	// The detect callback runs on the server's thread, so loading the runtime and finding a sensor are left to the lifecycle
+	bool KinectV1Device::Detect() {
+		return kinectV1RuntimeInstalled();
 	};
 
 	KinectV1Device::~KinectV1Device() {
-		if (m_pNuiSensor)
-		{
-			m_pNuiSensor->NuiShutdown();
-			m_pNuiSensor->Release();
-			m_pNuiSensor = NULL;
-		}
+		m_lifecycle.stop();
+		close();
+		saveSnapshot(true);
 
 		if (m_hNextSkeletonEvent && (m_hNextSkeletonEvent != INVALID_HANDLE_VALUE))
 		{
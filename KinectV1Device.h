@@ -1,22 +1,31 @@
 #include "stdafx.h"
-#include <NuiApi.h>
+#include "BodyIdentifier.h"
+#include "BoneSolver.h"
+#include "Config.h"
+#include "ControlQueue.h"
+#include "KinectV1Source.h"
+#include "OrientationClient.h"
+#include "SensorLifecycle.h"
+#include "SkeletonDevice.h"
+#include "WarmStart.h"
 
 namespace KinectOsvr {
-	class KinectV1Device {
+	class KinectV1Device : public SensorBackend {
 	public:
-		KinectV1Device(OSVR_PluginRegContext ctx, INuiSensor* pNuiSensor);
+		KinectV1Device(OSVR_PluginRegContext ctx, WorkerPool& pool, const Config& config);
 		~KinectV1Device();
 
 		OSVR_ReturnCode update();
-		static bool Detect(INuiSensor** ppNuiSensor);
+		static bool Detect();
 
-		enum BodyTrackingState {
-			CannotBeTracked,
-			CanBeTracked,
-			ShouldNotBeTracked,
-			ShouldBeTracked
-		};
+		bool load();
+		bool open();
+		bool isConnected();
+		void close();
+
+		typedef BodyIdentifier::BodyTrackingState BodyTrackingState;
 
+		// Safe from any thread, applied before the next frame
 		void toggleSeatedMode();
 		BodyTrackingState *getBodyStates();
 		void setTrackedBody(int i);
@@ -31,30 +40,30 @@ namespace KinectOsvr {
 		static void ui_thread(ui_thread_data& data);
 		static INT_PTR CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam);
 	private:
-
-
+		void applyCommands();
+		void restoreSnapshot();
+		void saveSnapshot(bool now);
+		void applySeatedMode();
 		void ProcessBody(NUI_SKELETON_FRAME* pSkeletons);
-		void IdentifyBodies(NUI_SKELETON_FRAME* pSkeletons);
+		void ProcessAttached();
 
-		osvr::pluginkit::DeviceToken m_dev;
-		OSVR_TrackerDeviceInterface m_tracker;
-		OSVR_AnalogDeviceInterface m_analog;
-		OSVR_ButtonDeviceInterface m_button;
+		SkeletonDevice m_device;
+		SkeletonFrame m_frame;
+		BoneSolver m_solver;
+		BodyIdentifier m_identifier;
+		ControlQueue m_commands;
+		std::unique_ptr<OrientationClient> m_orientation;
+		WarmStart m_warmStart;
+
+		// Frames come from the daemon instead of the sensor, when attached
+		std::unique_ptr<AttachedSensor> m_attached;
+		SharedFrame m_shared;
+		BodyTrackingState m_attachedStates[MaxBodies];
 
 		INuiSensor* m_pNuiSensor;
 		HANDLE m_pSkeletonStreamHandle;
 		HANDLE m_hNextSkeletonEvent;
 
-		BodyTrackingState m_body_states[NUI_SKELETON_COUNT];
-		DWORD m_trackingId;
-		int m_trackedBody;
-		bool m_trackedBodyChanged;
-		Vector4 m_lastTrackedPosition;
-		LONGLONG m_lastTrackedTime;
-
-		bool m_firstUpdate;
-		OSVR_PoseState m_offset;
-		OSVR_PoseState m_kinectPose;
 
 		OSVR_TimeValue m_initializeTime;
 		LONGLONG m_initializeOffset;
@@ -63,5 +72,8 @@ namespace KinectOsvr {
 		ui_thread_data mThreadData;
 
 		bool m_seatedMode;
+
+		SensorLifecycle m_lifecycle;
+		unsigned m_sensorGeneration;
 	};
 }
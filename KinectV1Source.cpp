@@ -0,0 +1,193 @@
+#include "KinectV1Source.h"
+#include "Log.h"
+
+namespace KinectOsvr {
+
+	NuiGetSensorCountType NuiGetSensorCount;
+	NuiCreateSensorByIndexType NuiCreateSensorByIndex;
+	NuiSkeletonCalculateBoneOrientationsType NuiSkeletonCalculateBoneOrientations;
+
+	bool loadKinectV1Runtime() {
+		static bool loaded = []() {
+			HINSTANCE hinstLib = LoadLibrary(TEXT("Kinect10.dll"));
+			if (hinstLib == NULL) return false;
+
+			NuiGetSensorCount = (NuiGetSensorCountType)GetProcAddress(hinstLib, "NuiGetSensorCount");
+			NuiCreateSensorByIndex = (NuiCreateSensorByIndexType)GetProcAddress(hinstLib, "NuiCreateSensorByIndex");
+			NuiSkeletonCalculateBoneOrientations = (NuiSkeletonCalculateBoneOrientationsType)GetProcAddress(hinstLib, "NuiSkeletonCalculateBoneOrientations");
+
+			return NuiGetSensorCount != NULL && NuiCreateSensorByIndex != NULL && NuiSkeletonCalculateBoneOrientations != NULL;
+		}();
+		return loaded;
+	}
+
+	bool kinectV1RuntimeInstalled() {
+		return SearchPath(NULL, TEXT("Kinect10.dll"), NULL, 0, NULL, NULL) > 0;
+	}
+
+	void readKinectV1Skeleton(const NUI_SKELETON_DATA& data, Skeleton& skeleton) {
+		switch (data.eTrackingState) {
+		case NUI_SKELETON_TRACKED:
+			skeleton.tracking = BodyTracked;
+			break;
+		case NUI_SKELETON_POSITION_ONLY:
+			skeleton.tracking = BodyPositionOnly;
+			break;
+		default:
+			return;
+		}
+
+		skeleton.trackingId = data.dwTrackingID;
+		skeleton.position[0] = data.Position.x;
+		skeleton.position[1] = data.Position.y;
+		skeleton.position[2] = data.Position.z;
+
+		for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+		{
+			skeleton.x[j] = data.SkeletonPositions[j].x;
+			skeleton.y[j] = data.SkeletonPositions[j].y;
+			skeleton.z[j] = data.SkeletonPositions[j].z;
+			skeleton.jointTracking[j] = (uint8_t)data.eSkeletonPositionTrackingState[j];
+		}
+	}
+
+	bool calculateKinectV1Orientations(Skeleton& skeleton) {
+		// Built from the skeleton rather than kept from the sensor, so frames from the daemon work the same
+		NUI_SKELETON_DATA data = { NUI_SKELETON_TRACKED };
+		for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+		{
+			data.SkeletonPositions[j].x = skeleton.x[j];
+			data.SkeletonPositions[j].y = skeleton.y[j];
+			data.SkeletonPositions[j].z = skeleton.z[j];
+			data.SkeletonPositions[j].w = 1;
+			data.eSkeletonPositionTrackingState[j] = (NUI_SKELETON_POSITION_TRACKING_STATE)skeleton.jointTracking[j];
+		}
+
+		NUI_SKELETON_BONE_ORIENTATION jointOrientations[NUI_SKELETON_POSITION_COUNT];
+		HRESULT hr = NuiSkeletonCalculateBoneOrientations(&data, jointOrientations);
+		if (FAILED(hr)) return false;
+
+		for (int j = 0; j < NUI_SKELETON_POSITION_COUNT; ++j)
+		{
+			Vector4 orientation = jointOrientations[j].absoluteRotation.rotationQuaternion;
+			skeleton.qw[j] = orientation.w;
+			skeleton.qx[j] = orientation.x;
+			skeleton.qy[j] = orientation.y;
+			skeleton.qz[j] = orientation.z;
+		}
+		return true;
+	}
+
+	KinectV1Source::KinectV1Source() : m_pNuiSensor(NULL), m_hNextSkeletonEvent(NULL), m_seatedMode(false), m_initializeOffset(0) {}
+
+	KinectV1Source::~KinectV1Source() {
+		close();
+		if (m_hNextSkeletonEvent && (m_hNextSkeletonEvent != INVALID_HANDLE_VALUE)) {
+			CloseHandle(m_hNextSkeletonEvent);
+		}
+	}
+
+	FrameSource* createKinectV1Source() {
+		return new KinectV1Source();
+	}
+
+	std::string KinectV1Source::name() const {
+		return "KinectV1";
+	}
+
+	int KinectV1Source::jointCount() const {
+		return KinectV1Layout.jointCount;
+	}
+
+	bool KinectV1Source::load() {
+		return loadKinectV1Runtime();
+	}
+
+	bool KinectV1Source::open() {
+		int iSensorCount = 0;
+		HRESULT hr = NuiGetSensorCount(&iSensorCount);
+		if (FAILED(hr)) return false;
+
+		for (int i = 0; i < iSensorCount; i++) {
+			hr = NuiCreateSensorByIndex(i, &m_pNuiSensor);
+			if (FAILED(hr)) continue;
+			if (m_pNuiSensor->NuiStatus() == S_OK) break;
+			SafeRelease(m_pNuiSensor);
+		}
+		if (m_pNuiSensor == NULL) return false;
+
+		hr = m_pNuiSensor->NuiInitialize(NUI_INITIALIZE_FLAG_USES_SKELETON);
+		if (SUCCEEDED(hr)) {
+			if (m_hNextSkeletonEvent == NULL) {
+				m_hNextSkeletonEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+			}
+			hr = m_pNuiSensor->NuiSkeletonTrackingEnable(m_hNextSkeletonEvent, m_seatedMode ? NUI_SKELETON_TRACKING_FLAG_ENABLE_SEATED_SUPPORT : 0);
+		}
+
+		if (FAILED(hr)) {
+			close();
+			return false;
+		}
+
+		// Sensor timestamps restart after a reconnect
+		m_initializeOffset = 0;
+		return true;
+	}
+
+	bool KinectV1Source::isConnected() {
+		return m_pNuiSensor != NULL && m_pNuiSensor->NuiStatus() == S_OK;
+	}
+
+	void KinectV1Source::close() {
+		if (m_pNuiSensor) {
+			m_pNuiSensor->NuiShutdown();
+			SafeRelease(m_pNuiSensor);
+		}
+	}
+
+	bool KinectV1Source::read(SkeletonFrame& frame, float floor[4], bool& hasFloor, int timeoutMilliseconds) {
+		if (WaitForSingleObject(m_hNextSkeletonEvent, (DWORD)timeoutMilliseconds) != WAIT_OBJECT_0) return false;
+
+		NUI_SKELETON_FRAME skeletonFrame = { 0 };
+		HRESULT hr = m_pNuiSensor->NuiSkeletonGetNextFrame(0, &skeletonFrame);
+		if (FAILED(hr)) {
+			if (hr != E_NUI_FRAME_NO_DATA) KINECT_LOG(Warning, "KinectV1: failed to get a skeleton frame (error {x})", (long)hr);
+			return false;
+		}
+
+		// Sensor time in milliseconds to server time, counting from when the first frame arrived
+		LONGLONG timestamp = skeletonFrame.liTimeStamp.QuadPart;
+		if (m_initializeOffset == 0) {
+			osvrTimeValueGetNow(&m_initializeTime);
+			m_initializeOffset = timestamp;
+		}
+		timestamp = timestamp - m_initializeOffset;
+
+		OSVR_TimeValue timeValue;
+		timeValue.seconds = timestamp / 1000;
+		timeValue.microseconds = (timestamp % 1000) * 1000;
+		osvrTimeValueSum(&timeValue, &m_initializeTime);
+
+		clearFrame(frame, KinectV1Layout.jointCount);
+		frame.timestamp = timeValue.seconds * 1000000LL + timeValue.microseconds;
+		for (int i = 0; i < NUI_SKELETON_COUNT; ++i) {
+			readKinectV1Skeleton(skeletonFrame.SkeletonData[i], frame.bodies[i]);
+		}
+
+		const Vector4& plane = skeletonFrame.vFloorClipPlane;
+		floor[0] = plane.x;
+		floor[1] = plane.y;
+		floor[2] = plane.z;
+		floor[3] = plane.w;
+		hasFloor = true;
+		return true;
+	}
+
+	// Called with the sensor mutex held, otherwise applied when the sensor is next opened
+	void KinectV1Source::toggleSeatedMode() {
+		m_seatedMode = !m_seatedMode;
+		if (m_pNuiSensor != NULL) {
+			m_pNuiSensor->NuiSkeletonTrackingEnable(m_hNextSkeletonEvent, m_seatedMode ? NUI_SKELETON_TRACKING_FLAG_ENABLE_SEATED_SUPPORT : 0);
+		}
+	}
+};
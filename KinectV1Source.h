@@ -0,0 +1,53 @@
+#pragma once
+
+#include "stdafx.h"
+#include "SensorDaemon.h"
+#include <NuiApi.h>
+
+namespace KinectOsvr {
+	typedef HRESULT(_stdcall *NuiGetSensorCountType)(int*);
+	typedef HRESULT(_stdcall *NuiCreateSensorByIndexType)(int, INuiSensor**);
+	typedef HRESULT(_stdcall *NuiSkeletonCalculateBoneOrientationsType)(NUI_SKELETON_DATA*, NUI_SKELETON_BONE_ORIENTATION*);
+
+	extern NuiGetSensorCountType NuiGetSensorCount;
+	extern NuiCreateSensorByIndexType NuiCreateSensorByIndex;
+	extern NuiSkeletonCalculateBoneOrientationsType NuiSkeletonCalculateBoneOrientations;
+
+	// Resolve the runtime entry points once, hardware detection runs repeatedly
+	bool loadKinectV1Runtime();
+
+	// Whether the runtime is installed, found on the DLL search path without loading it
+	bool kinectV1RuntimeInstalled();
+
+	// Leaves the skeleton as it was if the body isn't tracked
+	void readKinectV1Skeleton(const NUI_SKELETON_DATA& data, Skeleton& skeleton);
+
+	// Fills in the skeleton's orientations with the SDK's own, from its joint positions, false if the SDK fails
+	bool calculateKinectV1Orientations(Skeleton& skeleton);
+
+	// The Kinect V1's skeletons for the daemon
+	class KinectV1Source : public FrameSource {
+	public:
+		KinectV1Source();
+		~KinectV1Source();
+
+		std::string name() const;
+		int jointCount() const;
+
+		bool load();
+		bool open();
+		bool isConnected();
+		void close();
+
+		bool read(SkeletonFrame& frame, float floor[4], bool& hasFloor, int timeoutMilliseconds);
+		void toggleSeatedMode();
+
+	private:
+		INuiSensor* m_pNuiSensor;
+		HANDLE m_hNextSkeletonEvent;
+		bool m_seatedMode;
+
+		OSVR_TimeValue m_initializeTime;
+		LONGLONG m_initializeOffset;
+	};
+}
@@ -1,6 +1,8 @@
 #include "KinectV2Device.h"
 #include "KinectMath.h"
-#include <iostream>
+#include "Log.h"
+#include "Trace.h"
+#include <ctime>
 
 // Generated JSON header file
 #include "je_nourish_kinectv2_json.h"
@@ -9,33 +11,94 @@ namespace KinectOsvr {
 
 	std::map<HWND, KinectV2Device*> windowMap2;
 
-	KinectV2Device::KinectV2Device(OSVR_PluginRegContext ctx, IKinectSensor* pKinectSensor) : m_pKinectSensor(pKinectSensor) {
+	KinectV2Device::KinectV2Device(OSVR_PluginRegContext ctx, WorkerPool& pool, const Config& config)
+		: m_device(ctx, "KinectV2", KinectV2Layout, je_nourish_kinectv2_json, pool), m_solver(KinectV2Hierarchy), m_identifier(config.tracking), m_projector(KinectV2DepthCamera, KinectV2ColorCamera), m_depthHead(config.depthHeadFallback), m_pKinectSensor(NULL), m_pCoordinateMapper(NULL), m_pBodyFrameReader(NULL), m_pDepthFrameReader(NULL), m_pCaptureReader(NULL), m_lifecycle(*this) {
 
-		m_trackingId = m_trackedBody = -1;
-		m_lastTrackedPosition.X = m_lastTrackedPosition.X = m_lastTrackedPosition.X = 0;
-		m_lastTrackedTime = { 0, 0 };
-		m_firstUpdate = true;
-		m_trackedBodyChanged = false;
+		m_sensorGeneration = 0;
 
-		for (int i = 0; i < BODY_COUNT; i++) {
-			m_body_states[i] = CannotBeTracked;
+		m_device.setFilter(config.filter);
+		m_device.setFrameBudget(config.frameBudget);
+		if (!config.recordPath.empty()) {
+			m_device.record(config.recordPath + "-KinectV2.skr");
+			if (config.recordDepth) m_capturePath = config.recordPath + "-KinectV2.kdc";
+		}
+		if (!config.archivePath.empty()) {
+			std::string path = archivePath(config.archivePath + "-KinectV2");
+			if (!m_device.archive(path)) KINECT_LOG(Warning, "Failed to open archive {}", path);
+		}
+		if (!config.gesturePath.empty() && !m_device.loadGestures(config.gesturePath)) {
+			KINECT_LOG(Warning, "Failed to load gestures from {}", config.gesturePath);
+		}
+		if (!config.fusionPath.empty()) {
+			m_device.setHeadFusion(config.fusion);
+			if (config.estimateLatency > 0) m_device.setLatencyEstimation(LatencyParams(), config.estimateLatency > 1);
+			m_orientation.reset(new OrientationClient(config.fusionPath));
+		}
+		if (config.attachDaemon) {
+			m_attached.reset(new AttachedSensor("KinectV2", KinectV2Layout.jointCount));
+			for (int i = 0; i < MaxBodies; i++) m_attachedStates[i] = BodyIdentifier::CannotBeTracked;
+			if (m_depthHead || !m_capturePath.empty()) {
+				KINECT_LOG(Warning, "KinectV2: the daemon doesn't share depth, the head fallback and depth capture are off");
+			}
+		}
+		if (!config.snapshotPath.empty()) {
+			m_warmStart.open(config.snapshotPath + "-KinectV2.kws", KinectV2Layout.jointCount, config.snapshotMaxAge * 3600.0);
+			restoreSnapshot();
 		}
 
-		HRESULT hr;
+		// The SDK's orientations are noisy, particularly around the wrists
+		if (config.solveV2Orientations) {
+			m_device.setOrientationStage([this](int body, Skeleton& skeleton) {
+				m_solver.solve(skeleton);
+				return true;
+			}, true);
+		}
 
-		// Initialize the Kinect and get coordinate mapper and the body reader
-		IBodyFrameSource* pBodyFrameSource = NULL;
+		if (config.projectJoints) {
+			m_device.setProjectionStage([this](const SkeletonFrame& frame, const bool* bodies, FrameProjection& projection) {
+				ProjectJoints(frame, bodies, projection);
+			});
+		}
 
-		hr = m_pKinectSensor->Open();
+		mThreadData.kinect = this;
+		mThread = NULL;
 
+		/// Register update callback
+		m_device.registerUpdateCallback(this);
 
-		if (SUCCEEDED(hr))
-		{
-			hr = m_pKinectSensor->get_CoordinateMapper(&m_pCoordinateMapper);
-		}
-		else {
-			std::cout << "Failed to open sensor" << std::endl;
+		// Open the sensor in the background, the device reports nothing until it's ready
+		m_lifecycle.start();
+	};
+
+	bool KinectV2Device::load() {
+		return m_attached ? m_attached->load() : loadKinectV2Runtime();
+	}
+
+	bool KinectV2Device::open() {
+		if (m_attached) return m_attached->open();
+
+		HRESULT hr;
+
+		// The sensor object stays open across unplugs, it's what reports availability
+		if (m_pKinectSensor == NULL) {
+			hr = GetDefaultKinectSensor(&m_pKinectSensor);
+			if (FAILED(hr)) return false;
+
+			hr = m_pKinectSensor->Open();
+			if (FAILED(hr)) {
+				KINECT_LOG(Error, "KinectV2: failed to open the sensor (error {})", (long)hr);
+				SafeRelease(m_pKinectSensor);
+				return false;
+			}
 		}
+
+		// Open() returns straight away, wait for the sensor to come up before creating readers
+		if (!isConnected()) return false;
+
+		// Get coordinate mapper and the body reader
+		IBodyFrameSource* pBodyFrameSource = NULL;
+
+		hr = m_pKinectSensor->get_CoordinateMapper(&m_pCoordinateMapper);
 		if (SUCCEEDED(hr))
 		{
 			hr = m_pKinectSensor->get_BodyFrameSource(&pBodyFrameSource);
@@ -46,37 +109,118 @@ namespace KinectOsvr {
 		}
 		SafeRelease(pBodyFrameSource);
 
-		mThreadData.kinect = this;
-		mThread = new std::thread(KinectV2Device::ui_thread, std::ref(mThreadData));
+		if (FAILED(hr)) {
+			close();
+			return false;
+		}
 
-		/// Create the initialization options
-		OSVR_DeviceInitOptions opts = osvrDeviceCreateInitOptions(ctx);
+		// Tracking carries on without the head fallback if depth can't be read
+		if (m_depthHead) {
+			IDepthFrameSource* pDepthFrameSource = NULL;
+			hr = m_pKinectSensor->get_DepthFrameSource(&pDepthFrameSource);
+			if (SUCCEEDED(hr)) {
+				hr = pDepthFrameSource->OpenReader(&m_pDepthFrameReader);
+			}
+			SafeRelease(pDepthFrameSource);
+			if (FAILED(hr)) {
+				KINECT_LOG(Warning, "KinectV2: failed to open the depth reader, the head won't be followed when the skeleton is lost");
+			}
+		}
 
-		osvrDeviceTrackerConfigure(opts, &m_tracker);
-		osvrDeviceAnalogConfigure(opts, &m_analog, 26);
-		osvrDeviceButtonConfigure(opts, &m_button, 6);
+		// Depth and body index arrive together from one reader, so each pair is from the same moment
+		if (!m_capturePath.empty()) {
+			hr = m_pKinectSensor->OpenMultiSourceFrameReader(FrameSourceTypes_Depth | FrameSourceTypes_BodyIndex, &m_pCaptureReader);
+			if (FAILED(hr)) {
+				KINECT_LOG(Warning, "KinectV2: failed to open the depth capture reader, only skeletons will be recorded");
+			}
+		}
 
-		/// Create the device token with the options
-		m_dev.initAsync(ctx, "KinectV2", opts);
+		// The mapper's calibration for when it can't map points itself
+		PinholeIntrinsics depth = KinectV2DepthCamera;
+		CameraIntrinsics intrinsics;
+		if (SUCCEEDED(m_pCoordinateMapper->GetDepthCameraIntrinsics(&intrinsics)) && intrinsics.FocalLengthX > 0) {
+			depth.focalLengthX = intrinsics.FocalLengthX;
+			depth.focalLengthY = intrinsics.FocalLengthY;
+			depth.principalPointX = intrinsics.PrincipalPointX;
+			depth.principalPointY = intrinsics.PrincipalPointY;
+		}
+		m_projector.setDepthCamera(depth);
+		m_headTracker.setCamera(depth);
+		m_headTracker.reset();
+		return true;
+	}
 
-		/// Send JSON descriptor
-		m_dev.sendJsonDescriptor(je_nourish_kinectv2_json);
+	bool KinectV2Device::isConnected() {
+		if (m_attached) return m_attached->isConnected();
 
-		/// Register update callback
-		m_dev.registerUpdateCallback(this);
-	};
+		BOOLEAN available = false;
+		HRESULT hr = m_pKinectSensor->get_IsAvailable(&available);
+		return SUCCEEDED(hr) && available;
+	}
+
+	void KinectV2Device::close() {
+		if (m_attached) m_attached->close();
+		SafeRelease(m_pCaptureReader);
+		SafeRelease(m_pDepthFrameReader);
+		SafeRelease(m_pBodyFrameReader);
+		SafeRelease(m_pCoordinateMapper);
+	}
 
 	OSVR_ReturnCode KinectV2Device::update() {
+		KINECT_TRACE("update");
 
-		if (!m_pBodyFrameReader)
+		// Clients can tell a sensor still being looked for from one with nobody in front of it
+		OSVR_TimeValue now;
+		osvrTimeValueGetNow(&now);
+		m_device.reportStatus(m_lifecycle.state(), now);
+
+		// Skip the frame rather than wait if the sensor is being opened or torn down
+		std::unique_lock<std::mutex> lock(m_lifecycle.sensorMutex(), std::try_to_lock);
+		if (!lock.owns_lock())
 		{
 			return OSVR_RETURN_SUCCESS;
 		}
 
-		IBodyFrame* pBodyFrame = NULL;
+		applyCommands();
+		if (m_lifecycle.state() != SensorLifecycle::Ready)
+		{
+			return OSVR_RETURN_SUCCESS;
+		}
 
-		HRESULT hr = m_pBodyFrameReader->AcquireLatestFrame(&pBodyFrame);
+		// The config window waits for a sensor, so a runtime installed without one doesn't open a window of its own
+		if (mThread == NULL) {
+			mThread = new std::thread(KinectV2Device::ui_thread, std::ref(mThreadData));
+		}
+
+		// Orientations arrive many times a frame, each goes out fused as soon as it does
+		if (m_orientation) {
+			m_orientation->poll([this](const OSVR_Quaternion& orientation, const OSVR_TimeValue& timeValue) {
+				m_device.fuseOrientation(orientation, timeValue);
+			});
+		}
+
+		// The daemon has already read the bodies and picked one out
+		if (m_attached) {
+			ProcessAttached();
+			return OSVR_RETURN_SUCCESS;
+		}
+
+		// Sensor timestamps restart after a reconnect
+		if (m_sensorGeneration != m_lifecycle.generation()) {
+			m_sensorGeneration = m_lifecycle.generation();
+			m_initializeOffset = 0;
+		}
 
+		IBodyFrame* pBodyFrame = NULL;
+		HRESULT hr;
+		{
+			KINECT_TRACE("acquire frame");
+			hr = m_pBodyFrameReader->AcquireLatestFrame(&pBodyFrame);
+		}
+		// Pending just means there's no new frame yet
+		if (FAILED(hr) && hr != E_PENDING) {
+			KINECT_LOG(Warning, "KinectV2: failed to acquire a body frame (error {x})", (long)hr);
+		}
 
 		if (SUCCEEDED(hr))
 		{
@@ -88,22 +232,26 @@ namespace KinectOsvr {
 				osvrTimeValueGetNow(&m_initializeTime);
 				m_initializeOffset = nTime;
 			}
-			nTime = (nTime - m_initializeOffset) / 10;
-
-			OSVR_TimeValue timeValue;
-			timeValue.seconds = nTime / 1000000;
-			timeValue.microseconds = nTime % 1000000;
-			osvrTimeValueSum(&timeValue, &m_initializeTime);
+			OSVR_TimeValue timeValue = sensorTime(nTime);
 
 			IBody* ppBodies[BODY_COUNT] = { 0 };
 
 			if (SUCCEEDED(hr))
 			{
+				KINECT_TRACE("get body data");
 				hr = pBodyFrame->GetAndRefreshBodyData(_countof(ppBodies), ppBodies);
 			}
 
-			if (SUCCEEDED(hr))
+			if (FAILED(hr)) {
+				KINECT_LOG(Warning, "KinectV2: failed to read the body frame (error {x})", (long)hr);
+			}
+			else
 			{
+				Vector4 floor;
+				if (SUCCEEDED(pBodyFrame->get_FloorClipPlane(&floor))) {
+					float plane[4] = { floor.x, floor.y, floor.z, floor.w };
+					m_device.setFloor(plane);
+				}
 				ProcessBody(ppBodies, &timeValue);
 			}
 
@@ -115,17 +263,77 @@ namespace KinectOsvr {
 
 		SafeRelease(pBodyFrame);
 
+		// After the skeleton has gone out, the capture only ever copies the images
+		if (m_pCaptureReader && m_initializeOffset != 0) {
+			CaptureDepth();
+		}
+
 		return OSVR_RETURN_SUCCESS;
 	};
 
+	// Sensor time in 100 ns ticks to server time, counting from when the first frame arrived
+	OSVR_TimeValue KinectV2Device::sensorTime(INT64 relativeTime) {
+		INT64 nTime = (relativeTime - m_initializeOffset) / 10;
+
+		OSVR_TimeValue timeValue;
+		timeValue.seconds = nTime / 1000000;
+		timeValue.microseconds = nTime % 1000000;
+		osvrTimeValueSum(&timeValue, &m_initializeTime);
+		return timeValue;
+	}
+
 	KinectV2Device::BodyTrackingState* KinectV2Device::getBodyStates() {
-		return m_body_states;
+		return m_attached ? m_attachedStates : m_identifier.getBodyStates();
 	}
 
 	void KinectV2Device::setTrackedBody(int i)
 	{
-		m_trackedBody = i;
-		m_trackedBodyChanged = true;
+		ControlCommand command = { ControlCommand::SetTrackedBody, i };
+		m_commands.push(command);
+	}
+
+	// Picks up where the last session left off, tracking is calibrated from the first frame
+	void KinectV2Device::restoreSnapshot() {
+		WarmStartState state;
+		WarmStart::LoadResult result = m_warmStart.load(state, (int64_t)time(NULL));
+		if (result == WarmStart::Loaded) {
+			m_device.restoreState(state);
+			if (state.hasPerson) m_identifier.resume(state.signature, state.lastPosition);
+			KINECT_LOG(Info, "KinectV2: resuming from {}", m_warmStart.path());
+		}
+		else if (result != WarmStart::Missing) {
+			KINECT_LOG(Info, "KinectV2: ignoring {} snapshot {}", WarmStart::describe(result), m_warmStart.path());
+		}
+	}
+
+	// After each frame, only written when something has changed
+	void KinectV2Device::saveSnapshot(bool now) {
+		if (!m_warmStart.isOpen()) return;
+
+		KINECT_TRACE("save snapshot");
+		WarmStartState state;
+		m_device.saveState(state);
+		state.hasPerson = m_identifier.lastTracked(state.signature, state.lastPosition);
+		if (now) m_warmStart.flush(state, (int64_t)time(NULL));
+		else m_warmStart.update(state, (int64_t)time(NULL));
+	}
+
+	// Called between frames
+	void KinectV2Device::applyCommands() {
+		ControlCommand command;
+		while (m_commands.pop(command)) {
+			switch (command.type) {
+			case ControlCommand::SetTrackedBody:
+				if (m_attached) m_attached->send(command);
+				else if (command.body >= 0 && command.body < MaxBodies) m_identifier.setTrackedBody(command.body);
+				break;
+			case ControlCommand::Recenter:
+				m_device.recenter();
+				break;
+			case ControlCommand::ToggleSeatedMode:
+				break;
+			}
+		}
 	}
 
 	void KinectV2Device::ui_thread(ui_thread_data& data)
@@ -135,11 +343,14 @@ namespace KinectOsvr {
 		HWND hDlg;
 		HINSTANCE hInst;
 
+		Trace::setThreadName("ui");
+
 		hInst = GetModuleHandle("je_nourish_kinect.dll");
 		hDlg = CreateDialogParam(hInst, MAKEINTRESOURCE(IDD_DIALOG1), 0, DialogProc, 0);
 		SetWindowText(hDlg, "OSVR Kinect V2 Config");
 		ShowWindow(GetDlgItem(hDlg, IDC_CHECK1), SW_HIDE);
 		ShowWindow(hDlg, SW_RESTORE);
+		EnableWindow(GetDlgItem(hDlg, IDC_BUTTON2), Trace::enabled());
 		UpdateWindow(hDlg);
 
 		windowMap2[hDlg] = data.kinect;
@@ -165,22 +376,23 @@ namespace KinectOsvr {
 			int bodies = 0;
 
 			for (int i = 0; i < BODY_COUNT; i++) {
-				if (bodyStates[i] == ShouldBeTracked) {
+				if (bodyStates[i] == BodyIdentifier::ShouldBeTracked) {
 					foundBody = true;
 				}
-				if (bodyStates[i] != CannotBeTracked) {
+				if (bodyStates[i] != BodyIdentifier::CannotBeTracked) {
 					bodies++;
 				}
 				if (bodyStates[i] != previousStates[i]) {
 					redraw = true;
-					EnableWindow(GetDlgItem(hDlg, IDC_RADIO1 + i), bodyStates[i] != CannotBeTracked);
-					if (bodyStates[i] == ShouldBeTracked) {
+					EnableWindow(GetDlgItem(hDlg, IDC_RADIO1 + i), bodyStates[i] != BodyIdentifier::CannotBeTracked);
+					if (bodyStates[i] == BodyIdentifier::ShouldBeTracked) {
 						CheckRadioButton(hDlg, IDC_RADIO1, IDC_RADIO6, IDC_RADIO1 + i);
 					}
 					previousStates[i] = bodyStates[i];
 				}
 			}
 			if (redraw) {
+				KINECT_TRACE("ui redraw");
 				if (!foundBody) {
 					CheckRadioButton(hDlg, IDC_RADIO1, IDC_RADIO6, 0);
 				}
@@ -210,6 +422,9 @@ namespace KinectOsvr {
 			case IDC_BUTTON1:
 				windowMap2[hDlg]->recenter();
 				break;
+			case IDC_BUTTON2:
+				Trace::dump();
+				break;
 			case IDC_RADIO1:
 			case IDC_RADIO2:
 			case IDC_RADIO3:
@@ -235,287 +450,197 @@ namespace KinectOsvr {
 		return FALSE;
 	}
 
-	void setupOffset(OSVR_PoseState* offset, Joint* joint, JointOrientation* jointOrientation) {
-		osvrVec3SetX(&(offset->translation), joint->Position.X);
-		osvrVec3SetY(&(offset->translation), joint->Position.Y);
-		osvrVec3SetZ(&(offset->translation), joint->Position.Z);
-
-		osvrQuatSetX(&(offset->rotation), jointOrientation->Orientation.x);
-		osvrQuatSetY(&(offset->rotation), jointOrientation->Orientation.y);
-		osvrQuatSetZ(&(offset->rotation), jointOrientation->Orientation.z);
-		osvrQuatSetW(&(offset->rotation), jointOrientation->Orientation.w);
-
-		Eigen::Quaterniond q = osvr::util::fromQuat(offset->rotation);
-		osvr::util::toQuat(q.inverse(), offset->rotation);
-	}
-
 	void KinectV2Device::recenter()
 	{
-		m_firstUpdate = true;
+		ControlCommand command = { ControlCommand::Recenter, 0 };
+		m_commands.push(command);
 	}
 
 	void KinectV2Device::ProcessBody(IBody** ppBodies, OSVR_TimeValue* timeValue) {
 
 		if (m_pCoordinateMapper)
 		{
-			IdentifyBodies(ppBodies, timeValue);
-
-			if (m_trackedBody >= 0)
+			// Copy joints out of the SDK on this thread, the IBody interfaces stay here
+			clearFrame(m_frame, JointType_Count);
+			m_frame.timestamp = timeValue->seconds * 1000000LL + timeValue->microseconds;
 			{
-				IBody* pBody = ppBodies[m_trackedBody];
-
-				Joint joints[JointType_Count];
-				JointOrientation jointOrientations[JointType_Count];
-				HandState rightHandState = HandState_Unknown;
-				HandState leftHandState = HandState_Unknown;
-
-				pBody->get_HandRightState(&rightHandState);
-				pBody->get_HandLeftState(&leftHandState);
-
-				OSVR_ButtonState buttons[6];
-				buttons[0] = rightHandState == HandState_Open;
-				buttons[1] = rightHandState == HandState_Closed;
-				buttons[2] = rightHandState == HandState_Lasso;
-				buttons[3] = leftHandState == HandState_Open;
-				buttons[4] = leftHandState == HandState_Closed;
-				buttons[5] = leftHandState == HandState_Lasso;
-
-				// Send hand gestures as button presses
-				osvrDeviceButtonSetValues(m_dev, m_button, buttons, 6);
-
-				HRESULT hr = pBody->GetJoints(_countof(joints), joints);
-				HRESULT hr2 = pBody->GetJointOrientations(_countof(jointOrientations), jointOrientations);
-
-				if (SUCCEEDED(hr) && SUCCEEDED(hr2))
-				{
-					OSVR_PoseState poseState;
-					OSVR_Vec3 translation;
-					OSVR_Quaternion rotation;
-
-					osvrVec3Zero(&translation);
-					osvrQuatSetIdentity(&rotation);
-
-					if (m_firstUpdate) {
-						m_firstUpdate = false;
-
-						setupOffset(&m_offset, &joints[JointType_Head], &jointOrientations[JointType_Neck]);
-
-						osvrVec3SetX(&(m_kinectPose.translation), -joints[JointType_Head].Position.X);
-						osvrVec3SetY(&(m_kinectPose.translation), -joints[JointType_Head].Position.Y);
-						osvrVec3SetZ(&(m_kinectPose.translation), -joints[JointType_Head].Position.Z);
+				KINECT_TRACE("read bodies");
+				for (int i = 0; i < BODY_COUNT; ++i) {
+					readKinectV2Body(ppBodies[i], m_frame.bodies[i]);
+				}
+			}
 
-						Eigen::Quaterniond quaternion(Eigen::AngleAxisd(0, Eigen::Vector3d::UnitY()));
-						osvr::util::toQuat(quaternion, m_kinectPose.rotation);
-					}
+			int trackedBody;
+			{
+				KINECT_TRACE("identify bodies");
+				trackedBody = m_identifier.identify(m_frame);
+			}
+			m_device.process(m_frame, trackedBody, *timeValue);
 
-					osvrDeviceTrackerSendPoseTimestamped(m_dev, m_tracker, &m_kinectPose, 25, timeValue);
-
-					for (int j = 0; j < _countof(joints); ++j)
-					{
-						osvrVec3SetX(&translation, joints[j].Position.X);
-						osvrVec3SetY(&translation, joints[j].Position.Y);
-						osvrVec3SetZ(&translation, joints[j].Position.Z);
-
-						osvrQuatSetX(&rotation, jointOrientations[j].Orientation.x);
-						osvrQuatSetY(&rotation, jointOrientations[j].Orientation.y);
-						osvrQuatSetZ(&rotation, jointOrientations[j].Orientation.z);
-						osvrQuatSetW(&rotation, jointOrientations[j].Orientation.w);
-
-						// Rotate hand orientation to something more useful for OSVR
-						if (j == JointType_HandLeft || j == JointType_HandRight) {
-							boneSpaceToWorldSpace(&rotation);
-						}
-
-						poseState.translation = translation;
-						poseState.rotation = rotation;
-						applyOffset(&m_offset, &poseState);
-						// Send pose
-						osvrDeviceTrackerSendPoseTimestamped(m_dev, m_tracker, &poseState, j, timeValue);
-
-						OSVR_AnalogState confidence = 0;
-						switch (joints[j].TrackingState) {
-						case TrackingState_Tracked:
-							confidence = 1;
-							break;
-						case TrackingState_Inferred:
-							confidence = 0.5;
-							break;
-						default:
-						case TrackingState_NotTracked:
-							confidence = 0;
-							break;
-						}
-						// Tracking confidence for use in smoothing plugins
-						osvrDeviceAnalogSetValueTimestamped(m_dev, m_analog, confidence, j, timeValue);
-					}
-				}
+			if (m_pDepthFrameReader) {
+				FollowHead(trackedBody, *timeValue);
 			}
+			saveSnapshot(false);
 		}
 	};
 
-	void KinectV2Device::IdentifyBodies(IBody** ppBodies, OSVR_TimeValue* timeValue) {
-		HRESULT hr;
-		UINT64 trackingId;
+	// Timestamps from the daemon are already in server time
+	void KinectV2Device::ProcessAttached() {
+		FrameSubscriber& daemon = m_attached->subscriber();
+		daemon.bodyStates(m_attachedStates);
+		{
+			KINECT_TRACE("acquire frame");
+			if (!daemon.next(m_shared)) return;
+		}
 
-		if (m_trackedBody >= 0) { // We're tracking a body
-			if (m_trackedBodyChanged) {
-				hr = ppBodies[m_trackedBody]->get_TrackingId(&m_trackingId);
-				if (SUCCEEDED(hr)) {
-					m_trackedBodyChanged = false;
-				}
-				else {
-					return;
-				}
-			}
-			else {
-				for (int i = 0; i < BODY_COUNT; ++i) {
-					hr = ppBodies[i]->get_TrackingId(&trackingId);
-					if (SUCCEEDED(hr) && trackingId == m_trackingId) {
-						m_trackedBody = i;
-						break;
-					}
-				}
-			}
+		if (m_shared.hasFloor) m_device.setFloor(m_shared.floor);
 
-			BOOLEAN isTracked;
-			hr = ppBodies[m_trackedBody]->get_IsTracked(&isTracked);
+		OSVR_TimeValue timeValue;
+		timeValue.seconds = m_shared.frame.timestamp / 1000000;
+		timeValue.microseconds = m_shared.frame.timestamp % 1000000;
+		m_device.process(m_shared.frame, m_shared.trackedBody, timeValue);
+		saveSnapshot(false);
+	}
 
-			if (SUCCEEDED(hr)) {
-				if (isTracked) { // Discount other bodies
-					for (int i = 0; i < BODY_COUNT; ++i) {
-						hr = ppBodies[i]->get_TrackingId(&trackingId);
-						if (SUCCEEDED(hr) && trackingId == m_trackingId) continue;
-
-						hr = ppBodies[i]->get_IsTracked(&isTracked);
-						if (isTracked) {
-							m_body_states[i] = ShouldNotBeTracked;
-						}
-						else {
-							m_body_states[i] = CannotBeTracked;
-						}
-					}
-					return;
-				}
-				else {
-					m_body_states[m_trackedBody] = CannotBeTracked;
-					m_trackedBody = -1;
-					m_trackingId = -1;
-				}
-			}
+	// The skeleton's head seeds the depth tracker, which reports the head itself once the skeleton loses it
+	void KinectV2Device::FollowHead(int trackedBody, const OSVR_TimeValue& timeValue) {
+		if (trackedBody >= 0 && m_frame.bodies[trackedBody].tracking == BodyTracked) {
+			const Skeleton& skeleton = m_frame.bodies[trackedBody];
+			float head[3] = { skeleton.x[JointType_Head], skeleton.y[JointType_Head], skeleton.z[JointType_Head] };
+			m_headTracker.seed(head);
+			return;
+		}
+		if (!m_headTracker.tracking()) return;
+
+		KINECT_TRACE("depth head");
+		IDepthFrame* pDepthFrame = NULL;
+		HRESULT hr = m_pDepthFrameReader->AcquireLatestFrame(&pDepthFrame);
+
+		IFrameDescription* pDescription = NULL;
+		int width = 0, height = 0;
+		UINT capacity = 0;
+		UINT16* buffer = NULL;
+		if (SUCCEEDED(hr)) hr = pDepthFrame->get_FrameDescription(&pDescription);
+		if (SUCCEEDED(hr)) hr = pDescription->get_Width(&width);
+		if (SUCCEEDED(hr)) hr = pDescription->get_Height(&height);
+		if (SUCCEEDED(hr)) hr = pDepthFrame->AccessUnderlyingBuffer(&capacity, &buffer);
+
+		float head[3], confidence;
+		if (SUCCEEDED(hr) && capacity >= (UINT)(width * height) && m_headTracker.track(buffer, width, height, head, confidence)) {
+			m_device.sendHead(head, confidence, timeValue);
 		}
 
-		// Lost tracking or haven't started yet
-		m_trackedBody = m_trackingId = -1;
-		int candidates = 0;
-		double confidence[BODY_COUNT];
-		double timeConfidence = (timeValue->seconds - m_lastTrackedTime.seconds) / 15000.0; // If we lose tracking for a few seconds, just pick whoever's visible
+		SafeRelease(pDescription);
+		SafeRelease(pDepthFrame);
+	}
 
-		Joint joints[JointType_Count];
-		CameraSpacePoint position;
-		float distanceFromLastPosition;
-		float distanceConfidence;
-		for (int i = 0; i < BODY_COUNT; ++i)
-		{
-			BOOLEAN trackingState;
-
-			hr = ppBodies[i]->get_TrackingId(&trackingId);
-			hr = ppBodies[i]->get_IsTracked(&trackingState);
-			BodyTrackingState myTrackingState = m_body_states[i];
-
-			confidence[i] = 0.0f;
-
-			if (trackingState) {
-				switch (myTrackingState) {
-				case CannotBeTracked:
-				case CanBeTracked:
-					m_body_states[i] = CanBeTracked;
-					candidates++;
-
-					hr = ppBodies[i]->GetJoints(_countof(joints), joints);
-					position = joints[JointType_Head].Position;
-
-					distanceFromLastPosition = sqrt(pow(position.X - m_lastTrackedPosition.X, 2) +
-						pow(position.Y - m_lastTrackedPosition.Y, 2) + pow(position.Z - m_lastTrackedPosition.Z, 2));
-					distanceConfidence = 1.0f - distanceFromLastPosition / 7.0f; // Approx largest possible distance in playspace
-					confidence[i] = distanceConfidence + timeConfidence;
-
-					break;
-				case ShouldNotBeTracked: // Ignore bodies we've previously ruled out
-					break;
-				case ShouldBeTracked: // Shouldn't be possible at this point
-					break;
-				}
+	// Timestamps match the skeleton recording's, for lining the two up on replay
+	void KinectV2Device::CaptureDepth() {
+		KINECT_TRACE("capture depth");
+		IMultiSourceFrame* pFrame = NULL;
+		HRESULT hr = m_pCaptureReader->AcquireLatestFrame(&pFrame);
+		if (FAILED(hr)) return;
+
+		IDepthFrameReference* pDepthReference = NULL;
+		IDepthFrame* pDepthFrame = NULL;
+		IBodyIndexFrameReference* pBodyIndexReference = NULL;
+		IBodyIndexFrame* pBodyIndexFrame = NULL;
+		IFrameDescription* pDescription = NULL;
+
+		hr = pFrame->get_DepthFrameReference(&pDepthReference);
+		if (SUCCEEDED(hr)) hr = pDepthReference->AcquireFrame(&pDepthFrame);
+		if (SUCCEEDED(hr)) hr = pFrame->get_BodyIndexFrameReference(&pBodyIndexReference);
+		if (SUCCEEDED(hr)) hr = pBodyIndexReference->AcquireFrame(&pBodyIndexFrame);
+
+		INT64 nTime = 0;
+		int width = 0, height = 0;
+		UINT depthCapacity = 0, indexCapacity = 0;
+		UINT16* depth = NULL;
+		BYTE* bodyIndex = NULL;
+		if (SUCCEEDED(hr)) hr = pDepthFrame->get_RelativeTime(&nTime);
+		if (SUCCEEDED(hr)) hr = pDepthFrame->get_FrameDescription(&pDescription);
+		if (SUCCEEDED(hr)) hr = pDescription->get_Width(&width);
+		if (SUCCEEDED(hr)) hr = pDescription->get_Height(&height);
+		if (SUCCEEDED(hr)) hr = pDepthFrame->AccessUnderlyingBuffer(&depthCapacity, &depth);
+		if (SUCCEEDED(hr)) hr = pBodyIndexFrame->AccessUnderlyingBuffer(&indexCapacity, &bodyIndex);
+
+		UINT pixels = (UINT)(width * height);
+		if (SUCCEEDED(hr) && depthCapacity >= pixels && indexCapacity >= pixels) {
+			if (!m_capture.isOpen() && !m_capture.open(m_capturePath, width, height)) {
+				KINECT_LOG(Warning, "Failed to open {}, depth won't be captured", m_capturePath);
+				SafeRelease(m_pCaptureReader);
 			}
 			else {
-				m_body_states[i] = CannotBeTracked;
+				OSVR_TimeValue timeValue = sensorTime(nTime);
+				m_capture.submit(timeValue.seconds * 1000000LL + timeValue.microseconds, depth, bodyIndex);
 			}
 		}
 
-		switch (candidates) {
-		case 0: // No bodies found
-			break;
-		case 1: // Only 1 candidate (lets still wait until confidence is good enough)
-		default: // Multiple possible bodies, choose based on last known position
-			double bestConfidence = 0.0;
-			for (int i = 0; i < BODY_COUNT; ++i) {
-				if (m_body_states[i] == CanBeTracked) {
-					if (confidence[i] > bestConfidence) {
-						bestConfidence = confidence[i];
-						m_trackedBody = i;
-						hr = ppBodies[i]->get_TrackingId(&m_trackingId);
-					}
-				}
-			}
-			if (bestConfidence > 0.75) {
-				for (int i = 0; i < BODY_COUNT; ++i) {
-					if (i == m_trackedBody) {
-						m_body_states[i] = ShouldBeTracked;
-					}
-					else if (m_body_states[i] == CanBeTracked) {
-						m_body_states[i] = ShouldNotBeTracked;
-					}
-				}
-			}
-			else {
-				m_trackedBody = m_trackingId = -1;
-			}
-			break;
-		}
+		SafeRelease(pDescription);
+		SafeRelease(pBodyIndexFrame);
+		SafeRelease(pBodyIndexReference);
+		SafeRelease(pDepthFrame);
+		SafeRelease(pDepthReference);
+		SafeRelease(pFrame);
 	}
 
+	void KinectV2Device::ProjectJoints(const SkeletonFrame& frame, const bool* bodies, FrameProjection& projection) {
+		// Gather every body's joints so the mapper is called once per image rather than once per body
+		UINT count = 0;
+		for (int b = 0; b < BODY_COUNT; ++b) {
+			if (!bodies[b]) continue;
+			const Skeleton& skeleton = frame.bodies[b];
+			for (int j = 0; j < JointType_Count; ++j, ++count) {
+				m_cameraPoints[count].X = skeleton.x[j];
+				m_cameraPoints[count].Y = skeleton.y[j];
+				m_cameraPoints[count].Z = skeleton.z[j];
+			}
+		}
+		if (count == 0) return;
 
-	bool KinectV2Device::Detect(IKinectSensor** ppKinectSensor) {
-
-		typedef HRESULT(_stdcall *GetDefaultKinectSensorType)(IKinectSensor**);
-		GetDefaultKinectSensorType GetDefaultKinectSensor;
-
-		HINSTANCE hinstLib = LoadLibrary(TEXT("Kinect20.dll"));
-		if (hinstLib != NULL)
-		{
-			GetDefaultKinectSensor = (GetDefaultKinectSensorType)GetProcAddress(hinstLib, "GetDefaultKinectSensor");
-
-			// If the function address is valid, call the function.
+		if (m_pCoordinateMapper == NULL ||
+			FAILED(m_pCoordinateMapper->MapCameraPointsToColorSpace(count, m_cameraPoints, count, m_colorPoints)) ||
+			FAILED(m_pCoordinateMapper->MapCameraPointsToDepthSpace(count, m_cameraPoints, count, m_depthPoints))) {
+			m_projector.project(frame, bodies, projection);
+			return;
+		}
 
-			if (GetDefaultKinectSensor != NULL)
-			{
-				HRESULT hr = GetDefaultKinectSensor(ppKinectSensor);
-				return SUCCEEDED(hr);
+		UINT point = 0;
+		for (int b = 0; b < BODY_COUNT; ++b) {
+			if (!bodies[b]) continue;
+			for (int j = 0; j < JointType_Count; ++j, ++point) {
+				projection.colorX[b][j] = m_colorPoints[point].X;
+				projection.colorY[b][j] = m_colorPoints[point].Y;
+				projection.depthX[b][j] = m_depthPoints[point].X;
+				projection.depthY[b][j] = m_depthPoints[point].Y;
+				// The mapper gives -infinity for joints it can't map, the descriptor's range has no room for that
+				keepInImage(projection.colorX[b][j], projection.colorY[b][j], KinectV2ColorCamera.width, KinectV2ColorCamera.height);
+				keepInImage(projection.depthX[b][j], projection.depthY[b][j], KinectV2DepthCamera.width, KinectV2DepthCamera.height);
 			}
 		}
+	}
 
-		return false;
-
+	// The detect callback runs on the server's thread, so loading the runtime and finding a sensor are left to the lifecycle
+	bool KinectV2Device::Detect() {
+		return kinectV2RuntimeInstalled();
 	};
 
 	KinectV2Device::~KinectV2Device() {
-		SafeRelease(m_pBodyFrameReader);
-		SafeRelease(m_pCoordinateMapper);
+		m_lifecycle.stop();
+		close();
+		saveSnapshot(true);
 
 		if (m_pKinectSensor)
 		{
 			m_pKinectSensor->Close();
 		}
 		SafeRelease(m_pKinectSensor);
+
+		if (m_capture.isOpen()) {
+			m_capture.close();
+			DepthCaptureWriter::Stats stats = m_capture.stats();
+			KINECT_LOG(Info, "Depth capture: {} images written to {}, {} dropped", stats.written, m_capturePath, stats.dropped);
+		}
 	};
 
 };
@@ -1,23 +1,35 @@
 #include "stdafx.h"
-#include <Kinect.h>
+#include "BodyIdentifier.h"
+#include "BoneSolver.h"
+#include "Config.h"
+#include "ControlQueue.h"
+#include "DepthCapture.h"
+#include "DepthHeadTracker.h"
+#include "JointProjection.h"
+#include "KinectV2Source.h"
+#include "OrientationClient.h"
+#include "SensorLifecycle.h"
+#include "SkeletonDevice.h"
+#include "WarmStart.h"
 
 namespace KinectOsvr {
-	class KinectV2Device {
+	class KinectV2Device : public SensorBackend {
 	public:
-		KinectV2Device(OSVR_PluginRegContext ctx, IKinectSensor* pKinectSensor);
+		KinectV2Device(OSVR_PluginRegContext ctx, WorkerPool& pool, const Config& config);
 		~KinectV2Device();
 
-		enum BodyTrackingState {
-			CannotBeTracked,
-			CanBeTracked,
-			ShouldNotBeTracked,
-			ShouldBeTracked
-		};
+		typedef BodyIdentifier::BodyTrackingState BodyTrackingState;
 
 		OSVR_ReturnCode update();
-		static bool Detect(IKinectSensor** ppKinectSensor);
+		static bool Detect();
+
+		bool load();
+		bool open();
+		bool isConnected();
+		void close();
 
 		BodyTrackingState *getBodyStates();
+		// Safe from any thread, applied before the next frame
 		void setTrackedBody(int i);
 		void recenter();
 
@@ -30,33 +42,53 @@ namespace KinectOsvr {
 		static void ui_thread(ui_thread_data& data);
 		static INT_PTR CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wParam, LPARAM lParam);
 	private:
-		void IdentifyBodies(IBody** ppBodies, OSVR_TimeValue* timeValue);
+		void applyCommands();
+		void restoreSnapshot();
+		void saveSnapshot(bool now);
 		void ProcessBody(IBody** ppBodies, OSVR_TimeValue* timeValue);
+		void ProcessAttached();
+		void ProjectJoints(const SkeletonFrame& frame, const bool* bodies, FrameProjection& projection);
+		void FollowHead(int trackedBody, const OSVR_TimeValue& timeValue);
+		void CaptureDepth();
+		OSVR_TimeValue sensorTime(INT64 relativeTime);
+
+		SkeletonDevice m_device;
+		SkeletonFrame m_frame;
+		BoneSolver m_solver;
+		BodyIdentifier m_identifier;
+		ControlQueue m_commands;
+		std::unique_ptr<OrientationClient> m_orientation;
+		WarmStart m_warmStart;
+		PinholeProjector m_projector;
+		CameraSpacePoint m_cameraPoints[BODY_COUNT * JointType_Count];
+		ColorSpacePoint m_colorPoints[BODY_COUNT * JointType_Count];
+		DepthSpacePoint m_depthPoints[BODY_COUNT * JointType_Count];
+
+		bool m_depthHead;
+		DepthHeadTracker m_headTracker;
 
-		osvr::pluginkit::DeviceToken m_dev;
-		OSVR_TrackerDeviceInterface m_tracker;
-		OSVR_AnalogDeviceInterface m_analog;
-		OSVR_ButtonDeviceInterface m_button;
+		std::string m_capturePath;
+		DepthCaptureWriter m_capture;
+
+		// Frames come from the daemon instead of the sensor, when attached
+		std::unique_ptr<AttachedSensor> m_attached;
+		SharedFrame m_shared;
+		BodyTrackingState m_attachedStates[MaxBodies];
 
 		IKinectSensor* m_pKinectSensor;
 		ICoordinateMapper*      m_pCoordinateMapper;
 		IBodyFrameReader*       m_pBodyFrameReader;
-
-		bool m_firstUpdate = true;
-		OSVR_PoseState m_offset;
-		OSVR_PoseState m_kinectPose;
+		IDepthFrameReader*      m_pDepthFrameReader;
+		IMultiSourceFrameReader* m_pCaptureReader;
 
 		OSVR_TimeValue m_initializeTime;
 		INT64 m_initializeOffset = 0;
 
-		BodyTrackingState m_body_states[BODY_COUNT];
-		UINT64 m_trackingId;
-		int m_trackedBody;
-		bool m_trackedBodyChanged;
-		CameraSpacePoint m_lastTrackedPosition;
-		OSVR_TimeValue m_lastTrackedTime;
 
 		std::thread *mThread;
 		ui_thread_data mThreadData;
+
+		SensorLifecycle m_lifecycle;
+		unsigned m_sensorGeneration;
 	};
 }
\ No newline at end of file
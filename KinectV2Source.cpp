@@ -0,0 +1,201 @@
+#include "KinectV2Source.h"
+#include "Log.h"
+
+namespace KinectOsvr {
+
+	GetDefaultKinectSensorType GetDefaultKinectSensor;
+
+	bool loadKinectV2Runtime() {
+		static bool loaded = []() {
+			HINSTANCE hinstLib = LoadLibrary(TEXT("Kinect20.dll"));
+			if (hinstLib == NULL) return false;
+
+			GetDefaultKinectSensor = (GetDefaultKinectSensorType)GetProcAddress(hinstLib, "GetDefaultKinectSensor");
+			return GetDefaultKinectSensor != NULL;
+		}();
+		return loaded;
+	}
+
+	bool kinectV2RuntimeInstalled() {
+		return SearchPath(NULL, TEXT("Kinect20.dll"), NULL, 0, NULL, NULL) > 0;
+	}
+
+	void readKinectV2Body(IBody* pBody, Skeleton& skeleton) {
+		BOOLEAN isTracked = false;
+		HRESULT hr = pBody->get_IsTracked(&isTracked);
+		if (FAILED(hr) || !isTracked) return;
+
+		HandState rightHandState = HandState_Unknown;
+		HandState leftHandState = HandState_Unknown;
+
+		pBody->get_TrackingId(&skeleton.trackingId);
+		pBody->get_HandRightState(&rightHandState);
+		pBody->get_HandLeftState(&leftHandState);
+
+		skeleton.handRight = (uint8_t)rightHandState;
+		skeleton.handLeft = (uint8_t)leftHandState;
+
+		// Hand states still go out if the joints can't be read
+		skeleton.tracking = BodyPositionOnly;
+
+		Joint joints[JointType_Count];
+		JointOrientation jointOrientations[JointType_Count];
+
+		hr = pBody->GetJoints(_countof(joints), joints);
+		HRESULT hr2 = pBody->GetJointOrientations(_countof(jointOrientations), jointOrientations);
+		if (FAILED(hr) || FAILED(hr2)) {
+			KINECT_LOG(Warning, "KinectV2: failed to read the joints of body {} (error {x})", skeleton.trackingId, (long)(FAILED(hr) ? hr : hr2));
+			return;
+		}
+
+		skeleton.tracking = BodyTracked;
+		for (int j = 0; j < JointType_Count; ++j)
+		{
+			skeleton.x[j] = joints[j].Position.X;
+			skeleton.y[j] = joints[j].Position.Y;
+			skeleton.z[j] = joints[j].Position.Z;
+
+			skeleton.qw[j] = jointOrientations[j].Orientation.w;
+			skeleton.qx[j] = jointOrientations[j].Orientation.x;
+			skeleton.qy[j] = jointOrientations[j].Orientation.y;
+			skeleton.qz[j] = jointOrientations[j].Orientation.z;
+
+			skeleton.jointTracking[j] = (uint8_t)joints[j].TrackingState;
+		}
+
+		skeleton.position[0] = joints[JointType_Head].Position.X;
+		skeleton.position[1] = joints[JointType_Head].Position.Y;
+		skeleton.position[2] = joints[JointType_Head].Position.Z;
+	}
+
+	KinectV2Source::KinectV2Source() : m_pKinectSensor(NULL), m_pBodyFrameReader(NULL), m_frameArrived(0), m_initializeOffset(0) {}
+
+	KinectV2Source::~KinectV2Source() {
+		close();
+		if (m_pKinectSensor) {
+			m_pKinectSensor->Close();
+		}
+		SafeRelease(m_pKinectSensor);
+	}
+
+	FrameSource* createKinectV2Source() {
+		return new KinectV2Source();
+	}
+
+	std::string KinectV2Source::name() const {
+		return "KinectV2";
+	}
+
+	int KinectV2Source::jointCount() const {
+		return KinectV2Layout.jointCount;
+	}
+
+	bool KinectV2Source::load() {
+		return loadKinectV2Runtime();
+	}
+
+	// Only the body stream, depth stays with plugins that open the sensor themselves
+	bool KinectV2Source::open() {
+		HRESULT hr;
+
+		// The sensor object stays open across unplugs, it's what reports availability
+		if (m_pKinectSensor == NULL) {
+			hr = GetDefaultKinectSensor(&m_pKinectSensor);
+			if (FAILED(hr)) return false;
+
+			hr = m_pKinectSensor->Open();
+			if (FAILED(hr)) {
+				KINECT_LOG(Error, "KinectV2: failed to open the sensor (error {})", (long)hr);
+				SafeRelease(m_pKinectSensor);
+				return false;
+			}
+		}
+		if (!isConnected()) return false;
+
+		IBodyFrameSource* pBodyFrameSource = NULL;
+		hr = m_pKinectSensor->get_BodyFrameSource(&pBodyFrameSource);
+		if (SUCCEEDED(hr)) hr = pBodyFrameSource->OpenReader(&m_pBodyFrameReader);
+		if (SUCCEEDED(hr)) hr = m_pBodyFrameReader->SubscribeFrameArrived(&m_frameArrived);
+		SafeRelease(pBodyFrameSource);
+
+		if (FAILED(hr)) {
+			close();
+			return false;
+		}
+
+		// Sensor timestamps restart after a reconnect
+		m_initializeOffset = 0;
+		return true;
+	}
+
+	bool KinectV2Source::isConnected() {
+		BOOLEAN available = false;
+		HRESULT hr = m_pKinectSensor->get_IsAvailable(&available);
+		return SUCCEEDED(hr) && available;
+	}
+
+	void KinectV2Source::close() {
+		if (m_pBodyFrameReader && m_frameArrived) {
+			m_pBodyFrameReader->UnsubscribeFrameArrived(m_frameArrived);
+		}
+		m_frameArrived = 0;
+		SafeRelease(m_pBodyFrameReader);
+	}
+
+	bool KinectV2Source::read(SkeletonFrame& frame, float floor[4], bool& hasFloor, int timeoutMilliseconds) {
+		if (WaitForSingleObject(reinterpret_cast<HANDLE>(m_frameArrived), (DWORD)timeoutMilliseconds) != WAIT_OBJECT_0) return false;
+
+		// Resets the event
+		IBodyFrameArrivedEventArgs* pArgs = NULL;
+		if (SUCCEEDED(m_pBodyFrameReader->GetFrameArrivedEventData(m_frameArrived, &pArgs))) SafeRelease(pArgs);
+
+		IBodyFrame* pBodyFrame = NULL;
+		HRESULT hr = m_pBodyFrameReader->AcquireLatestFrame(&pBodyFrame);
+		if (FAILED(hr)) {
+			if (hr != E_PENDING) KINECT_LOG(Warning, "KinectV2: failed to acquire a body frame (error {x})", (long)hr);
+			return false;
+		}
+
+		INT64 nTime = 0;
+		IBody* ppBodies[BODY_COUNT] = { 0 };
+		hr = pBodyFrame->get_RelativeTime(&nTime);
+		if (SUCCEEDED(hr)) hr = pBodyFrame->GetAndRefreshBodyData(_countof(ppBodies), ppBodies);
+
+		if (SUCCEEDED(hr)) {
+			// Sensor time in 100 ns ticks to server time, counting from when the first frame arrived
+			if (m_initializeOffset == 0) {
+				osvrTimeValueGetNow(&m_initializeTime);
+				m_initializeOffset = nTime;
+			}
+			INT64 elapsed = (nTime - m_initializeOffset) / 10;
+			OSVR_TimeValue timeValue;
+			timeValue.seconds = elapsed / 1000000;
+			timeValue.microseconds = elapsed % 1000000;
+			osvrTimeValueSum(&timeValue, &m_initializeTime);
+
+			clearFrame(frame, JointType_Count);
+			frame.timestamp = timeValue.seconds * 1000000LL + timeValue.microseconds;
+			for (int i = 0; i < BODY_COUNT; ++i) {
+				readKinectV2Body(ppBodies[i], frame.bodies[i]);
+			}
+
+			Vector4 plane;
+			hasFloor = SUCCEEDED(pBodyFrame->get_FloorClipPlane(&plane));
+			if (hasFloor) {
+				floor[0] = plane.x;
+				floor[1] = plane.y;
+				floor[2] = plane.z;
+				floor[3] = plane.w;
+			}
+		}
+		else {
+			KINECT_LOG(Warning, "KinectV2: failed to read the body frame (error {x})", (long)hr);
+		}
+
+		for (int i = 0; i < _countof(ppBodies); ++i) {
+			SafeRelease(ppBodies[i]);
+		}
+		SafeRelease(pBodyFrame);
+		return SUCCEEDED(hr);
+	}
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "stdafx.h"
+#include "SensorDaemon.h"
+#include <Kinect.h>
+
+namespace KinectOsvr {
+	typedef HRESULT(_stdcall *GetDefaultKinectSensorType)(IKinectSensor**);
+	extern GetDefaultKinectSensorType GetDefaultKinectSensor;
+
+	// Resolve the runtime entry point once, hardware detection runs repeatedly
+	bool loadKinectV2Runtime();
+
+	// Whether the runtime is installed, found on the DLL search path without loading it
+	bool kinectV2RuntimeInstalled();
+
+	// Leaves the skeleton as it was if the body isn't tracked
+	void readKinectV2Body(IBody* pBody, Skeleton& skeleton);
+
+	// The Kinect V2's bodies for the daemon
+	class KinectV2Source : public FrameSource {
+	public:
+		KinectV2Source();
+		~KinectV2Source();
+
+		std::string name() const;
+		int jointCount() const;
+
+		bool load();
+		bool open();
+		bool isConnected();
+		void close();
+
+		bool read(SkeletonFrame& frame, float floor[4], bool& hasFloor, int timeoutMilliseconds);
+
+	private:
+		IKinectSensor* m_pKinectSensor;
+		IBodyFrameReader* m_pBodyFrameReader;
+		WAITABLE_HANDLE m_frameArrived;
+
+		OSVR_TimeValue m_initializeTime;
+		INT64 m_initializeOffset;
+	};
+}
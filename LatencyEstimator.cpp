@@ -0,0 +1,369 @@
+#include "LatencyEstimator.h"
+#include "Trace.h"
+#include "WorkerPool.h"
+
+#include <Eigen/SVD>
+
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <complex>
+
+namespace KinectOsvr {
+
+	namespace {
+		typedef std::complex<double> Complex;
+
+		// Both trajectories are resampled onto a clock of this many steps a second, in microseconds each
+		const int64_t BinTime = 10000;
+		// Velocities are taken across this many steps either side, which also smooths the sensor's noise
+		const int DerivativeBins = 10;
+		// and their average across this many either side is taken away
+		const int HighPassBins = 250;
+		// Longer than this between samples and the trajectory isn't interpolated across, in microseconds
+		const int64_t MaxGap = 200000;
+		// Samples each producer can get ahead of the gathering thread by, a few seconds of an orientation tracker
+		// while a window's compared
+		const int RingCapacity = 4096;
+		// How long the gathering thread sleeps between looks, so adding never has to wake it
+		const int PollMilliseconds = 20;
+
+		void fft(std::vector<Complex>& data, bool inverse) {
+			size_t n = data.size();
+			for (size_t i = 1, j = 0; i < n; i++) {
+				size_t bit = n >> 1;
+				for (; j & bit; bit >>= 1) j ^= bit;
+				j ^= bit;
+				if (i < j) std::swap(data[i], data[j]);
+			}
+			for (size_t length = 2; length <= n; length <<= 1) {
+				double angle = (inverse ? 2 : -2) * M_PI / length;
+				Complex step(cos(angle), sin(angle));
+				for (size_t start = 0; start < n; start += length) {
+					Complex w(1, 0);
+					for (size_t k = 0; k < length / 2; k++) {
+						Complex a = data[start + k];
+						Complex b = data[start + k + length / 2] * w;
+						data[start + k] = a + b;
+						data[start + k + length / 2] = a - b;
+						w *= step;
+					}
+				}
+			}
+		}
+	}
+
+	LatencyParams::LatencyParams() : window(20.0), interval(2.0), memory(60.0), maxLatency(250.0), minConfidence(0.3), stableWindows(10), stableSpread(5.0) {}
+
+	LatencyEstimate::LatencyEstimate() : valid(false), latency(0), stable(false), stableLatency(0), confidence(0), timestamp(0), windows(0) {}
+
+	LatencyEstimator::SampleRing::SampleRing(int capacity) : m_written(0), m_read(0) {
+		uint64_t size = 1;
+		while (size < (uint64_t)capacity) size <<= 1;
+		m_slots.reset(new Sample[size]);
+		m_mask = size - 1;
+	}
+
+	bool LatencyEstimator::SampleRing::push(const Sample& sample) {
+		uint64_t written = m_written.load(std::memory_order_relaxed);
+		if (written - m_read.load(std::memory_order_acquire) > m_mask) return false;
+		m_slots[written & m_mask] = sample;
+		m_written.store(written + 1, std::memory_order_release);
+		return true;
+	}
+
+	template <typename Add>
+	void LatencyEstimator::SampleRing::take(Add add) {
+		uint64_t read = m_read.load(std::memory_order_relaxed);
+		uint64_t written = m_written.load(std::memory_order_acquire);
+		for (; read != written; read++) add(m_slots[read & m_mask]);
+		m_read.store(written, std::memory_order_release);
+	}
+
+	LatencyEstimator::LatencyEstimator(const LatencyParams& params, bool background)
+		: m_params(params), m_background(background), m_referenceRing(RingCapacity), m_measuredRing(RingCapacity), m_resets(0),
+		m_gathered(0), m_nextWindow(0), m_referenceEnergy(0), m_stopping(false) {
+		m_maxLag = std::max(1, (int)ceil(m_params.maxLatency * 1000.0 / BinTime));
+		m_bins = std::max(4 * (m_maxLag + HighPassBins), (int)(m_params.window * 1e6 / BinTime));
+		m_size = 1;
+		while (m_size < m_bins + m_maxLag) m_size <<= 1;
+
+		if (background) {
+			m_thread = std::thread(&LatencyEstimator::run, this);
+			lowerPriority(m_thread);
+		}
+	}
+
+	LatencyEstimator::~LatencyEstimator() {
+		if (m_thread.joinable()) {
+			m_stopping.store(true);
+			m_thread.join();
+		}
+	}
+
+	// Whatever's on its way is dropped along with the trajectories, when the gathering thread next looks
+	void LatencyEstimator::reset() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_estimate = LatencyEstimate();
+		m_run.clear();
+		m_resets.fetch_add(1, std::memory_order_release);
+	}
+
+	void LatencyEstimator::seed(double latency) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_estimate.latency = latency;
+		m_estimate.valid = true;
+		m_estimate.stable = true;
+		m_estimate.stableLatency = latency;
+	}
+
+	LatencyEstimate LatencyEstimator::estimate() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_estimate;
+	}
+
+	// A tracker running ahead of the gathering thread by more than a ring loses samples, which only leaves a gap
+	void LatencyEstimator::addReference(int64_t timestamp, const OSVR_Vec3& value) {
+		Sample sample = { timestamp, osvr::util::vecMap(value), false };
+		m_referenceRing.push(sample);
+		if (!m_background) update();
+	}
+
+	void LatencyEstimator::addMeasured(int64_t timestamp, const OSVR_Vec3& value, bool restart) {
+		Sample sample = { timestamp, osvr::util::vecMap(value), restart };
+		m_measuredRing.push(sample);
+		if (!m_background) update();
+	}
+
+	void LatencyEstimator::update() {
+		int generation = m_resets.load(std::memory_order_acquire);
+		bool stale = generation != m_gathered;
+		if (stale) {
+			m_gathered = generation;
+			m_reference.clear();
+			m_measured.clear();
+			m_nextWindow = 0;
+			m_covariance.clear();
+			m_compared.clear();
+			m_referenceEnergy = 0;
+		}
+		m_referenceRing.take([this, stale](const Sample& sample) {
+			if (!stale) append(m_reference, sample);
+		});
+		m_measuredRing.take([this, stale](const Sample& sample) {
+			if (!stale) append(m_measured, sample);
+		});
+
+		if (!due()) return;
+		int64_t end = std::min(m_reference.back().timestamp, m_measured.back().timestamp);
+		m_nextWindow = end + (int64_t)(m_params.interval * 1e6);
+		compare(end, generation);
+	}
+
+	void LatencyEstimator::append(Samples& samples, const Sample& sample) {
+		if (!samples.empty() && sample.timestamp <= samples.back().timestamp) return;
+
+		samples.push_back(sample);
+		// A second more than a window, so the window's start can still be interpolated after a late stream catches up
+		int64_t keep = m_bins * BinTime + 1000000;
+		while (samples.front().timestamp < sample.timestamp - keep) samples.pop_front();
+	}
+
+	// Once both trajectories cover a whole window, then every interval
+	bool LatencyEstimator::due() const {
+		if (m_reference.empty() || m_measured.empty()) return false;
+		int64_t start = std::max(m_reference.front().timestamp, m_measured.front().timestamp);
+		int64_t end = std::min(m_reference.back().timestamp, m_measured.back().timestamp);
+		return end - start >= m_bins * BinTime && end >= m_nextWindow;
+	}
+
+	void LatencyEstimator::run() {
+		Trace::setThreadName("latency estimator");
+		while (!m_stopping.load()) {
+			update();
+			std::this_thread::sleep_for(std::chrono::milliseconds(PollMilliseconds));
+		}
+	}
+
+	// The trajectory at each step from start, and which unbroken stretch of it each step falls in, -1 for none
+	void LatencyEstimator::resample(const Samples& samples, int64_t start, int bins, Vectors& values, std::vector<int>& stretches) {
+		values.assign(bins, Eigen::Vector3d::Zero());
+		stretches.assign(bins, -1);
+
+		std::vector<int> sampleStretch(samples.size(), 0);
+		for (size_t i = 1; i < samples.size(); i++) {
+			bool broken = samples[i].restart || samples[i].timestamp - samples[i - 1].timestamp > MaxGap;
+			sampleStretch[i] = sampleStretch[i - 1] + (broken ? 1 : 0);
+		}
+
+		size_t next = 0;
+		for (int b = 0; b < bins; b++) {
+			int64_t t = start + b * BinTime;
+			while (next < samples.size() && samples[next].timestamp <= t) next++;
+			if (next == 0) continue;
+
+			const Sample& before = samples[next - 1];
+			if (before.timestamp == t) {
+				values[b] = before.value;
+				stretches[b] = sampleStretch[next - 1];
+				continue;
+			}
+			if (next == samples.size() || sampleStretch[next] != sampleStretch[next - 1]) continue;
+
+			const Sample& after = samples[next];
+			double f = (double)(t - before.timestamp) / (double)(after.timestamp - before.timestamp);
+			values[b] = before.value + (after.value - before.value) * f;
+			stretches[b] = sampleStretch[next - 1];
+		}
+	}
+
+	// Velocity at each step, zero where it can't be told, less its average over the surrounding couple of seconds.
+	// Slow, sweeping movement could be lined up nearly as well by turning one trajectory a little as by shifting it
+	// in time, so only the quicker movements on top are compared. Gives the sum of squares.
+	double LatencyEstimator::velocities(const Vectors& values, const std::vector<int>& stretches, Vectors& velocity) {
+		int bins = (int)values.size();
+		Vectors raw(bins, Eigen::Vector3d::Zero());
+		std::vector<int> known(bins, 0);
+		double scale = 1e6 / (2 * DerivativeBins * BinTime);
+		for (int b = DerivativeBins; b < bins - DerivativeBins; b++) {
+			int from = stretches[b - DerivativeBins], to = stretches[b + DerivativeBins];
+			if (from < 0 || from != to) continue;
+			raw[b] = (values[b + DerivativeBins] - values[b - DerivativeBins]) * scale;
+			known[b] = 1;
+		}
+
+		Vectors sums(bins + 1, Eigen::Vector3d::Zero());
+		std::vector<int> counts(bins + 1, 0);
+		for (int b = 0; b < bins; b++) {
+			sums[b + 1] = sums[b] + raw[b];
+			counts[b + 1] = counts[b] + known[b];
+		}
+
+		velocity.assign(bins, Eigen::Vector3d::Zero());
+		double energy = 0;
+		for (int b = HighPassBins; b < bins - HighPassBins; b++) {
+			if (!known[b]) continue;
+			int count = counts[b + HighPassBins + 1] - counts[b - HighPassBins];
+			velocity[b] = raw[b] - (sums[b + HighPassBins + 1] - sums[b - HighPassBins]) / count;
+			energy += velocity[b].squaredNorm();
+		}
+		return energy;
+	}
+
+	void LatencyEstimator::compare(int64_t end, int generation) {
+		KINECT_TRACE("estimate latency");
+		int64_t start = end - (m_bins - 1) * BinTime;
+
+		Vectors values, referenceVelocity, measuredVelocity;
+		std::vector<int> stretches;
+		resample(m_reference, start, m_bins, values, stretches);
+		double referenceEnergy = velocities(values, stretches, referenceVelocity);
+		resample(m_measured, start, m_bins, values, stretches);
+		double measuredEnergy = velocities(values, stretches, measuredVelocity);
+
+		// The reference leaves out each end of the window so that, at every offset searched, all of it is compared
+		int margin = m_maxLag + HighPassBins;
+		referenceEnergy = 0;
+		for (int b = 0; b < m_bins; b++) {
+			if (b < margin || b >= m_bins - margin) referenceVelocity[b].setZero();
+			referenceEnergy += referenceVelocity[b].squaredNorm();
+		}
+		if (measuredEnergy <= 0) {
+			publish(end, 0, 0, false, generation);
+			return;
+		}
+		std::vector<double> measuredSums(m_bins + 1, 0.0);
+		for (int b = 0; b < m_bins; b++) measuredSums[b + 1] = measuredSums[b] + measuredVelocity[b].squaredNorm();
+
+		// Each axis of one against each axis of the other, at every offset
+		std::vector<Complex> referenceSpectra[3], measuredSpectra[3];
+		for (int axis = 0; axis < 3; axis++) {
+			referenceSpectra[axis].assign(m_size, Complex(0, 0));
+			measuredSpectra[axis].assign(m_size, Complex(0, 0));
+			for (int b = 0; b < m_bins; b++) {
+				referenceSpectra[axis][b] = referenceVelocity[b][axis];
+				measuredSpectra[axis][b] = measuredVelocity[b][axis];
+			}
+			fft(referenceSpectra[axis], false);
+			fft(measuredSpectra[axis], false);
+		}
+
+		int lags = 2 * m_maxLag + 1;
+		std::vector<Eigen::Matrix3d> covariance(lags);
+		std::vector<Complex> product(m_size);
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++) {
+				for (int k = 0; k < m_size; k++) product[k] = std::conj(referenceSpectra[i][k]) * measuredSpectra[j][k];
+				fft(product, true);
+				for (int lag = -m_maxLag; lag <= m_maxLag; lag++) {
+					covariance[lag + m_maxLag](i, j) = product[(lag + m_size) % m_size].real() / m_size;
+				}
+			}
+		}
+
+		// Windows are pooled, older ones counting for less, as the trackers' axes stay put between them
+		if (m_covariance.empty()) {
+			m_covariance.assign(lags, Eigen::Matrix3d::Zero());
+			m_compared.assign(lags, 0.0);
+			m_referenceEnergy = 0;
+		}
+		double decay = m_params.memory > 0 ? exp(-m_params.interval / m_params.memory) : 0.0;
+		m_referenceEnergy = m_referenceEnergy * decay + referenceEnergy;
+		for (int l = 0; l < lags; l++) {
+			int lag = l - m_maxLag;
+			m_covariance[l] = m_covariance[l] * decay + covariance[l];
+			m_compared[l] = m_compared[l] * decay + measuredSums[m_bins - margin + lag] - measuredSums[margin + lag];
+		}
+
+		// How well the velocities match at each offset under the best rotation between the trackers' axes, against
+		// the part of the measured trajectory compared there
+		std::vector<double> scores(lags, 0.0);
+		int best = 0;
+		for (int l = 0; l < lags; l++) {
+			if (m_compared[l] <= 0 || m_referenceEnergy <= 0) continue;
+
+			Eigen::JacobiSVD<Eigen::Matrix3d> svd(m_covariance[l]);
+			Eigen::Vector3d singular = svd.singularValues();
+			double sign = m_covariance[l].determinant() < 0 ? -1.0 : 1.0;
+			scores[l] = (singular[0] + singular[1] + sign * singular[2]) / sqrt(m_referenceEnergy * m_compared[l]);
+			if (scores[l] > scores[best]) best = l;
+		}
+
+		// A peak at the edge of the search is probably past it
+		double offset = best - m_maxLag;
+		bool inside = best > 0 && best < lags - 1;
+		if (inside) {
+			double before = scores[best - 1], peak = scores[best], after = scores[best + 1];
+			double curvature = before - 2 * peak + after;
+			if (curvature < 0) offset += 0.5 * (before - after) / curvature;
+		}
+		publish(end, offset * BinTime / 1000.0, std::max(0.0, std::min(1.0, scores[best])), inside, generation);
+	}
+
+	// Nothing from before a reset that came in while comparing
+	void LatencyEstimator::publish(int64_t end, double latency, double confidence, bool counts, int generation) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (generation != m_resets.load(std::memory_order_relaxed)) return;
+		m_estimate.timestamp = end;
+		m_estimate.windows++;
+		m_estimate.confidence = confidence;
+		if (!counts || confidence < m_params.minConfidence) {
+			m_run.clear();
+			return;
+		}
+
+		m_estimate.latency = latency;
+		m_estimate.valid = true;
+
+		// A confident window can still land on the wrong peak, only a run of them agreeing is corrected by
+		m_run.push_back(latency);
+		while ((int)m_run.size() > m_params.stableWindows) m_run.pop_front();
+		if ((int)m_run.size() < m_params.stableWindows) return;
+		double low = *std::min_element(m_run.begin(), m_run.end());
+		double high = *std::max_element(m_run.begin(), m_run.end());
+		if (high - low > m_params.stableSpread) return;
+		m_estimate.stable = true;
+		m_estimate.stableLatency = latency;
+	}
+}
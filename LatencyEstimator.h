@@ -0,0 +1,141 @@
+#pragma once
+
+#include <osvr/Util/Pose3C.h>
+#include <osvr/Util/EigenInterop.h>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace KinectOsvr {
+	struct LatencyParams {
+		LatencyParams();
+
+		// Seconds of both trajectories compared for each estimate, and between estimates
+		double window;
+		double interval;
+		// Seconds over which comparisons are pooled, steadier when longer but slower to follow a change
+		double memory;
+		// Largest latency searched for either way, in milliseconds
+		double maxLatency;
+		// How well the trajectories must match, from 0 to 1, for an estimate to count
+		double minConfidence;
+		// Estimates that count, in a row and within this many milliseconds of each other, before the latest is
+		// stable enough to correct by
+		int stableWindows;
+		double stableSpread;
+	};
+
+	struct LatencyEstimate {
+		LatencyEstimate();
+
+		// Whether any estimate has been confident enough to count
+		bool valid;
+		// How much later the measured trajectory's timestamps are than the reference's for the same movement, in
+		// milliseconds, as of the last estimate that counted
+		double latency;
+		// Whether some run of stableWindows estimates in a row has counted and agreed, and the last estimate of the
+		// latest such run
+		bool stable;
+		double stableLatency;
+		// How well the trajectories match in the pooled windows, from 0 to 1
+		double confidence;
+		// End of the latest window, and how many windows have been compared
+		int64_t timestamp;
+		int windows;
+	};
+
+	// Works out how late one tracker's timestamps are against another's, by where the two trajectories' velocities
+	// line up best. Each window is resampled onto a common clock and cross-correlated with FFTs, and the trackers
+	// may have their axes turned any way from each other: at each offset the velocities are matched under the best
+	// rotation between them. Trajectories can be positions or directions, such as which way is up for the head.
+	// Timestamps are microseconds, as for SkeletonFrame.
+	class LatencyEstimator {
+	public:
+		// With background set, samples are gathered and windows compared on a low-priority thread of the estimator's
+		// own, otherwise on the thread adding the sample that completes one, which is then the only one adding
+		explicit LatencyEstimator(const LatencyParams& params = LatencyParams(), bool background = true);
+		~LatencyEstimator();
+
+		// Any thread
+		void reset();
+		// Starts from a latency measured before, as after a restart, until an estimate here counts
+		void seed(double latency);
+
+		// Each from one thread at a time, such as the orientation tracker's and the frame's, without locking
+		void addReference(int64_t timestamp, const OSVR_Vec3& value);
+		// restart for a sample that isn't a continuation of the last, such as a different person's
+		void addMeasured(int64_t timestamp, const OSVR_Vec3& value, bool restart = false);
+
+		LatencyEstimate estimate() const;
+
+	private:
+		struct Sample {
+			int64_t timestamp;
+			Eigen::Vector3d value;
+			bool restart;
+		};
+		typedef std::deque<Sample> Samples;
+		typedef std::vector<Eigen::Vector3d> Vectors;
+
+		// Samples on their way from the one thread adding them to the one gathering them, so neither locks. The slot
+		// is written before the count that hands it over.
+		class SampleRing {
+		public:
+			explicit SampleRing(int capacity);
+
+			// False, dropping the sample, when the gathering thread is that far behind
+			bool push(const Sample& sample);
+			// Hands over everything pushed since the last time, oldest first
+			template <typename Add>
+			void take(Add add);
+
+		private:
+			std::unique_ptr<Sample[]> m_slots;
+			uint64_t m_mask;
+			std::atomic<uint64_t> m_written;
+			std::atomic<uint64_t> m_read;
+		};
+
+		static void resample(const Samples& samples, int64_t start, int bins, Vectors& values, std::vector<int>& stretches);
+		static double velocities(const Vectors& values, const std::vector<int>& stretches, Vectors& velocity);
+
+		// Gathers what's been added and compares a window if one's due, on one thread only
+		void update();
+		void append(Samples& samples, const Sample& sample);
+		bool due() const;
+		void run();
+		void compare(int64_t end, int generation);
+		void publish(int64_t end, double latency, double confidence, bool counts, int generation);
+
+		LatencyParams m_params;
+		int m_bins, m_size, m_maxLag;
+		bool m_background;
+
+		SampleRing m_referenceRing, m_measuredRing;
+		// Bumped by reset, and caught up with by the gathering thread when it next looks
+		std::atomic<int> m_resets;
+
+		mutable std::mutex m_mutex;
+		LatencyEstimate m_estimate;
+		// The estimates that have counted since the last one that didn't, up to stableWindows
+		std::deque<double> m_run;
+
+		// Owned by the gathering thread: the trajectories so far, when the next window's due, and the cross-covariance
+		// at each offset and what it's scaled against, pooled over windows
+		int m_gathered;
+		Samples m_reference, m_measured;
+		int64_t m_nextWindow;
+		std::vector<Eigen::Matrix3d> m_covariance;
+		std::vector<double> m_compared;
+		double m_referenceEnergy;
+
+		std::thread m_thread;
+		std::atomic<bool> m_stopping;
+	};
+}
@@ -0,0 +1,428 @@
+#include "Log.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace KinectOsvr {
+	namespace Log {
+
+		namespace {
+			// How long the logger sleeps when there's nothing to write, so posting never has to wake it
+			const int PollMilliseconds = 10;
+
+			struct Slot {
+				std::atomic<uint64_t> sequence;
+				Detail::Record record;
+			};
+
+			LogParams g_params;
+			int64_t g_window = (int64_t)(g_params.window * 1e9);
+
+			// A slot is free for position p when its sequence is p, and holds p's record when it's p + 1, as in
+			// ControlQueue
+			std::unique_ptr<Slot[]> g_slots;
+			uint64_t g_mask = 0;
+			std::atomic<uint64_t> g_tail(0);
+			uint64_t g_head = 0;
+
+			std::thread g_thread;
+			std::atomic<bool> g_stopping(false);
+			std::atomic<uint64_t> g_dropped(0);
+			uint64_t g_reportedDropped = 0;
+			int64_t g_droppedReportTime = 0;
+
+			// Held while writing, by the logger thread or by callers when it isn't running
+			std::mutex g_outputMutex;
+			FILE* g_file = NULL;
+			size_t g_fileBytes = 0;
+			std::vector<Site*> g_muted;
+			uint64_t g_written = 0;
+			uint64_t g_suppressed = 0;
+
+			// Everything before this position has been written, for flush
+			std::mutex g_doneMutex;
+			std::condition_variable g_doneChanged;
+			uint64_t g_done = 0;
+
+			std::atomic<int> g_threadCount(0);
+			thread_local int t_thread = 0;
+
+			int64_t steadyNow() {
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			}
+
+			// Steady timestamps to wall clock, for the lines
+			int64_t wallOffset() {
+				int64_t wall = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+				return wall - steadyNow();
+			}
+
+			const char* levelName(Level level) {
+				switch (level) {
+				case Info: return "info";
+				case Warning: return "warning";
+				case Error: return "error";
+				}
+				return "";
+			}
+
+			void appendTime(std::string& line, int64_t timestamp) {
+				int64_t wall = timestamp + wallOffset();
+				time_t seconds = (time_t)(wall / 1000000000);
+				struct tm local;
+#ifdef _WIN32
+				localtime_s(&local, &seconds);
+#else
+				localtime_r(&seconds, &local);
+#endif
+				char text[32];
+				size_t length = strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+				snprintf(text + length, sizeof(text) - length, ".%03d ", (int)(wall / 1000000 % 1000));
+				line += text;
+			}
+
+			// Integers in hex for {x}, as error codes read
+			void appendArgument(std::string& line, const Detail::Record& record, int i, bool hex) {
+				char text[32];
+				switch (record.types[i]) {
+				case Detail::Signed:
+					// A negative HRESULT shows as its 32 bits
+					if (hex && record.values[i].i >= INT32_MIN && record.values[i].i < 0) snprintf(text, sizeof(text), "0x%08x", (unsigned)(uint32_t)record.values[i].i);
+					else if (hex) snprintf(text, sizeof(text), "0x%08llx", (unsigned long long)record.values[i].i);
+					else snprintf(text, sizeof(text), "%lld", (long long)record.values[i].i);
+					break;
+				case Detail::Unsigned:
+					snprintf(text, sizeof(text), hex ? "0x%08llx" : "%llu", (unsigned long long)record.values[i].u);
+					break;
+				case Detail::Real:
+					snprintf(text, sizeof(text), "%g", record.values[i].d);
+					break;
+				case Detail::Text:
+					line.append(record.text + record.values[i].text.offset, record.values[i].text.length);
+					return;
+				}
+				line += text;
+			}
+
+			void format(std::string& line, const Detail::Record& record) {
+				line.clear();
+				appendTime(line, record.timestamp);
+				line += levelName(record.site->level);
+				char thread[16];
+				snprintf(thread, sizeof(thread), " [%d] ", record.thread);
+				line += thread;
+
+				int argument = 0;
+				for (const char* c = record.format; *c; c++) {
+					if (c[0] == '{' && c[1] == '}' && argument < record.count) {
+						appendArgument(line, record, argument++, false);
+						c++;
+					}
+					else if (c[0] == '{' && c[1] == 'x' && c[2] == '}' && argument < record.count) {
+						appendArgument(line, record, argument++, true);
+						c += 2;
+					}
+					else {
+						line += *c;
+					}
+				}
+				line += '\n';
+			}
+
+			void openFile() {
+				g_file = stdout;
+				g_fileBytes = 0;
+				if (g_params.path.empty()) return;
+
+				FILE* file = fopen(g_params.path.c_str(), "a");
+				if (file == NULL) {
+					fprintf(stderr, "Failed to open the log %s, logging to the console\n", g_params.path.c_str());
+					return;
+				}
+				fseek(file, 0, SEEK_END);
+				long size = ftell(file);
+				g_file = file;
+				g_fileBytes = size > 0 ? (size_t)size : 0;
+			}
+
+			void closeFile() {
+				if (g_file != NULL && g_file != stdout) fclose(g_file);
+				g_file = NULL;
+			}
+
+			// path.1 is the newest of the old files, path.<files> the oldest
+			void rotate() {
+				closeFile();
+				std::string oldest = g_params.path + "." + std::to_string(g_params.files);
+				remove(g_params.files > 0 ? oldest.c_str() : g_params.path.c_str());
+				for (int i = g_params.files - 1; i >= 0; i--) {
+					std::string from = i > 0 ? g_params.path + "." + std::to_string(i) : g_params.path;
+					rename(from.c_str(), (g_params.path + "." + std::to_string(i + 1)).c_str());
+				}
+				openFile();
+			}
+
+			void writeLine(const std::string& line) {
+				FILE* file = g_file != NULL ? g_file : stdout;
+				fwrite(line.data(), 1, line.size(), file);
+				g_written++;
+				if (file == stdout) return;
+
+				g_fileBytes += line.size();
+				if (g_fileBytes >= g_params.fileSize) rotate();
+			}
+
+			void writeSummary(Site& site, uint32_t count, int64_t now) {
+				Detail::Record record;
+				record.site = &site;
+				record.format = "{} more of \"{}\" in the last {} s";
+				record.timestamp = now;
+				record.thread = 0;
+				record.count = 0;
+				record.textUsed = 0;
+				Detail::add(record, count);
+				Detail::add(record, site.format != NULL ? site.format : "");
+				Detail::add(record, (now - site.windowStart) / 1e9);
+
+				std::string line;
+				format(line, record);
+				writeLine(line);
+				g_suppressed += count;
+			}
+
+			// Whether a record gets written, counting it against its site's window. With the logger running, a site
+			// over its limit is muted so its callers stop queueing.
+			bool admit(Site& site, int64_t timestamp, bool canMute) {
+				if (g_params.burst <= 0) return true;
+
+				// Queued before it was muted, its window is reopened by unmuteExpired
+				if (site.muted.load(std::memory_order_relaxed)) {
+					site.suppressed.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+
+				if (timestamp - site.windowStart >= g_window) {
+					uint32_t suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+					if (suppressed > 0) writeSummary(site, suppressed, timestamp);
+					site.windowStart = timestamp;
+					site.lines = 0;
+				}
+				if (site.lines < g_params.burst) {
+					site.lines++;
+					return true;
+				}
+
+				site.suppressed.fetch_add(1, std::memory_order_relaxed);
+				if (canMute && !site.muted.exchange(true, std::memory_order_relaxed)) g_muted.push_back(&site);
+				return false;
+			}
+
+			// Muted sites are looked at even when they've nothing queued, since muting stops them queueing
+			void unmuteExpired(int64_t now) {
+				for (size_t i = 0; i < g_muted.size();) {
+					Site& site = *g_muted[i];
+					if (now - site.windowStart < g_window) {
+						i++;
+						continue;
+					}
+					writeSummary(site, site.suppressed.exchange(0, std::memory_order_relaxed), now);
+					site.windowStart = now;
+					site.lines = 0;
+					site.muted.store(false, std::memory_order_relaxed);
+					g_muted[i] = g_muted.back();
+					g_muted.pop_back();
+				}
+			}
+
+			void reportDropped(int64_t now) {
+				uint64_t dropped = g_dropped.load(std::memory_order_relaxed);
+				if (dropped == g_reportedDropped || now - g_droppedReportTime < g_window) return;
+
+				static Site site(Warning);
+				Detail::Record record;
+				Detail::begin(record, site, "{} log records dropped, the queue was full");
+				Detail::add(record, dropped - g_reportedDropped);
+				std::string line;
+				format(line, record);
+				writeLine(line);
+				g_reportedDropped = dropped;
+				g_droppedReportTime = now;
+			}
+
+			// Writes everything published so far, returning how many records it took
+			size_t drain(std::string& line) {
+				size_t count = 0;
+				for (;;) {
+					Slot& slot = g_slots[g_head & g_mask];
+					if (slot.sequence.load(std::memory_order_acquire) != g_head + 1) break;
+
+					const Detail::Record& record = slot.record;
+					if (admit(*record.site, record.timestamp, true)) {
+						record.site->format = record.format;
+						format(line, record);
+						writeLine(line);
+					}
+					slot.sequence.store(g_head + g_mask + 1, std::memory_order_release);
+					g_head++;
+					count++;
+				}
+				return count;
+			}
+
+			void run() {
+				std::string line;
+				for (;;) {
+					bool stopping = g_stopping.load(std::memory_order_acquire);
+					size_t count;
+					{
+						std::lock_guard<std::mutex> lock(g_outputMutex);
+						count = drain(line);
+						int64_t now = steadyNow();
+						unmuteExpired(now);
+						reportDropped(now);
+						if (count > 0) fflush(g_file);
+					}
+					{
+						std::lock_guard<std::mutex> lock(g_doneMutex);
+						g_done = g_head;
+					}
+					g_doneChanged.notify_all();
+
+					if (stopping && count == 0) break;
+					if (count == 0) std::this_thread::sleep_for(std::chrono::milliseconds(PollMilliseconds));
+				}
+			}
+		}
+
+		namespace Detail {
+			std::atomic<bool> running(false);
+
+			Record* claim() {
+				uint64_t position = g_tail.load(std::memory_order_relaxed);
+				for (;;) {
+					Slot& slot = g_slots[position & g_mask];
+					uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+					int64_t lap = (int64_t)(sequence - position);
+
+					if (lap == 0) {
+						if (g_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+							slot.record.position = position;
+							return &slot.record;
+						}
+					}
+					else if (lap < 0) {
+						g_dropped.fetch_add(1, std::memory_order_relaxed);
+						return NULL;
+					}
+					else {
+						position = g_tail.load(std::memory_order_relaxed);
+					}
+				}
+			}
+
+			void publish(Record* record) {
+				g_slots[record->position & g_mask].sequence.store(record->position + 1, std::memory_order_release);
+			}
+
+			void begin(Record& record, Site& site, const char* format) {
+				if (t_thread == 0) t_thread = g_threadCount.fetch_add(1, std::memory_order_relaxed) + 1;
+				record.site = &site;
+				record.format = format;
+				record.timestamp = steadyNow();
+				record.thread = t_thread;
+				record.count = 0;
+				record.textUsed = 0;
+			}
+
+			void writeNow(Record& record) {
+				std::lock_guard<std::mutex> lock(g_outputMutex);
+				if (!admit(*record.site, record.timestamp, false)) return;
+				record.site->format = record.format;
+
+				std::string line;
+				format(line, record);
+				writeLine(line);
+				fflush(g_file != NULL ? g_file : stdout);
+			}
+		}
+
+		LogParams::LogParams() : fileSize(1 << 20), files(3), burst(10), window(10), capacity(1024) {}
+
+		void start(const LogParams& params) {
+			stop();
+
+			std::lock_guard<std::mutex> lock(g_outputMutex);
+			g_params = params;
+			g_window = (int64_t)(params.window * 1e9);
+
+			uint64_t size = 1;
+			while (size < (uint64_t)(params.capacity > 1 ? params.capacity : 1)) size <<= 1;
+			g_mask = size - 1;
+			g_slots.reset(new Slot[size]);
+			for (uint64_t i = 0; i < size; i++) {
+				g_slots[i].sequence.store(i, std::memory_order_relaxed);
+			}
+			g_tail.store(0, std::memory_order_relaxed);
+			g_head = 0;
+			g_done = 0;
+
+			openFile();
+			g_stopping.store(false, std::memory_order_relaxed);
+			g_thread = std::thread(run);
+			Detail::running.store(true, std::memory_order_release);
+		}
+
+		void stop() {
+			if (!Detail::running.exchange(false)) return;
+
+			// Whatever's posted from here on is written by its caller. A record claimed just before this may be
+			// published after the last drain and lost.
+			g_stopping.store(true, std::memory_order_release);
+			g_thread.join();
+
+			std::lock_guard<std::mutex> lock(g_outputMutex);
+			for (size_t i = 0; i < g_muted.size(); i++) {
+				g_muted[i]->muted.store(false, std::memory_order_relaxed);
+			}
+			g_muted.clear();
+			fflush(g_file);
+			closeFile();
+		}
+
+		void flush() {
+			if (!Detail::running.load(std::memory_order_acquire)) return;
+
+			uint64_t target = g_tail.load(std::memory_order_acquire);
+			std::unique_lock<std::mutex> lock(g_doneMutex);
+			g_doneChanged.wait(lock, [target]() { return g_done >= target || !Detail::running.load(std::memory_order_relaxed); });
+		}
+
+		Stats stats() {
+			Stats stats;
+			stats.posted = g_tail.load(std::memory_order_relaxed);
+			stats.dropped = g_dropped.load(std::memory_order_relaxed);
+			std::lock_guard<std::mutex> lock(g_outputMutex);
+			stats.written = g_written;
+			stats.suppressed = g_suppressed;
+			for (size_t i = 0; i < g_muted.size(); i++) {
+				stats.suppressed += g_muted[i]->suppressed.load(std::memory_order_relaxed);
+			}
+			return stats;
+		}
+
+		Session::Session(const LogParams& params) {
+			start(params);
+		}
+
+		Session::~Session() {
+			stop();
+		}
+	}
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Logs from any thread without formatting, locking or touching the disk there: KINECT_LOG(Warning, "lost body {}", i)
+// puts the format and a copy of the arguments on a queue, and the logger's own thread writes the line. Each {} is
+// replaced by the next argument, {x} by the next in hex. Every call site is rate-limited on its own, so one failing every frame can't
+// drown out the rest.
+#define KINECT_LOG(level, ...) do { \
+		static KinectOsvr::Log::Site kinectLogSite(KinectOsvr::Log::level); \
+		KinectOsvr::Log::post(kinectLogSite, __VA_ARGS__); \
+	} while (0)
+
+namespace KinectOsvr {
+	namespace Log {
+		enum Level {
+			Info,
+			Warning,
+			Error
+		};
+
+		struct LogParams {
+			LogParams();
+
+			// Empty for the console
+			std::string path;
+			// Bytes a file grows to before it's moved aside to path.1, and how many old files are kept
+			size_t fileSize;
+			int files;
+			// Lines each call site may write per window in seconds, the rest are counted and summed up after.
+			// 0 lines for no limit.
+			int burst;
+			double window;
+			// Records waiting to be written, beyond that they're dropped and counted
+			int capacity;
+		};
+
+		// Starts the logger's thread. Until it's started each call formats and prints its line straight away.
+		void start(const LogParams& params);
+
+		// Writes what's queued and stops the thread
+		void stop();
+
+		// Waits until everything queued before the call has been written
+		void flush();
+
+		struct Stats {
+			Stats() : posted(0), written(0), suppressed(0), dropped(0) {}
+
+			// Records queued, lines written, and records turned away by rate limits or a full queue
+			uint64_t posted, written, suppressed, dropped;
+		};
+		Stats stats();
+
+		// Logs for as long as it exists, for handing to registerObjectForDeletion
+		class Session {
+		public:
+			explicit Session(const LogParams& params);
+			~Session();
+		};
+
+		// One per KINECT_LOG. The logger mutes a site that's over its limit, after which calls only count themselves
+		// until the window is up.
+		struct Site {
+			explicit Site(Level level) : level(level), muted(false), suppressed(0), format(NULL), windowStart(0), lines(0) {}
+
+			const Level level;
+			std::atomic<bool> muted;
+			std::atomic<uint32_t> suppressed;
+
+			// Whoever's writing only
+			const char* format;
+			int64_t windowStart;
+			int lines;
+		};
+
+		namespace Detail {
+			const int MaxArguments = 6;
+			const int MaxText = 128;
+
+			enum Type : uint8_t {
+				Signed,
+				Unsigned,
+				Real,
+				Text
+			};
+
+			struct Record {
+				// Where it is in the queue
+				uint64_t position;
+				Site* site;
+				const char* format;
+				int64_t timestamp;
+				int thread;
+				uint8_t count;
+				uint8_t textUsed;
+				Type types[MaxArguments];
+				union {
+					int64_t i;
+					uint64_t u;
+					double d;
+					struct {
+						uint16_t offset;
+						uint16_t length;
+					} text;
+				} values[MaxArguments];
+				// Strings are copied, since they may be gone by the time they're written
+				char text[MaxText];
+			};
+
+			extern std::atomic<bool> running;
+
+			// A slot to fill in and publish, NULL when the queue is full
+			Record* claim();
+			void publish(Record* record);
+			// Without the logger running, the line is written by the caller
+			void writeNow(Record& record);
+			void begin(Record& record, Site& site, const char* format);
+
+			inline void addSigned(Record& record, int64_t value) {
+				record.types[record.count] = Signed;
+				record.values[record.count++].i = value;
+			}
+
+			inline void addUnsigned(Record& record, uint64_t value) {
+				record.types[record.count] = Unsigned;
+				record.values[record.count++].u = value;
+			}
+
+			inline void addReal(Record& record, double value) {
+				record.types[record.count] = Real;
+				record.values[record.count++].d = value;
+			}
+
+			// Truncated to what's left of the record's text
+			inline void addText(Record& record, const char* value, size_t length) {
+				size_t room = MaxText - record.textUsed;
+				if (length > room) length = room;
+				for (size_t i = 0; i < length; i++) record.text[record.textUsed + i] = value[i];
+				record.types[record.count] = Text;
+				record.values[record.count].text.offset = record.textUsed;
+				record.values[record.count++].text.length = (uint16_t)length;
+				record.textUsed = (uint8_t)(record.textUsed + length);
+			}
+
+			inline void add(Record& record, bool value) { addSigned(record, value); }
+			inline void add(Record& record, int value) { addSigned(record, value); }
+			inline void add(Record& record, long value) { addSigned(record, value); }
+			inline void add(Record& record, long long value) { addSigned(record, value); }
+			inline void add(Record& record, unsigned value) { addUnsigned(record, value); }
+			inline void add(Record& record, unsigned long value) { addUnsigned(record, value); }
+			inline void add(Record& record, unsigned long long value) { addUnsigned(record, value); }
+			inline void add(Record& record, float value) { addReal(record, value); }
+			inline void add(Record& record, double value) { addReal(record, value); }
+
+			inline void add(Record& record, const char* value) {
+				size_t length = 0;
+				while (value[length] != '\0' && length < MaxText) length++;
+				addText(record, value, length);
+			}
+
+			inline void add(Record& record, const std::string& value) { addText(record, value.data(), value.size()); }
+
+			inline void addAll(Record&) {}
+
+			template <typename First, typename... Rest>
+			inline void addAll(Record& record, const First& first, const Rest&... rest) {
+				add(record, first);
+				addAll(record, rest...);
+			}
+		}
+
+		template <typename... Args>
+		inline void post(Site& site, const char* format, const Args&... args) {
+			static_assert(sizeof...(Args) <= Detail::MaxArguments, "Too many arguments to log");
+
+			if (site.muted.load(std::memory_order_relaxed)) {
+				site.suppressed.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			if (!Detail::running.load(std::memory_order_acquire)) {
+				Detail::Record local;
+				Detail::begin(local, site, format);
+				Detail::addAll(local, args...);
+				Detail::writeNow(local);
+				return;
+			}
+
+			Detail::Record* record = Detail::claim();
+			if (record == NULL) return;
+			Detail::begin(*record, site, format);
+			Detail::addAll(*record, args...);
+			Detail::publish(record);
+		}
+	}
+}
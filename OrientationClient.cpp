@@ -0,0 +1,43 @@
+#include "OrientationClient.h"
+#include "Log.h"
+
+#include <osvr/ClientKit/InterfaceCallbackC.h>
+
+namespace KinectOsvr {
+
+	OrientationClient::OrientationClient(const std::string& path) : m_path(path), m_interface(NULL) {
+		m_context = osvrClientInit("je_nourish.kinect.fusion", 0);
+		if (m_context == NULL || osvrClientGetInterface(m_context, m_path.c_str(), &m_interface) != OSVR_RETURN_SUCCESS) {
+			KINECT_LOG(Warning, "Failed to follow {}, the head won't be fused", m_path);
+			m_interface = NULL;
+			return;
+		}
+		osvrRegisterOrientationCallback(m_interface, &OrientationClient::onOrientation, this);
+	}
+
+	OrientationClient::~OrientationClient() {
+		if (m_context != NULL) {
+			if (m_interface != NULL) osvrClientFreeInterface(m_context, m_interface);
+			osvrClientShutdown(m_context);
+		}
+	}
+
+	// Callbacks only arrive during osvrClientUpdate, on the calling thread
+	void OrientationClient::poll(const Callback& callback) {
+		if (m_interface == NULL) return;
+
+		m_samples.clear();
+		osvrClientUpdate(m_context);
+		for (size_t i = 0; i < m_samples.size(); i++) {
+			callback(m_samples[i].orientation, m_samples[i].timeValue);
+		}
+	}
+
+	void OSVR_CALLBACK OrientationClient::onOrientation(void* userdata, const OSVR_TimeValue* timestamp, const OSVR_OrientationReport* report) {
+		OrientationClient* client = static_cast<OrientationClient*>(userdata);
+		Sample sample;
+		sample.orientation = report->rotation;
+		sample.timeValue = *timestamp;
+		client->m_samples.push_back(sample);
+	}
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <osvr/ClientKit/ContextC.h>
+#include <osvr/ClientKit/InterfaceC.h>
+#include <osvr/Util/ClientReportTypesC.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace KinectOsvr {
+	// Follows another device's orientation through the server the plugin is loaded into, such as a HMD's
+	class OrientationClient {
+	public:
+		typedef std::function<void(const OSVR_Quaternion& orientation, const OSVR_TimeValue& timeValue)> Callback;
+
+		explicit OrientationClient(const std::string& path);
+		~OrientationClient();
+
+		// Hands over every orientation that's arrived since the last call, oldest first
+		void poll(const Callback& callback);
+
+	private:
+		struct Sample {
+			OSVR_Quaternion orientation;
+			OSVR_TimeValue timeValue;
+		};
+
+		static void OSVR_CALLBACK onOrientation(void* userdata, const OSVR_TimeValue* timestamp, const OSVR_OrientationReport* report);
+
+		std::string m_path;
+		OSVR_ClientContext m_context;
+		OSVR_ClientInterface m_interface;
+		std::vector<Sample> m_samples;
+	};
+}
@@ -0,0 +1,165 @@
+#include "PoseHistory.h"
+
+#include <Eigen/Geometry>
+
+#include <string.h>
+
+namespace KinectOsvr {
+
+	namespace {
+		void interpolate(const OSVR_PoseState& a, const OSVR_PoseState& b, double t, OSVR_PoseState& out) {
+			for (int i = 0; i < 3; i++) {
+				out.translation.data[i] = a.translation.data[i] + (b.translation.data[i] - a.translation.data[i]) * t;
+			}
+
+			Eigen::Quaterniond qa(osvrQuatGetW(&a.rotation), osvrQuatGetX(&a.rotation), osvrQuatGetY(&a.rotation), osvrQuatGetZ(&a.rotation));
+			Eigen::Quaterniond qb(osvrQuatGetW(&b.rotation), osvrQuatGetX(&b.rotation), osvrQuatGetY(&b.rotation), osvrQuatGetZ(&b.rotation));
+			Eigen::Quaterniond q = qa.slerp(t, qb);
+			osvrQuatSetW(&out.rotation, q.w());
+			osvrQuatSetX(&out.rotation, q.x());
+			osvrQuatSetY(&out.rotation, q.y());
+			osvrQuatSetZ(&out.rotation, q.z());
+		}
+	}
+
+	PoseHistory::PoseHistory(int jointCount, int capacity)
+		: m_jointCount(jointCount < MaxJoints ? jointCount : MaxJoints), m_capacity(capacity < 2 ? 2 : capacity), m_slots(new Slot[m_capacity]),
+		m_poses(m_capacity * m_jointCount), m_written(0), m_first(0), m_retries(0) {
+
+		for (int i = 0; i < m_capacity; i++) {
+			m_slots[i].sequence.store(0, std::memory_order_relaxed);
+			m_slots[i].timestamp.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	bool PoseHistory::push(int64_t timestamp, const OSVR_PoseState* poses) {
+		uint64_t index = m_written.load(std::memory_order_relaxed);
+		if (index > m_first.load(std::memory_order_relaxed) &&
+			timestamp <= m_slots[(index - 1) % m_capacity].timestamp.load(std::memory_order_relaxed)) {
+			return false;
+		}
+
+		Slot& slot = m_slots[index % m_capacity];
+		uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+		slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		slot.timestamp.store(timestamp, std::memory_order_relaxed);
+		memcpy(&m_poses[(index % m_capacity) * m_jointCount], poses, sizeof(OSVR_PoseState) * m_jointCount);
+
+		slot.sequence.store(sequence + 2, std::memory_order_release);
+		m_written.store(index + 1, std::memory_order_release);
+		return true;
+	}
+
+	void PoseHistory::restart() {
+		m_first.store(m_written.load(std::memory_order_relaxed), std::memory_order_release);
+	}
+
+	void PoseHistory::oldestIndex(uint64_t& begin, uint64_t& end) const {
+		// In this order so a restart in between can't put the start after the end
+		begin = m_first.load(std::memory_order_acquire);
+		end = m_written.load(std::memory_order_acquire);
+
+		// The slot after the newest may be mid-write, so it isn't counted
+		if (end - begin > (uint64_t)m_capacity - 1) {
+			begin = end - (m_capacity - 1);
+		}
+	}
+
+	bool PoseHistory::readSlot(uint64_t index, int firstJoint, int jointCount, int64_t& timestamp, OSVR_PoseState* poses) const {
+		const Slot& slot = m_slots[index % m_capacity];
+		uint32_t expected = (uint32_t)(2 * (index / m_capacity + 1));
+
+		if (slot.sequence.load(std::memory_order_acquire) != expected) return false;
+		timestamp = slot.timestamp.load(std::memory_order_relaxed);
+		if (poses) {
+			memcpy(poses, &m_poses[(index % m_capacity) * m_jointCount + firstJoint], sizeof(OSVR_PoseState) * jointCount);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return slot.sequence.load(std::memory_order_relaxed) == expected;
+	}
+
+	bool PoseHistory::sample(int64_t timestamp, int firstJoint, int jointCount, OSVR_PoseState* poses) const {
+		OSVR_PoseState before[MaxJoints];
+		OSVR_PoseState after[MaxJoints];
+
+		for (bool retry = false;; retry = true) {
+			if (retry) m_retries.fetch_add(1, std::memory_order_relaxed);
+			uint64_t begin, end;
+			oldestIndex(begin, end);
+			if (begin == end) return false;
+
+			// First pose at or after the time. Timestamps read here can be torn by the writer lapping
+			// the reader, which the slot reads below catch.
+			uint64_t low = begin, high = end;
+			while (low < high) {
+				uint64_t middle = low + (high - low) / 2;
+				if (m_slots[middle % m_capacity].timestamp.load(std::memory_order_relaxed) < timestamp) {
+					low = middle + 1;
+				} else {
+					high = middle;
+				}
+			}
+
+			int64_t beforeTime, afterTime;
+			if (low == end) {
+				// Past the newest, hold it
+				if (!readSlot(end - 1, firstJoint, jointCount, beforeTime, poses)) continue;
+				if (beforeTime >= timestamp) continue;
+				return true;
+			}
+
+			if (!readSlot(low, firstJoint, jointCount, afterTime, after)) continue;
+			if (afterTime < timestamp) continue;
+			if (afterTime == timestamp) {
+				memcpy(poses, after, sizeof(OSVR_PoseState) * jointCount);
+				return true;
+			}
+
+			// Before the oldest
+			if (low == begin) return false;
+
+			if (!readSlot(low - 1, firstJoint, jointCount, beforeTime, before)) continue;
+			if (beforeTime >= timestamp) continue;
+
+			double t = (double)(timestamp - beforeTime) / (double)(afterTime - beforeTime);
+			for (int j = 0; j < jointCount; j++) {
+				interpolate(before[j], after[j], t, poses[j]);
+			}
+			return true;
+		}
+	}
+
+	bool PoseHistory::sample(int64_t timestamp, int joint, OSVR_PoseState& pose) const {
+		if (joint < 0 || joint >= m_jointCount) return false;
+		return sample(timestamp, joint, 1, &pose);
+	}
+
+	bool PoseHistory::sample(int64_t timestamp, OSVR_PoseState* poses) const {
+		return sample(timestamp, 0, m_jointCount, poses);
+	}
+
+	bool PoseHistory::range(int64_t& oldest, int64_t& newest) const {
+		for (bool retry = false;; retry = true) {
+			if (retry) m_retries.fetch_add(1, std::memory_order_relaxed);
+			uint64_t begin, end;
+			oldestIndex(begin, end);
+			if (begin == end) return false;
+
+			if (readSlot(begin, 0, 0, oldest, NULL) && readSlot(end - 1, 0, 0, newest, NULL)) return true;
+		}
+	}
+
+	int PoseHistory::jointCount() const {
+		return m_jointCount;
+	}
+
+	int PoseHistory::capacity() const {
+		return m_capacity;
+	}
+
+	uint64_t PoseHistory::retries() const {
+		return m_retries.load(std::memory_order_relaxed);
+	}
+};
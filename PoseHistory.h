@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Skeleton.h"
+
+#include <osvr/Util/Pose3C.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace KinectOsvr {
+	// The last few seconds of reported poses, for consumers that need a pose as of some other time than the
+	// frame's. One thread pushes, any number sample without locks: each slot is a seqlock, and readers retry
+	// the rare lookup that overlaps the slot being overwritten.
+	class PoseHistory {
+	public:
+		// Over four seconds at the Kinect's 30 Hz
+		static const int DefaultCapacity = 128;
+
+		explicit PoseHistory(int jointCount, int capacity = DefaultCapacity);
+
+		// Writer only. Timestamps are in microseconds and must increase, older ones are ignored.
+		bool push(int64_t timestamp, const OSVR_PoseState* poses);
+
+		// Writer only. Forgets every earlier pose, for when what's reported jumps (a different body, a recenter).
+		void restart();
+
+		// Interpolates between the poses either side of the time, or holds the newest one past it.
+		// False if nothing is recorded at or before the time.
+		bool sample(int64_t timestamp, int joint, OSVR_PoseState& pose) const;
+		bool sample(int64_t timestamp, OSVR_PoseState* poses) const;
+
+		// Times covered, false when empty
+		bool range(int64_t& oldest, int64_t& newest) const;
+
+		int jointCount() const;
+		int capacity() const;
+
+		// Lookups started over after overlapping a write
+		uint64_t retries() const;
+
+	private:
+		struct Slot {
+			// Even when stable, 2 * (how many times the slot has been written)
+			std::atomic<uint32_t> sequence;
+			std::atomic<int64_t> timestamp;
+		};
+
+		bool sample(int64_t timestamp, int firstJoint, int jointCount, OSVR_PoseState* poses) const;
+		bool readSlot(uint64_t index, int firstJoint, int jointCount, int64_t& timestamp, OSVR_PoseState* poses) const;
+		void oldestIndex(uint64_t& begin, uint64_t& end) const;
+
+		int m_jointCount;
+		int m_capacity;
+		std::unique_ptr<Slot[]> m_slots;
+		std::vector<OSVR_PoseState> m_poses;
+
+		// Pushes so far, and the first since the last restart
+		std::atomic<uint64_t> m_written;
+		std::atomic<uint64_t> m_first;
+
+		mutable std::atomic<uint64_t> m_retries;
+	};
+}
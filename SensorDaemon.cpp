@@ -0,0 +1,196 @@
+#include "SensorDaemon.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <osvr/Util/TimeValueC.h>
+
+#include <algorithm>
+
+namespace KinectOsvr {
+
+	namespace {
+		// How long the daemon's thread waits on the sensor before looking at commands and the heartbeat again
+		const int ReadTimeout = 20;
+		const int IdleSleep = 10;
+
+		// The synthetic people's feet are this far below the sensor
+		const float FakeFloor[4] = { 0.0f, 1.0f, 0.0f, 0.83f };
+	}
+
+	FakeSensor::FakeSensor(const SyntheticSource::Options& options, int openMilliseconds)
+		: m_source(options), m_jointCount(options.jointCount), m_openMilliseconds(openMilliseconds), m_connected(false) {
+		m_framePeriod = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / options.frameRate));
+	}
+
+	std::string FakeSensor::name() const {
+		return m_jointCount == KinectV1Layout.jointCount ? "KinectV1" : "KinectV2";
+	}
+
+	int FakeSensor::jointCount() const {
+		return m_jointCount;
+	}
+
+	bool FakeSensor::load() {
+		return true;
+	}
+
+	bool FakeSensor::open() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(m_openMilliseconds));
+		m_connected.store(true);
+		m_nextFrame = Clock::now() + m_framePeriod;
+		return true;
+	}
+
+	bool FakeSensor::isConnected() {
+		return m_connected.load();
+	}
+
+	void FakeSensor::close() {}
+
+	bool FakeSensor::read(SkeletonFrame& frame, float floor[4], bool& hasFloor, int timeoutMilliseconds) {
+		if (!m_connected.load()) return false;
+
+		Clock::time_point now = Clock::now();
+		if (m_nextFrame - now > std::chrono::milliseconds(timeoutMilliseconds)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMilliseconds));
+			return false;
+		}
+		std::this_thread::sleep_until(m_nextFrame);
+		// Falls behind rather than bursting to catch up, as a sensor that's been kept waiting does
+		m_nextFrame = std::max(m_nextFrame + m_framePeriod, Clock::now());
+
+		m_source.next(frame);
+		OSVR_TimeValue timeValue;
+		osvrTimeValueGetNow(&timeValue);
+		frame.timestamp = timeValue.seconds * 1000000LL + timeValue.microseconds;
+		for (int i = 0; i < 4; i++) floor[i] = FakeFloor[i];
+		hasFloor = true;
+		return true;
+	}
+
+	void FakeSensor::setConnected(bool connected) {
+		m_connected.store(connected);
+	}
+
+	SensorDaemon::SensorDaemon(FrameSource& source, const TrackingParams& tracking)
+		: m_source(source), m_identifier(tracking), m_lifecycle(source), m_stop(false), m_published(0), m_commands(0) {}
+
+	SensorDaemon::~SensorDaemon() {
+		stop();
+	}
+
+	bool SensorDaemon::start() {
+		if (m_thread.joinable()) return true;
+		if (!m_publisher.create(m_source.name(), m_source.jointCount())) return false;
+
+		m_stop.store(false);
+		m_lifecycle.start();
+		m_thread = std::thread(&SensorDaemon::run, this);
+		return true;
+	}
+
+	void SensorDaemon::stop() {
+		m_stop.store(true);
+		if (m_thread.joinable()) m_thread.join();
+		m_lifecycle.stop();
+
+		if (m_publisher.isOpen()) {
+			m_publisher.setSensor(SensorLifecycle::Stopped, m_lifecycle.generation());
+			m_publisher.close();
+		}
+	}
+
+	SensorLifecycle::State SensorDaemon::state() const {
+		return m_lifecycle.state();
+	}
+
+	SensorDaemon::Stats SensorDaemon::stats() const {
+		Stats stats;
+		stats.published = m_published.load(std::memory_order_relaxed);
+		stats.commands = m_commands.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	void SensorDaemon::run() {
+		Trace::setThreadName("daemon");
+
+		while (!m_stop.load(std::memory_order_relaxed)) {
+			// Kept up while the sensor is opening too, so plugins can tell a slow sensor from a dead daemon
+			m_publisher.heartbeat();
+
+			std::unique_lock<std::mutex> lock(m_lifecycle.sensorMutex(), std::try_to_lock);
+			SensorLifecycle::State state = m_lifecycle.state();
+			m_publisher.setSensor(state, m_lifecycle.generation());
+			if (!lock.owns_lock() || state != SensorLifecycle::Ready) {
+				if (lock.owns_lock()) lock.unlock();
+				std::this_thread::sleep_for(std::chrono::milliseconds(IdleSleep));
+				continue;
+			}
+
+			applyCommands();
+
+			float floor[4];
+			bool hasFloor = false;
+			if (!m_source.read(m_frame, floor, hasFloor, ReadTimeout)) continue;
+
+			int trackedBody;
+			{
+				KINECT_TRACE("identify bodies");
+				trackedBody = m_identifier.identify(m_frame);
+			}
+			m_publisher.publish(m_frame, trackedBody, hasFloor ? floor : NULL);
+			m_publisher.setBodyStates(m_identifier.getBodyStates());
+			m_published.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	// Called with the sensor mutex held, between frames. Recentering stays with each plugin's device.
+	void SensorDaemon::applyCommands() {
+		ControlCommand command;
+		while (m_publisher.pop(command)) {
+			m_commands.fetch_add(1, std::memory_order_relaxed);
+			switch (command.type) {
+			case ControlCommand::SetTrackedBody:
+				if (command.body >= 0 && command.body < MaxBodies) m_identifier.setTrackedBody(command.body);
+				break;
+			case ControlCommand::ToggleSeatedMode:
+				m_source.toggleSeatedMode();
+				break;
+			default:
+				KINECT_LOG(Warning, "Daemon: ignoring command {} from a plugin", (int)command.type);
+				break;
+			}
+		}
+	}
+
+	AttachedSensor::AttachedSensor(const std::string& name, int jointCount) : m_name(name), m_jointCount(jointCount) {}
+
+	bool AttachedSensor::load() {
+		return true;
+	}
+
+	// Each attempt is a few system calls, retried at the lifecycle's pace until the daemon's running
+	bool AttachedSensor::open() {
+		if (!m_subscriber.attach(m_name, m_jointCount)) return false;
+		if (m_subscriber.alive() && m_subscriber.sensorState() == SensorLifecycle::Ready) return true;
+
+		m_subscriber.detach();
+		return false;
+	}
+
+	bool AttachedSensor::isConnected() {
+		return m_subscriber.alive() && m_subscriber.sensorState() == SensorLifecycle::Ready;
+	}
+
+	void AttachedSensor::close() {
+		m_subscriber.detach();
+	}
+
+	FrameSubscriber& AttachedSensor::subscriber() {
+		return m_subscriber;
+	}
+
+	bool AttachedSensor::send(const ControlCommand& command) {
+		return m_subscriber.isAttached() && m_subscriber.send(command);
+	}
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "BodyIdentifier.h"
+#include "FrameShare.h"
+#include "SensorLifecycle.h"
+#include "SyntheticSource.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace KinectOsvr {
+	// A sensor as the daemon drives it: the lifecycle opens and closes it, the daemon's thread reads it
+	class FrameSource : public SensorBackend {
+	public:
+		// What plugins attach to it by, KinectV1 or KinectV2
+		virtual std::string name() const = 0;
+		virtual int jointCount() const = 0;
+
+		// Waits up to timeoutMilliseconds for the next frame, with timestamps in server time. hasFloor says whether
+		// floor was filled in.
+		virtual bool read(SkeletonFrame& frame, float floor[4], bool& hasFloor, int timeoutMilliseconds) = 0;
+
+		virtual void toggleSeatedMode() {}
+	};
+
+	// Synthetic people on a sensor that takes a while to open, as a real one does, and runs at its frame rate
+	class FakeSensor : public FrameSource {
+	public:
+		FakeSensor(const SyntheticSource::Options& options, int openMilliseconds = 2000);
+
+		std::string name() const;
+		int jointCount() const;
+
+		bool load();
+		bool open();
+		bool isConnected();
+		void close();
+
+		bool read(SkeletonFrame& frame, float floor[4], bool& hasFloor, int timeoutMilliseconds);
+
+		// Any thread, as if the cable were pulled or put back
+		void setConnected(bool connected);
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		SyntheticSource m_source;
+		int m_jointCount;
+		Clock::duration m_framePeriod;
+		int m_openMilliseconds;
+		Clock::time_point m_nextFrame;
+		std::atomic<bool> m_connected;
+	};
+
+	// Owns a sensor for as long as it runs, so servers can come and go without it starting over: opens it in the
+	// background, picks out the tracked body and publishes every frame for plugins to attach to
+	class SensorDaemon {
+	public:
+		struct Stats {
+			Stats() : published(0), commands(0) {}
+
+			uint64_t published, commands;
+		};
+
+		SensorDaemon(FrameSource& source, const TrackingParams& tracking);
+		~SensorDaemon();
+
+		// False if the shared memory can't be created, or another daemon already has the sensor
+		bool start();
+		void stop();
+
+		SensorLifecycle::State state() const;
+		Stats stats() const;
+
+	private:
+		void run();
+		void applyCommands();
+
+		FrameSource& m_source;
+		BodyIdentifier m_identifier;
+		SensorLifecycle m_lifecycle;
+		FramePublisher m_publisher;
+		SkeletonFrame m_frame;
+
+		std::thread m_thread;
+		std::atomic<bool> m_stop;
+		std::atomic<uint64_t> m_published, m_commands;
+	};
+
+	// The plugin's side, standing in for the sensor: opening it attaches to the daemon, and it stays connected for
+	// as long as the daemon's alive and has its sensor open
+	class AttachedSensor : public SensorBackend {
+	public:
+		AttachedSensor(const std::string& name, int jointCount);
+
+		bool load();
+		bool open();
+		bool isConnected();
+		void close();
+
+		// Update thread only, while the lifecycle says Ready
+		FrameSubscriber& subscriber();
+		// Update thread only, dropped while detached
+		bool send(const ControlCommand& command);
+
+	private:
+		std::string m_name;
+		int m_jointCount;
+		FrameSubscriber m_subscriber;
+	};
+}
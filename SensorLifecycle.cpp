@@ -0,0 +1,88 @@
+#include "SensorLifecycle.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace KinectOsvr {
+
+	SensorLifecycle::SensorLifecycle(SensorBackend& backend, int pollMilliseconds, int maxRetryMilliseconds)
+		: m_backend(backend), m_pollMilliseconds(pollMilliseconds), m_maxRetryMilliseconds(std::max(pollMilliseconds, maxRetryMilliseconds)),
+		m_state(Loading), m_generation(0), m_stop(false) {}
+
+	SensorLifecycle::~SensorLifecycle() {
+		stop();
+	}
+
+	void SensorLifecycle::start() {
+		if (!m_thread.joinable()) {
+			m_thread = std::thread(&SensorLifecycle::run, this);
+		}
+	}
+
+	void SensorLifecycle::stop() {
+		{
+			std::lock_guard<std::mutex> lock(m_stopMutex);
+			m_stop = true;
+		}
+		m_stopCondition.notify_all();
+
+		if (m_thread.joinable()) {
+			m_thread.join();
+		}
+	}
+
+	SensorLifecycle::State SensorLifecycle::state() const {
+		return (State)m_state.load(std::memory_order_acquire);
+	}
+
+	unsigned SensorLifecycle::generation() const {
+		return m_generation.load(std::memory_order_acquire);
+	}
+
+	std::mutex& SensorLifecycle::sensorMutex() {
+		return m_sensorMutex;
+	}
+
+	bool SensorLifecycle::sleep(int milliseconds) {
+		std::unique_lock<std::mutex> lock(m_stopMutex);
+		return !m_stopCondition.wait_for(lock, std::chrono::milliseconds(milliseconds), [this]() { return m_stop; });
+	}
+
+	void SensorLifecycle::run() {
+		if (!m_backend.load()) {
+			m_state.store(Unavailable, std::memory_order_release);
+			return;
+		}
+		m_state.store(Searching, std::memory_order_release);
+
+		// No sensor plugged in can mean a while without one, there's no need to keep asking every poll
+		int wait = m_pollMilliseconds;
+		int retry = m_pollMilliseconds;
+		do {
+			if (state() == Searching) {
+				std::lock_guard<std::mutex> lock(m_sensorMutex);
+				if (m_backend.open()) {
+					m_generation.fetch_add(1, std::memory_order_release);
+					m_state.store(Ready, std::memory_order_release);
+					wait = retry = m_pollMilliseconds;
+				}
+				else {
+					wait = retry;
+					retry = std::min(retry * 2, m_maxRetryMilliseconds);
+				}
+			}
+			else if (!m_backend.isConnected()) {
+				// Unplugged, tear down the streams and go back to looking for it
+				std::lock_guard<std::mutex> lock(m_sensorMutex);
+				m_state.store(Searching, std::memory_order_release);
+				m_backend.close();
+			}
+		} while (sleep(wait));
+
+		std::lock_guard<std::mutex> lock(m_sensorMutex);
+		if (state() == Ready) {
+			m_backend.close();
+		}
+		m_state.store(Stopped, std::memory_order_release);
+	}
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace KinectOsvr {
+	// Sensor operations the lifecycle drives from its background thread
+	class SensorBackend {
+	public:
+		virtual ~SensorBackend() {}
+
+		// Load the runtime and resolve entry points, called once
+		virtual bool load() = 0;
+		// Find a sensor and start its streams, may block while the sensor warms up
+		virtual bool open() = 0;
+		virtual bool isConnected() = 0;
+		// Stop streams after a disconnect or on shutdown
+		virtual void close() = 0;
+	};
+
+	class SensorLifecycle {
+	public:
+		enum State {
+			Loading,
+			Searching,
+			Ready,
+			Unavailable,
+			Stopped
+		};
+
+		// Failed opens are retried after pollMilliseconds, then twice as long each time up to maxRetryMilliseconds
+		explicit SensorLifecycle(SensorBackend& backend, int pollMilliseconds = 500, int maxRetryMilliseconds = 4000);
+		~SensorLifecycle();
+
+		void start();
+		void stop();
+
+		State state() const;
+		// Bumped every time the sensor is (re)opened, so users can resync clocks after a reconnect
+		unsigned generation() const;
+
+		// Held by the update thread while it touches the sensor, transitions wait for it
+		std::mutex& sensorMutex();
+
+	private:
+		void run();
+		bool sleep(int milliseconds);
+
+		SensorBackend& m_backend;
+		int m_pollMilliseconds;
+		int m_maxRetryMilliseconds;
+
+		std::atomic<int> m_state;
+		std::atomic<unsigned> m_generation;
+		std::mutex m_sensorMutex;
+
+		std::thread m_thread;
+		std::mutex m_stopMutex;
+		std::condition_variable m_stopCondition;
+		bool m_stop;
+	};
+}
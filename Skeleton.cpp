@@ -0,0 +1,44 @@
+#include "Skeleton.h"
+
+#include <string.h>
+
+namespace KinectOsvr {
+
+	const SkeletonLayout KinectV1Layout = {
+		V1Joint::Count,
+		V1Joint::Head,
+		V1Joint::Head,
+		V1Joint::HandLeft,
+		V1Joint::HandRight,
+		V1Joint::Count,
+		V1Joint::Count + 1,
+		0,
+		-1,
+		8,
+		V1Joint::Count
+	};
+
+	const SkeletonLayout KinectV2Layout = {
+		V2Joint::Count,
+		V2Joint::Head,
+		V2Joint::Neck,
+		V2Joint::HandLeft,
+		V2Joint::HandRight,
+		V2Joint::Count,
+		V2Joint::Count + 1,
+		6,
+		V2Joint::Count,
+		8,
+		V2Joint::Count * 5
+	};
+
+	void clearFrame(SkeletonFrame& frame, int jointCount) {
+		memset(&frame, 0, sizeof(frame));
+		frame.jointCount = jointCount;
+		for (int b = 0; b < MaxBodies; b++) {
+			for (int j = 0; j < MaxJoints; j++) {
+				frame.bodies[b].qw[j] = 1;
+			}
+		}
+	}
+};
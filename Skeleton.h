@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace KinectOsvr {
+	const int MaxBodies = 6;
+	const int MaxJoints = 25;
+
+	// Joint indices follow NUI_SKELETON_POSITION_INDEX
+	namespace V1Joint {
+		enum Type {
+			HipCenter, Spine, ShoulderCenter, Head,
+			ShoulderLeft, ElbowLeft, WristLeft, HandLeft,
+			ShoulderRight, ElbowRight, WristRight, HandRight,
+			HipLeft, KneeLeft, AnkleLeft, FootLeft,
+			HipRight, KneeRight, AnkleRight, FootRight,
+			Count
+		};
+	}
+
+	// Joint indices follow JointType
+	namespace V2Joint {
+		enum Type {
+			SpineBase, SpineMid, Neck, Head,
+			ShoulderLeft, ElbowLeft, WristLeft, HandLeft,
+			ShoulderRight, ElbowRight, WristRight, HandRight,
+			HipLeft, KneeLeft, AnkleLeft, FootLeft,
+			HipRight, KneeRight, AnkleRight, FootRight,
+			SpineShoulder, HandTipLeft, ThumbLeft, HandTipRight, ThumbRight,
+			Count
+		};
+	}
+
+	// Same values as the SDK tracking states
+	enum JointTracking {
+		JointNotTracked,
+		JointInferred,
+		JointTracked
+	};
+
+	enum BodyTracking {
+		BodyNotTracked,
+		BodyPositionOnly,
+		BodyTracked
+	};
+
+	// Same values as the V2 HandState
+	enum HandTracking {
+		HandUnknown,
+		HandNotTracked,
+		HandOpen,
+		HandClosed,
+		HandLasso
+	};
+
+	// One body, stored as structure-of-arrays so per-joint loops vectorize
+	struct Skeleton {
+		uint64_t trackingId;
+		BodyTracking tracking;
+		// Where the body is as a whole, used to tell bodies apart
+		float position[3];
+
+		float x[MaxJoints], y[MaxJoints], z[MaxJoints];
+		float qw[MaxJoints], qx[MaxJoints], qy[MaxJoints], qz[MaxJoints];
+		uint8_t jointTracking[MaxJoints];
+
+		uint8_t handLeft;
+		uint8_t handRight;
+	};
+
+	struct SkeletonFrame {
+		// Sensor clock, in microseconds
+		int64_t timestamp;
+		int jointCount;
+		Skeleton bodies[MaxBodies];
+	};
+
+	// Where a sensor's joint set keeps the joints the pipeline treats specially
+	struct SkeletonLayout {
+		int jointCount;
+		int head;
+		int recenterOrientation;
+		int handLeft;
+		int handRight;
+		// Tracker channel for the sensor's own pose
+		int sensorChannel;
+		// Tracker channel for the head fused with an orientation tracker
+		int fusedHeadChannel;
+		// Hand states are sent as this many buttons, 0 if the sensor has none
+		int handButtons;
+		// First analog channel of joint image positions, -1 if the descriptor has none
+		int projectionChannel;
+		// Recognized gestures are sent as this many buttons after the hand states
+		int gestureButtons;
+		// Analog channel for the sensor's lifecycle state, after every other analog
+		int statusChannel;
+	};
+
+	extern const SkeletonLayout KinectV1Layout;
+	extern const SkeletonLayout KinectV2Layout;
+
+	void clearFrame(SkeletonFrame& frame, int jointCount);
+}
@@ -0,0 +1,578 @@
+#include "SkeletonDevice.h"
+#include "KinectMath.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <string.h>
+
+namespace KinectOsvr {
+
+	SkeletonDevice::SkeletonDevice(OSVR_PluginRegContext ctx, const char* name, const SkeletonLayout& layout, const char* descriptor, WorkerPool& pool)
+		: m_name(name), m_button(NULL), m_layout(layout), m_firstUpdate(true), m_checkFloor(false), m_pipeline(pool), m_orientationOptional(false),
+		m_scheduler(0), m_runFilter(false), m_runOrientations(false), m_loggedShed(0), m_lastBudgetLog(0), m_tracking(false), m_trackingId(0), m_frame(NULL), m_reportedBody(-1),
+		m_gestures(layout.jointCount), m_gestureBody(-1), m_fusing(false),
+		m_correctLatency(false), m_latencyWindows(0), m_loggedLatencyValid(false), m_loggedLatency(0),
+		m_status(-1), m_statusSent(0) {
+
+		osvrPose3SetIdentity(&m_offset);
+		osvrPose3SetIdentity(&m_kinectPose);
+		osvrPose3SetIdentity(&m_lastHead);
+		m_floor[0] = m_floor[1] = m_floor[2] = m_floor[3] = 0;
+
+		for (int i = 0; i < MaxBodies; i++) {
+			m_bodyValid[i] = false;
+			m_filterTime[i] = m_orientationTime[i] = 0;
+		}
+
+		m_prepareStage = [this](int body) {
+			typedef std::chrono::steady_clock Clock;
+			Skeleton& skeleton = m_frame->bodies[body];
+			Clock::time_point start = Clock::now();
+			if (m_runFilter) {
+				KINECT_TRACE("filter joints");
+				m_filters[body].apply(skeleton, m_layout.jointCount, m_filterParams);
+			}
+			Clock::time_point filtered = Clock::now();
+			if (m_runOrientations) {
+				KINECT_TRACE("joint orientations");
+				if (!m_orientationStage(body, skeleton)) {
+					m_bodyValid[body] = false;
+				}
+			}
+			m_filterTime[body] = std::chrono::duration<double, std::micro>(filtered - start).count();
+			m_orientationTime[body] = std::chrono::duration<double, std::micro>(Clock::now() - filtered).count();
+		};
+		m_stages[0] = [this](int body) { TransformJoints(body); };
+		m_stages[1] = [this](int body) { JointConfidence(body); };
+
+		/// Create the initialization options
+		OSVR_DeviceInitOptions opts = osvrDeviceCreateInitOptions(ctx);
+
+		osvrDeviceTrackerConfigure(opts, &m_tracker);
+		// Confidence per joint, then color and depth image X and Y per joint, then the sensor's status
+		osvrDeviceAnalogConfigure(opts, &m_analog, m_layout.statusChannel + 1);
+		if (m_layout.handButtons + m_layout.gestureButtons > 0) {
+			osvrDeviceButtonConfigure(opts, &m_button, m_layout.handButtons + m_layout.gestureButtons);
+		}
+
+		/// Create the device token with the options
+		m_dev.initAsync(ctx, name, opts);
+
+		/// Send JSON descriptor
+		m_dev.sendJsonDescriptor(descriptor);
+	}
+
+	SkeletonDevice::~SkeletonDevice() {
+		if (m_archive.isOpen()) {
+			m_archive.close();
+			ArchiveWriter::Stats stats = m_archive.stats();
+			KINECT_LOG(Info, "Archive: {} frames in {} chunks, {} dropped", stats.frames, stats.chunks, stats.droppedFrames);
+		}
+	}
+
+	void SkeletonDevice::setOrientationStage(OrientationStage stage, bool optional) {
+		m_orientationStage = stage;
+		m_orientationOptional = optional;
+	}
+
+	void SkeletonDevice::setProjectionStage(ProjectionStage stage) {
+		if (m_layout.projectionChannel >= 0) {
+			m_projectionStage = stage;
+		}
+	}
+
+	void SkeletonDevice::setGestures(const std::vector<GestureTemplate>& templates) {
+		std::vector<GestureTemplate> usable;
+		for (size_t t = 0; t < templates.size(); t++) {
+			if (templates[t].button >= 0 && templates[t].button < m_layout.gestureButtons) {
+				usable.push_back(templates[t]);
+			}
+		}
+		m_gestures.setTemplates(usable);
+		if (m_gestures.templates().size() < usable.size()) {
+			KINECT_LOG(Info, "{}: testing {} of the {} gesture templates each frame", m_name, m_gestures.templates().size(), usable.size());
+		}
+	}
+
+	bool SkeletonDevice::loadGestures(const std::string& path) {
+		std::vector<GestureTemplate> templates;
+		if (!KinectOsvr::loadGestures(path, templates)) return false;
+		setGestures(templates);
+		return true;
+	}
+
+	void SkeletonDevice::setFilter(const FilterParams& params) {
+		m_filterParams = params;
+	}
+
+	bool SkeletonDevice::record(const std::string& path) {
+		return m_recorder.open(path, m_layout.jointCount);
+	}
+
+	bool SkeletonDevice::archive(const std::string& path) {
+		return m_archive.open(path, m_layout.jointCount);
+	}
+
+	void SkeletonDevice::setHeadFusion(const FusionParams& params) {
+		m_fusion = HeadFusion(params);
+		m_fusing = m_layout.fusedHeadChannel >= 0;
+	}
+
+	void SkeletonDevice::setLatencyEstimation(const LatencyParams& params, bool correct) {
+		m_latency.reset(new LatencyEstimator(params));
+		m_correctLatency = correct;
+	}
+
+	LatencyEstimate SkeletonDevice::latencyEstimate() const {
+		return m_latency ? m_latency->estimate() : LatencyEstimate();
+	}
+
+	void SkeletonDevice::reportStatus(int status, const OSVR_TimeValue& timeValue) {
+		int64_t timestamp = timeValue.seconds * 1000000LL + timeValue.microseconds;
+		if (status == m_status && timestamp - m_statusSent < 1000000) return;
+		m_status = status;
+		m_statusSent = timestamp;
+		osvrDeviceAnalogSetValueTimestamped(m_dev, m_analog, status, m_layout.statusChannel, &timeValue);
+	}
+
+	void SkeletonDevice::recenter() {
+		m_firstUpdate = true;
+	}
+
+	void SkeletonDevice::setFloor(const float plane[4]) {
+		// All zero until the sensor has found it
+		if (plane[0] == 0 && plane[1] == 0 && plane[2] == 0) return;
+
+		bool moved = !WarmStart::sameFloor(plane, m_floor);
+		if (m_checkFloor) {
+			m_checkFloor = false;
+			if (moved) {
+				KINECT_LOG(Info, "{}: the sensor has moved since its state was saved, recentering", m_name);
+				recenter();
+			}
+		}
+		if (moved) memcpy(m_floor, plane, sizeof(m_floor));
+	}
+
+	void SkeletonDevice::saveState(WarmStartState& state) const {
+		state.calibrated = !m_firstUpdate;
+		memcpy(state.floor, m_floor, sizeof(state.floor));
+		state.offset = m_offset;
+		state.kinectPose = m_kinectPose;
+		if (m_fusing) state.neckLength = m_fusion.neckLength();
+		if (m_latency) {
+			LatencyEstimate estimate = m_latency->estimate();
+			state.hasLatency = estimate.stable;
+			state.latency = estimate.stableLatency;
+		}
+	}
+
+	void SkeletonDevice::restoreState(const WarmStartState& state) {
+		if (state.calibrated) {
+			m_offset = state.offset;
+			m_kinectPose = state.kinectPose;
+			m_firstUpdate = false;
+		}
+		memcpy(m_floor, state.floor, sizeof(m_floor));
+		m_checkFloor = state.calibrated && (m_floor[0] != 0 || m_floor[1] != 0 || m_floor[2] != 0);
+
+		if (m_fusing && state.neckLength > 0) m_fusion.setNeckLength(state.neckLength);
+		if (m_latency && state.hasLatency) {
+			m_latency->seed(state.latency);
+			if (m_correctLatency) m_fusion.setLatency(state.latency);
+			m_loggedLatencyValid = true;
+			m_loggedLatency = state.latency;
+		}
+	}
+
+	void SkeletonDevice::setFrameBudget(double milliseconds) {
+		m_scheduler.setBudget(milliseconds * 1000.0);
+	}
+
+	FrameScheduler::Metrics SkeletonDevice::schedulerMetrics() const {
+		return m_scheduler.metrics();
+	}
+
+	const SkeletonLayout& SkeletonDevice::layout() const {
+		return m_layout;
+	}
+
+	const OSVR_PoseState* SkeletonDevice::poses(int body) const {
+		return m_poses[body];
+	}
+
+	const OSVR_AnalogState* SkeletonDevice::confidence(int body) const {
+		return m_confidence[body];
+	}
+
+	void SkeletonDevice::setupOffset(const Skeleton& skeleton) {
+		int head = m_layout.head;
+		int orientation = m_layout.recenterOrientation;
+
+		osvrVec3SetX(&(m_offset.translation), skeleton.x[head]);
+		osvrVec3SetY(&(m_offset.translation), skeleton.y[head]);
+		osvrVec3SetZ(&(m_offset.translation), skeleton.z[head]);
+
+		Eigen::Quaterniond q(skeleton.qw[orientation], skeleton.qx[orientation], skeleton.qy[orientation], skeleton.qz[orientation]);
+		osvr::util::toQuat(q.inverse(), m_offset.rotation);
+
+		osvrVec3SetX(&(m_kinectPose.translation), -skeleton.x[head]);
+		osvrVec3SetY(&(m_kinectPose.translation), -skeleton.y[head]);
+		osvrVec3SetZ(&(m_kinectPose.translation), -skeleton.z[head]);
+
+		Eigen::Quaterniond quaternion(Eigen::AngleAxisd(0, Eigen::Vector3d::UnitY()));
+		osvr::util::toQuat(quaternion, m_kinectPose.rotation);
+	}
+
+	bool SkeletonDevice::process(SkeletonFrame& frame, int trackedBody, const OSVR_TimeValue& timeValue) {
+		KINECT_TRACE("process bodies");
+		typedef std::chrono::steady_clock Clock;
+
+		int64_t timestamp = timeValue.seconds * 1000000LL + timeValue.microseconds;
+		if (!m_pipeline.beginFrame(timestamp)) {
+			return false;
+		}
+
+		reportTracking(frame, trackedBody);
+
+		m_frame = &frame;
+		int bodies = 0;
+		for (int i = 0; i < MaxBodies; ++i) {
+			m_bodyValid[i] = frame.bodies[i].tracking == BodyTracked;
+			if (m_bodyValid[i]) bodies++;
+		}
+		bool primary = trackedBody >= 0 && m_bodyValid[trackedBody];
+
+		m_scheduler.beginFrame(bodies);
+		Clock::time_point start = Clock::now();
+
+		if (m_recorder.isOpen()) {
+			KINECT_TRACE("record frame");
+			m_recorder.write(frame);
+		}
+
+		// Optional work is admitted in the order it's given up
+		if (bodies > (primary ? 1 : 0) && !m_scheduler.admit(FrameScheduler::SecondaryBodies)) {
+			for (int i = 0; i < MaxBodies; ++i) {
+				m_bodyValid[i] = i == trackedBody && primary;
+			}
+			bodies = primary ? 1 : 0;
+		}
+		m_runOrientations = m_orientationStage && (!m_orientationOptional || m_scheduler.admit(FrameScheduler::Orientations));
+		m_runFilter = m_filterParams.enabled() && m_scheduler.admit(FrameScheduler::Filtering);
+		if (m_filterParams.enabled() && !m_runFilter) {
+			// Smoothing picks up afresh rather than from where it was skipped
+			for (int i = 0; i < MaxBodies; ++i) {
+				m_filters[i].reset();
+			}
+		}
+
+		if (m_runOrientations || m_runFilter) {
+			m_pipeline.run(m_bodyValid, MaxBodies, m_prepareStage);
+		}
+
+		if (primary && m_bodyValid[trackedBody] && m_firstUpdate) {
+			m_firstUpdate = false;
+			setupOffset(frame.bodies[trackedBody]);
+			m_fusion.resetPosition();
+		}
+
+		// All tracked bodies are processed so extra outputs come for free, only the chosen one is reported
+		m_pipeline.run(m_bodyValid, MaxBodies, m_stages, 2);
+
+		// Each body's share of the work, less the primary's optional stages, is what's given up per secondary body
+		if (bodies > 0) {
+			double perBody = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / bodies;
+			if (bodies > 1) m_scheduler.record(FrameScheduler::SecondaryBodies, perBody);
+			if (primary) {
+				double optional = 0;
+				if (m_runFilter) {
+					m_scheduler.record(FrameScheduler::Filtering, m_filterTime[trackedBody]);
+					optional += m_filterTime[trackedBody];
+				}
+				if (m_runOrientations && m_orientationOptional) {
+					m_scheduler.record(FrameScheduler::Orientations, m_orientationTime[trackedBody]);
+					optional += m_orientationTime[trackedBody];
+				}
+				m_scheduler.record(FrameScheduler::Essential, perBody > optional ? perBody - optional : 0);
+			}
+		}
+		primary = primary && m_bodyValid[trackedBody];
+
+		// Every body at once, so the sensor's mapper is called once per frame rather than once per body
+		bool projected = false;
+		if (m_projectionStage && bodies > 0 && m_scheduler.admit(FrameScheduler::Projection)) {
+			KINECT_TRACE("project joints");
+			Clock::time_point projectionStart = Clock::now();
+			m_projectionStage(frame, m_bodyValid, m_projection);
+			m_scheduler.record(FrameScheduler::Projection, std::chrono::duration<double, std::micro>(Clock::now() - projectionStart).count());
+			projected = true;
+		}
+
+		int gesture = -1;
+		if (!m_gestures.empty() && primary && m_scheduler.admit(FrameScheduler::Gestures)) {
+			KINECT_TRACE("recognize gestures");
+			Clock::time_point gestureStart = Clock::now();
+			if (trackedBody != m_gestureBody) {
+				m_gestures.reset();
+				m_gestureBody = trackedBody;
+			}
+			gesture = m_gestures.update(frame.bodies[trackedBody]);
+			m_scheduler.record(FrameScheduler::Gestures, std::chrono::duration<double, std::micro>(Clock::now() - gestureStart).count());
+		}
+
+		if (trackedBody >= 0 && (m_layout.handButtons > 0 || !m_gestures.empty()) && frame.bodies[trackedBody].tracking != BodyNotTracked) {
+			sendButtons(frame.bodies[trackedBody], gesture);
+		}
+
+		if (primary) {
+			sendReports(trackedBody, projected, timeValue);
+
+			// The fused head can't carry on from someone else's
+			if (trackedBody != m_reportedBody) {
+				m_fusion.resetPosition();
+				m_reportedBody = trackedBody;
+			}
+		}
+
+		if (m_archive.isOpen()) {
+			KINECT_TRACE("archive frame");
+			if (primary) {
+				m_archive.write(timestamp, ArchiveState::Tracked, m_poses[trackedBody], m_confidence[trackedBody]);
+			}
+			else {
+				bool positionOnly = trackedBody >= 0 && frame.bodies[trackedBody].tracking == BodyPositionOnly;
+				m_archive.write(timestamp, positionOnly ? ArchiveState::PositionOnly : ArchiveState::None, NULL, NULL);
+			}
+		}
+
+		reportBudget(timestamp, m_scheduler.endFrame());
+		return true;
+	}
+
+	void SkeletonDevice::sendHead(const float position[3], float confidence, const OSVR_TimeValue& timeValue) {
+		KINECT_TRACE("send head");
+		OSVR_PoseState pose = m_lastHead;
+		osvrVec3SetX(&pose.translation, position[0]);
+		osvrVec3SetY(&pose.translation, position[1]);
+		osvrVec3SetZ(&pose.translation, position[2]);
+		applyOffset(&m_offset, &pose);
+
+		osvrDeviceTrackerSendPoseTimestamped(m_dev, m_tracker, &pose, m_layout.head, &timeValue);
+		osvrDeviceAnalogSetValueTimestamped(m_dev, m_analog, confidence, m_layout.head, &timeValue);
+
+		if (m_fusing) {
+			m_fusion.observe(timeValue.seconds * 1000000LL + timeValue.microseconds, pose.translation, NULL, NULL, NULL);
+		}
+	}
+
+	void SkeletonDevice::fuseOrientation(const OSVR_Quaternion& orientation, const OSVR_TimeValue& timeValue) {
+		if (!m_fusing) return;
+
+		KINECT_TRACE("fuse head");
+		int64_t timestamp = timeValue.seconds * 1000000LL + timeValue.microseconds;
+		if (m_latency) {
+			OSVR_Vec3 up;
+			osvr::util::vecMap(up) = osvr::util::fromQuat(orientation) * Eigen::Vector3d::UnitY();
+			m_latency->addReference(timestamp, up);
+		}
+
+		OSVR_PoseState pose;
+		if (m_fusion.fuse(timestamp, orientation, pose)) {
+			osvrDeviceTrackerSendPoseTimestamped(m_dev, m_tracker, &pose, m_layout.fusedHeadChannel, &timeValue);
+		}
+	}
+
+	// Joint indices up to the feet are the same in both joint sets, the V1's shoulder centre standing in for the neck
+	void SkeletonDevice::observeHead(int body, int64_t timestamp) {
+		const Skeleton& skeleton = m_frame->bodies[body];
+		const OSVR_PoseState* poses = m_poses[body];
+		bool neck = skeleton.jointTracking[V2Joint::Neck] == JointTracked;
+		bool shoulders = skeleton.jointTracking[V2Joint::ShoulderLeft] == JointTracked && skeleton.jointTracking[V2Joint::ShoulderRight] == JointTracked;
+
+		m_fusion.observe(timestamp, poses[m_layout.head].translation,
+			neck ? &poses[V2Joint::Neck].translation : NULL,
+			shoulders ? &poses[V2Joint::ShoulderLeft].translation : NULL,
+			shoulders ? &poses[V2Joint::ShoulderRight].translation : NULL);
+
+		// Which way is up for the head, as the orientation tracker gives it
+		if (m_latency && neck && skeleton.jointTracking[m_layout.head] == JointTracked) {
+			OSVR_Vec3 up;
+			osvr::util::vecMap(up) = (osvr::util::vecMap(poses[m_layout.head].translation) - osvr::util::vecMap(poses[V2Joint::Neck].translation)).normalized();
+			m_latency->addMeasured(timestamp, up, body != m_reportedBody);
+			reportLatency();
+		}
+	}
+
+	void SkeletonDevice::reportLatency() {
+		LatencyEstimate estimate = m_latency->estimate();
+		if (estimate.windows == m_latencyWindows) return;
+		m_latencyWindows = estimate.windows;
+		if (!estimate.valid) return;
+
+		// Only a run of windows agreeing is corrected by, one confident window can still be on the wrong peak
+		if (m_correctLatency && estimate.stable) m_fusion.setLatency(estimate.stableLatency);
+		if (m_loggedLatencyValid && fabs(estimate.latency - m_loggedLatency) < 5.0) return;
+		KINECT_LOG(Info, "{}: skeleton {} ms behind the orientation tracker (confidence {})", m_name, (int)(estimate.latency + 0.5), estimate.confidence);
+		m_loggedLatencyValid = true;
+		m_loggedLatency = estimate.latency;
+	}
+
+	void SkeletonDevice::sendReports(int body, bool projected, const OSVR_TimeValue& timeValue) {
+		KINECT_TRACE("send reports");
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point start = Clock::now();
+
+		// The head and hands go out whatever else is given up
+		osvrDeviceTrackerSendPoseTimestamped(m_dev, m_tracker, &m_kinectPose, m_layout.sensorChannel, &timeValue);
+		osvrDeviceTrackerSendPoseTimestamped(m_dev, m_tracker, &m_poses[body][m_layout.head], m_layout.head, &timeValue);
+		m_lastHead = m_poses[body][m_layout.head];
+		if (m_fusing) {
+			observeHead(body, timeValue.seconds * 1000000LL + timeValue.microseconds);
+		}
+		osvrDeviceTrackerSendPoseTimestamped(m_dev, m_tracker, &m_poses[body][m_layout.handLeft], m_layout.handLeft, &timeValue);
+		osvrDeviceTrackerSendPoseTimestamped(m_dev, m_tracker, &m_poses[body][m_layout.handRight], m_layout.handRight, &timeValue);
+
+		// Their confidence too, or smoothing plugins would hold on to a stale one while the other joints are given up
+		osvrDeviceAnalogSetValueTimestamped(m_dev, m_analog, m_confidence[body][m_layout.head], m_layout.head, &timeValue);
+		osvrDeviceAnalogSetValueTimestamped(m_dev, m_analog, m_confidence[body][m_layout.handLeft], m_layout.handLeft, &timeValue);
+		osvrDeviceAnalogSetValueTimestamped(m_dev, m_analog, m_confidence[body][m_layout.handRight], m_layout.handRight, &timeValue);
+
+		Clock::time_point essential = Clock::now();
+		m_scheduler.record(FrameScheduler::Essential, std::chrono::duration<double, std::micro>(essential - start).count());
+		if (!m_scheduler.admit(FrameScheduler::SecondaryJoints)) return;
+
+		int analogCount = m_layout.jointCount;
+		for (int j = 0; j < m_layout.jointCount; ++j)
+		{
+			// Send pose
+			if (j != m_layout.head && j != m_layout.handLeft && j != m_layout.handRight) {
+				osvrDeviceTrackerSendPoseTimestamped(m_dev, m_tracker, &m_poses[body][j], j, &timeValue);
+			}
+
+			// Tracking confidence for use in smoothing plugins, sent as one block so the head and hands go again
+			m_analogValues[j] = m_confidence[body][j];
+		}
+
+		if (projected) {
+			OSVR_AnalogState* values = m_analogValues + m_layout.projectionChannel;
+			for (int j = 0; j < m_layout.jointCount; ++j) {
+				values[j * 4] = m_projection.colorX[body][j];
+				values[j * 4 + 1] = m_projection.colorY[body][j];
+				values[j * 4 + 2] = m_projection.depthX[body][j];
+				values[j * 4 + 3] = m_projection.depthY[body][j];
+			}
+			analogCount = m_layout.projectionChannel + m_layout.jointCount * 4;
+		}
+
+		osvrDeviceAnalogSetValuesTimestamped(m_dev, m_analog, m_analogValues, analogCount, &timeValue);
+		m_scheduler.record(FrameScheduler::SecondaryJoints, std::chrono::duration<double, std::micro>(Clock::now() - essential).count());
+	}
+
+	// Says when the device starts and stops giving things up, at most once a second
+	void SkeletonDevice::reportBudget(int64_t timestamp, unsigned shed) {
+		if (shed == m_loggedShed || timestamp - m_lastBudgetLog < 1000000) return;
+
+		if (shed) {
+			KINECT_LOG(Warning, "{}: over its {} ms frame budget, skipping {}", m_name, m_scheduler.budget() / 1000.0, FrameScheduler::describe(shed));
+		}
+		else {
+			KINECT_LOG(Info, "{}: back within its frame budget", m_name);
+		}
+		m_loggedShed = shed;
+		m_lastBudgetLog = timestamp;
+	}
+
+	void SkeletonDevice::reportTracking(const SkeletonFrame& frame, int trackedBody) {
+		bool tracking = trackedBody >= 0 && frame.bodies[trackedBody].tracking != BodyNotTracked;
+		if (tracking) {
+			uint64_t id = frame.bodies[trackedBody].trackingId;
+			if (!m_tracking) KINECT_LOG(Info, "{}: tracking body {} (id {})", m_name, trackedBody, id);
+			else if (id != m_trackingId) KINECT_LOG(Info, "{}: switched from id {} to body {} (id {})", m_name, m_trackingId, trackedBody, id);
+			m_trackingId = id;
+		}
+		else if (m_tracking) {
+			KINECT_LOG(Info, "{}: lost the tracked body (id {})", m_name, m_trackingId);
+		}
+		m_tracking = tracking;
+	}
+
+	void SkeletonDevice::sendButtons(const Skeleton& skeleton, int gesture) {
+		KINECT_TRACE("send buttons");
+		OSVR_ButtonState buttons[32];
+		OSVR_ChannelCount count = 0;
+
+		// Send hand states as button presses
+		if (m_layout.handButtons > 0) {
+			buttons[0] = skeleton.handRight == HandOpen;
+			buttons[1] = skeleton.handRight == HandClosed;
+			buttons[2] = skeleton.handRight == HandLasso;
+			buttons[3] = skeleton.handLeft == HandOpen;
+			buttons[4] = skeleton.handLeft == HandClosed;
+			buttons[5] = skeleton.handLeft == HandLasso;
+			count = m_layout.handButtons;
+		}
+
+		// Recognized gestures are pressed for the one frame
+		if (!m_gestures.empty()) {
+			for (int g = 0; g < m_layout.gestureButtons; g++) {
+				buttons[count + g] = 0;
+			}
+			if (gesture >= 0) {
+				buttons[count + m_gestures.templates()[gesture].button] = 1;
+			}
+			count += m_layout.gestureButtons;
+		}
+
+		osvrDeviceButtonSetValues(m_dev, m_button, buttons, count);
+	}
+
+	void SkeletonDevice::TransformJoints(int body) {
+		KINECT_TRACE("transform joints");
+		const Skeleton& skeleton = m_frame->bodies[body];
+
+		for (int j = 0; j < m_layout.jointCount; ++j)
+		{
+			OSVR_PoseState* poseState = &m_poses[body][j];
+
+			osvrVec3SetX(&poseState->translation, skeleton.x[j]);
+			osvrVec3SetY(&poseState->translation, skeleton.y[j]);
+			osvrVec3SetZ(&poseState->translation, skeleton.z[j]);
+
+			osvrQuatSetW(&poseState->rotation, skeleton.qw[j]);
+			osvrQuatSetX(&poseState->rotation, skeleton.qx[j]);
+			osvrQuatSetY(&poseState->rotation, skeleton.qy[j]);
+			osvrQuatSetZ(&poseState->rotation, skeleton.qz[j]);
+
+			// Rotate hand orientation to something more useful for OSVR
+			if (j == m_layout.handLeft || j == m_layout.handRight) {
+				boneSpaceToWorldSpace(&poseState->rotation);
+			}
+
+			applyOffset(&m_offset, poseState);
+		}
+	}
+
+	void SkeletonDevice::JointConfidence(int body) {
+		KINECT_TRACE("joint confidence");
+		const Skeleton& skeleton = m_frame->bodies[body];
+
+		for (int j = 0; j < m_layout.jointCount; ++j)
+		{
+			OSVR_AnalogState confidence = 0;
+			switch (skeleton.jointTracking[j]) {
+			case JointTracked:
+				confidence = 1;
+				break;
+			case JointInferred:
+				confidence = 0.5;
+				break;
+			default:
+			case JointNotTracked:
+				confidence = 0;
+				break;
+			}
+			m_confidence[body][j] = confidence;
+		}
+	}
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "Archive.h"
+#include "FramePipeline.h"
+#include "FrameScheduler.h"
+#include "GestureRecognizer.h"
+#include "HeadFusion.h"
+#include "JointFilter.h"
+#include "JointProjection.h"
+#include "LatencyEstimator.h"
+#include "Skeleton.h"
+#include "SkeletonRecording.h"
+#include "WarmStart.h"
+
+#include <osvr/PluginKit/PluginKit.h>
+#include <osvr/PluginKit/TrackerInterfaceC.h>
+#include <osvr/PluginKit/AnalogInterfaceC.h>
+#include <osvr/PluginKit/ButtonInterfaceC.h>
+
+#include <memory>
+
+namespace KinectOsvr {
+	// The OSVR side of a skeleton sensor: turns sensor-independent frames into tracker, analog and button reports
+	class SkeletonDevice {
+	public:
+		typedef std::function<bool(int body, Skeleton& skeleton)> OrientationStage;
+		typedef std::function<void(const SkeletonFrame& frame, const bool* bodies, FrameProjection& projection)> ProjectionStage;
+
+		SkeletonDevice(OSVR_PluginRegContext ctx, const char* name, const SkeletonLayout& layout, const char* descriptor, WorkerPool& pool);
+		~SkeletonDevice();
+
+		template <typename DeviceObjectType>
+		void registerUpdateCallback(DeviceObjectType* device) {
+			m_dev.registerUpdateCallback(device);
+		}
+
+		// Fills in joint orientations per body before anything else runs, returning false drops the body.
+		// Optional orientations are skipped when the frame budget is tight, leaving the sensor's own.
+		void setOrientationStage(OrientationStage stage, bool optional = false);
+
+		// Reports each joint's image positions, if the layout has channels for them. Called once per
+		// frame for all bodies together, on the thread calling process.
+		void setProjectionStage(ProjectionStage stage);
+
+		// Presses a gesture button for a frame when the tracked body performs one of these
+		void setGestures(const std::vector<GestureTemplate>& templates);
+		bool loadGestures(const std::string& path);
+
+		// Smooths joint positions of every tracked body before orientations are worked out
+		void setFilter(const FilterParams& params);
+
+		// Writes every frame as it arrives, before any filtering
+		bool record(const std::string& path);
+
+		// Keeps the reported body's joints, as sent, for querying long sessions afterwards
+		bool archive(const std::string& path);
+
+		void recenter();
+
+		// Where the sensor sees the floor, as a plane in sensor space. Recenters if it's moved from where a restored
+		// snapshot had it, as when the sensor has been knocked or set up somewhere else.
+		void setFloor(const float plane[4]);
+
+		// What's worth keeping across a restart, and picking up from it so tracking is calibrated from the first frame.
+		// Restore after setting up head fusion and latency estimation.
+		void saveState(WarmStartState& state) const;
+		void restoreState(const WarmStartState& state);
+
+		// Gives up optional work to keep each frame's processing within this, 0 for no limit
+		void setFrameBudget(double milliseconds);
+		FrameScheduler::Metrics schedulerMetrics() const;
+
+		// Processes every tracked body and reports the chosen one, returns false for a frame older than the last
+		bool process(SkeletonFrame& frame, int trackedBody, const OSVR_TimeValue& timeValue);
+
+		// Reports just the head, found some other way while the skeleton has lost it, in metres in sensor space.
+		// It keeps the last orientation the skeleton gave it.
+		void sendHead(const float position[3], float confidence, const OSVR_TimeValue& timeValue);
+
+		// Combines the tracked head with an orientation tracker's samples into a head pose on the fused head channel
+		void setHeadFusion(const FusionParams& params);
+		// Each orientation tracker sample as it arrives, reported straight away once the skeleton has placed the head
+		void fuseOrientation(const OSVR_Quaternion& orientation, const OSVR_TimeValue& timeValue);
+
+		// Measures how late skeleton timestamps are against the orientation tracker's, by how the head tilts in
+		// each, and optionally lines the fused head up by it in place of FusionParams::kinectLatency
+		void setLatencyEstimation(const LatencyParams& params, bool correct);
+		LatencyEstimate latencyEstimate() const;
+
+		// Sends the sensor's SensorLifecycle::State on the status channel when it changes, and once a second
+		// besides for clients that connect later. Called every update, frame or not.
+		void reportStatus(int status, const OSVR_TimeValue& timeValue);
+
+		const SkeletonLayout& layout() const;
+		const OSVR_PoseState* poses(int body) const;
+		const OSVR_AnalogState* confidence(int body) const;
+
+	private:
+		void TransformJoints(int body);
+		void JointConfidence(int body);
+		void setupOffset(const Skeleton& skeleton);
+		void sendButtons(const Skeleton& skeleton, int gesture);
+		void sendReports(int body, bool projected, const OSVR_TimeValue& timeValue);
+		void observeHead(int body, int64_t timestamp);
+		void reportLatency();
+		void reportBudget(int64_t timestamp, unsigned shed);
+		void reportTracking(const SkeletonFrame& frame, int trackedBody);
+
+		std::string m_name;
+		osvr::pluginkit::DeviceToken m_dev;
+		OSVR_TrackerDeviceInterface m_tracker;
+		OSVR_AnalogDeviceInterface m_analog;
+		OSVR_ButtonDeviceInterface m_button;
+
+		SkeletonLayout m_layout;
+
+		bool m_firstUpdate;
+		OSVR_PoseState m_offset;
+		OSVR_PoseState m_kinectPose;
+		OSVR_PoseState m_lastHead;
+		// Only updated when it moves past what the estimate wanders by, so it doesn't count as a change every frame
+		float m_floor[4];
+		bool m_checkFloor;
+
+		FramePipeline m_pipeline;
+		OrientationStage m_orientationStage;
+		bool m_orientationOptional;
+		FramePipeline::BodyStage m_prepareStage;
+		FramePipeline::BodyStage m_stages[2];
+		ProjectionStage m_projectionStage;
+
+		FrameScheduler m_scheduler;
+		bool m_runFilter;
+		bool m_runOrientations;
+		// Time each body spent in the optional per-body stages this frame, in microseconds
+		double m_filterTime[MaxBodies];
+		double m_orientationTime[MaxBodies];
+		unsigned m_loggedShed;
+		int64_t m_lastBudgetLog;
+
+		// Who was being reported, to say when that changes
+		bool m_tracking;
+		uint64_t m_trackingId;
+
+		FilterParams m_filterParams;
+		JointFilter m_filters[MaxBodies];
+		SkeletonRecorder m_recorder;
+		ArchiveWriter m_archive;
+
+		SkeletonFrame* m_frame;
+		bool m_bodyValid[MaxBodies];
+		OSVR_PoseState m_poses[MaxBodies][MaxJoints];
+		OSVR_AnalogState m_confidence[MaxBodies][MaxJoints];
+		FrameProjection m_projection;
+		OSVR_AnalogState m_analogValues[MaxJoints * 5];
+
+		// Who the last frame reported, to tell when someone else takes over
+		int m_reportedBody;
+
+		GestureRecognizer m_gestures;
+		int m_gestureBody;
+
+		bool m_fusing;
+		HeadFusion m_fusion;
+
+		std::unique_ptr<LatencyEstimator> m_latency;
+		bool m_correctLatency;
+		int m_latencyWindows;
+		bool m_loggedLatencyValid;
+		double m_loggedLatency;
+
+		int m_status;
+		int64_t m_statusSent;
+	};
+}
@@ -0,0 +1,87 @@
+#include "SkeletonRecording.h"
+
+#include <string.h>
+
+namespace KinectOsvr {
+
+	namespace {
+		const char Magic[4] = { 'K', 'S', 'K', 'R' };
+		const uint32_t Version = 1;
+
+		struct Header {
+			char magic[4];
+			uint32_t version;
+			// Frames are stored as they are in memory, so a reader has to agree on the layout
+			uint32_t frameSize;
+			int32_t jointCount;
+		};
+	}
+
+	SkeletonRecorder::SkeletonRecorder() : m_file(NULL) {}
+
+	SkeletonRecorder::~SkeletonRecorder() {
+		close();
+	}
+
+	bool SkeletonRecorder::open(const std::string& path, int jointCount) {
+		close();
+
+		m_file = fopen(path.c_str(), "wb");
+		if (m_file == NULL) return false;
+
+		Header header;
+		memcpy(header.magic, Magic, sizeof(Magic));
+		header.version = Version;
+		header.frameSize = sizeof(SkeletonFrame);
+		header.jointCount = jointCount;
+
+		if (fwrite(&header, sizeof(header), 1, m_file) != 1) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	bool SkeletonRecorder::isOpen() const {
+		return m_file != NULL;
+	}
+
+	void SkeletonRecorder::write(const SkeletonFrame& frame) {
+		if (m_file == NULL) return;
+
+		// Stop rather than leave a torn frame in the middle of the file
+		if (fwrite(&frame, sizeof(frame), 1, m_file) != 1) {
+			close();
+		}
+	}
+
+	void SkeletonRecorder::close() {
+		if (m_file != NULL) {
+			fclose(m_file);
+			m_file = NULL;
+		}
+	}
+
+	bool loadRecording(const std::string& path, std::vector<SkeletonFrame>& frames) {
+		FILE* file = fopen(path.c_str(), "rb");
+		if (file == NULL) return false;
+
+		Header header;
+		bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+			memcmp(header.magic, Magic, sizeof(Magic)) == 0 &&
+			header.version == Version &&
+			header.frameSize == sizeof(SkeletonFrame) &&
+			header.jointCount > 0 && header.jointCount <= MaxJoints;
+
+		if (valid) {
+			SkeletonFrame frame;
+			while (fread(&frame, sizeof(frame), 1, file) == 1) {
+				frame.jointCount = header.jointCount;
+				frames.push_back(frame);
+			}
+		}
+
+		fclose(file);
+		return valid;
+	}
+};
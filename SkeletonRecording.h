@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Skeleton.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace KinectOsvr {
+	// Writes sessions as a short header followed by raw SkeletonFrames, for replaying offline
+	class SkeletonRecorder {
+	public:
+		SkeletonRecorder();
+		~SkeletonRecorder();
+
+		bool open(const std::string& path, int jointCount);
+		bool isOpen() const;
+		void write(const SkeletonFrame& frame);
+		void close();
+
+	private:
+		FILE* m_file;
+	};
+
+	// Reads a whole recording, false if it's missing or from an incompatible build
+	bool loadRecording(const std::string& path, std::vector<SkeletonFrame>& frames);
+}
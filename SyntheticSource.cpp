@@ -0,0 +1,372 @@
+#include "SyntheticSource.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace KinectOsvr {
+
+	namespace {
+		// Standing pose relative to SpineBase, facing the sensor, in V2 joint order
+		const float RestPose[V2Joint::Count][3] = {
+			{ 0.0f, 0.0f, 0.0f },		// SpineBase
+			{ 0.0f, 0.25f, 0.0f },		// SpineMid
+			{ 0.0f, 0.52f, 0.0f },		// Neck
+			{ 0.0f, 0.66f, 0.0f },		// Head
+			{ -0.18f, 0.47f, 0.0f },	// ShoulderLeft
+			{ -0.22f, 0.20f, 0.0f },	// ElbowLeft
+			{ -0.24f, -0.05f, 0.0f },	// WristLeft
+			{ -0.24f, -0.12f, 0.0f },	// HandLeft
+			{ 0.18f, 0.47f, 0.0f },		// ShoulderRight
+			{ 0.22f, 0.20f, 0.0f },		// ElbowRight
+			{ 0.24f, -0.05f, 0.0f },	// WristRight
+			{ 0.24f, -0.12f, 0.0f },	// HandRight
+			{ -0.09f, -0.05f, 0.0f },	// HipLeft
+			{ -0.10f, -0.48f, 0.0f },	// KneeLeft
+			{ -0.10f, -0.88f, 0.0f },	// AnkleLeft
+			{ -0.10f, -0.93f, -0.10f },	// FootLeft
+			{ 0.09f, -0.05f, 0.0f },	// HipRight
+			{ 0.10f, -0.48f, 0.0f },	// KneeRight
+			{ 0.10f, -0.88f, 0.0f },	// AnkleRight
+			{ 0.10f, -0.93f, -0.10f },	// FootRight
+			{ 0.0f, 0.45f, 0.0f },		// SpineShoulder
+			{ -0.24f, -0.20f, 0.0f },	// HandTipLeft
+			{ -0.21f, -0.14f, -0.03f },	// ThumbLeft
+			{ 0.24f, -0.20f, 0.0f },	// HandTipRight
+			{ 0.21f, -0.14f, -0.03f }	// ThumbRight
+		};
+
+		// V1 joints in terms of the V2 ones
+		const int V1FromV2[V1Joint::Count] = {
+			V2Joint::SpineBase, V2Joint::SpineMid, V2Joint::SpineShoulder, V2Joint::Head,
+			V2Joint::ShoulderLeft, V2Joint::ElbowLeft, V2Joint::WristLeft, V2Joint::HandLeft,
+			V2Joint::ShoulderRight, V2Joint::ElbowRight, V2Joint::WristRight, V2Joint::HandRight,
+			V2Joint::HipLeft, V2Joint::KneeLeft, V2Joint::AnkleLeft, V2Joint::FootLeft,
+			V2Joint::HipRight, V2Joint::KneeRight, V2Joint::AnkleRight, V2Joint::FootRight
+		};
+
+		bool isLeftArm(int v2) {
+			return v2 == V2Joint::ElbowLeft || v2 == V2Joint::WristLeft || v2 == V2Joint::HandLeft ||
+				v2 == V2Joint::HandTipLeft || v2 == V2Joint::ThumbLeft;
+		}
+
+		bool isRightArm(int v2) {
+			return v2 == V2Joint::ElbowRight || v2 == V2Joint::WristRight || v2 == V2Joint::HandRight ||
+				v2 == V2Joint::HandTipRight || v2 == V2Joint::ThumbRight;
+		}
+
+		double smoothstep(double edge0, double edge1, double x) {
+			double t = (x - edge0) / (edge1 - edge0);
+			t = t < 0 ? 0 : t > 1 ? 1 : t;
+			return t * t * (3 - 2 * t);
+		}
+
+		const char* GestureNames[SyntheticGesture::Count] = {
+			"none", "raise-right", "raise-left", "swipe-left", "bow"
+		};
+
+		// Bones drawn into depth images, with their thickness in metres. Indices up to the feet are the same
+		// in both joint sets.
+		struct DepthBone {
+			int from, to;
+			float radius;
+		};
+
+		const DepthBone DepthBones[] = {
+			{ V2Joint::SpineBase, V2Joint::SpineMid, 0.13f },
+			{ V2Joint::SpineMid, V2Joint::Neck, 0.13f },
+			{ V2Joint::Neck, V2Joint::Head, 0.05f },
+			{ V2Joint::Head, V2Joint::Head, 0.1f },
+			{ V2Joint::ShoulderLeft, V2Joint::ShoulderRight, 0.06f },
+			{ V2Joint::ShoulderLeft, V2Joint::ElbowLeft, 0.05f },
+			{ V2Joint::ElbowLeft, V2Joint::WristLeft, 0.04f },
+			{ V2Joint::WristLeft, V2Joint::HandLeft, 0.045f },
+			{ V2Joint::ShoulderRight, V2Joint::ElbowRight, 0.05f },
+			{ V2Joint::ElbowRight, V2Joint::WristRight, 0.04f },
+			{ V2Joint::WristRight, V2Joint::HandRight, 0.045f },
+			{ V2Joint::HipLeft, V2Joint::HipRight, 0.1f },
+			{ V2Joint::HipLeft, V2Joint::KneeLeft, 0.07f },
+			{ V2Joint::KneeLeft, V2Joint::AnkleLeft, 0.05f },
+			{ V2Joint::HipRight, V2Joint::KneeRight, 0.07f },
+			{ V2Joint::KneeRight, V2Joint::AnkleRight, 0.05f }
+		};
+
+		const uint16_t WallDepth = 4500;
+		// Body-index value for pixels that aren't anyone, as the Kinect V2 reports it
+		const uint8_t NoBody = 255;
+
+		void renderSphere(const PinholeIntrinsics& camera, int width, int height, const float centre[3], float radius, uint16_t* depth, uint8_t* bodyIndex, uint8_t body) {
+			float u, v;
+			PinholeProjector::project(camera, &centre[0], &centre[1], &centre[2], 1, &u, &v);
+			float z = centre[2] - camera.offsetZ;
+			if (z <= radius) return;
+
+			float pixels = radius * camera.focalLengthX / z;
+			int left = std::max(0, (int)(u - pixels)), right = std::min(width - 1, (int)(u + pixels) + 1);
+			int top = std::max(0, (int)(v - pixels)), bottom = std::min(height - 1, (int)(v + pixels) + 1);
+			for (int y = top; y <= bottom; y++) {
+				float dy = (y - v) * z / camera.focalLengthY;
+				for (int x = left; x <= right; x++) {
+					float dx = (x - u) * z / camera.focalLengthX;
+					float inside = radius * radius - dx * dx - dy * dy;
+					if (inside <= 0) continue;
+
+					uint16_t surface = (uint16_t)((z - sqrtf(inside)) * 1000.0f);
+					uint16_t& pixel = depth[y * width + x];
+					if (surface < pixel) {
+						pixel = surface;
+						if (bodyIndex != NULL) bodyIndex[y * width + x] = body;
+					}
+				}
+			}
+		}
+	}
+
+	void renderSyntheticDepth(const SkeletonFrame& frame, const PinholeIntrinsics& camera, int width, int height, uint16_t* depth, uint8_t* bodyIndex) {
+		std::fill(depth, depth + width * height, WallDepth);
+		if (bodyIndex != NULL) std::fill(bodyIndex, bodyIndex + width * height, NoBody);
+
+		for (int b = 0; b < MaxBodies; b++) {
+			const Skeleton& skeleton = frame.bodies[b];
+			if (skeleton.tracking == BodyNotTracked) continue;
+
+			for (size_t i = 0; i < sizeof(DepthBones) / sizeof(DepthBones[0]); i++) {
+				const DepthBone& bone = DepthBones[i];
+				float from[3] = { skeleton.x[bone.from], skeleton.y[bone.from], skeleton.z[bone.from] };
+				float to[3] = { skeleton.x[bone.to], skeleton.y[bone.to], skeleton.z[bone.to] };
+				float length = sqrtf((to[0] - from[0]) * (to[0] - from[0]) + (to[1] - from[1]) * (to[1] - from[1]) + (to[2] - from[2]) * (to[2] - from[2]));
+
+				// Overlapping spheres every half radius make a capsule
+				int steps = 1 + (int)(length / (bone.radius * 0.5f));
+				for (int s = 0; s <= steps; s++) {
+					float t = (float)s / steps;
+					float centre[3] = { from[0] + (to[0] - from[0]) * t, from[1] + (to[1] - from[1]) * t, from[2] + (to[2] - from[2]) * t };
+					renderSphere(camera, width, height, centre, bone.radius, depth, bodyIndex, (uint8_t)b);
+				}
+			}
+		}
+	}
+
+	const char* syntheticGestureName(int gesture) {
+		return gesture >= 0 && gesture < SyntheticGesture::Count ? GestureNames[gesture] : "unknown";
+	}
+
+	SyntheticSource::Options::Options()
+		: bodies(1), jointCount(V2Joint::Count), seed(1), frameRate(30.0), noise(0.005), inferredRate(0.01), churnRate(0.0), gestureRate(0.0), buildSpread(0.0) {}
+
+	SyntheticSource::SyntheticSource(const Options& options)
+		: m_options(options), m_rng(0x9E3779B97F4A7C15ULL ^ options.seed), m_frameIndex(0), m_nextTrackingId(72057594037927936ULL + options.seed * 1000) {
+
+		if (m_options.bodies > MaxBodies) m_options.bodies = MaxBodies;
+		for (int i = 0; i < MaxBodies; i++) {
+			m_trackingIds[i] = m_nextTrackingId++;
+			m_dropoutFrames[i] = 0;
+			m_gesture[i] = SyntheticGesture::None;
+			m_gestureStart[i] = 0;
+			m_gestureLength[i] = 1;
+			m_stature[i] = 1.0f;
+			m_armScale[i] = 1.0f;
+		}
+		if (m_options.buildSpread > 0) {
+			for (int i = 0; i < MaxBodies; i++) {
+				m_stature[i] = (float)(1.0 + m_options.buildSpread * (2 * uniform() - 1));
+				m_armScale[i] = (float)(1.0 + m_options.buildSpread * (2 * uniform() - 1));
+			}
+		}
+		clearFrame(m_truth, m_options.jointCount);
+	}
+
+	// xorshift64*, so sequences are the same on every platform
+	double SyntheticSource::uniform() {
+		m_rng ^= m_rng >> 12;
+		m_rng ^= m_rng << 25;
+		m_rng ^= m_rng >> 27;
+		return ((m_rng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	double SyntheticSource::gaussian() {
+		double u = uniform();
+		double v = uniform();
+		if (u < 1e-12) u = 1e-12;
+		return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+	}
+
+	void SyntheticSource::pose(int body, double t, Skeleton& skeleton) {
+		double phase = body * 1.1;
+		float rootX = (float)(1.2 * sin(0.23 * t + phase));
+		float rootY = 0.1f;
+		float rootZ = (float)(2.6 + 0.9 * sin(0.17 * t + 2 * phase));
+		double yaw = 0.4 * sin(0.31 * t + phase);
+		double swing = 0.5 * sin(1.7 * t + phase);
+		float bob = (float)(0.02 * sin(3.4 * t + phase));
+
+		float cy = (float)cos(yaw), sy = (float)sin(yaw);
+		float cs = (float)cos(swing), ss = (float)sin(swing);
+
+		skeleton.position[0] = rootX;
+		skeleton.position[1] = rootY;
+		skeleton.position[2] = rootZ;
+
+		for (int j = 0; j < m_options.jointCount; j++) {
+			int v2 = m_options.jointCount == V1Joint::Count ? V1FromV2[j] : j;
+			float x = RestPose[v2][0], y = RestPose[v2][1], z = RestPose[v2][2];
+
+			// Swing the arms forward and back about the shoulders, in opposite directions
+			int shoulder = isLeftArm(v2) ? V2Joint::ShoulderLeft : isRightArm(v2) ? V2Joint::ShoulderRight : -1;
+			float armSign = isLeftArm(v2) ? 1.0f : -1.0f;
+			if (shoulder >= 0) {
+				float dy = y - RestPose[shoulder][1];
+				float dz = z - RestPose[shoulder][2];
+				y = RestPose[shoulder][1] + dy * cs - dz * ss * armSign;
+				z = RestPose[shoulder][2] + dy * ss * armSign + dz * cs;
+			}
+			if (y > 0.4f) y += bob;
+
+			if (m_gesture[body] != SyntheticGesture::None) {
+				gesture(body, t, v2, x, y, z);
+			}
+
+			if (shoulder >= 0) {
+				x = RestPose[shoulder][0] + (x - RestPose[shoulder][0]) * m_armScale[body];
+				y = RestPose[shoulder][1] + (y - RestPose[shoulder][1]) * m_armScale[body];
+				z = RestPose[shoulder][2] + (z - RestPose[shoulder][2]) * m_armScale[body];
+			}
+			x *= m_stature[body];
+			y *= m_stature[body];
+			z *= m_stature[body];
+
+			// Turn the whole body about its spine
+			skeleton.x[j] = rootX + x * cy + z * sy;
+			skeleton.y[j] = rootY + y;
+			skeleton.z[j] = rootZ - x * sy + z * cy;
+
+			double angle = shoulder >= 0 ? swing * armSign : 0.0;
+			float ca = (float)cos(angle / 2), sa = (float)sin(angle / 2);
+			float cyh = (float)cos(yaw / 2), syh = (float)sin(yaw / 2);
+			// Yaw about Y followed by swing about X
+			skeleton.qw[j] = cyh * ca;
+			skeleton.qx[j] = cyh * sa;
+			skeleton.qy[j] = syh * ca;
+			skeleton.qz[j] = -syh * sa;
+			skeleton.jointTracking[j] = JointTracked;
+		}
+
+		skeleton.handLeft = swing > 0.3 ? HandClosed : HandOpen;
+		skeleton.handRight = swing < -0.3 ? HandClosed : HandOpen;
+	}
+
+	// Straight-arm movements about the shoulder, and bowing about the hips, blended in and out of the walking pose
+	void SyntheticSource::gesture(int body, double t, int v2, float& x, float& y, float& z) const {
+		int type = m_gesture[body];
+		double p = (t - m_gestureStart[body]) / m_gestureLength[body];
+		if (p < 0) p = 0;
+		double blend = smoothstep(0.0, 0.15, p) * (1.0 - smoothstep(0.85, 1.0, p));
+
+		if (type == SyntheticGesture::Bow) {
+			if (RestPose[v2][1] <= 0.0f) return;
+			double angle = 0.6 * sin(M_PI * p);
+			float c = (float)cos(angle), s = (float)sin(angle);
+			float by = y * c + z * s;
+			float bz = z * c - y * s;
+			y = by;
+			z = bz;
+			return;
+		}
+
+		bool right = type != SyntheticGesture::RaiseLeft;
+		if (!(right ? isRightArm(v2) : isLeftArm(v2))) return;
+
+		// Elevation from hanging down, and azimuth from straight ahead towards the body's right
+		double elevation, azimuth;
+		if (type == SyntheticGesture::SwipeLeft) {
+			elevation = M_PI / 2 * smoothstep(0.0, 0.3, p) * (1.0 - smoothstep(0.7, 1.0, p));
+			azimuth = 0.8 - 1.6 * smoothstep(0.2, 0.8, p);
+		}
+		else {
+			elevation = 0.9 * M_PI * sin(M_PI * p);
+			azimuth = right ? M_PI / 2 : -M_PI / 2;
+		}
+
+		int shoulder = right ? V2Joint::ShoulderRight : V2Joint::ShoulderLeft;
+		float dx = RestPose[v2][0] - RestPose[shoulder][0];
+		float dy = RestPose[v2][1] - RestPose[shoulder][1];
+		float dz = RestPose[v2][2] - RestPose[shoulder][2];
+		double length = sqrt(dx * dx + dy * dy + dz * dz);
+
+		// Forward is towards the sensor, -Z
+		double gx = RestPose[shoulder][0] + length * sin(elevation) * sin(azimuth);
+		double gy = RestPose[shoulder][1] - length * cos(elevation);
+		double gz = RestPose[shoulder][2] - length * sin(elevation) * cos(azimuth);
+
+		x = (float)(x + (gx - x) * blend);
+		y = (float)(y + (gy - y) * blend);
+		z = (float)(z + (gz - z) * blend);
+	}
+
+	void SyntheticSource::perform(int body, int gesture, double speed) {
+		if (body < 0 || body >= MaxBodies || speed <= 0) return;
+		m_gesture[body] = gesture;
+		m_gestureStart[body] = m_frameIndex / m_options.frameRate;
+		m_gestureLength[body] = 1.0 / speed;
+	}
+
+	int SyntheticSource::performing(int body) const {
+		return m_gesture[body];
+	}
+
+	void SyntheticSource::next(SkeletonFrame& frame) {
+		double t = m_frameIndex / m_options.frameRate;
+		int64_t timestamp = (int64_t)(t * 1000000.0);
+		m_frameIndex++;
+
+		clearFrame(frame, m_options.jointCount);
+		frame.timestamp = timestamp;
+		m_truth.timestamp = timestamp;
+
+		for (int b = 0; b < m_options.bodies; b++) {
+			if (m_gesture[b] != SyntheticGesture::None && t >= m_gestureStart[b] + m_gestureLength[b]) {
+				m_gesture[b] = SyntheticGesture::None;
+			}
+			// At varying speeds, so recognition has to cope with people taking more or less time
+			if (m_gesture[b] == SyntheticGesture::None && m_options.gestureRate > 0 && uniform() < m_options.gestureRate) {
+				int type = 1 + (int)(uniform() * (SyntheticGesture::Count - 1));
+				perform(b, type < SyntheticGesture::Count ? type : SyntheticGesture::Count - 1, 0.7 + uniform() * 0.6);
+			}
+
+			Skeleton& truth = m_truth.bodies[b];
+			pose(b, t, truth);
+			truth.trackingId = m_trackingIds[b];
+			truth.tracking = BodyTracked;
+
+			// Lose the body for a second or so, it comes back as someone new
+			if (m_dropoutFrames[b] == 0 && m_options.churnRate > 0 && uniform() < m_options.churnRate) {
+				m_dropoutFrames[b] = 10 + (int)(uniform() * 30);
+			}
+			if (m_dropoutFrames[b] > 0) {
+				if (--m_dropoutFrames[b] == 0) {
+					m_trackingIds[b] = m_nextTrackingId++;
+				}
+				continue;
+			}
+
+			Skeleton& skeleton = frame.bodies[b];
+			memcpy(&skeleton, &truth, sizeof(Skeleton));
+			for (int j = 0; j < m_options.jointCount; j++) {
+				double scale = m_options.noise;
+				if (uniform() < m_options.inferredRate) {
+					skeleton.jointTracking[j] = JointInferred;
+					scale *= 5;
+				}
+				skeleton.x[j] += (float)(gaussian() * scale);
+				skeleton.y[j] += (float)(gaussian() * scale);
+				skeleton.z[j] += (float)(gaussian() * scale);
+			}
+		}
+	}
+
+	const SkeletonFrame& SyntheticSource::truth() const {
+		return m_truth;
+	}
+};
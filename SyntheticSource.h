@@ -0,0 +1,83 @@
+#pragma once
+
+#include "JointProjection.h"
+#include "Skeleton.h"
+
+#include <stddef.h>
+
+namespace KinectOsvr {
+	// Gestures the synthetic people can perform, for testing recognition
+	namespace SyntheticGesture {
+		enum Type {
+			None, RaiseRight, RaiseLeft, SwipeLeft, Bow,
+			Count
+		};
+	}
+
+	const char* syntheticGestureName(int gesture);
+
+	// Draws the bodies in a frame as chains of spheres in front of a wall, as a depth image in millimetres,
+	// and optionally which body each pixel shows, 255 for none
+	void renderSyntheticDepth(const SkeletonFrame& frame, const PinholeIntrinsics& camera, int width, int height, uint16_t* depth, uint8_t* bodyIndex = NULL);
+
+	// Deterministic stand-in for a sensor: people walking around in front of it, with noise, dropouts and identity churn
+	class SyntheticSource {
+	public:
+		struct Options {
+			Options();
+
+			int bodies;
+			// KinectV1Layout or KinectV2Layout joint set
+			int jointCount;
+			unsigned seed;
+			double frameRate;
+			// Standard deviation of joint position noise, in metres
+			double noise;
+			// Chance per joint per frame of the joint being inferred
+			double inferredRate;
+			// Chance per body per frame of tracking dropping out and coming back with a new ID
+			double churnRate;
+			// Chance per body per frame of starting a gesture, when not already performing one
+			double gestureRate;
+			// How much people's height and arm length vary, as a fraction either way, 0 for everyone the same build
+			double buildSpread;
+		};
+
+		explicit SyntheticSource(const Options& options);
+
+		void next(SkeletonFrame& frame);
+
+		// Starts a gesture from the next frame, taking a second at speed 1
+		void perform(int body, int gesture, double speed = 1.0);
+
+		// The gesture a body is in the middle of, SyntheticGesture::None if any
+		int performing(int body) const;
+
+		// The last frame without noise or dropouts
+		const SkeletonFrame& truth() const;
+
+	private:
+		double uniform();
+		double gaussian();
+		void pose(int body, double t, Skeleton& skeleton);
+		void gesture(int body, double t, int v2, float& x, float& y, float& z) const;
+
+		Options m_options;
+		uint64_t m_rng;
+		int64_t m_frameIndex;
+		uint64_t m_nextTrackingId;
+
+		uint64_t m_trackingIds[MaxBodies];
+		int m_dropoutFrames[MaxBodies];
+
+		// Scale of each person's body, and of their arms on top of that
+		float m_stature[MaxBodies];
+		float m_armScale[MaxBodies];
+
+		int m_gesture[MaxBodies];
+		double m_gestureStart[MaxBodies];
+		double m_gestureLength[MaxBodies];
+
+		SkeletonFrame m_truth;
+	};
+}
@@ -0,0 +1,179 @@
+#include "Trace.h"
+
+#include <stdio.h>
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace KinectOsvr {
+	namespace Trace {
+
+		namespace {
+			struct Event {
+				const char* name;
+				int64_t start;
+				int64_t end;
+			};
+
+			// Written only by its own thread, read by whoever dumps
+			struct ThreadBuffer {
+				std::vector<Event> events;
+				std::atomic<uint64_t> written;
+				int id;
+				std::string name;
+			};
+
+			// Buffers outlive their threads so a dump at shutdown still sees finished workers
+			std::mutex g_registryMutex;
+			std::mutex g_dumpMutex;
+			std::vector<ThreadBuffer*> g_buffers;
+			std::string g_path;
+			size_t g_eventsPerThread = 1 << 16;
+			int64_t g_startTime = 0;
+
+			thread_local ThreadBuffer* t_buffer = NULL;
+			thread_local std::string t_name;
+
+			ThreadBuffer* registerThread() {
+				std::lock_guard<std::mutex> lock(g_registryMutex);
+				ThreadBuffer* buffer = new ThreadBuffer();
+				buffer->events.resize(g_eventsPerThread);
+				buffer->written.store(0, std::memory_order_relaxed);
+				buffer->id = (int)g_buffers.size() + 1;
+				buffer->name = t_name;
+				g_buffers.push_back(buffer);
+				return buffer;
+			}
+
+			void writeString(FILE* file, const char* text) {
+				fputc('"', file);
+				for (const char* c = text; *c; c++) {
+					if (*c == '"' || *c == '\\') fputc('\\', file);
+					fputc(*c, file);
+				}
+				fputc('"', file);
+			}
+		}
+
+		namespace Detail {
+			std::atomic<bool> enabled(false);
+
+			int64_t now() {
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			}
+
+			void record(const char* name, int64_t start, int64_t end) {
+				ThreadBuffer* buffer = t_buffer;
+				if (buffer == NULL) {
+					buffer = t_buffer = registerThread();
+				}
+
+				uint64_t index = buffer->written.load(std::memory_order_relaxed);
+				Event& event = buffer->events[index % buffer->events.size()];
+				event.name = name;
+				event.start = start;
+				event.end = end;
+				buffer->written.store(index + 1, std::memory_order_release);
+			}
+
+			void finish(const char* name, int64_t start) {
+				record(name, start, now());
+			}
+		}
+
+		void start(const std::string& path, size_t eventsPerThread) {
+			{
+				std::lock_guard<std::mutex> lock(g_registryMutex);
+				g_path = path;
+				g_eventsPerThread = eventsPerThread > 0 ? eventsPerThread : 1;
+				g_startTime = Detail::now();
+				for (size_t i = 0; i < g_buffers.size(); i++) {
+					g_buffers[i]->written.store(0, std::memory_order_relaxed);
+				}
+			}
+			Detail::enabled.store(true, std::memory_order_release);
+		}
+
+		void stop() {
+			if (!Detail::enabled.exchange(false)) return;
+			dump();
+		}
+
+		bool dump() {
+			// Only one dump writes the file at a time, but threads starting meanwhile don't wait on the disk
+			std::lock_guard<std::mutex> dumping(g_dumpMutex);
+			std::string path;
+			int64_t startTime;
+			std::vector<ThreadBuffer*> buffers;
+			std::vector<std::string> names;
+			{
+				std::lock_guard<std::mutex> lock(g_registryMutex);
+				path = g_path;
+				startTime = g_startTime;
+				buffers = g_buffers;
+				for (size_t b = 0; b < buffers.size(); b++) names.push_back(buffers[b]->name);
+			}
+			if (path.empty()) return false;
+
+			FILE* file = fopen(path.c_str(), "w");
+			if (file == NULL) return false;
+
+			fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+			bool first = true;
+			std::vector<Event> events;
+
+			for (size_t b = 0; b < buffers.size(); b++) {
+				ThreadBuffer* buffer = buffers[b];
+				uint64_t capacity = buffer->events.size();
+
+				if (!names[b].empty()) {
+					fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", buffer->id);
+					writeString(file, names[b].c_str());
+					fprintf(file, "}}");
+					first = false;
+				}
+
+				// Copy without stopping the writer, then drop anything it may have lapped meanwhile
+				uint64_t written = buffer->written.load(std::memory_order_acquire);
+				uint64_t begin = written > capacity ? written - capacity : 0;
+				events.clear();
+				for (uint64_t i = begin; i < written; i++) {
+					events.push_back(buffer->events[i % capacity]);
+				}
+				uint64_t after = buffer->written.load(std::memory_order_acquire);
+				uint64_t valid = after >= capacity ? after - capacity + 1 : 0;
+
+				for (uint64_t i = begin; i < written; i++) {
+					if (i < valid) continue;
+					const Event& event = events[i - begin];
+					fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+					writeString(file, event.name);
+					fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", buffer->id,
+						(event.start - startTime) / 1000.0, (event.end - event.start) / 1000.0);
+					first = false;
+				}
+			}
+
+			fprintf(file, "\n]}\n");
+			fclose(file);
+			return true;
+		}
+
+		void setThreadName(const std::string& name) {
+			t_name = name;
+			if (t_buffer != NULL) {
+				std::lock_guard<std::mutex> lock(g_registryMutex);
+				t_buffer->name = name;
+			}
+		}
+
+		Session::Session(const std::string& path) {
+			start(path);
+		}
+
+		Session::~Session() {
+			stop();
+		}
+	}
+};
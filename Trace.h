@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Times the enclosing block when tracing is on, otherwise costs a branch on entry and an empty call on exit
+#define KINECT_TRACE_CONCAT2(a, b) a##b
+#define KINECT_TRACE_CONCAT(a, b) KINECT_TRACE_CONCAT2(a, b)
+#define KINECT_TRACE(name) KinectOsvr::Trace::Scope KINECT_TRACE_CONCAT(traceScope, __LINE__)(name)
+
+namespace KinectOsvr {
+	// Opt-in timeline of where each thread's time went, written as a Chrome trace for chrome://tracing or Perfetto
+	namespace Trace {
+		// Starts recording into per-thread rings, each keeping the most recent events
+		void start(const std::string& path, size_t eventsPerThread = 1 << 16);
+
+		// Writes the trace and stops recording
+		void stop();
+
+		// Writes what the rings hold now, recording carries on
+		bool dump();
+
+		// Shown as the thread's name in the trace
+		void setThreadName(const std::string& name);
+
+		// Starts tracing for as long as it exists, for handing to registerObjectForDeletion
+		class Session {
+		public:
+			explicit Session(const std::string& path);
+			~Session();
+		};
+
+		namespace Detail {
+			extern std::atomic<bool> enabled;
+			int64_t now();
+			void record(const char* name, int64_t start, int64_t end);
+			inline void skip(const char*, int64_t) {}
+			void finish(const char* name, int64_t start);
+		}
+
+		inline bool enabled() {
+			return Detail::enabled.load(std::memory_order_relaxed);
+		}
+
+		class Scope {
+		public:
+			// The one branch picks what the exit does, so tracing off costs no second test on the way out
+			explicit Scope(const char* name) : m_name(name), m_start(0), m_exit(&Detail::skip) {
+				if (enabled()) {
+					m_start = Detail::now();
+					m_exit = &Detail::finish;
+				}
+			}
+
+			~Scope() {
+				m_exit(m_name, m_start);
+			}
+
+		private:
+			Scope(const Scope&);
+			Scope& operator=(const Scope&);
+
+			const char* m_name;
+			int64_t m_start;
+			void (*m_exit)(const char* name, int64_t start);
+		};
+	}
+}
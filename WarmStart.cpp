@@ -0,0 +1,372 @@
+#include "WarmStart.h"
+#include "Log.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <type_traits>
+
+namespace KinectOsvr {
+
+	static_assert(std::is_trivially_copyable<WarmStartState>::value, "WarmStartState is saved as it is in memory");
+
+	namespace {
+		const char Magic[4] = { 'K', 'W', 'S', 'T' };
+		const uint32_t Version = 1;
+
+		// Anything but the calibration is saved at most this often, in seconds
+		const int64_t SaveInterval = 10;
+		// How long the writer sleeps between looking for a new state, so handing one over never has to wake it
+		const int PollMilliseconds = 50;
+		// Marks the middle buffer as holding a state the writer hasn't taken
+		const int Fresh = 4;
+
+		// How far ahead of the clock a snapshot may have been saved before the clock is taken to have been set back
+		const int64_t ClockSlack = 300;
+
+		// The sensor's floor estimate wanders by less than this between sessions, 2 degrees and 5 cm
+		const double FloorAngle = 0.035;
+		const double FloorDistance = 0.05;
+
+		struct Header {
+			char magic[4];
+			uint32_t version;
+			// The state is stored as it is in memory, so a reader has to agree on the layout
+			uint32_t stateSize;
+			int32_t jointCount;
+			int64_t savedAt;
+			// CRC-32 of the state
+			uint32_t checksum;
+			uint32_t reserved;
+		};
+
+		struct CrcTable {
+			CrcTable() {
+				for (uint32_t i = 0; i < 256; i++) {
+					uint32_t c = i;
+					for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					entries[i] = c;
+				}
+			}
+			uint32_t entries[256];
+		};
+
+		uint32_t crc32(const void* data, size_t size) {
+			static const CrcTable table;
+
+			const unsigned char* bytes = (const unsigned char*)data;
+			uint32_t crc = 0xFFFFFFFFu;
+			for (size_t i = 0; i < size; i++) {
+				crc = table.entries[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+			}
+			return crc ^ 0xFFFFFFFFu;
+		}
+
+		// A whole file mapped read-only for as long as this is in scope
+		class MappedFile {
+		public:
+			explicit MappedFile(const std::string& path) : m_data(NULL), m_size(0) {
+#ifdef _WIN32
+				m_mapping = NULL;
+				m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+				if (m_file == INVALID_HANDLE_VALUE) return;
+
+				LARGE_INTEGER size;
+				if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) return;
+				m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+				if (m_mapping == NULL) return;
+				m_data = (const unsigned char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+				if (m_data != NULL) m_size = (size_t)size.QuadPart;
+#else
+				m_file = ::open(path.c_str(), O_RDONLY);
+				if (m_file < 0) return;
+
+				struct stat info;
+				if (fstat(m_file, &info) != 0 || info.st_size == 0) return;
+				void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+				if (data == MAP_FAILED) return;
+				m_data = (const unsigned char*)data;
+				m_size = (size_t)info.st_size;
+#endif
+			}
+
+			~MappedFile() {
+#ifdef _WIN32
+				if (m_data != NULL) UnmapViewOfFile(m_data);
+				if (m_mapping != NULL) CloseHandle(m_mapping);
+				if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+#else
+				if (m_data != NULL) munmap((void*)m_data, m_size);
+				if (m_file >= 0) ::close(m_file);
+#endif
+			}
+
+			bool exists() const {
+#ifdef _WIN32
+				return m_file != INVALID_HANDLE_VALUE;
+#else
+				return m_file >= 0;
+#endif
+			}
+
+			const unsigned char* data() const { return m_data; }
+			size_t size() const { return m_size; }
+
+		private:
+#ifdef _WIN32
+			HANDLE m_file;
+			HANDLE m_mapping;
+#else
+			int m_file;
+#endif
+			const unsigned char* m_data;
+			size_t m_size;
+		};
+
+		bool bounded(double value) {
+			return value == value && fabs(value) < 1e6;
+		}
+
+		bool validPose(const OSVR_PoseState& pose) {
+			const OSVR_Quaternion& q = pose.rotation;
+			for (int i = 0; i < 3; i++) {
+				if (!bounded(pose.translation.data[i])) return false;
+			}
+			for (int i = 0; i < 4; i++) {
+				if (!bounded(q.data[i])) return false;
+			}
+			double norm = q.data[0] * q.data[0] + q.data[1] * q.data[1] + q.data[2] * q.data[2] + q.data[3] * q.data[3];
+			return fabs(norm - 1.0) < 1e-3;
+		}
+
+		// Checks what the checksum can't: a snapshot written with the right layout from bad values
+		bool plausible(const WarmStartState& state) {
+			if (state.calibrated && !(validPose(state.offset) && validPose(state.kinectPose))) return false;
+			for (int i = 0; i < 4; i++) {
+				if (!bounded(state.floor[i])) return false;
+			}
+			for (int i = 0; i < 3; i++) {
+				if (!bounded(state.lastPosition[i])) return false;
+			}
+			if (!bounded(state.neckLength) || state.neckLength < 0 || state.neckLength > 1.0) return false;
+			return !state.hasLatency || (bounded(state.latency) && fabs(state.latency) < 10000.0);
+		}
+
+		bool sameCalibration(const WarmStartState& a, const WarmStartState& b) {
+			return a.calibrated == b.calibrated &&
+				memcmp(a.floor, b.floor, sizeof(a.floor)) == 0 &&
+				memcmp(&a.offset, &b.offset, sizeof(a.offset)) == 0 &&
+				memcmp(&a.kinectPose, &b.kinectPose, sizeof(a.kinectPose)) == 0;
+		}
+
+		// Replaces the file in one step, so a crash part way leaves the old snapshot or the new one, never half of each
+		bool replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+			return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+			return rename(from.c_str(), to.c_str()) == 0;
+#endif
+		}
+	}
+
+	WarmStartState::WarmStartState() {
+		// Padding included, so states compare and checksum the same byte for byte
+		memset((void*)this, 0, sizeof(*this));
+		osvrPose3SetIdentity(&offset);
+		osvrPose3SetIdentity(&kinectPose);
+		signature.clear();
+	}
+
+	const char* WarmStart::describe(LoadResult result) {
+		switch (result) {
+		case Loaded: return "loaded";
+		case Missing: return "missing";
+		case Corrupt: return "corrupt";
+		case Incompatible: return "incompatible";
+		case Stale: return "stale";
+		}
+		return "unknown";
+	}
+
+	WarmStart::WarmStart() : m_jointCount(0), m_maxAge(0), m_saved(false), m_savedAt(0), m_queued(0), m_failed(false),
+		m_back(0), m_front(2), m_middle(1), m_stopping(false), m_wake(false), m_written(0), m_writtenOk(false) {}
+
+	WarmStart::~WarmStart() {
+		close();
+	}
+
+	void WarmStart::open(const std::string& path, int jointCount, double maxAge) {
+		close();
+		m_path = path;
+		m_jointCount = jointCount;
+		m_maxAge = maxAge;
+		m_saved = false;
+		m_failed.store(false, std::memory_order_relaxed);
+		if (m_path.empty()) return;
+
+		m_stopping.store(false, std::memory_order_relaxed);
+		m_thread = std::thread(&WarmStart::run, this);
+	}
+
+	void WarmStart::close() {
+		if (!m_thread.joinable()) return;
+		m_stopping.store(true, std::memory_order_release);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_wake = true;
+		}
+		m_changed.notify_all();
+		m_thread.join();
+	}
+
+	bool WarmStart::isOpen() const {
+		return !m_path.empty();
+	}
+
+	const std::string& WarmStart::path() const {
+		return m_path;
+	}
+
+	WarmStart::LoadResult WarmStart::load(WarmStartState& state, int64_t now) const {
+		if (m_path.empty()) return Missing;
+
+		MappedFile file(m_path);
+		if (!file.exists()) return Missing;
+		if (file.size() < sizeof(Header)) return Corrupt;
+
+		Header header;
+		memcpy(&header, file.data(), sizeof(header));
+		if (memcmp(header.magic, Magic, sizeof(Magic)) != 0) return Corrupt;
+		if (header.version != Version || header.stateSize != sizeof(WarmStartState) || header.jointCount != m_jointCount) return Incompatible;
+		if (file.size() != sizeof(Header) + sizeof(WarmStartState)) return Corrupt;
+
+		const unsigned char* data = file.data() + sizeof(Header);
+		if (crc32(data, sizeof(WarmStartState)) != header.checksum) return Corrupt;
+
+		WarmStartState loaded;
+		memcpy(&loaded, data, sizeof(loaded));
+		if (!plausible(loaded)) return Corrupt;
+
+		if (header.savedAt > now + ClockSlack) return Stale;
+		if (m_maxAge > 0 && now - header.savedAt > m_maxAge) return Stale;
+
+		memcpy(&state, &loaded, sizeof(state));
+		return Loaded;
+	}
+
+	bool WarmStart::update(const WarmStartState& state, int64_t now) {
+		if (!m_thread.joinable()) return false;
+
+		bool failed = m_failed.load(std::memory_order_relaxed);
+		if (m_saved && !failed) {
+			if (memcmp(&state, &m_last, sizeof(state)) == 0) return false;
+			if (sameCalibration(state, m_last) && now - m_savedAt < SaveInterval) return false;
+		}
+		// Don't keep retrying every frame once the file can't be written
+		if (failed && now - m_savedAt < SaveInterval) return false;
+		queue(state, now);
+		return true;
+	}
+
+	bool WarmStart::flush(const WarmStartState& state, int64_t now) {
+		if (!m_thread.joinable()) return false;
+
+		uint64_t sequence = queue(state, now);
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_wake = true;
+		m_changed.notify_all();
+		m_changed.wait(lock, [this, sequence]() { return m_written >= sequence; });
+		return m_writtenOk;
+	}
+
+	uint64_t WarmStart::queue(const WarmStartState& state, int64_t now) {
+		Pending& pending = m_pending[m_back];
+		memcpy(&pending.state, &state, sizeof(state));
+		pending.savedAt = now;
+		pending.sequence = ++m_queued;
+		m_back = m_middle.exchange(m_back | Fresh, std::memory_order_acq_rel) & ~Fresh;
+
+		m_saved = true;
+		m_savedAt = now;
+		memcpy(&m_last, &state, sizeof(state));
+		return m_queued;
+	}
+
+	const WarmStart::Pending* WarmStart::take() {
+		if (!(m_middle.load(std::memory_order_relaxed) & Fresh)) return NULL;
+		m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & ~Fresh;
+		return &m_pending[m_front];
+	}
+
+	void WarmStart::run() {
+		for (;;) {
+			// Anything handed over before close is taken on the way out
+			bool stopping = m_stopping.load(std::memory_order_acquire);
+			const Pending* pending = take();
+			if (pending != NULL) {
+				bool saved = save(pending->state, pending->savedAt);
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_written = pending->sequence;
+					m_writtenOk = saved;
+				}
+				m_changed.notify_all();
+				continue;
+			}
+			if (stopping) break;
+
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_changed.wait_for(lock, std::chrono::milliseconds(PollMilliseconds), [this]() { return m_wake; });
+			m_wake = false;
+		}
+	}
+
+	// On the writer's thread
+	bool WarmStart::save(const WarmStartState& state, int64_t now) {
+		Header header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, Magic, sizeof(Magic));
+		header.version = Version;
+		header.stateSize = sizeof(WarmStartState);
+		header.jointCount = m_jointCount;
+		header.savedAt = now;
+		header.checksum = crc32(&state, sizeof(state));
+
+		std::string temporary = m_path + ".tmp";
+		FILE* file = fopen(temporary.c_str(), "wb");
+		bool written = file != NULL &&
+			fwrite(&header, sizeof(header), 1, file) == 1 &&
+			fwrite(&state, sizeof(state), 1, file) == 1;
+		if (file != NULL) written = fclose(file) == 0 && written;
+		written = written && replaceFile(temporary, m_path);
+
+		if (!written) {
+			if (!m_failed.exchange(true, std::memory_order_relaxed)) KINECT_LOG(Warning, "Failed to save the warm-start snapshot {}", m_path);
+			remove(temporary.c_str());
+			return false;
+		}
+
+		m_failed.store(false, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool WarmStart::sameFloor(const float a[4], const float b[4]) {
+		double na = sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+		double nb = sqrt(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+		if (na <= 0 || nb <= 0) return false;
+
+		double cosine = (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / (na * nb);
+		return cosine >= cos(FloorAngle) && fabs(a[3] / na - b[3] / nb) <= FloorDistance;
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "BodyIdentifier.h"
+
+#include <osvr/Util/Pose3C.h>
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace KinectOsvr {
+	// What a device has worked out about where it is and who it's tracking, kept across server restarts.
+	// It's stored as it is in memory, so it has to stay trivially copyable.
+	struct WarmStartState {
+		WarmStartState();
+
+		// Whether the device has been recentered, the transforms mean nothing until it has
+		int32_t calibrated;
+		// Where the sensor sees the floor, as a plane in sensor space, all zero if it hasn't
+		float floor[4];
+		OSVR_PoseState offset;
+		OSVR_PoseState kinectPose;
+
+		// The person last tracked, and where
+		int32_t hasPerson;
+		float lastPosition[3];
+		BodySignature signature;
+
+		// Neck to head as learned by head fusion, 0 if it hasn't been
+		double neckLength;
+		// Skeleton latency against the orientation tracker in milliseconds, if it's been measured
+		int32_t hasLatency;
+		double latency;
+	};
+
+	// Keeps a WarmStartState in a small versioned file, written whenever it changes and read back when a device
+	// starts so it can track from its first frame. Times are wall clock seconds since 1970. The file is written by
+	// a thread of its own, so updating from the device's update thread never touches the disk or takes a lock.
+	class WarmStart {
+	public:
+		enum LoadResult {
+			Loaded,
+			// No snapshot yet
+			Missing,
+			// Damaged or not a snapshot at all
+			Corrupt,
+			// From another version, build or sensor
+			Incompatible,
+			// Too old to trust, or saved by a clock that's since been set back
+			Stale
+		};
+		static const char* describe(LoadResult result);
+
+		WarmStart();
+		~WarmStart();
+
+		// maxAge in seconds, 0 for no limit. Starts the writer.
+		void open(const std::string& path, int jointCount, double maxAge);
+		// Writes what's been handed over and stops the writer
+		void close();
+		bool isOpen() const;
+		const std::string& path() const;
+
+		// Maps the snapshot and copies the state out if it can be trusted
+		LoadResult load(WarmStartState& state, int64_t now) const;
+
+		// Saves straight away when the calibration has changed, otherwise at most every few seconds, and only if
+		// anything has. Returns whether it handed the state to the writer, which only ever writes the newest.
+		bool update(const WarmStartState& state, int64_t now);
+		// Saves now, as on shutdown, so the snapshot's age counts from when it was last in use. Waits for the
+		// writer and returns whether the file was written.
+		bool flush(const WarmStartState& state, int64_t now);
+
+		// Whether two floor planes are the same to within what the sensor's estimate wanders by
+		static bool sameFloor(const float a[4], const float b[4]);
+
+	private:
+		struct Pending {
+			WarmStartState state;
+			int64_t savedAt;
+			uint64_t sequence;
+		};
+
+		// Hands a state to the writer, returning its sequence number
+		uint64_t queue(const WarmStartState& state, int64_t now);
+		// The newest state handed over since the last call, NULL if there isn't one
+		const Pending* take();
+		void run();
+		bool save(const WarmStartState& state, int64_t now);
+
+		std::string m_path;
+		int m_jointCount;
+		double m_maxAge;
+
+		// What was last handed over, for deciding whether to hand over another
+		bool m_saved;
+		int64_t m_savedAt;
+		WarmStartState m_last;
+		uint64_t m_queued;
+		// Set by the writer while the file can't be written
+		std::atomic<bool> m_failed;
+
+		// A triple buffer: the caller fills m_pending[m_back] and swaps it for the middle one, the writer swaps the
+		// middle one for m_pending[m_front] when it's marked fresh. Neither side waits for the other.
+		Pending m_pending[3];
+		int m_back;
+		int m_front;
+		std::atomic<int> m_middle;
+
+		std::thread m_thread;
+		std::atomic<bool> m_stopping;
+		// Wakes the writer for flush and close, and tells flush what's been written
+		std::mutex m_mutex;
+		std::condition_variable m_changed;
+		bool m_wake;
+		uint64_t m_written;
+		bool m_writtenOk;
+	};
+}
@@ -0,0 +1,302 @@
+#include "WorkerPool.h"
+#include "Log.h"
+#include "Trace.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <string>
+
+namespace KinectOsvr {
+
+	namespace {
+		thread_local WorkerPool* t_pool = NULL;
+		thread_local int t_queue = -1;
+
+		// Spin briefly before sleeping, per-frame batches arrive a few microseconds apart
+		const int SpinCount = 2000;
+
+		int currentCore() {
+#ifdef _WIN32
+			return (int)GetCurrentProcessorNumber();
+#else
+			return sched_getcpu();
+#endif
+		}
+
+#ifdef _WIN32
+		typedef DWORD_PTR CoreMask;
+		typedef HANDLE ThreadHandle;
+
+		// The cores the process may run on
+		bool allowedCores(CoreMask& mask) {
+			DWORD_PTR system;
+			return GetProcessAffinityMask(GetCurrentProcess(), &mask, &system) != 0;
+		}
+
+		CoreMask noCores() {
+			return 0;
+		}
+
+		bool hasCore(const CoreMask& mask, int core) {
+			return core < 64 && ((mask >> core) & 1) != 0;
+		}
+
+		void setCore(CoreMask& mask, int core, bool on) {
+			if (core >= 64) return;
+			if (on) mask |= DWORD_PTR(1) << core;
+			else mask &= ~(DWORD_PTR(1) << core);
+		}
+
+		int countCores(const CoreMask& mask) {
+			int count = 0;
+			for (int i = 0; i < 64; i++) count += hasCore(mask, i);
+			return count;
+		}
+
+		ThreadHandle currentThread() {
+			return GetCurrentThread();
+		}
+
+		// 0, or the error the system gave
+		long setAffinity(ThreadHandle thread, const CoreMask& mask) {
+			return SetThreadAffinityMask(thread, mask) != 0 ? 0 : (long)GetLastError();
+		}
+#else
+		typedef cpu_set_t CoreMask;
+		typedef pthread_t ThreadHandle;
+
+		// The cores the calling thread may run on, which takes in the process's affinity and cpuset
+		bool allowedCores(CoreMask& mask) {
+			CPU_ZERO(&mask);
+			return sched_getaffinity(0, sizeof(mask), &mask) == 0;
+		}
+
+		CoreMask noCores() {
+			CoreMask mask;
+			CPU_ZERO(&mask);
+			return mask;
+		}
+
+		bool hasCore(const CoreMask& mask, int core) {
+			return core < CPU_SETSIZE && CPU_ISSET(core, &mask);
+		}
+
+		void setCore(CoreMask& mask, int core, bool on) {
+			if (core >= CPU_SETSIZE) return;
+			if (on) CPU_SET(core, &mask);
+			else CPU_CLR(core, &mask);
+		}
+
+		int countCores(const CoreMask& mask) {
+			return CPU_COUNT(&mask);
+		}
+
+		ThreadHandle currentThread() {
+			return pthread_self();
+		}
+
+		// 0, or the error the system gave
+		long setAffinity(ThreadHandle thread, const CoreMask& mask) {
+			return pthread_setaffinity_np(thread, sizeof(mask), &mask);
+		}
+#endif
+
+		// Once a pool has reserved the update thread's core, the cores background threads are kept to. Written by the
+		// first pool to reserve one, before the flag is set.
+		CoreMask g_backgroundCores;
+		std::once_flag g_backgroundOnce;
+		std::atomic<bool> g_coreReserved(false);
+	}
+
+	WorkerPool::WorkerPool(int threads) : m_nextQueue(0), m_queued(0), m_stop(false), m_pinned(false) {
+		CoreMask allowed;
+		int cores = allowedCores(allowed) ? countCores(allowed) : (int)std::thread::hardware_concurrency();
+		if (threads < 0) {
+			threads = cores > 1 ? cores - 1 : 0;
+		}
+
+		// The calling thread always helps out in wait(), so a pool of size 0 still needs a queue
+		int queues = threads > 0 ? threads : 1;
+		for (int i = 0; i < queues; i++) {
+			m_queues.push_back(new Queue());
+		}
+
+		for (int i = 0; i < threads; i++) {
+			m_threads.push_back(std::thread(&WorkerPool::workerLoop, this, i));
+		}
+	}
+
+	WorkerPool::~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+
+		for (size_t i = 0; i < m_threads.size(); i++) {
+			m_threads[i].join();
+		}
+		for (size_t i = 0; i < m_queues.size(); i++) {
+			delete m_queues[i];
+		}
+	}
+
+	int WorkerPool::size() const {
+		return (int)m_threads.size();
+	}
+
+	bool WorkerPool::reserveCurrentCore() {
+		if (m_threads.empty() || t_pool == this || m_pinned.exchange(true)) return false;
+
+		CoreMask allowed;
+		int core = currentCore();
+		if (core < 0 || !allowedCores(allowed) || !hasCore(allowed, core)) return false;
+
+		// With only the one core there's nowhere else for workers to go
+		CoreMask others = allowed;
+		setCore(others, core, false);
+		if (countCores(others) == 0) return false;
+
+		CoreMask own = noCores();
+		setCore(own, core, true);
+		long error = setAffinity(currentThread(), own);
+		if (error != 0) {
+			KINECT_LOG(Warning, "Failed to pin the update thread to core {} (error {}), workers are left unpinned", core, error);
+			return false;
+		}
+
+		for (size_t i = 0; i < m_threads.size(); i++) {
+			error = setAffinity(m_threads[i].native_handle(), others);
+			if (error == 0) continue;
+
+			// Half pinned is worse than not at all, everyone goes back to where they were allowed
+			KINECT_LOG(Warning, "Failed to keep worker {} off core {} (error {}), workers are left unpinned", (int)i, core, error);
+			for (size_t j = 0; j < i; j++) setAffinity(m_threads[j].native_handle(), allowed);
+			setAffinity(currentThread(), allowed);
+			return false;
+		}
+
+		std::call_once(g_backgroundOnce, [&others]() {
+			g_backgroundCores = others;
+			g_coreReserved.store(true, std::memory_order_release);
+		});
+		KINECT_LOG(Info, "Update thread pinned to core {}, {} workers on the other {} cores", core, (int)m_threads.size(), countCores(others));
+		return true;
+	}
+
+	void WorkerPool::submit(TaskGroup& group, Task task) {
+		group.m_pending.fetch_add(1, std::memory_order_relaxed);
+
+		// Workers push onto their own queue, everyone else spreads work round-robin
+		int queue = t_pool == this ? t_queue : (int)(m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size());
+		Item item = { task, &group };
+		{
+			std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+			m_queues[queue]->items.push_back(item);
+		}
+		m_queued.fetch_add(1, std::memory_order_release);
+
+		if (!m_threads.empty()) {
+			{
+				std::lock_guard<std::mutex> lock(m_sleepMutex);
+			}
+			m_wake.notify_one();
+		}
+	}
+
+	void WorkerPool::wait(TaskGroup& group) {
+		int self = t_pool == this ? t_queue : -1;
+		while (!group.done()) {
+			Item item;
+			if ((self >= 0 && pop(self, item)) || steal(self, item)) {
+				run(item);
+			}
+			else {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	bool WorkerPool::pop(int queue, Item& item) {
+		Queue* q = m_queues[queue];
+		std::lock_guard<std::mutex> lock(q->mutex);
+		if (q->items.empty()) return false;
+
+		// Newest first from our own queue, it's most likely still in cache
+		item = q->items.back();
+		q->items.pop_back();
+		m_queued.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool WorkerPool::steal(int thief, Item& item) {
+		int queues = (int)m_queues.size();
+		for (int i = 1; i <= queues; i++) {
+			int victim = (thief + i) % queues;
+			if (victim < 0) victim += queues;
+			if (victim == thief) continue;
+
+			Queue* q = m_queues[victim];
+			std::lock_guard<std::mutex> lock(q->mutex);
+			if (!q->items.empty()) {
+				item = q->items.front();
+				q->items.pop_front();
+				m_queued.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void WorkerPool::run(Item& item) {
+		item.task();
+		item.group->m_pending.fetch_sub(1, std::memory_order_release);
+	}
+
+	void WorkerPool::workerLoop(int index) {
+		t_pool = this;
+		t_queue = index;
+		Trace::setThreadName("worker " + std::to_string(index));
+
+		int idle = 0;
+		while (true) {
+			Item item;
+			if (pop(index, item) || steal(index, item)) {
+				run(item);
+				idle = 0;
+				continue;
+			}
+
+			if (++idle < SpinCount) {
+				std::this_thread::yield();
+				continue;
+			}
+			idle = 0;
+
+			std::unique_lock<std::mutex> lock(m_sleepMutex);
+			m_wake.wait(lock, [this]() { return m_stop || m_queued.load(std::memory_order_acquire) > 0; });
+			if (m_stop && m_queued.load(std::memory_order_acquire) == 0) {
+				return;
+			}
+		}
+	}
+
+	void lowerPriority(std::thread& thread) {
+#ifdef _WIN32
+		SetThreadPriority(thread.native_handle(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(SCHED_IDLE)
+		sched_param param = {};
+		pthread_setschedparam(thread.native_handle(), SCHED_IDLE, &param);
+#endif
+
+		// Started from the update thread it would otherwise share that thread's core alone
+		if (g_coreReserved.load(std::memory_order_acquire)) {
+			setAffinity(thread.native_handle(), g_backgroundCores);
+		}
+	}
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace KinectOsvr {
+	class WorkerPool {
+	public:
+		typedef std::function<void()> Task;
+
+		// Counts outstanding tasks so a caller can join on a batch of work
+		class TaskGroup {
+		public:
+			TaskGroup() : m_pending(0) {}
+			bool done() const { return m_pending.load(std::memory_order_acquire) == 0; }
+		private:
+			friend class WorkerPool;
+			std::atomic<int> m_pending;
+		};
+
+		// threads < 0 starts one worker per core but one, which is left for the server's update thread
+		explicit WorkerPool(int threads = -1);
+		~WorkerPool();
+
+		int size() const;
+
+		// Pins the calling thread to the core it's on and every worker to the other cores the process may use, so
+		// neither migrates onto the other. Only the first call counts, and it's meant for the server's update thread,
+		// since the thread that builds the pool at plugin load isn't that one. False if nothing was pinned.
+		bool reserveCurrentCore();
+		void submit(TaskGroup& group, Task task);
+
+		// Blocks until every task in the group has finished, running queued work on the calling thread meanwhile
+		void wait(TaskGroup& group);
+
+	private:
+		struct Item {
+			Task task;
+			TaskGroup* group;
+		};
+		struct Queue {
+			std::mutex mutex;
+			std::deque<Item> items;
+		};
+
+		bool pop(int queue, Item& item);
+		bool steal(int thief, Item& item);
+		void run(Item& item);
+		void workerLoop(int index);
+
+		std::vector<Queue*> m_queues;
+		std::vector<std::thread> m_threads;
+		std::atomic<unsigned> m_nextQueue;
+		std::atomic<int> m_queued;
+
+		std::mutex m_sleepMutex;
+		std::condition_variable m_wake;
+		bool m_stop;
+		std::atomic<bool> m_pinned;
+	};
+
+	// For background threads that should only get time the sensor and worker threads leave over. Once a core has been
+	// reserved for the update thread they're kept off it too.
+	void lowerPriority(std::thread& thread);
+}
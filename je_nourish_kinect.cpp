@@ -2,6 +2,10 @@
 #include "stdafx.h"
 #include "KinectV1Device.h"
 #include "KinectV2Device.h"
+#include "Config.h"
+#include "Log.h"
+#include "Trace.h"
+#include "WorkerPool.h"
 
 // Standard includes
 #include <iostream>
@@ -9,15 +13,15 @@
 namespace KinectOsvr {
 	class HardwareDetectionV1 {
 	public:
-		HardwareDetectionV1() : m_found(false) {}
+		HardwareDetectionV1(WorkerPool& pool, const Config& config) : m_found(false), m_pool(pool), m_config(config) {}
 		OSVR_ReturnCode operator()(OSVR_PluginRegContext ctx) {
 
 			if (!m_found) {
-				INuiSensor* pNuiSensor;
-
-				if (KinectV1Device::Detect(&pNuiSensor)) {
+				// Only checks the runtime is installed, loading it and finding a sensor happen in the background.
+				// Until a sensor's ready the device says so on its status channel.
+				if (KinectV1Device::Detect()) {
 					m_found = true;
-					osvr::pluginkit::registerObjectForDeletion(ctx, new KinectV1Device(ctx, pNuiSensor));
+					osvr::pluginkit::registerObjectForDeletion(ctx, new KinectV1Device(ctx, m_pool, m_config));
 				}
 			}
 			return OSVR_RETURN_SUCCESS;
@@ -25,19 +29,19 @@ namespace KinectOsvr {
 
 	private:
 		bool m_found;
+		WorkerPool& m_pool;
+		Config m_config;
 	};
 	class HardwareDetectionV2 {
 	public:
-		HardwareDetectionV2() : m_found(false) {}
+		HardwareDetectionV2(WorkerPool& pool, const Config& config) : m_found(false), m_pool(pool), m_config(config) {}
 		OSVR_ReturnCode operator()(OSVR_PluginRegContext ctx) {
 
 			if (!m_found) {
-				IKinectSensor* pKinectSensor;
-				
-				if (KinectV2Device::Detect(&pKinectSensor)) {
+				if (KinectV2Device::Detect()) {
 					m_found = true;
 					osvr::pluginkit::registerObjectForDeletion(
-						ctx, new KinectV2Device(ctx, pKinectSensor));
+						ctx, new KinectV2Device(ctx, m_pool, m_config));
 				}
 			}
 			return OSVR_RETURN_SUCCESS;
@@ -45,6 +49,8 @@ namespace KinectOsvr {
 
 	private:
 		bool m_found;
+		WorkerPool& m_pool;
+		Config m_config;
 	};
 }
 
@@ -52,8 +58,26 @@ OSVR_PLUGIN(je_nourish_kinect) {
 
     osvr::pluginkit::PluginContext context(ctx);
 
-	context.registerHardwareDetectCallback(new KinectOsvr::HardwareDetectionV1());
-    context.registerHardwareDetectCallback(new KinectOsvr::HardwareDetectionV2());
+	KinectOsvr::Config config = KinectOsvr::Config::fromEnvironment();
+
+	// Registered first of all, so it's still writing while everything else shuts down
+	KinectOsvr::Log::LogParams logParams;
+	logParams.path = config.logPath;
+	if (config.logSize > 0) logParams.fileSize = (size_t)config.logSize * 1024;
+	context.registerObjectForDeletion(new KinectOsvr::Log::Session(logParams));
+
+	// Registered before anything it traces, so the trace is written after they've shut down
+	if (!config.tracePath.empty()) {
+		KinectOsvr::Trace::setThreadName("server");
+		context.registerObjectForDeletion(new KinectOsvr::Trace::Session(config.tracePath));
+	}
+
+	// Shared by both devices, registered first so it outlives them
+	KinectOsvr::WorkerPool* pool = new KinectOsvr::WorkerPool(config.workerThreads);
+	context.registerObjectForDeletion(pool);
+
+	context.registerHardwareDetectCallback(new KinectOsvr::HardwareDetectionV1(*pool, config));
+    context.registerHardwareDetectCallback(new KinectOsvr::HardwareDetectionV2(*pool, config));
 
     return OSVR_RETURN_SUCCESS;
 }
@@ -0,0 +1,355 @@
+// Session archives: measures what archiving costs the update thread and how fast queries scan hours of it,
+// on synthetic sessions, and summarizes and queries archives written with OSVR_KINECT_ARCHIVE
+#include "Archive.h"
+#include "SyntheticSource.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace KinectOsvr {
+	namespace {
+		typedef std::chrono::steady_clock Clock;
+
+		// Head and hands are the same joints in both sensors' sets
+		const int Head = V2Joint::Head;
+		const int HandLeft = V2Joint::HandLeft;
+		const int HandRight = V2Joint::HandRight;
+
+		// Distinct frames cycled through when timing the writer
+		const int Frames = 300;
+
+		struct Options {
+			Options() : hours(3), frames(100000), chunkFrames(ArchiveWriter::DefaultChunkFrames), seed(1), write("archive_bench.ksa") {}
+
+			double hours;
+			int frames;
+			int chunkFrames;
+			unsigned seed;
+			std::string write;
+			std::vector<std::string> files;
+		};
+
+		struct Frame {
+			int64_t timestamp;
+			ArchiveState::Type state;
+			OSVR_PoseState poses[MaxJoints];
+			double confidence[MaxJoints];
+		};
+
+		double seconds(Clock::time_point start) {
+			return std::chrono::duration<double>(Clock::now() - start).count();
+		}
+
+		// The first body as the device would report it
+		void convert(const SkeletonFrame& source, Frame& frame) {
+			const Skeleton& body = source.bodies[0];
+			frame.timestamp = source.timestamp;
+			frame.state = body.tracking == BodyTracked ? ArchiveState::Tracked : body.tracking == BodyPositionOnly ? ArchiveState::PositionOnly : ArchiveState::None;
+			for (int j = 0; j < source.jointCount; j++) {
+				OSVR_PoseState& pose = frame.poses[j];
+				osvrVec3SetX(&pose.translation, body.x[j]);
+				osvrVec3SetY(&pose.translation, body.y[j]);
+				osvrVec3SetZ(&pose.translation, body.z[j]);
+				osvrQuatSetW(&pose.rotation, body.qw[j]);
+				osvrQuatSetX(&pose.rotation, body.qx[j]);
+				osvrQuatSetY(&pose.rotation, body.qy[j]);
+				osvrQuatSetZ(&pose.rotation, body.qz[j]);
+				frame.confidence[j] = body.jointTracking[j] == JointTracked ? 1.0 : body.jointTracking[j] == JointInferred ? 0.5 : 0.0;
+			}
+		}
+
+		void write(ArchiveWriter& writer, const Frame& frame, int64_t later = 0) {
+			bool tracked = frame.state == ArchiveState::Tracked;
+			writer.write(frame.timestamp + later, frame.state, tracked ? frame.poses : NULL, tracked ? frame.confidence : NULL);
+		}
+
+		// A person who mostly stands about, occasionally raising a hand or gesturing, and now and then steps away
+		SyntheticSource::Options session(const Options& options) {
+			SyntheticSource::Options sourceOptions;
+			sourceOptions.seed = options.seed;
+			sourceOptions.gestureRate = 0.0002;
+			sourceOptions.churnRate = 0.0002;
+			return sourceOptions;
+		}
+
+		// Nobody there for five minutes in every half hour
+		bool away(int64_t frame) {
+			return frame % 54000 >= 45000;
+		}
+
+		// Whether it reads back within quantization, by timestamp, state and every joint's fields
+		bool readsBack(const std::string& path, const std::vector<Frame>& frames, long long count, int jointCount) {
+			ArchiveReader reader;
+			if (!reader.open(path) || reader.jointCount() != jointCount) return false;
+
+			std::vector<int64_t> timestamps;
+			std::vector<uint8_t> states;
+			std::vector<float> values;
+			long long frame = 0;
+			for (size_t c = 0; c < reader.chunks(); c++) {
+				const ArchiveChunk& chunk = reader.chunk(c);
+				if (!reader.readTimestamps(c, timestamps) || !reader.readStates(c, states)) return false;
+				for (size_t i = 0; i < chunk.frames; i++) {
+					int64_t index = frame + (int64_t)i;
+					const Frame& expected = frames[index % frames.size()];
+					if (timestamps[i] != expected.timestamp + index / Frames * Frames * 33333 || states[i] != expected.state) return false;
+				}
+
+				for (int j = 0; j < jointCount; j++) {
+					for (int f = 0; f < ArchiveField::Count; f++) {
+						if (!reader.readColumn(c, j, (ArchiveField::Type)f, values)) return false;
+						for (size_t i = 0; i < chunk.frames; i++) {
+							const Frame& expected = frames[(frame + i) % frames.size()];
+							if (expected.state != ArchiveState::Tracked) continue;
+							const OSVR_PoseState& pose = expected.poses[j];
+							double sign = osvrQuatGetW(&pose.rotation) < 0 ? -1 : 1;
+							double truth[ArchiveField::Count] = {
+								osvrVec3GetX(&pose.translation), osvrVec3GetY(&pose.translation), osvrVec3GetZ(&pose.translation),
+								sign * osvrQuatGetW(&pose.rotation), sign * osvrQuatGetX(&pose.rotation), sign * osvrQuatGetY(&pose.rotation), sign * osvrQuatGetZ(&pose.rotation),
+								expected.confidence[j]
+							};
+							double tolerance = f < ArchiveField::QW ? 0.00006 : f < ArchiveField::Confidence ? 0.00002 : 0.002;
+							if (fabs(values[i] - truth[f]) > tolerance) return false;
+						}
+					}
+				}
+				frame += chunk.frames;
+			}
+			return frame == count;
+		}
+
+		// Times write() on the calling thread. The writer's caught up with between chunks, so on one core its
+		// low priority doesn't drop any and only the update thread's side is measured.
+		int writer(const Options& options) {
+			SyntheticSource::Options sourceOptions = session(options);
+			sourceOptions.gestureRate = 0.01;
+			sourceOptions.churnRate = 0.002;
+			SyntheticSource source(sourceOptions);
+
+			std::vector<Frame> frames(Frames);
+			SkeletonFrame skeleton;
+			for (int i = 0; i < Frames; i++) {
+				source.next(skeleton);
+				convert(skeleton, frames[i]);
+			}
+			int jointCount = skeleton.jointCount;
+
+			ArchiveWriter archive(options.chunkFrames);
+			if (!archive.open(options.write, jointCount)) {
+				std::cerr << "Can't write " << options.write << std::endl;
+				return 1;
+			}
+
+			long long count = options.frames;
+			double elapsed = 0;
+			for (long long start = 0; start < count; start += options.chunkFrames) {
+				long long end = std::min(count, start + options.chunkFrames);
+				Clock::time_point began = Clock::now();
+				for (long long i = start; i < end; i++) {
+					write(archive, frames[i % Frames], i / Frames * (int64_t)Frames * 33333);
+				}
+				elapsed += seconds(began);
+				while (archive.stats().frames + archive.stats().droppedFrames < (uint64_t)end / options.chunkFrames * options.chunkFrames) {
+					std::this_thread::sleep_for(std::chrono::microseconds(200));
+				}
+			}
+			archive.close();
+			ArchiveWriter::Stats stats = archive.stats();
+
+			bool intact = stats.droppedFrames == 0 && readsBack(options.write, frames, count, jointCount);
+			printf("writer: %.0f ns a frame on the update thread, %.1f us a frame compressing on its own (%llu frames%s)\n",
+				elapsed / count * 1e9, stats.encodeSeconds / count * 1e6, count,
+				stats.droppedFrames > 0 ? ", some dropped" : "");
+			printf("        %.1fx smaller than floats, %.0f bytes a frame, %.1f MB an hour at 30 Hz, %s\n",
+				(double)stats.rawBytes / stats.compressedBytes, (double)stats.compressedBytes / count,
+				stats.compressedBytes / (double)count * 30 * 3600 / 1e6, intact ? "reads back within quantization" : "MISMATCH");
+			return intact ? 0 : 1;
+		}
+
+		ArchiveQuery handsAboveHead() {
+			ArchiveQuery query;
+			query.anyOf.push_back(ArchiveCondition(HandLeft, ArchiveField::Y, true, Head));
+			query.anyOf.push_back(ArchiveCondition(HandRight, ArchiveField::Y, true, Head));
+			return query;
+		}
+
+		// Writes hours of a session and times queries over it, with and without passing over chunks by their summaries
+		int scan(const Options& options) {
+			SyntheticSource source(session(options));
+			ArchiveWriter archive(options.chunkFrames);
+			SkeletonFrame skeleton;
+			source.next(skeleton);
+			if (!archive.open(options.write, skeleton.jointCount)) {
+				std::cerr << "Can't write " << options.write << std::endl;
+				return 1;
+			}
+
+			long long count = (long long)(options.hours * 3600 * 30);
+			Frame frame;
+			for (long long i = 0; i < count; i++) {
+				if (i > 0) source.next(skeleton);
+				convert(skeleton, frame);
+				if (away(i)) frame.state = ArchiveState::None;
+				write(archive, frame);
+
+				if ((i + 1) % options.chunkFrames == 0) {
+					while (archive.stats().frames + archive.stats().droppedFrames < (uint64_t)(i + 1)) {
+						std::this_thread::sleep_for(std::chrono::microseconds(200));
+					}
+				}
+			}
+			archive.close();
+			ArchiveWriter::Stats stats = archive.stats();
+			printf("archive: %.1f hours, %llu chunks, %.1f MB\n", options.hours, (unsigned long long)stats.chunks, stats.compressedBytes / 1e6);
+
+			ArchiveReader reader;
+			if (!reader.open(options.write)) {
+				std::cerr << "Can't read " << options.write << std::endl;
+				return 1;
+			}
+
+			ArchiveResult results[2];
+			for (int skipping = 1; skipping >= 0; skipping--) {
+				ArchiveQuery query = handsAboveHead();
+				query.useSummaries = skipping != 0;
+				ArchiveResult& result = results[skipping];
+
+				// Best of a few, the first also pays for the file coming into the cache
+				double best = 1e9;
+				uint64_t bytes = 0;
+				for (int pass = 0; pass < 5; pass++) {
+					uint64_t before = reader.bytesRead();
+					Clock::time_point began = Clock::now();
+					if (!archiveDuration(reader, query, result)) {
+						std::cerr << "Query failed" << std::endl;
+						return 1;
+					}
+					best = std::min(best, seconds(began));
+					bytes = reader.bytesRead() - before;
+				}
+				printf("hands above head %s: %.1f s over %llu frames; %zu chunks read, %zu skipped, %.1f MB decoded, %.1f ms, %.0f M frames/s\n",
+					skipping ? "with summaries" : "reading all  ", result.seconds, (unsigned long long)result.matched,
+					result.chunksRead, result.chunksSkipped, bytes / 1e6, best * 1e3, count / best / 1e6);
+			}
+
+			ArchiveQuery tracked;
+			ArchiveResult trackedResult;
+			ArchiveResult extent;
+			Clock::time_point began = Clock::now();
+			bool answered = archiveDuration(reader, tracked, trackedResult) && archiveExtent(reader, tracked, Head, ArchiveField::Y, extent);
+			printf("tracked %.1f of %.1f minutes, head between %.3f and %.3f m, %.1f ms\n",
+				trackedResult.seconds / 60, options.hours * 60, extent.min, extent.max, seconds(began) * 1e3);
+
+			bool same = answered && results[0].matched == results[1].matched && fabs(results[0].seconds - results[1].seconds) < 1e-6;
+			if (!same) std::cerr << "Skipping chunks changed the answer" << std::endl;
+			return same ? 0 : 1;
+		}
+
+		int bench(const Options& options) {
+			int result = writer(options);
+			if (result == 0) result = scan(options);
+			return result;
+		}
+
+		int info(const std::string& path) {
+			ArchiveReader reader;
+			if (!reader.open(path)) {
+				std::cerr << "Can't read archive " << path << std::endl;
+				return 1;
+			}
+
+			uint64_t frames = 0, states[ArchiveState::Count] = { 0 }, bytes = 0;
+			for (size_t c = 0; c < reader.chunks(); c++) {
+				const ArchiveChunk& chunk = reader.chunk(c);
+				frames += chunk.frames;
+				bytes += chunk.bytes;
+				for (int s = 0; s < ArchiveState::Count; s++) states[s] += chunk.stateFrames[s];
+			}
+			printf("%s: %d joints, %zu chunks, %llu frames", path.c_str(), reader.jointCount(), reader.chunks(), (unsigned long long)frames);
+			if (frames == 0) {
+				printf("\n");
+				return 0;
+			}
+
+			double duration = (reader.chunk(reader.chunks() - 1).end - reader.chunk(0).start) / 1e6;
+			printf(" over %.1f minutes, %.0f bytes a frame\n", duration / 60, (double)bytes / frames);
+			printf("%llu tracked, %llu position only, %llu nobody\n",
+				(unsigned long long)states[ArchiveState::Tracked], (unsigned long long)states[ArchiveState::PositionOnly], (unsigned long long)states[ArchiveState::None]);
+			return 0;
+		}
+
+		int query(const std::vector<std::string>& paths) {
+			for (size_t i = 0; i < paths.size(); i++) {
+				ArchiveReader reader;
+				if (!reader.open(paths[i])) {
+					std::cerr << "Can't read archive " << paths[i] << std::endl;
+					return 1;
+				}
+
+				ArchiveQuery tracked;
+				ArchiveResult trackedResult, handsResult, extent;
+				if (!archiveDuration(reader, tracked, trackedResult) || !archiveDuration(reader, handsAboveHead(), handsResult) ||
+					!archiveExtent(reader, tracked, Head, ArchiveField::Y, extent)) {
+					std::cerr << "Can't query " << paths[i] << std::endl;
+					return 1;
+				}
+				printf("%s: tracked %.1f minutes, hands above head %.1f s, head between %.3f and %.3f m\n",
+					paths[i].c_str(), trackedResult.seconds / 60, handsResult.seconds, extent.min, extent.max);
+			}
+			return 0;
+		}
+
+		void usage() {
+			std::cerr << "Usage: kinect_archive bench [options]\n"
+				"       kinect_archive info archive.ksa\n"
+				"       kinect_archive query archive.ksa...\n"
+				"bench measures the writer and queries on synthetic sessions:\n"
+				"  --frames N          Frames to time the writer over (100000)\n"
+				"  --hours H           Length of the session to query (3)\n"
+				"  --chunk N           Frames in a chunk (1024)\n"
+				"  --seed N            Seed for the sessions (1)\n"
+				"  --write PATH        Where the archives go (archive_bench.ksa)" << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace KinectOsvr;
+
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+	std::string command = argv[1];
+
+	Options options;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--frames" && hasValue) options.frames = std::max(1, atoi(argv[++i]));
+		else if (arg == "--hours" && hasValue) options.hours = std::max(0.01, atof(argv[++i]));
+		else if (arg == "--chunk" && hasValue) options.chunkFrames = std::max(2, atoi(argv[++i]));
+		else if (arg == "--seed" && hasValue) options.seed = (unsigned)atoi(argv[++i]);
+		else if (arg == "--write" && hasValue) options.write = argv[++i];
+		else if (arg.compare(0, 2, "--") == 0) {
+			usage();
+			return 1;
+		}
+		else options.files.push_back(arg);
+	}
+
+	if (command == "bench") return bench(options);
+	if (command == "info" && options.files.size() == 1) return info(options.files[0]);
+	if (command == "query" && !options.files.empty()) return query(options.files);
+	usage();
+	return 1;
+}
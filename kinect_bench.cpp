@@ -0,0 +1,801 @@
+// Regression benchmarks for the tracking hot path: the pose math, body identification and whole frames through
+// SkeletonDevice on synthetic scenes, compared against stored baselines
+#include "BodyIdentifier.h"
+#include "BoneSolver.h"
+#include "ControlQueue.h"
+#include "JointFilter.h"
+#include "JointProjection.h"
+#include "KinectMath.h"
+#include "Log.h"
+#include "PoseHistory.h"
+#include "SkeletonDevice.h"
+#include "SyntheticSource.h"
+#include "Trace.h"
+#include "WorkerPool.h"
+
+#include <PluginKitStandIn.h>
+
+// Generated JSON header files
+#include "je_nourish_kinectv1_json.h"
+#include "je_nourish_kinectv2_json.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace KinectOsvr {
+	namespace {
+		typedef std::chrono::steady_clock Clock;
+
+		// Frames in each synthetic scene, cycled through with fresh timestamps
+		const int SceneFrames = 300;
+		const int64_t FrameMicroseconds = 33333;
+		// A change has to be this many times the samples' spread before it's taken as more than noise
+		const double NoiseFactor = 3.0;
+
+#ifdef _WIN32
+		const char* const NullDevice = "NUL";
+#else
+		const char* const NullDevice = "/dev/null";
+#endif
+
+#ifdef NDEBUG
+		const char* const Build = "release";
+#else
+		const char* const Build = "debug";
+#endif
+
+		volatile double g_sink;
+
+		struct Options {
+			Options() : rounds(3), samples(7), sampleMs(10), repeat(1), tolerance(0.15), retries(2), absolute(false) {}
+
+			// Each benchmark is timed in rounds of batches, and its fastest round counts
+			int rounds;
+			int samples;
+			// How long each timed batch runs
+			double sampleMs;
+			// Whole passes over the benchmarks, each result is the median of them
+			int repeat;
+			// Slowdown allowed on top of the noise, as a fraction
+			double tolerance;
+			// Times a benchmark that looks slower is measured again, keeping its fastest run
+			int retries;
+			// Compare nanoseconds as they are, rather than relative to the reference loop
+			bool absolute;
+			std::string filter;
+			std::string output;
+			std::string baseline;
+		};
+
+		struct Benchmark {
+			std::string name;
+			// What one operation is
+			std::string unit;
+			std::function<void(long long operations)> run;
+		};
+
+		struct Result {
+			Result() : ns(0), mad(0), relative(0) {}
+
+			std::string name, unit;
+			// Nanoseconds per operation, the median of the fastest round, and the median absolute deviation of every
+			// batch from it
+			double ns, mad;
+			// Against the reference loop in the same run, so machines of different speeds compare
+			double relative;
+		};
+
+		typedef std::shared_ptr<std::vector<SkeletonFrame> > Scene;
+
+		// People walking about, some joints inferred and tracking IDs changing as the sensor loses and finds them
+		Scene scene(int bodies, int jointCount) {
+			SyntheticSource::Options sourceOptions;
+			sourceOptions.bodies = bodies;
+			sourceOptions.jointCount = jointCount;
+			sourceOptions.seed = 7;
+			sourceOptions.inferredRate = 0.02;
+			sourceOptions.churnRate = 0.002;
+			sourceOptions.buildSpread = 0.1;
+			SyntheticSource source(sourceOptions);
+
+			Scene frames(new std::vector<SkeletonFrame>(SceneFrames));
+			for (int i = 0; i < SceneFrames; i++) source.next((*frames)[i]);
+			return frames;
+		}
+
+		OSVR_Quaternion randomQuaternion(std::mt19937& rng) {
+			std::normal_distribution<double> gaussian(0.0, 1.0);
+			Eigen::Quaterniond q(gaussian(rng), gaussian(rng), gaussian(rng), gaussian(rng));
+			q.normalize();
+			OSVR_Quaternion result;
+			osvr::util::toQuat(q, result);
+			return result;
+		}
+
+		// Integer and floating point dependency chains the compiler can't fold away, timed alongside everything
+		// else to tell a slower machine from slower code
+		Benchmark referenceLoop() {
+			Benchmark benchmark = { "reference", "iteration", [](long long operations) {
+				uint64_t x = 1;
+				double y = 1.0;
+				for (long long i = 0; i < operations; i++) {
+					x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+					y = y * 0.999 + (double)(x >> 40);
+				}
+				g_sink = (double)x + y;
+			} };
+			return benchmark;
+		}
+
+		void mathBenchmarks(std::vector<Benchmark>& benchmarks) {
+			const int Count = 1024;
+			std::shared_ptr<std::vector<OSVR_PoseState> > poses(new std::vector<OSVR_PoseState>(Count));
+			std::mt19937 rng(3);
+			std::uniform_real_distribution<double> position(-2.0, 2.0);
+			for (int i = 0; i < Count; i++) {
+				OSVR_PoseState& pose = (*poses)[i];
+				pose.rotation = randomQuaternion(rng);
+				for (int k = 0; k < 3; k++) pose.translation.data[k] = position(rng);
+			}
+			std::shared_ptr<OSVR_PoseState> offset(new OSVR_PoseState);
+			offset->rotation = randomQuaternion(rng);
+			for (int k = 0; k < 3; k++) offset->translation.data[k] = position(rng);
+
+			// Each works on a copy, so repeated batches see the same inputs
+			Benchmark bone = { "math/boneSpaceToWorldSpace", "quaternion", [poses](long long operations) {
+				std::vector<OSVR_PoseState> work(*poses);
+				for (long long i = 0; i < operations; i++) {
+					boneSpaceToWorldSpace(&work[i % Count].rotation);
+				}
+				g_sink = work[0].rotation.data[0];
+			} };
+			benchmarks.push_back(bone);
+
+			Benchmark translation = { "math/offsetTranslation", "vector", [poses, offset](long long operations) {
+				std::vector<OSVR_PoseState> work(*poses);
+				for (long long i = 0; i < operations; i++) {
+					offsetTranslation(&offset->translation, &work[i % Count].translation);
+				}
+				g_sink = work[0].translation.data[0];
+			} };
+			benchmarks.push_back(translation);
+
+			Benchmark apply = { "math/applyOffset", "pose", [poses, offset](long long operations) {
+				std::vector<OSVR_PoseState> work(*poses);
+				for (long long i = 0; i < operations; i++) {
+					applyOffset(offset.get(), &work[i % Count]);
+				}
+				g_sink = work[0].translation.data[0];
+			} };
+			benchmarks.push_back(apply);
+		}
+
+		void identifyBenchmark(std::vector<Benchmark>& benchmarks, int bodies) {
+			Scene frames = scene(bodies, V2Joint::Count);
+			std::shared_ptr<BodyIdentifier> identifier(new BodyIdentifier());
+			std::shared_ptr<int64_t> frameIndex(new int64_t(0));
+
+			std::ostringstream name;
+			name << "identify/" << bodies << (bodies == 1 ? " body" : " bodies");
+			Benchmark benchmark = { name.str(), "frame", [frames, identifier, frameIndex](long long operations) {
+				SkeletonFrame frame;
+				int tracked = 0;
+				for (long long i = 0; i < operations; i++) {
+					int64_t n = (*frameIndex)++;
+					frame = (*frames)[n % SceneFrames];
+					frame.timestamp = n * FrameMicroseconds;
+					tracked += identifier->identify(frame);
+				}
+				g_sink = tracked;
+			} };
+			benchmarks.push_back(benchmark);
+		}
+
+		// A device fed as the Kinect classes feed theirs: each frame's bodies are copied in, identified and processed
+		struct DeviceFixture {
+			DeviceFixture(const char* name, const SkeletonLayout& layout, const char* descriptor, int threads, const BoneHierarchy& hierarchy)
+				: pool(threads), device(StandIn::context(), name, layout, descriptor, pool), solver(hierarchy),
+				projector(KinectV2DepthCamera, KinectV2ColorCamera), frameIndex(0), recenterEvery(0) {}
+
+			WorkerPool pool;
+			SkeletonDevice device;
+			BoneSolver solver;
+			PinholeProjector projector;
+			BodyIdentifier identifier;
+			Scene frames;
+			SkeletonFrame frame;
+			int64_t frameIndex;
+			int recenterEvery;
+		};
+
+		struct DeviceSetup {
+			DeviceSetup() : v1(false), bodies(6), threads(0), solve(false), smooth(false), project(false), recenterEvery(0), trace(false) {}
+
+			std::string name;
+			bool v1;
+			int bodies;
+			// For the worker pool, 0 does everything on the calling thread
+			int threads;
+			bool solve;
+			bool smooth;
+			// Every tracked body's joints into image space, as the V2 does without its mapper
+			bool project;
+			int recenterEvery;
+			bool trace;
+		};
+
+		void deviceBenchmark(std::vector<Benchmark>& benchmarks, const DeviceSetup& setup) {
+			const SkeletonLayout& layout = setup.v1 ? KinectV1Layout : KinectV2Layout;
+			std::shared_ptr<DeviceFixture> fixture(setup.v1 ?
+				new DeviceFixture("KinectV1", layout, je_nourish_kinectv1_json, setup.threads, KinectV1Hierarchy) :
+				new DeviceFixture("KinectV2", layout, je_nourish_kinectv2_json, setup.threads, KinectV2Hierarchy));
+			fixture->frames = scene(setup.bodies, layout.jointCount);
+			fixture->recenterEvery = setup.recenterEvery;
+
+			// The V1's orientations are always calculated, here by the solver since the SDK's can't run outside
+			// Windows, the V2's when asked to
+			if (setup.v1 || setup.solve) {
+				DeviceFixture* f = fixture.get();
+				fixture->device.setOrientationStage([f](int, Skeleton& skeleton) {
+					f->solver.solve(skeleton);
+					return true;
+				}, !setup.v1);
+			}
+			if (setup.smooth) {
+				FilterParams filter;
+				filter.smoothing = 0.5f;
+				fixture->device.setFilter(filter);
+			}
+			if (setup.project) {
+				DeviceFixture* f = fixture.get();
+				fixture->device.setProjectionStage([f](const SkeletonFrame& frame, const bool* bodies, FrameProjection& projection) {
+					f->projector.project(frame, bodies, projection);
+				});
+			}
+			fixture->device.setFrameBudget(0);
+
+			bool trace = setup.trace;
+			Benchmark benchmark = { setup.name, "frame", [fixture, trace](long long operations) {
+				DeviceFixture& f = *fixture;
+				if (trace) Trace::start("");
+				for (long long i = 0; i < operations; i++) {
+					int64_t n = f.frameIndex++;
+					f.frame = (*f.frames)[n % SceneFrames];
+					f.frame.timestamp = (n + 1) * FrameMicroseconds;
+					if (f.recenterEvery > 0 && n % f.recenterEvery == 0) f.device.recenter();
+
+					OSVR_TimeValue timeValue;
+					timeValue.seconds = f.frame.timestamp / 1000000;
+					timeValue.microseconds = f.frame.timestamp % 1000000;
+					int trackedBody = f.identifier.identify(f.frame);
+					f.device.process(f.frame, trackedBody, timeValue);
+					// Keeps the stand-in's report log from growing past the cache
+					StandIn::clearReports();
+				}
+				if (trace) Trace::stop();
+			} };
+			benchmarks.push_back(benchmark);
+		}
+
+		void componentBenchmarks(std::vector<Benchmark>& benchmarks) {
+			Scene frames = scene(1, V2Joint::Count);
+
+			std::shared_ptr<BoneSolver> solver(new BoneSolver(KinectV2Hierarchy));
+			Benchmark solve = { "solver/v2", "skeleton", [frames, solver](long long operations) {
+				Skeleton skeleton;
+				for (long long i = 0; i < operations; i++) {
+					skeleton = (*frames)[i % SceneFrames].bodies[0];
+					solver->solve(skeleton);
+				}
+				g_sink = skeleton.qw[0];
+			} };
+			benchmarks.push_back(solve);
+
+			std::shared_ptr<JointFilter> filter(new JointFilter());
+			Benchmark smooth = { "filter/v2", "skeleton", [frames, filter](long long operations) {
+				FilterParams params;
+				params.smoothing = 0.5f;
+				Skeleton skeleton;
+				for (long long i = 0; i < operations; i++) {
+					skeleton = (*frames)[i % SceneFrames].bodies[0];
+					filter->apply(skeleton, V2Joint::Count, params);
+				}
+				g_sink = skeleton.x[0];
+			} };
+			benchmarks.push_back(smooth);
+
+			Scene crowd = scene(MaxBodies, V2Joint::Count);
+			std::shared_ptr<PinholeProjector> projector(new PinholeProjector(KinectV2DepthCamera, KinectV2ColorCamera));
+			std::shared_ptr<FrameProjection> projection(new FrameProjection());
+			Benchmark project = { "projection/v2/6 bodies", "frame", [crowd, projector, projection](long long operations) {
+				const bool bodies[MaxBodies] = { true, true, true, true, true, true };
+				for (long long i = 0; i < operations; i++) {
+					projector->project((*crowd)[i % SceneFrames], bodies, *projection);
+				}
+				g_sink = projection->colorX[0][0];
+			} };
+			benchmarks.push_back(project);
+
+			// A full history, sampled at times between frames as a late consumer would
+			std::shared_ptr<PoseHistory> history(new PoseHistory(V2Joint::Count));
+			std::vector<OSVR_PoseState> poses(V2Joint::Count);
+			std::mt19937 rng(5);
+			for (int i = 0; i < PoseHistory::DefaultCapacity; i++) {
+				for (int j = 0; j < V2Joint::Count; j++) {
+					poses[j].rotation = randomQuaternion(rng);
+					for (int k = 0; k < 3; k++) poses[j].translation.data[k] = i * 0.01 + j;
+				}
+				history->push(i * FrameMicroseconds, &poses[0]);
+			}
+			Benchmark sample = { "history/sample", "query", [history](long long operations) {
+				OSVR_PoseState pose;
+				double sum = 0;
+				int64_t span = (PoseHistory::DefaultCapacity - 1) * FrameMicroseconds;
+				for (long long i = 0; i < operations; i++) {
+					int64_t t = (i * 7919 * 1000) % span;
+					if (history->sample(t, (int)(i % V2Joint::Count), pose)) sum += pose.translation.data[0];
+				}
+				g_sink = sum;
+			} };
+			benchmarks.push_back(sample);
+
+			// The same lookups over the last two seconds while the tracking thread pushes as fast as it can, so
+			// reads share cache lines with writes and now and then start over
+			std::shared_ptr<PoseHistory> live(new PoseHistory(V2Joint::Count));
+			const int LiveFrames = 64;
+			std::shared_ptr<std::vector<OSVR_PoseState> > livePoses(new std::vector<OSVR_PoseState>(LiveFrames * V2Joint::Count));
+			for (size_t p = 0; p < livePoses->size(); p++) {
+				(*livePoses)[p].rotation = randomQuaternion(rng);
+				for (int k = 0; k < 3; k++) (*livePoses)[p].translation.data[k] = p * 0.01;
+			}
+			Benchmark contended = { "history/sample with a writer", "query", [live, livePoses, LiveFrames](long long operations) {
+				// Carrying on from the last batch, as older pushes are refused
+				int64_t oldest, start = 0;
+				live->range(oldest, start);
+				std::atomic<bool> stop(false);
+				std::atomic<int64_t> newest(start);
+				std::thread writer([&]() {
+					int64_t t = newest.load();
+					for (int frame = 0; !stop.load(std::memory_order_relaxed); frame = (frame + 1) % LiveFrames) {
+						t += FrameMicroseconds;
+						live->push(t, &(*livePoses)[frame * V2Joint::Count]);
+						newest.store(t, std::memory_order_relaxed);
+					}
+				});
+				while (newest.load() < start + 60 * FrameMicroseconds) std::this_thread::yield();
+
+				OSVR_PoseState pose;
+				double sum = 0;
+				for (long long i = 0; i < operations; i++) {
+					int64_t t = newest.load(std::memory_order_relaxed) - (i * 7919 * 1000) % (60 * FrameMicroseconds);
+					if (live->sample(t, (int)(i % V2Joint::Count), pose)) sum += pose.translation.data[0];
+				}
+				stop.store(true);
+				writer.join();
+				g_sink = sum;
+			} };
+			benchmarks.push_back(contended);
+
+			// One probe on its own, as the hot path has a few dozen of them a frame
+			for (int on = 0; on < 2; on++) {
+				Benchmark scope = { on ? "trace/scope on" : "trace/scope off", "scope", [on](long long operations) {
+					if (on) Trace::start("");
+					for (long long i = 0; i < operations; i++) {
+						KINECT_TRACE("bench");
+						g_sink = (double)i;
+					}
+					if (on) Trace::stop();
+				} };
+				benchmarks.push_back(scope);
+			}
+
+			std::shared_ptr<ControlQueue> queue(new ControlQueue());
+			Benchmark command = { "queue/push and pop", "command", [queue](long long operations) {
+				ControlCommand in = { ControlCommand::SetTrackedBody, 0 }, out;
+				int sum = 0;
+				for (long long i = 0; i < operations; i++) {
+					in.body = (int)(i % MaxBodies);
+					queue->push(in);
+					if (queue->pop(out)) sum += out.body;
+				}
+				g_sink = sum;
+			} };
+			benchmarks.push_back(command);
+		}
+
+		std::vector<Benchmark> allBenchmarks() {
+			std::vector<Benchmark> benchmarks;
+			mathBenchmarks(benchmarks);
+
+			int identifyBodies[] = { 1, 3, 6 };
+			for (int b = 0; b < 3; b++) identifyBenchmark(benchmarks, identifyBodies[b]);
+
+			int processBodies[] = { 1, 2, 4, 6 };
+			for (int b = 0; b < 4; b++) {
+				DeviceSetup setup;
+				setup.bodies = processBodies[b];
+				std::ostringstream name;
+				name << "process/v2/" << setup.bodies << (setup.bodies == 1 ? " body" : " bodies");
+				setup.name = name.str();
+				deviceBenchmark(benchmarks, setup);
+			}
+
+			DeviceSetup recentering;
+			recentering.name = "process/v2/6 bodies recentering every second";
+			recentering.recenterEvery = 30;
+			deviceBenchmark(benchmarks, recentering);
+
+			DeviceSetup solved;
+			solved.name = "process/v2/6 bodies solved orientations";
+			solved.solve = true;
+			deviceBenchmark(benchmarks, solved);
+
+			DeviceSetup projected;
+			projected.name = "process/v2/6 bodies projected";
+			projected.project = true;
+			deviceBenchmark(benchmarks, projected);
+
+			DeviceSetup smoothed;
+			smoothed.name = "process/v2/6 bodies smoothed";
+			smoothed.smooth = true;
+			deviceBenchmark(benchmarks, smoothed);
+
+			// The probes stay compiled in, so off against on is what a user pays for the option and for having it
+			for (int on = 0; on < 2; on++) {
+				DeviceSetup traced;
+				traced.name = on ? "process/v2/6 bodies tracing on" : "process/v2/6 bodies tracing off";
+				traced.trace = on != 0;
+				deviceBenchmark(benchmarks, traced);
+			}
+
+			// Past five workers there's no body left for another to take. These only mean something recorded on a machine
+			// with cores to spare, the stored baseline leaves them out until it's recorded on one.
+			for (int threads = 1; threads < MaxBodies; threads++) {
+				DeviceSetup workers;
+				std::ostringstream name;
+				name << "process/v2/6 bodies " << threads << (threads == 1 ? " worker" : " workers");
+				workers.name = name.str();
+				workers.threads = threads;
+				deviceBenchmark(benchmarks, workers);
+			}
+
+			DeviceSetup v1;
+			v1.name = "process/v1/6 bodies";
+			v1.v1 = true;
+			deviceBenchmark(benchmarks, v1);
+
+			componentBenchmarks(benchmarks);
+			return benchmarks;
+		}
+
+		double timeBatch(const Benchmark& benchmark, long long operations) {
+			Clock::time_point start = Clock::now();
+			benchmark.run(operations);
+			return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+		}
+
+		double median(std::vector<double> values) {
+			std::sort(values.begin(), values.end());
+			size_t n = values.size();
+			return n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+		}
+
+		// Grows the batch until it runs long enough to time, which also warms up caches and the pool
+		long long calibrate(const Benchmark& benchmark, const Options& options) {
+			double target = options.sampleMs * 1e6;
+			long long operations = 1;
+			for (;;) {
+				double elapsed = timeBatch(benchmark, operations);
+				if (elapsed >= target) return operations;
+				double scale = elapsed > 0 ? std::min(100.0, std::max(2.0, target / elapsed * 1.2)) : 100.0;
+				operations = (long long)(operations * scale);
+			}
+		}
+
+		struct Timing {
+			Timing() : operations(0), best(0), spread(0), rounds(0) {}
+
+			long long operations;
+			// Median of the fastest round and how far its batches stray from it
+			double best;
+			double spread;
+			int rounds;
+		};
+
+		// Only the fastest round counts, a busy spell slows a whole round and would otherwise pass for noise
+		void timeRound(const Benchmark& benchmark, const Options& options, Timing& timing) {
+			std::vector<double> round(options.samples);
+			for (int s = 0; s < options.samples; s++) {
+				round[s] = timeBatch(benchmark, timing.operations) / timing.operations;
+			}
+			double roundMedian = median(round);
+			if (timing.rounds == 0 || roundMedian < timing.best) {
+				for (int s = 0; s < options.samples; s++) round[s] = fabs(round[s] - roundMedian);
+				timing.best = roundMedian;
+				timing.spread = median(round);
+			}
+			timing.rounds++;
+		}
+
+		Result summarize(const Benchmark& benchmark, const Timing& timing) {
+			Result result;
+			result.name = benchmark.name;
+			result.unit = benchmark.unit;
+			result.ns = timing.best;
+			result.mad = timing.spread;
+			return result;
+		}
+
+		Result measure(const Benchmark& benchmark, const Options& options) {
+			Timing timing;
+			timing.operations = calibrate(benchmark, options);
+			for (int r = 0; r < options.rounds; r++) timeRound(benchmark, options, timing);
+			return summarize(benchmark, timing);
+		}
+
+		void writeResults(std::ostream& out, const std::vector<Result>& results, const Options& options) {
+			out << "# kinect_bench " << Build << " build, fastest of " << options.rounds << " rounds of " << options.samples << " batches of " << options.sampleMs << " ms, median of " << options.repeat << " passes\n";
+			out << "# build\t" << Build << "\n";
+			out << "name\tunit\tns\tmad\trelative\n";
+			char line[512];
+			for (size_t i = 0; i < results.size(); i++) {
+				const Result& r = results[i];
+				snprintf(line, sizeof(line), "%s\t%s\t%.3f\t%.3f\t%.5f\n", r.name.c_str(), r.unit.c_str(), r.ns, r.mad, r.relative);
+				out << line;
+			}
+		}
+
+		bool readResults(const std::string& path, std::vector<Result>& results, std::string& build) {
+			std::ifstream in(path.c_str());
+			if (!in) return false;
+
+			std::string line;
+			while (std::getline(in, line)) {
+				if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+				if (line.compare(0, 8, "# build\t") == 0) build = line.substr(8);
+				if (line.empty() || line[0] == '#' || line.compare(0, 5, "name\t") == 0) continue;
+
+				std::vector<std::string> fields;
+				std::stringstream stream(line);
+				std::string field;
+				while (std::getline(stream, field, '\t')) fields.push_back(field);
+				if (fields.size() < 5) return false;
+
+				Result result;
+				result.name = fields[0];
+				result.unit = fields[1];
+				result.ns = atof(fields[2].c_str());
+				result.mad = atof(fields[3].c_str());
+				result.relative = atof(fields[4].c_str());
+				results.push_back(result);
+			}
+			return true;
+		}
+
+		// How much slower the current result is than the baseline, as a ratio, and the threshold it's judged against
+		double change(const Result& current, const Result& baseline, const Options& options) {
+			return options.absolute ? current.ns / baseline.ns : current.relative / baseline.relative;
+		}
+
+		double threshold(const Result& current, const Result& baseline, const Options& options) {
+			double noise = NoiseFactor * (current.mad / current.ns + baseline.mad / baseline.ns);
+			return std::max(options.tolerance, noise);
+		}
+
+		// Rounds go through every benchmark in turn, so a busy spell slows one round of each rather than every
+		// round of one
+		std::vector<Result> measureAll(const std::vector<const Benchmark*>& benchmarks, const Options& options) {
+			std::vector<Timing> timings(benchmarks.size());
+			for (size_t i = 0; i < benchmarks.size(); i++) timings[i].operations = calibrate(*benchmarks[i], options);
+			for (int r = 0; r < options.rounds; r++) {
+				for (size_t i = 0; i < benchmarks.size(); i++) timeRound(*benchmarks[i], options, timings[i]);
+			}
+
+			std::vector<Result> results;
+			for (size_t i = 0; i < benchmarks.size(); i++) results.push_back(summarize(*benchmarks[i], timings[i]));
+			return results;
+		}
+
+		int run(const Options& options, bool compareBaseline) {
+			std::vector<Result> baseline;
+			std::map<std::string, size_t> baselineIndex;
+			if (compareBaseline) {
+				std::string baselineBuild;
+				if (!readResults(options.baseline, baseline, baselineBuild)) {
+					std::cerr << "Failed to read baseline " << options.baseline << std::endl;
+					return 2;
+				}
+				// Optimized and unoptimized builds don't compare, whatever the noise
+				if (baselineBuild != Build) {
+					std::cerr << options.baseline << " is from a " << (baselineBuild.empty() ? "unknown" : baselineBuild) << " build and this is a " << Build
+						<< " build, build with CMAKE_BUILD_TYPE=Release to compare" << std::endl;
+					return 2;
+				}
+				for (size_t i = 0; i < baseline.size(); i++) baselineIndex[baseline[i].name] = i;
+			}
+
+			StandIn::reset(1 << 12);
+			std::vector<Benchmark> benchmarks = allBenchmarks();
+			benchmarks.insert(benchmarks.begin(), referenceLoop());
+
+			// Devices log who they're tracking, which would otherwise land among the results. Logging goes on as it
+			// would in the server, just to nowhere, and a device is never moved aside.
+			Log::LogParams logParams;
+			logParams.path = NullDevice;
+			logParams.fileSize = (size_t)-1;
+			Log::Session logSession(logParams);
+
+			std::vector<const Benchmark*> selected;
+			for (size_t i = 0; i < benchmarks.size(); i++) {
+				if (i == 0 || options.filter.empty() || benchmarks[i].name.find(options.filter) != std::string::npos) selected.push_back(&benchmarks[i]);
+			}
+
+			// A machine's speed drifts over minutes as well as between batches, so a baseline recorded over several
+			// passes takes their median and counts how far they differ as noise
+			std::vector<std::vector<Result> > passes;
+			for (int pass = 0; pass < options.repeat; pass++) passes.push_back(measureAll(selected, options));
+			std::vector<Result> measured = passes[0];
+			for (size_t i = 0; options.repeat > 1 && i < selected.size(); i++) {
+				std::vector<double> ns, mad;
+				for (int pass = 0; pass < options.repeat; pass++) {
+					ns.push_back(passes[pass][i].ns);
+					mad.push_back(passes[pass][i].mad);
+				}
+				measured[i].ns = median(ns);
+				for (int pass = 0; pass < options.repeat; pass++) ns[pass] = fabs(ns[pass] - measured[i].ns);
+				measured[i].mad = std::max(median(mad), median(ns));
+			}
+
+			std::vector<Result> results;
+			int slower = 0, faster = 0, unmatched = 0;
+			if (compareBaseline) printf("name\tbaseline_ns\tns\tchange_pct\tthreshold_pct\tverdict\n");
+			else printf("name\tunit\tns\tmad\trelative\n");
+
+			double reference = 0;
+			for (size_t i = 0; i < selected.size(); i++) {
+				const Benchmark& benchmark = *selected[i];
+				bool isReference = i == 0;
+
+				Result result = measured[i];
+				if (isReference) reference = result.ns;
+				result.relative = result.ns / reference;
+
+				if (!compareBaseline) {
+					printf("%s\t%s\t%.3f\t%.3f\t%.5f\n", result.name.c_str(), result.unit.c_str(), result.ns, result.mad, result.relative);
+					fflush(stdout);
+					results.push_back(result);
+					continue;
+				}
+
+				std::map<std::string, size_t>::const_iterator found = baselineIndex.find(result.name);
+				if (found == baselineIndex.end()) {
+					printf("%s\t-\t%.3f\t-\t-\tnew\n", result.name.c_str(), result.ns);
+					unmatched++;
+					results.push_back(result);
+					continue;
+				}
+
+				// Anything that looks slower is measured again before it counts, a busy moment shouldn't fail the run
+				const Result& base = baseline[found->second];
+				for (int retry = 0; !isReference && retry < options.retries && change(result, base, options) > 1.0 + threshold(result, base, options); retry++) {
+					Result again = measure(benchmark, options);
+					again.relative = again.ns / reference;
+					if (again.ns < result.ns) result = again;
+				}
+
+				double ratio = change(result, base, options);
+				double limit = threshold(result, base, options);
+				const char* verdict = "ok";
+				if (isReference) verdict = "reference";
+				else if (ratio > 1.0 + limit) {
+					verdict = "SLOWER";
+					slower++;
+				}
+				else if (ratio < 1.0 - limit) {
+					verdict = "faster";
+					faster++;
+				}
+				printf("%s\t%.3f\t%.3f\t%+.1f\t%.1f\t%s\n", result.name.c_str(), base.ns, result.ns, (ratio - 1.0) * 100.0, limit * 100.0, verdict);
+				fflush(stdout);
+				results.push_back(result);
+			}
+
+			if (!options.output.empty()) {
+				std::ofstream out(options.output.c_str());
+				writeResults(out, results, options);
+				if (!out) {
+					std::cerr << "Failed to write " << options.output << std::endl;
+					return 2;
+				}
+			}
+
+			if (compareBaseline) {
+				printf("%d compared, %d slower, %d faster, %d not in the baseline%s\n", (int)(results.size() - 1 - unmatched), slower, faster, unmatched,
+					options.absolute ? "" : ", relative to the reference loop");
+			}
+			return slower > 0 ? 1 : 0;
+		}
+
+		void usage() {
+			std::cerr << "Usage: kinect_bench run [options]\n"
+				"       kinect_bench compare BASELINE [options]\n"
+				"       kinect_bench list\n"
+				"run times every benchmark, compare also checks each against a baseline written by --output and fails if\n"
+				"any is slower by more than the tolerance and the noise in both runs\n"
+				"  --filter TEXT       Only benchmarks with this in their name\n"
+				"  --rounds N          Rounds per benchmark, the fastest counts (3)\n"
+				"  --samples N         Timed batches per round (7)\n"
+				"  --sample-ms MS      Length of each batch (10)\n"
+				"  --repeat N          Passes over every benchmark, the median counts (1), more for recording a baseline\n"
+				"  --tolerance F       Slowdown allowed beyond the noise, as a fraction (0.15)\n"
+				"  --retries N         Times a slower-looking benchmark is measured again (2)\n"
+				"  --absolute          Compare nanoseconds rather than time relative to the reference loop\n"
+				"  --output FILE       Write the results in baseline form" << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace KinectOsvr;
+
+	if (argc < 2) {
+		usage();
+		return 2;
+	}
+	std::string command = argv[1];
+
+	Options options;
+	int first = 2;
+	if (command == "compare") {
+		if (argc < 3) {
+			usage();
+			return 2;
+		}
+		options.baseline = argv[2];
+		first = 3;
+	}
+	for (int i = first; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--filter" && hasValue) options.filter = argv[++i];
+		else if (arg == "--rounds" && hasValue) options.rounds = std::max(1, atoi(argv[++i]));
+		else if (arg == "--samples" && hasValue) options.samples = std::max(3, atoi(argv[++i]));
+		else if (arg == "--sample-ms" && hasValue) options.sampleMs = std::max(1.0, atof(argv[++i]));
+		else if (arg == "--repeat" && hasValue) options.repeat = std::max(1, atoi(argv[++i]));
+		else if (arg == "--tolerance" && hasValue) options.tolerance = std::max(0.0, atof(argv[++i]));
+		else if (arg == "--retries" && hasValue) options.retries = std::max(0, atoi(argv[++i]));
+		else if (arg == "--absolute") options.absolute = true;
+		else if (arg == "--output" && hasValue) options.output = argv[++i];
+		else {
+			usage();
+			return 2;
+		}
+	}
+
+	if (command == "list") {
+		StandIn::reset(1 << 12);
+		std::vector<Benchmark> benchmarks = allBenchmarks();
+		for (size_t i = 0; i < benchmarks.size(); i++) printf("%s\t%s\n", benchmarks[i].name.c_str(), benchmarks[i].unit.c_str());
+		return 0;
+	}
+	if (command == "run") return run(options, false);
+	if (command == "compare") return run(options, true);
+	usage();
+	return 2;
+}
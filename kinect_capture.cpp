@@ -0,0 +1,273 @@
+// Depth capture: measures the codec and the background writer on synthetic depth and body-index images,
+// and summarizes capture files written with OSVR_KINECT_RECORD_DEPTH
+#include "DepthCapture.h"
+#include "DepthCodec.h"
+#include "SyntheticSource.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace KinectOsvr {
+	namespace {
+		const int DepthWidth = 512;
+		const int DepthHeight = 424;
+		// Distinct images cycled through by the benchmarks
+		const int Images = 90;
+
+		typedef std::chrono::steady_clock Clock;
+
+		struct Options {
+			Options() : bodies(2), seconds(10), seed(1), noise(0.5), encoders(2), buffers(8), write("capture_bench.kdc") {}
+
+			int bodies;
+			double seconds;
+			unsigned seed;
+			// Depth noise at a metre away in millimetres, growing with the square of distance as the sensor's does
+			double noise;
+			int encoders, buffers;
+			std::string write;
+			std::vector<std::string> files;
+		};
+
+		struct Image {
+			int64_t timestamp;
+			std::vector<uint16_t> depth;
+			std::vector<uint8_t> bodyIndex;
+		};
+
+		double seconds(Clock::time_point start) {
+			return std::chrono::duration<double>(Clock::now() - start).count();
+		}
+
+		// Synthetic images with sensor-like noise, and readings missing along the edges of people
+		void render(const Options& options, std::vector<Image>& images) {
+			SyntheticSource::Options sourceOptions;
+			sourceOptions.bodies = options.bodies;
+			sourceOptions.seed = options.seed;
+			sourceOptions.gestureRate = 0.01;
+			SyntheticSource source(sourceOptions);
+
+			std::mt19937 rng(options.seed);
+			std::normal_distribution<double> gaussian(0.0, 1.0);
+			std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+			SkeletonFrame frame;
+			images.resize(Images);
+			for (int i = 0; i < Images; i++) {
+				Image& image = images[i];
+				source.next(frame);
+				image.timestamp = frame.timestamp;
+				image.depth.resize(DepthWidth * DepthHeight);
+				image.bodyIndex.resize(DepthWidth * DepthHeight);
+				renderSyntheticDepth(source.truth(), KinectV2DepthCamera, DepthWidth, DepthHeight, &image.depth[0], &image.bodyIndex[0]);
+
+				for (int p = 0; p < DepthWidth * DepthHeight; p++) {
+					uint16_t& pixel = image.depth[p];
+					bool edge = p % DepthWidth > 0 && abs(pixel - image.depth[p - 1]) > 100;
+					if (edge && uniform(rng) < 0.5) {
+						pixel = 0;
+						continue;
+					}
+					double metres = pixel / 1000.0;
+					pixel = (uint16_t)std::max(1.0, pixel + gaussian(rng) * options.noise * metres * metres + 0.5);
+				}
+			}
+		}
+
+		int codec(const std::vector<Image>& images) {
+			size_t rawBytes = 0, depthBytes = 0, indexBytes = 0;
+			double encodeTime = 0, decodeTime = 0;
+			bool lossless = true;
+
+			std::vector<uint8_t> encoded;
+			std::vector<uint16_t> depth(DepthWidth * DepthHeight);
+			std::vector<uint8_t> bodyIndex(DepthWidth * DepthHeight);
+			for (int pass = 0; pass < 3; pass++) {
+				for (size_t i = 0; i < images.size(); i++) {
+					const Image& image = images[i];
+					encoded.clear();
+
+					Clock::time_point start = Clock::now();
+					DepthCodec::encodeDepth(&image.depth[0], DepthWidth, DepthHeight, encoded);
+					size_t split = encoded.size();
+					DepthCodec::encodeBodyIndex(&image.bodyIndex[0], (int)image.bodyIndex.size(), encoded);
+					encodeTime += seconds(start);
+
+					start = Clock::now();
+					bool decoded = DepthCodec::decodeDepth(&encoded[0], split, DepthWidth, DepthHeight, &depth[0]) &&
+						DepthCodec::decodeBodyIndex(&encoded[split], encoded.size() - split, (int)bodyIndex.size(), &bodyIndex[0]);
+					decodeTime += seconds(start);
+
+					lossless = lossless && decoded && depth == image.depth && bodyIndex == image.bodyIndex;
+					rawBytes += image.depth.size() * sizeof(uint16_t) + image.bodyIndex.size();
+					depthBytes += split;
+					indexBytes += encoded.size() - split;
+				}
+			}
+
+			size_t frames = images.size() * 3;
+			printf("codec: depth %.2f bits a pixel, body index %.3f, %.1fx smaller overall, %s\n",
+				8.0 * depthBytes / (frames * DepthWidth * DepthHeight), 8.0 * indexBytes / (frames * DepthWidth * DepthHeight),
+				(double)rawBytes / (depthBytes + indexBytes), lossless ? "lossless" : "MISMATCH");
+			printf("       encode %.0f MB/s (%.2f ms an image), decode %.0f MB/s (%.2f ms an image)\n",
+				rawBytes / encodeTime / 1e6, encodeTime / frames * 1000.0, rawBytes / decodeTime / 1e6, decodeTime / frames * 1000.0);
+			return lossless ? 0 : 1;
+		}
+
+		// Submits images at the sensor's rate, or as fast as possible with no pacing, as the sensor thread would
+		int writer(const Options& options, const std::vector<Image>& images, double rate) {
+			DepthCaptureWriter capture(options.encoders, options.buffers);
+			if (!capture.open(options.write, DepthWidth, DepthHeight)) {
+				std::cerr << "Can't write " << options.write << std::endl;
+				return 1;
+			}
+
+			long long frames = (long long)(options.seconds * 30.0);
+			std::vector<double> submitTimes;
+			std::vector<bool> accepted;
+			Clock::time_point start = Clock::now();
+			for (long long i = 0; i < frames; i++) {
+				if (rate > 0) std::this_thread::sleep_until(start + std::chrono::microseconds((long long)(i * 1e6 / rate)));
+
+				const Image& image = images[i % images.size()];
+				Clock::time_point submitted = Clock::now();
+				accepted.push_back(capture.submit(image.timestamp + (i / Images) * 3000000LL, &image.depth[0], &image.bodyIndex[0]));
+				submitTimes.push_back(std::chrono::duration<double, std::micro>(Clock::now() - submitted).count());
+			}
+			double elapsed = seconds(start);
+			capture.close();
+			DepthCaptureWriter::Stats stats = capture.stats();
+
+			std::sort(submitTimes.begin(), submitTimes.end());
+			double mean = 0;
+			for (size_t i = 0; i < submitTimes.size(); i++) mean += submitTimes[i];
+			mean /= submitTimes.size();
+
+			if (rate > 0) printf("writer at %.0f Hz", rate);
+			else printf("writer unpaced, %.0f Hz reached", frames / elapsed);
+			printf(" with %d encoders and %d buffers: %llu of %llu images written, %llu dropped\n",
+				options.encoders, options.buffers, (unsigned long long)stats.written, (unsigned long long)stats.submitted, (unsigned long long)stats.dropped);
+			printf("       submit %.0f us mean, %.0f us p99, %.0f us max; %.1f MB a minute on disk\n",
+				mean, submitTimes[submitTimes.size() * 99 / 100], submitTimes.back(),
+				stats.compressedBytes / (frames / 30.0) * 60.0 / 1e6);
+
+			// Everything accepted should read back as it went in, found by its own timestamp
+			DepthCaptureReader reader;
+			if (!reader.open(options.write) || reader.frames() != stats.written) {
+				std::cerr << "Capture didn't read back" << std::endl;
+				return 1;
+			}
+			DepthImage depth;
+			std::vector<uint8_t> bodyIndex;
+			for (long long i = 0; i < frames; i++) {
+				if (!accepted[i]) continue;
+				const Image& image = images[i % images.size()];
+				long frame = reader.find(image.timestamp + (i / Images) * 3000000LL);
+				if (frame < 0 || !reader.read(frame, depth, &bodyIndex) || depth.depth != image.depth || bodyIndex != image.bodyIndex) {
+					std::cerr << "Image " << i << " didn't read back" << std::endl;
+					return 1;
+				}
+			}
+			return 0;
+		}
+
+		int bench(const Options& options) {
+			std::vector<Image> images;
+			render(options, images);
+
+			int result = codec(images);
+			if (result == 0) result = writer(options, images, 30.0);
+			if (result == 0) result = writer(options, images, 0.0);
+			return result;
+		}
+
+		int info(const std::string& path) {
+			DepthCaptureReader reader;
+			if (!reader.open(path)) {
+				std::cerr << "Can't read capture " << path << std::endl;
+				return 1;
+			}
+
+			size_t frames = reader.frames();
+			printf("%s: %zu images of %dx%d", path.c_str(), frames, reader.width(), reader.height());
+			if (frames == 0) {
+				printf("\n");
+				return 0;
+			}
+
+			double duration = (reader.timestamp(frames - 1) - reader.timestamp(0)) / 1e6;
+			int64_t longestGap = 0;
+			for (size_t i = 1; i < frames; i++) longestGap = std::max(longestGap, reader.timestamp(i) - reader.timestamp(i - 1));
+			printf(" over %.1f s, longest gap %.0f ms\n", duration, longestGap / 1000.0);
+
+			DepthImage image;
+			std::vector<uint8_t> bodyIndex;
+			size_t withIndex = 0, bad = 0;
+			Clock::time_point start = Clock::now();
+			for (size_t i = 0; i < frames; i++) {
+				if (!reader.read(i, image, &bodyIndex)) bad++;
+				else if (!bodyIndex.empty()) withIndex++;
+			}
+			double elapsed = seconds(start);
+			printf("%zu with body indices, %zu unreadable, decoded at %.0f images a second\n", withIndex, bad, frames / elapsed);
+			return bad == 0 ? 0 : 1;
+		}
+
+		void usage() {
+			std::cerr << "Usage: kinect_capture bench [options]\n"
+				"       kinect_capture info capture.kdc\n"
+				"bench measures the codec and writer on synthetic images:\n"
+				"  --bodies N          People in view (2)\n"
+				"  --seconds S         Length of each writer run (10)\n"
+				"  --noise MM          Depth noise at a metre (0.5)\n"
+				"  --encoders N        Encoder threads (2)\n"
+				"  --buffers N         Images that can wait to be encoded (8)\n"
+				"  --seed N            Seed for the images (1)\n"
+				"  --write PATH        Where the writer runs capture to (capture_bench.kdc)" << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace KinectOsvr;
+
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+	std::string command = argv[1];
+
+	Options options;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--bodies" && hasValue) options.bodies = std::max(0, std::min(MaxBodies, atoi(argv[++i])));
+		else if (arg == "--seconds" && hasValue) options.seconds = std::max(1.0, atof(argv[++i]));
+		else if (arg == "--noise" && hasValue) options.noise = atof(argv[++i]);
+		else if (arg == "--encoders" && hasValue) options.encoders = std::max(1, atoi(argv[++i]));
+		else if (arg == "--buffers" && hasValue) options.buffers = std::max(1, atoi(argv[++i]));
+		else if (arg == "--seed" && hasValue) options.seed = (unsigned)atoi(argv[++i]);
+		else if (arg == "--write" && hasValue) options.write = argv[++i];
+		else if (arg.compare(0, 2, "--") == 0) {
+			usage();
+			return 1;
+		}
+		else options.files.push_back(arg);
+	}
+
+	if (command == "bench") return bench(options);
+	if (command == "info" && options.files.size() == 1) return info(options.files[0]);
+	usage();
+	return 1;
+}
@@ -0,0 +1,326 @@
+// Sensor daemon: owns a sensor and publishes its frames for plugins started with OSVR_KINECT_DAEMON, so restarting
+// the server doesn't restart the sensor. Also measures how long attaching takes against opening a sensor, and what
+// handing a frame over costs, with a fake sensor or a daemon already running.
+#include "Config.h"
+#include "Log.h"
+#include "SensorDaemon.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace KinectOsvr {
+#ifdef KINECT_DAEMON_SENSORS
+	// The two SDKs' headers can't be included together, each source is made next to its own
+	FrameSource* createKinectV1Source();
+	FrameSource* createKinectV2Source();
+#endif
+
+	namespace {
+		typedef std::chrono::steady_clock Clock;
+
+		struct Options {
+			Options() : v1(false), fake(false), openMilliseconds(2000), seconds(0), attaches(20), frames(200000) {}
+
+			bool v1;
+			bool fake;
+			int openMilliseconds;
+			double seconds;
+			int attaches;
+			int frames;
+		};
+
+		double milliseconds(Clock::time_point start, Clock::time_point end) {
+			return std::chrono::duration<double, std::milli>(end - start).count();
+		}
+
+		double percentile(std::vector<double> values, double fraction) {
+			if (values.empty()) return 0;
+			std::sort(values.begin(), values.end());
+			return values[std::min(values.size() - 1, (size_t)(fraction * values.size()))];
+		}
+
+		std::string sensorName(const Options& options) {
+			return options.v1 ? "KinectV1" : "KinectV2";
+		}
+
+		int sensorJoints(const Options& options) {
+			return options.v1 ? KinectV1Layout.jointCount : KinectV2Layout.jointCount;
+		}
+
+		FrameSource* createSource(const Options& options) {
+			if (options.fake) {
+				SyntheticSource::Options synthetic;
+				synthetic.bodies = 2;
+				synthetic.jointCount = sensorJoints(options);
+				return new FakeSensor(synthetic, options.openMilliseconds);
+			}
+#ifdef KINECT_DAEMON_SENSORS
+			return options.v1 ? createKinectV1Source() : createKinectV2Source();
+#else
+			return NULL;
+#endif
+		}
+
+		int run(const Options& options) {
+			Config config = Config::fromEnvironment();
+			Log::LogParams logParams;
+			logParams.path = config.logPath;
+			if (config.logSize > 0) logParams.fileSize = (size_t)config.logSize * 1024;
+			Log::Session logSession(logParams);
+
+			std::unique_ptr<FrameSource> source(createSource(options));
+			if (!source) {
+				std::cerr << "This build can't open Kinect sensors, run with --fake" << std::endl;
+				return 1;
+			}
+
+			SensorDaemon daemon(*source, config.tracking);
+			if (!daemon.start()) {
+				std::cerr << "Can't publish " << source->name() << ", is another daemon running?" << std::endl;
+				return 1;
+			}
+
+			if (options.seconds > 0) {
+				printf("Publishing %s for %.0f s\n", source->name().c_str(), options.seconds);
+				std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+			}
+			else {
+				printf("Publishing %s, press Enter to stop\n", source->name().c_str());
+				std::string line;
+				std::getline(std::cin, line);
+			}
+			daemon.stop();
+
+			SensorDaemon::Stats stats = daemon.stats();
+			printf("%llu frames published, %llu commands from plugins\n", (unsigned long long)stats.published, (unsigned long long)stats.commands);
+			return 0;
+		}
+
+		// What a plugin opening the sensor itself waits for: the sensor to come up and its first frame, here as the
+		// daemon starting from nothing
+		bool coldStart(SensorDaemon& daemon) {
+			Clock::time_point start = Clock::now();
+			if (!daemon.start()) return false;
+			while (daemon.stats().published == 0) {
+				if (daemon.state() == SensorLifecycle::Unavailable) return false;
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+			printf("opening the sensor: %.0f ms to the first frame\n", milliseconds(start, Clock::now()));
+			return true;
+		}
+
+		// A plugin's lifecycle attaching as the server starts, then waiting for the next frame, then detaching as it
+		// shuts down
+		bool attachDetach(const Options& options) {
+			std::vector<double> attach, firstFrame, detach;
+			SharedFrame frame;
+			unsigned rng = 1;
+			for (int i = 0; i < options.attaches; i++) {
+				// Servers start at any point between two frames
+				rng = rng * 1103515245u + 12345u;
+				std::this_thread::sleep_for(std::chrono::microseconds((rng >> 8) % 40000));
+
+				AttachedSensor sensor(sensorName(options), sensorJoints(options));
+				SensorLifecycle lifecycle(sensor);
+
+				Clock::time_point start = Clock::now();
+				lifecycle.start();
+				while (lifecycle.state() != SensorLifecycle::Ready) {
+					if (milliseconds(start, Clock::now()) > 2000) {
+						std::cerr << "Couldn't attach to the daemon" << std::endl;
+						return false;
+					}
+					std::this_thread::yield();
+				}
+				Clock::time_point attached = Clock::now();
+
+				bool received = false;
+				while (!received && milliseconds(attached, Clock::now()) < 2000) {
+					std::lock_guard<std::mutex> lock(lifecycle.sensorMutex());
+					received = sensor.subscriber().next(frame);
+				}
+				if (!received) {
+					std::cerr << "No frames from the daemon" << std::endl;
+					return false;
+				}
+				Clock::time_point first = Clock::now();
+
+				lifecycle.stop();
+				Clock::time_point stopped = Clock::now();
+
+				attach.push_back(milliseconds(start, attached));
+				firstFrame.push_back(milliseconds(start, first));
+				detach.push_back(milliseconds(first, stopped));
+			}
+			printf("attaching: %.3f ms to attach, %.1f ms to the first frame (%.1f at worst), %.3f ms to detach, median of %d\n",
+				percentile(attach, 0.5), percentile(firstFrame, 0.5), percentile(firstFrame, 1.0), percentile(detach, 0.5), options.attaches);
+			return true;
+		}
+
+		// Both sides on one thread with the frame hot in cache, so this is the copying alone. Each call is timed on
+		// its own, which adds reading the clock to both.
+		bool handOffCost(const Options& options) {
+			const std::string name = "KinectBench";
+			FramePublisher publisher;
+			FrameSubscriber subscriber;
+			if (!publisher.create(name, sensorJoints(options)) || !subscriber.attach(name, sensorJoints(options))) {
+				std::cerr << "Can't create shared memory" << std::endl;
+				return false;
+			}
+
+			SyntheticSource::Options synthetic;
+			synthetic.bodies = 2;
+			synthetic.jointCount = sensorJoints(options);
+			SyntheticSource source(synthetic);
+			SkeletonFrame skeletons;
+			source.next(skeletons);
+			const float floor[4] = { 0.0f, 1.0f, 0.0f, 0.83f };
+
+			SharedFrame frame;
+			uint64_t checksum = 0;
+			std::vector<double> publish, read, clock;
+			publish.reserve(options.frames);
+			read.reserve(options.frames);
+			clock.reserve(options.frames);
+			for (int i = 0; i < options.frames; i++) {
+				skeletons.timestamp = i;
+				Clock::time_point start = Clock::now();
+				publisher.publish(skeletons, 0, floor);
+				Clock::time_point published = Clock::now();
+				if (subscriber.next(frame)) checksum += frame.frame.timestamp;
+				Clock::time_point received = Clock::now();
+				Clock::time_point nothing = Clock::now();
+
+				publish.push_back(milliseconds(start, published) * 1e6);
+				read.push_back(milliseconds(published, received) * 1e6);
+				clock.push_back(milliseconds(received, nothing) * 1e6);
+			}
+
+			printf("hand-off: %.0f ns to publish a %zu byte frame, %.0f ns to read it, medians including %.0f ns of reading the clock (%llu read, %llu skipped)\n",
+				percentile(publish, 0.5), sizeof(SharedFrame), percentile(read, 0.5), percentile(clock, 0.5),
+				(unsigned long long)subscriber.received(), (unsigned long long)subscriber.skipped());
+			return checksum != 0 && subscriber.received() == (uint64_t)options.frames;
+		}
+
+		// Polling at a server's rate, how long frames wait between the daemon publishing them and the plugin seeing them
+		bool delivery(const Options& options) {
+			AttachedSensor sensor(sensorName(options), sensorJoints(options));
+			if (!sensor.open()) {
+				std::cerr << "Couldn't attach to the daemon" << std::endl;
+				return false;
+			}
+
+			std::vector<double> latency;
+			SharedFrame frame;
+			Clock::time_point start = Clock::now();
+			while (milliseconds(start, Clock::now()) < options.seconds * 1000) {
+				if (sensor.subscriber().next(frame)) latency.push_back((steadyMicroseconds() - frame.publishedAt) / 1000.0);
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			printf("delivery: %.2f ms median from publishing to reading, %.2f ms at the 99th percentile, polling every ms; %llu frames, %llu skipped\n",
+				percentile(latency, 0.5), percentile(latency, 0.99), (unsigned long long)sensor.subscriber().received(), (unsigned long long)sensor.subscriber().skipped());
+
+			// Picking a body from the config window, as far as frames coming back with that body
+			BodyIdentifier::BodyTrackingState states[MaxBodies];
+			sensor.subscriber().bodyStates(states);
+			int body = 0;
+			while (body < MaxBodies && (states[body] == BodyIdentifier::CannotBeTracked || states[body] == BodyIdentifier::ShouldBeTracked)) body++;
+			if (body < MaxBodies) {
+				ControlCommand command = { ControlCommand::SetTrackedBody, body };
+				Clock::time_point sent = Clock::now();
+				sensor.send(command);
+				bool switched = false;
+				while (!switched && milliseconds(sent, Clock::now()) < 1000) {
+					if (sensor.subscriber().next(frame)) switched = frame.trackedBody == body;
+					else std::this_thread::sleep_for(std::chrono::microseconds(100));
+				}
+				if (!switched) {
+					std::cerr << "The daemon didn't switch to body " << body << std::endl;
+					return false;
+				}
+				printf("control: %.1f ms until frames came back tracking body %d\n", milliseconds(sent, Clock::now()), body);
+			}
+			sensor.close();
+			return !latency.empty();
+		}
+
+		int bench(Options options) {
+			if (options.seconds <= 0) options.seconds = 5;
+
+			// Against a daemon already running in another process if there is one, otherwise a fake one here
+			std::unique_ptr<FrameSource> source;
+			std::unique_ptr<SensorDaemon> daemon;
+			AttachedSensor probe(sensorName(options), sensorJoints(options));
+			if (probe.open()) {
+				probe.close();
+				printf("attaching to the running %s daemon\n", sensorName(options).c_str());
+			}
+			else {
+				options.fake = true;
+				source.reset(createSource(options));
+				daemon.reset(new SensorDaemon(*source, TrackingParams()));
+				if (!coldStart(*daemon)) {
+					std::cerr << "Can't start a daemon for " << source->name() << std::endl;
+					return 1;
+				}
+			}
+
+			bool passed = attachDetach(options) && delivery(options) && handOffCost(options);
+			if (daemon) daemon->stop();
+			return passed ? 0 : 1;
+		}
+
+		void usage() {
+			std::cerr << "Usage: kinect_daemon run [options]\n"
+				"       kinect_daemon bench [options]\n"
+				"run publishes a sensor's frames until Enter is pressed, bench measures attaching and hand-off against a\n"
+				"running daemon, or a fake one if there isn't one:\n"
+				"  --v1                The Kinect V1 rather than the V2\n"
+				"  --fake              Synthetic people rather than the sensor\n"
+				"  --open-ms N         How long the fake sensor takes to open (2000)\n"
+				"  --seconds S         How long to run for rather than until Enter, or to measure delivery over (5)\n"
+				"  --attaches N        Attaches to time (20)\n"
+				"  --frames N          Frames to time the hand-off over (200000)" << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace KinectOsvr;
+
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+	std::string command = argv[1];
+
+	Options options;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--v1") options.v1 = true;
+		else if (arg == "--fake") options.fake = true;
+		else if (arg == "--open-ms" && hasValue) options.openMilliseconds = std::max(0, atoi(argv[++i]));
+		else if (arg == "--seconds" && hasValue) options.seconds = std::max(0.0, atof(argv[++i]));
+		else if (arg == "--attaches" && hasValue) options.attaches = std::max(1, atoi(argv[++i]));
+		else if (arg == "--frames" && hasValue) options.frames = std::max(1, atoi(argv[++i]));
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	if (command == "run") return run(options);
+	if (command == "bench") return bench(options);
+	usage();
+	return 1;
+}
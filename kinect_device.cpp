@@ -0,0 +1,1249 @@
+// Device checks without a sensor, each group of them pass or fail:
+//   lifecycle  a scripted backend for runtimes that won't load, sensors slow to open or pulled out, shutting down part way
+//   reports    what the device reports for synthetic people through the stand-in, against its descriptor
+//   solver     bone orientations against poses worked out by hand
+//   history    pose lookups between, before and after what's recorded, and against a writer lapping the reader
+//   reacquire  picking the user back up after scripted occlusions, by their build rather than where they were
+//   control    commands from several threads at once, each applied once and in order between frames
+//   budget     what a device gives up under synthetic load, and what it reports while it does
+#include "BodyIdentifier.h"
+#include "BoneSolver.h"
+#include "ControlQueue.h"
+#include "KinectMath.h"
+#include "Log.h"
+#include "PoseHistory.h"
+#include "SensorLifecycle.h"
+#include "SkeletonDevice.h"
+#include "SyntheticSource.h"
+#include "WorkerPool.h"
+
+#include <PluginKitStandIn.h>
+
+// Generated JSON header files
+#include "je_nourish_kinectv1_json.h"
+#include "je_nourish_kinectv2_json.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace KinectOsvr {
+	namespace {
+		typedef std::chrono::steady_clock Clock;
+
+		struct Options {
+			std::string filter;
+		};
+
+		struct Check {
+			std::string name;
+			bool passed;
+			std::string detail;
+		};
+
+		double milliseconds(Clock::time_point start, Clock::time_point end) {
+			return std::chrono::duration<double, std::milli>(end - start).count();
+		}
+
+		// Polls until the condition holds or the time is up, and says which
+		bool waitFor(std::function<bool()> condition, int timeoutMilliseconds) {
+			Clock::time_point start = Clock::now();
+			while (!condition()) {
+				if (milliseconds(start, Clock::now()) > timeoutMilliseconds) return false;
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			return true;
+		}
+
+		const char* describe(SensorLifecycle::State state) {
+			switch (state) {
+			case SensorLifecycle::Loading: return "loading";
+			case SensorLifecycle::Searching: return "searching";
+			case SensorLifecycle::Ready: return "ready";
+			case SensorLifecycle::Unavailable: return "unavailable";
+			case SensorLifecycle::Stopped: return "stopped";
+			}
+			return "unknown";
+		}
+
+		// A sensor whose runtime, opening and cable are scripted, counting what the lifecycle asks of it
+		class ScriptedSensor : public SensorBackend {
+		public:
+			ScriptedSensor() : loads(true), failedOpens(0), openMilliseconds(0), opens(0), closes(0), m_plugged(true), m_open(false) {}
+
+			bool load() {
+				return loads;
+			}
+
+			bool open() {
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_openTimes.push_back(Clock::now());
+				}
+				int attempt = opens.fetch_add(1);
+				std::this_thread::sleep_for(std::chrono::milliseconds(openMilliseconds));
+				if (!m_plugged.load() || attempt < failedOpens) return false;
+				m_open.store(true);
+				return true;
+			}
+
+			bool isConnected() {
+				return m_open.load() && m_plugged.load();
+			}
+
+			void close() {
+				closes.fetch_add(1);
+				m_open.store(false);
+			}
+
+			void setPlugged(bool plugged) {
+				m_plugged.store(plugged);
+			}
+
+			// Milliseconds between each open and the one before
+			std::vector<double> openIntervals() {
+				std::lock_guard<std::mutex> lock(m_mutex);
+				std::vector<double> intervals;
+				for (size_t i = 1; i < m_openTimes.size(); i++) intervals.push_back(milliseconds(m_openTimes[i - 1], m_openTimes[i]));
+				return intervals;
+			}
+
+			bool loads;
+			int failedOpens;
+			int openMilliseconds;
+			std::atomic<int> opens, closes;
+
+		private:
+			std::atomic<bool> m_plugged, m_open;
+			std::mutex m_mutex;
+			std::vector<Clock::time_point> m_openTimes;
+		};
+
+		void lifecycleChecks(std::vector<Check>& checks) {
+			{
+				ScriptedSensor sensor;
+				sensor.loads = false;
+				SensorLifecycle lifecycle(sensor, 10);
+				lifecycle.start();
+				waitFor([&]() { return lifecycle.state() != SensorLifecycle::Loading; }, 1000);
+				Check check = { "lifecycle: runtime missing", lifecycle.state() == SensorLifecycle::Unavailable && sensor.opens == 0,
+					std::string(describe(lifecycle.state())) + " after " + std::to_string(sensor.opens.load()) + " opens, expected unavailable without any" };
+				checks.push_back(check);
+			}
+
+			// Four failed opens a poll, then two, four and eight polls apart, where the backoff stops growing
+			{
+				const int Poll = 20, MaxRetry = 80;
+				ScriptedSensor sensor;
+				sensor.failedOpens = 4;
+				SensorLifecycle lifecycle(sensor, Poll, MaxRetry);
+				lifecycle.start();
+				bool ready = waitFor([&]() { return lifecycle.state() == SensorLifecycle::Ready; }, 2000);
+
+				std::vector<double> intervals = sensor.openIntervals();
+				bool backedOff = intervals.size() == 4;
+				std::string detail;
+				for (size_t i = 0; i < intervals.size(); i++) {
+					double expected = std::min(Poll << i, MaxRetry);
+					backedOff = backedOff && intervals[i] >= expected * 0.9 && intervals[i] < expected + 50;
+					detail += (i ? ", " : "") + std::to_string((int)(intervals[i] + 0.5));
+				}
+				Check check = { "lifecycle: open retried with backoff", ready && backedOff && lifecycle.generation() == 1,
+					"opens " + detail + " ms apart then " + describe(lifecycle.state()) + ", expected 20, 40, 80, 80 then ready" };
+				checks.push_back(check);
+			}
+
+			// Pulled out and put back, reopened as a new generation so users resync their clocks
+			{
+				ScriptedSensor sensor;
+				SensorLifecycle lifecycle(sensor, 10);
+				lifecycle.start();
+				bool ready = waitFor([&]() { return lifecycle.state() == SensorLifecycle::Ready; }, 1000);
+
+				sensor.setPlugged(false);
+				bool searching = waitFor([&]() { return lifecycle.state() == SensorLifecycle::Searching; }, 1000);
+				Check unplugged = { "lifecycle: unplugged", ready && searching && sensor.closes == 1 && lifecycle.generation() == 1,
+					std::string(describe(lifecycle.state())) + ", closed " + std::to_string(sensor.closes.load()) + " times, expected searching and closed once" };
+				checks.push_back(unplugged);
+
+				// Nothing to open while it's out
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+				bool stillSearching = lifecycle.state() == SensorLifecycle::Searching;
+				sensor.setPlugged(true);
+				bool reopened = waitFor([&]() { return lifecycle.state() == SensorLifecycle::Ready; }, 1000);
+				Check replugged = { "lifecycle: plugged back in", stillSearching && reopened && lifecycle.generation() == 2,
+					std::string(describe(lifecycle.state())) + " as generation " + std::to_string(lifecycle.generation()) + ", expected ready as generation 2" };
+				checks.push_back(replugged);
+			}
+
+			// The update thread skips frames rather than waiting on a sensor that's opening
+			{
+				ScriptedSensor sensor;
+				sensor.openMilliseconds = 200;
+				SensorLifecycle lifecycle(sensor, 10);
+				lifecycle.start();
+				waitFor([&]() { return sensor.opens == 1; }, 1000);
+				std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+				std::unique_lock<std::mutex> lock(lifecycle.sensorMutex(), std::try_to_lock);
+				bool held = !lock.owns_lock();
+				if (lock.owns_lock()) lock.unlock();
+
+				// Shutting down meanwhile waits for the open to finish, then closes what it opened
+				Clock::time_point start = Clock::now();
+				lifecycle.stop();
+				double stopped = milliseconds(start, Clock::now());
+				Check skipped = { "lifecycle: sensor held while opening", held, held ? "update would skip the frame" : "update would touch a sensor being opened" };
+				checks.push_back(skipped);
+				Check shutdown = { "lifecycle: shutdown while opening", lifecycle.state() == SensorLifecycle::Stopped && sensor.closes == 1 && stopped < 250,
+					std::string(describe(lifecycle.state())) + " after " + std::to_string((int)stopped) + " ms and closed " + std::to_string(sensor.closes.load()) +
+					" times, expected stopped as the open finishes and closed once" };
+				checks.push_back(shutdown);
+			}
+
+			// A long backoff doesn't hold up shutdown
+			{
+				ScriptedSensor sensor;
+				sensor.failedOpens = 1000;
+				SensorLifecycle lifecycle(sensor, 100, 4000);
+				lifecycle.start();
+				waitFor([&]() { return sensor.opens == 3; }, 5000);
+
+				Clock::time_point start = Clock::now();
+				lifecycle.stop();
+				double stopped = milliseconds(start, Clock::now());
+				Check check = { "lifecycle: shutdown while backing off", lifecycle.state() == SensorLifecycle::Stopped && sensor.closes == 0 && stopped < 50,
+					std::string(describe(lifecycle.state())) + " after " + std::to_string((int)stopped) + " ms, expected stopped at once with nothing to close" };
+				checks.push_back(check);
+			}
+		}
+
+#ifdef _WIN32
+		const char* const NullDevice = "NUL";
+#else
+		const char* const NullDevice = "/dev/null";
+#endif
+
+		int64_t microseconds(const OSVR_TimeValue& timeValue) {
+			return timeValue.seconds * 1000000LL + timeValue.microseconds;
+		}
+
+		// What a frame with the body tracked should send: every joint and the sensor's own pose, a confidence per
+		// joint with the head and hands' sent once more ahead of the rest, and the hand states
+		struct ReportCounts {
+			ReportCounts() : trackers(0), analogs(0), buttons(0), badChannels(0), badValues(0), badTimestamps(0) {}
+
+			int trackers, analogs, buttons;
+			int badChannels, badValues, badTimestamps;
+		};
+
+		ReportCounts countReports(const SkeletonLayout& layout, int64_t timestamp) {
+			ReportCounts counts;
+			std::vector<int> trackerChannels(layout.sensorChannel + 1, 0);
+			for (size_t r = 0; r < StandIn::reportCount(); r++) {
+				const StandIn::Report& report = StandIn::report(r);
+				switch (report.type) {
+				case StandIn::TrackerReport: {
+					counts.trackers++;
+					if ((int)report.channel > layout.sensorChannel || trackerChannels[report.channel]++ > 0) counts.badChannels++;
+					double norm = 0;
+					for (int k = 3; k < 7; k++) norm += report.value[k] * report.value[k];
+					bool finite = true;
+					for (int k = 0; k < 7; k++) finite = finite && std::isfinite(report.value[k]);
+					if (!finite || fabs(norm - 1.0) > 1e-3) counts.badValues++;
+					break;
+				}
+				case StandIn::AnalogReport:
+					counts.analogs++;
+					if ((int)report.channel >= layout.jointCount) counts.badChannels++;
+					if (!(report.value[0] == 0 || report.value[0] == 0.5 || report.value[0] == 1)) counts.badValues++;
+					break;
+				case StandIn::ButtonReport:
+					counts.buttons++;
+					if ((int)report.channel >= layout.handButtons + layout.gestureButtons) counts.badChannels++;
+					if (report.value[0] != 0 && report.value[0] != 1) counts.badValues++;
+					break;
+				default:
+					break;
+				}
+				// Buttons have no timestamp of their own, everything else carries the frame's
+				if (report.type != StandIn::ButtonReport && microseconds(report.timestamp) != timestamp) counts.badTimestamps++;
+			}
+			return counts;
+		}
+
+		// People coming and going in front of a device fed the way the Kinect classes feed theirs, with nothing given
+		// up to the frame budget, checking every frame's reports
+		void deviceReportChecks(const char* name, const SkeletonLayout& layout, const char* descriptor, const BoneHierarchy* hierarchy, std::vector<Check>& checks) {
+			const int Frames = 600;
+			StandIn::reset(1 << 12);
+			StandIn::setValidation(true);
+
+			WorkerPool pool(0);
+			SkeletonDevice device(StandIn::context(), name, layout, descriptor, pool);
+			device.setFrameBudget(0);
+			std::unique_ptr<BoneSolver> solver;
+			if (hierarchy) {
+				solver.reset(new BoneSolver(*hierarchy));
+				BoneSolver* s = solver.get();
+				device.setOrientationStage([s](int, Skeleton& skeleton) {
+					s->solve(skeleton);
+					return true;
+				});
+			}
+
+			SyntheticSource::Options sourceOptions;
+			sourceOptions.bodies = 3;
+			sourceOptions.jointCount = layout.jointCount;
+			sourceOptions.inferredRate = 0.05;
+			sourceOptions.churnRate = 0.01;
+			SyntheticSource source(sourceOptions);
+			BodyIdentifier identifier;
+			SkeletonFrame frame;
+
+			int reported = 0, silent = 0, wrongCounts = 0, wrongSilent = 0;
+			ReportCounts totals;
+			OSVR_TimeValue last = { 0, 0 };
+			for (int i = 0; i < Frames; i++) {
+				source.next(frame);
+				frame.timestamp = (i + 1) * 33333LL;
+				OSVR_TimeValue timeValue;
+				timeValue.seconds = frame.timestamp / 1000000;
+				timeValue.microseconds = frame.timestamp % 1000000;
+				last = timeValue;
+				int trackedBody = identifier.identify(frame);
+
+				StandIn::clearReports();
+				device.process(frame, trackedBody, timeValue);
+				ReportCounts counts = countReports(layout, frame.timestamp);
+				totals.badChannels += counts.badChannels;
+				totals.badValues += counts.badValues;
+				totals.badTimestamps += counts.badTimestamps;
+
+				BodyTracking tracking = trackedBody >= 0 ? frame.bodies[trackedBody].tracking : BodyNotTracked;
+				if (tracking == BodyTracked) {
+					reported++;
+					if (counts.trackers != layout.jointCount + 1 || counts.analogs != layout.jointCount + 3 || counts.buttons != layout.handButtons) wrongCounts++;
+				}
+				else {
+					// A body the sensor only has the position of still has its hands
+					silent++;
+					int buttons = tracking == BodyPositionOnly ? layout.handButtons : 0;
+					if (counts.trackers != 0 || counts.analogs != 0 || counts.buttons != buttons) wrongSilent++;
+				}
+			}
+
+			std::string prefix = std::string("reports: ") + name;
+			Check perFrame = { prefix + " per frame", reported > Frames / 2 && wrongCounts == 0 && wrongSilent == 0,
+				std::to_string(reported) + " frames tracked with " + std::to_string(wrongCounts) + " wrong, " + std::to_string(silent) + " untracked with " +
+				std::to_string(wrongSilent) + " wrong; expected " + std::to_string(layout.jointCount + 1) + " tracker, " + std::to_string(layout.jointCount) + " analog and " +
+				std::to_string(layout.handButtons) + " button reports while tracked, none while not" };
+			checks.push_back(perFrame);
+
+			Check ranges = { prefix + " channels and values", totals.badChannels == 0 && totals.badValues == 0,
+				std::to_string(totals.badChannels) + " channels out of range or repeated, " + std::to_string(totals.badValues) +
+				" values that aren't a unit pose, a confidence or a button; expected none" };
+			checks.push_back(ranges);
+
+			Check timestamps = { prefix + " timestamps", totals.badTimestamps == 0,
+				std::to_string(totals.badTimestamps) + " reports not stamped with their frame's time, expected none" };
+			checks.push_back(timestamps);
+
+			// Sensors can hand over a frame late, it's dropped rather than reported out of order
+			StandIn::clearReports();
+			frame.timestamp = microseconds(last) - 33333;
+			OSVR_TimeValue earlier;
+			earlier.seconds = frame.timestamp / 1000000;
+			earlier.microseconds = frame.timestamp % 1000000;
+			bool processed = device.process(frame, identifier.trackedBody(), earlier);
+			Check stale = { prefix + " older frame", !processed && StandIn::reportCount() == 0,
+				std::to_string(StandIn::reportCount()) + " reports for a frame older than the last, expected it dropped" };
+			checks.push_back(stale);
+
+			// The lifecycle's state goes out when it changes and once a second after, whether or not frames do
+			StandIn::clearReports();
+			const SensorLifecycle::State states[] = { SensorLifecycle::Loading, SensorLifecycle::Searching, SensorLifecycle::Searching, SensorLifecycle::Ready, SensorLifecycle::Ready };
+			const int64_t times[] = { 0, 100000, 600000, 700000, 1800000 };
+			const double expected[] = { SensorLifecycle::Loading, SensorLifecycle::Searching, SensorLifecycle::Ready, SensorLifecycle::Ready };
+			for (int s = 0; s < 5; s++) {
+				OSVR_TimeValue at;
+				at.seconds = (microseconds(last) + times[s]) / 1000000;
+				at.microseconds = (microseconds(last) + times[s]) % 1000000;
+				device.reportStatus(states[s], at);
+			}
+			int statusRight = 0;
+			for (size_t r = 0; r < StandIn::reportCount() && r < 4; r++) {
+				const StandIn::Report& report = StandIn::report(r);
+				if (report.type == StandIn::AnalogReport && (int)report.channel == layout.statusChannel && report.value[0] == expected[r]) statusRight++;
+			}
+			Check status = { prefix + " sensor status", StandIn::reportCount() == 4 && statusRight == 4,
+				std::to_string(StandIn::reportCount()) + " status reports with " + std::to_string(statusRight) + " as expected, expected loading, searching, ready and ready again a second on" };
+			checks.push_back(status);
+
+			const std::vector<std::string>& errors = StandIn::validationErrors();
+			Check valid = { prefix + " against the descriptor", errors.empty() && StandIn::droppedReports() == 0,
+				errors.empty() ? "every report has a semantic path within the descriptor's counts" : std::to_string(errors.size()) + " errors, the first " + errors[0] };
+			checks.push_back(valid);
+			StandIn::setValidation(false);
+		}
+
+		void reportChecks(std::vector<Check>& checks) {
+			deviceReportChecks("KinectV1", KinectV1Layout, je_nourish_kinectv1_json, &KinectV1Hierarchy, checks);
+			deviceReportChecks("KinectV2", KinectV2Layout, je_nourish_kinectv2_json, NULL, checks);
+
+			// Joint pixels stay within the descriptor's ranges: in the image, or the sentinel for both coordinates
+			{
+				PinholeProjector projector(KinectV2DepthCamera, KinectV2ColorCamera);
+				SkeletonFrame frame;
+				clearFrame(frame, 3);
+				const float joints[3][3] = { { 0.0f, 0.0f, -1.0f }, { 5.0f, 0.0f, 1.0f }, { 0.1f, 0.2f, 2.0f } };
+				for (int j = 0; j < 3; j++) {
+					frame.bodies[0].x[j] = joints[j][0];
+					frame.bodies[0].y[j] = joints[j][1];
+					frame.bodies[0].z[j] = joints[j][2];
+				}
+				bool bodies[MaxBodies] = { true };
+				FrameProjection projection;
+				projector.project(frame, bodies, projection);
+
+				int unmapped = 0, inside = 0;
+				for (int j = 0; j < 2; j++) {
+					if (projection.colorX[0][j] == UnmappedPixel && projection.colorY[0][j] == UnmappedPixel &&
+						projection.depthX[0][j] == UnmappedPixel && projection.depthY[0][j] == UnmappedPixel) unmapped++;
+				}
+				if (projection.colorX[0][2] >= 0 && projection.colorX[0][2] < KinectV2ColorCamera.width && projection.colorY[0][2] >= 0 && projection.colorY[0][2] < KinectV2ColorCamera.height &&
+					projection.depthX[0][2] >= 0 && projection.depthX[0][2] < KinectV2DepthCamera.width && projection.depthY[0][2] >= 0 && projection.depthY[0][2] < KinectV2DepthCamera.height) inside++;
+				Check check = { "reports: projection off the image", unmapped == 2 && inside == 1,
+					std::to_string(unmapped) + " of 2 joints behind the camera or past an edge sent as -1, " + std::to_string(inside) +
+					" of 1 in view within the image; expected all" };
+				checks.push_back(check);
+			}
+
+			// The stand-in itself turns away what a real server would, or the checks above prove nothing
+			StandIn::reset(16);
+			StandIn::setValidation(true);
+			const char* descriptor = "{ \"interfaces\": { \"analog\": { \"count\": 2 } }, \"semantic\": { \"value\": \"analog/0\" } }";
+			OSVR_DeviceInitOptions opts = osvrDeviceCreateInitOptions(StandIn::context());
+			OSVR_AnalogDeviceInterface analog;
+			osvrDeviceAnalogConfigure(opts, &analog, 4);
+			OSVR_DeviceToken token;
+			osvrDeviceAsyncInitWithOptions(StandIn::context(), "Invalid", opts, &token);
+			osvrDeviceSendJsonDescriptor(token, descriptor, strlen(descriptor));
+			OSVR_TimeValue now;
+			osvrTimeValueGetNow(&now);
+			bool accepted = osvrDeviceAnalogSetValueTimestamped(token, analog, 1, 0, &now) == OSVR_RETURN_SUCCESS;
+			int rejected = 0;
+			for (OSVR_ChannelCount channel = 1; channel < 6; channel++) {
+				if (osvrDeviceAnalogSetValueTimestamped(token, analog, 1, channel, &now) != OSVR_RETURN_SUCCESS) rejected++;
+			}
+			Check check = { "reports: stand-in validation", accepted && rejected == 5 && StandIn::stats(StandIn::AnalogReport).rejected == 5,
+				std::to_string(rejected) + " of 5 reports outside the descriptor rejected, " + (accepted ? "the one inside accepted" : "the one inside rejected too") };
+			checks.push_back(check);
+			StandIn::setValidation(false);
+			StandIn::reset(16);
+		}
+
+		// A joint of a pose whose orientations are known: Y along the bone ending at it, X across it
+		struct GoldenJoint {
+			int joint;
+			float position[3];
+			float y[3];
+			float x[3];
+		};
+
+		// Standing with arms out to the sides, left towards -X, thumbs and feet towards +Z. The torso and head are
+		// square to the hips and shoulders; limbs carry their parent's X down each bend, so the arms have Y towards
+		// their own side, left X up and right X down, and after the knee both legs have X towards -X. The V2's hands
+		// twist to put X towards the thumb, or away from it on the right.
+		const GoldenJoint V1TPose[] = {
+			{ V1Joint::HipCenter, { 0, 0, 0 }, { 0, 1, 0 }, { 1, 0, 0 } },
+			{ V1Joint::Spine, { 0, 0.3f, 0 }, { 0, 1, 0 }, { 1, 0, 0 } },
+			{ V1Joint::ShoulderCenter, { 0, 0.55f, 0 }, { 0, 1, 0 }, { 1, 0, 0 } },
+			{ V1Joint::Head, { 0, 0.75f, 0 }, { 0, 1, 0 }, { 1, 0, 0 } },
+			{ V1Joint::ShoulderLeft, { -0.2f, 0.55f, 0 }, { -1, 0, 0 }, { 0, 1, 0 } },
+			{ V1Joint::ElbowLeft, { -0.45f, 0.55f, 0 }, { -1, 0, 0 }, { 0, 1, 0 } },
+			{ V1Joint::WristLeft, { -0.7f, 0.55f, 0 }, { -1, 0, 0 }, { 0, 1, 0 } },
+			{ V1Joint::HandLeft, { -0.78f, 0.55f, 0 }, { -1, 0, 0 }, { 0, 1, 0 } },
+			{ V1Joint::ShoulderRight, { 0.2f, 0.55f, 0 }, { 1, 0, 0 }, { 0, -1, 0 } },
+			{ V1Joint::ElbowRight, { 0.45f, 0.55f, 0 }, { 1, 0, 0 }, { 0, -1, 0 } },
+			{ V1Joint::WristRight, { 0.7f, 0.55f, 0 }, { 1, 0, 0 }, { 0, -1, 0 } },
+			{ V1Joint::HandRight, { 0.78f, 0.55f, 0 }, { 1, 0, 0 }, { 0, -1, 0 } },
+			{ V1Joint::HipLeft, { -0.1f, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 } },
+			{ V1Joint::KneeLeft, { -0.1f, -0.45f, 0 }, { 0, -1, 0 }, { -1, 0, 0 } },
+			{ V1Joint::AnkleLeft, { -0.1f, -0.85f, 0 }, { 0, -1, 0 }, { -1, 0, 0 } },
+			{ V1Joint::FootLeft, { -0.1f, -0.85f, 0.1f }, { 0, 0, 1 }, { -1, 0, 0 } },
+			{ V1Joint::HipRight, { 0.1f, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 } },
+			{ V1Joint::KneeRight, { 0.1f, -0.45f, 0 }, { 0, -1, 0 }, { -1, 0, 0 } },
+			{ V1Joint::AnkleRight, { 0.1f, -0.85f, 0 }, { 0, -1, 0 }, { -1, 0, 0 } },
+			{ V1Joint::FootRight, { 0.1f, -0.85f, 0.1f }, { 0, 0, 1 }, { -1, 0, 0 } },
+		};
+
+		const float R = 0.70710678f;
+		const GoldenJoint V2TPose[] = {
+			{ V2Joint::SpineBase, { 0, 0, 0 }, { 0, 1, 0 }, { 1, 0, 0 } },
+			{ V2Joint::SpineMid, { 0, 0.3f, 0 }, { 0, 1, 0 }, { 1, 0, 0 } },
+			{ V2Joint::SpineShoulder, { 0, 0.55f, 0 }, { 0, 1, 0 }, { 1, 0, 0 } },
+			{ V2Joint::Neck, { 0, 0.65f, 0 }, { 0, 1, 0 }, { 1, 0, 0 } },
+			{ V2Joint::Head, { 0, 0.8f, 0 }, { 0, 1, 0 }, { 1, 0, 0 } },
+			{ V2Joint::ShoulderLeft, { -0.2f, 0.55f, 0 }, { -1, 0, 0 }, { 0, 1, 0 } },
+			{ V2Joint::ElbowLeft, { -0.45f, 0.55f, 0 }, { -1, 0, 0 }, { 0, 1, 0 } },
+			{ V2Joint::WristLeft, { -0.7f, 0.55f, 0 }, { -1, 0, 0 }, { 0, 1, 0 } },
+			{ V2Joint::HandLeft, { -0.78f, 0.55f, 0 }, { -1, 0, 0 }, { 0, 0, 1 } },
+			{ V2Joint::HandTipLeft, { -0.85f, 0.55f, 0 }, { -1, 0, 0 }, { 0, 0, 1 } },
+			{ V2Joint::ThumbLeft, { -0.75f, 0.55f, 0.05f }, { -R, 0, R }, { 0, 1, 0 } },
+			{ V2Joint::ShoulderRight, { 0.2f, 0.55f, 0 }, { 1, 0, 0 }, { 0, -1, 0 } },
+			{ V2Joint::ElbowRight, { 0.45f, 0.55f, 0 }, { 1, 0, 0 }, { 0, -1, 0 } },
+			{ V2Joint::WristRight, { 0.7f, 0.55f, 0 }, { 1, 0, 0 }, { 0, -1, 0 } },
+			{ V2Joint::HandRight, { 0.78f, 0.55f, 0 }, { 1, 0, 0 }, { 0, 0, -1 } },
+			{ V2Joint::HandTipRight, { 0.85f, 0.55f, 0 }, { 1, 0, 0 }, { 0, 0, -1 } },
+			{ V2Joint::ThumbRight, { 0.75f, 0.55f, 0.05f }, { R, 0, R }, { 0, -1, 0 } },
+			{ V2Joint::HipLeft, { -0.1f, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 } },
+			{ V2Joint::KneeLeft, { -0.1f, -0.45f, 0 }, { 0, -1, 0 }, { -1, 0, 0 } },
+			{ V2Joint::AnkleLeft, { -0.1f, -0.85f, 0 }, { 0, -1, 0 }, { -1, 0, 0 } },
+			{ V2Joint::FootLeft, { -0.1f, -0.85f, 0.1f }, { 0, 0, 1 }, { -1, 0, 0 } },
+			{ V2Joint::HipRight, { 0.1f, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 } },
+			{ V2Joint::KneeRight, { 0.1f, -0.45f, 0 }, { 0, -1, 0 }, { -1, 0, 0 } },
+			{ V2Joint::AnkleRight, { 0.1f, -0.85f, 0 }, { 0, -1, 0 }, { -1, 0, 0 } },
+			{ V2Joint::FootRight, { 0.1f, -0.85f, 0.1f }, { 0, 0, 1 }, { -1, 0, 0 } },
+		};
+
+		Eigen::Quaterniond jointOrientation(const Skeleton& skeleton, int j) {
+			return Eigen::Quaterniond(skeleton.qw[j], skeleton.qx[j], skeleton.qy[j], skeleton.qz[j]);
+		}
+
+		Eigen::Vector3d jointPosition(const Skeleton& skeleton, int j) {
+			return Eigen::Vector3d(skeleton.x[j], skeleton.y[j], skeleton.z[j]);
+		}
+
+		double degreesBetween(const Eigen::Vector3d& a, const Eigen::Vector3d& b) {
+			double d = a.normalized().dot(b.normalized());
+			return acos(std::max(-1.0, std::min(1.0, d))) * 180.0 / M_PI;
+		}
+
+		// The pose turned and moved as a whole, which should turn every orientation with it
+		std::string goldenPose(const BoneHierarchy& hierarchy, const GoldenJoint* pose, size_t count, const Eigen::Quaterniond& turn, double& worst) {
+			Skeleton skeleton;
+			skeleton.tracking = BodyTracked;
+			const Eigen::Vector3d offset(0.3, 0.9, 2.5);
+			for (size_t i = 0; i < count; i++) {
+				Eigen::Vector3d position = turn * Eigen::Vector3d(pose[i].position[0], pose[i].position[1], pose[i].position[2]) + offset;
+				skeleton.x[pose[i].joint] = (float)position.x();
+				skeleton.y[pose[i].joint] = (float)position.y();
+				skeleton.z[pose[i].joint] = (float)position.z();
+			}
+			BoneSolver(hierarchy).solve(skeleton);
+
+			worst = 0;
+			std::string worstJoint = "none";
+			for (size_t i = 0; i < count; i++) {
+				Eigen::Quaterniond q = jointOrientation(skeleton, pose[i].joint);
+				Eigen::Vector3d y = turn * Eigen::Vector3d(pose[i].y[0], pose[i].y[1], pose[i].y[2]);
+				Eigen::Vector3d x = turn * Eigen::Vector3d(pose[i].x[0], pose[i].x[1], pose[i].x[2]);
+				double error = std::max(degreesBetween(q * Eigen::Vector3d::UnitY(), y), degreesBetween(q * Eigen::Vector3d::UnitX(), x));
+				if (error > worst) {
+					worst = error;
+					worstJoint = "joint " + std::to_string(pose[i].joint);
+				}
+			}
+			return worstJoint;
+		}
+
+		void goldenChecks(const char* name, const BoneHierarchy& hierarchy, const GoldenJoint* pose, size_t count, std::vector<Check>& checks) {
+			const double Tolerance = 0.01;
+			char detail[160];
+
+			double worst;
+			std::string joint = goldenPose(hierarchy, pose, count, Eigen::Quaterniond::Identity(), worst);
+			snprintf(detail, sizeof(detail), "%.4f degrees from the worked out axes at worst (%s), expected under %.2f", worst, joint.c_str(), Tolerance);
+			Check standing = { std::string("solver: ") + name + " T-pose", count == (size_t)hierarchy.jointCount && worst < Tolerance, detail };
+			checks.push_back(standing);
+
+			Eigen::Quaterniond turn = Eigen::AngleAxisd(0.7, Eigen::Vector3d::UnitY()) * Eigen::AngleAxisd(-0.3, Eigen::Vector3d::UnitX()) * Eigen::AngleAxisd(0.2, Eigen::Vector3d::UnitZ());
+			joint = goldenPose(hierarchy, pose, count, turn, worst);
+			snprintf(detail, sizeof(detail), "%.4f degrees from the worked out axes turned with it at worst (%s), expected under %.2f", worst, joint.c_str(), Tolerance);
+			Check turned = { std::string("solver: ") + name + " turned T-pose", worst < Tolerance, detail };
+			checks.push_back(turned);
+		}
+
+		// Properties that hold for any pose, over synthetic people: each bone along its joint's Y, X towards the
+		// twist pair where there is one, and relative orientations that chain back up to the absolute ones
+		void solvedBodyChecks(const char* name, const BoneHierarchy& hierarchy, std::vector<Check>& checks) {
+			const double Tolerance = 0.01;
+			SyntheticSource::Options options;
+			options.bodies = 6;
+			options.jointCount = hierarchy.jointCount;
+			options.noise = 0.01;
+			SyntheticSource source(options);
+			BoneSolver solver(hierarchy);
+			SkeletonFrame frame;
+			BoneOrientations relative;
+
+			double worstBone = 0, worstTwist = 0, worstChain = 0, worstNorm = 0;
+			int bones = 0, twists = 0;
+			for (int f = 0; f < 300; f++) {
+				source.next(frame);
+				for (int b = 0; b < MaxBodies; b++) {
+					Skeleton& skeleton = frame.bodies[b];
+					if (skeleton.tracking != BodyTracked) continue;
+					solver.solve(skeleton, &relative);
+
+					for (int j = 0; j < hierarchy.jointCount; j++) {
+						Eigen::Quaterniond q = jointOrientation(skeleton, j);
+						worstNorm = std::max(worstNorm, fabs(q.norm() - 1.0));
+
+						int parent = hierarchy.parent[j];
+						Eigen::Vector3d bone = parent >= 0 ? jointPosition(skeleton, j) - jointPosition(skeleton, parent)
+							: jointPosition(skeleton, hierarchy.rootChild) - jointPosition(skeleton, j);
+						if (bone.norm() < 1e-3) continue;
+						bones++;
+						worstBone = std::max(worstBone, degreesBetween(q * Eigen::Vector3d::UnitY(), bone));
+
+						if (hierarchy.twistFrom[j] >= 0) {
+							Eigen::Vector3d t = jointPosition(skeleton, hierarchy.twistTo[j]) - jointPosition(skeleton, hierarchy.twistFrom[j]);
+							Eigen::Vector3d across = t - t.dot(bone.normalized()) * bone.normalized();
+							if (across.norm() > 0.2 * t.norm()) {
+								twists++;
+								worstTwist = std::max(worstTwist, degreesBetween(q * Eigen::Vector3d::UnitX(), across));
+							}
+						}
+
+						Eigen::Quaterniond r(relative.qw[j], relative.qx[j], relative.qy[j], relative.qz[j]);
+						Eigen::Quaterniond chained = parent >= 0 ? jointOrientation(skeleton, parent) * r : r;
+						worstChain = std::max(worstChain, q.angularDistance(chained) * 180.0 / M_PI);
+					}
+				}
+			}
+
+			char detail[200];
+			snprintf(detail, sizeof(detail), "%.4f degrees from %d bones, %.4f from %d twist pairs, at worst; expected under %.2f", worstBone, bones, worstTwist, twists, Tolerance);
+			Check along = { std::string("solver: ") + name + " bones and twists", bones > 0 && twists > 0 && worstBone < Tolerance && worstTwist < Tolerance, detail };
+			checks.push_back(along);
+
+			snprintf(detail, sizeof(detail), "%.4f degrees between relative orientations chained up and absolute ones, %.1e off unit length, at worst", worstChain, worstNorm);
+			Check chain = { std::string("solver: ") + name + " relative orientations", worstChain < Tolerance && worstNorm < 1e-5, detail };
+			checks.push_back(chain);
+		}
+
+		void solverChecks(std::vector<Check>& checks) {
+			goldenChecks("KinectV1", KinectV1Hierarchy, V1TPose, sizeof(V1TPose) / sizeof(V1TPose[0]), checks);
+			goldenChecks("KinectV2", KinectV2Hierarchy, V2TPose, sizeof(V2TPose) / sizeof(V2TPose[0]), checks);
+			solvedBodyChecks("KinectV1", KinectV1Hierarchy, checks);
+			solvedBodyChecks("KinectV2", KinectV2Hierarchy, checks);
+		}
+
+		// Every joint's pose a function of the time, so any mix of two pushes shows
+		void historyPoses(int64_t timestamp, std::vector<OSVR_PoseState>& poses) {
+			Eigen::Quaterniond q(Eigen::AngleAxisd(timestamp * 1e-3, Eigen::Vector3d::UnitY()));
+			for (size_t j = 0; j < poses.size(); j++) {
+				poses[j].translation.data[0] = (double)timestamp;
+				poses[j].translation.data[1] = 2.0 * timestamp;
+				poses[j].translation.data[2] = (double)(timestamp + (int64_t)j);
+				osvrQuatSetW(&poses[j].rotation, q.w());
+				osvrQuatSetX(&poses[j].rotation, q.x());
+				osvrQuatSetY(&poses[j].rotation, q.y());
+				osvrQuatSetZ(&poses[j].rotation, q.z());
+			}
+		}
+
+		bool poseAt(const OSVR_PoseState* poses, int jointCount, double timestamp) {
+			Eigen::Quaterniond q(Eigen::AngleAxisd(timestamp * 1e-3, Eigen::Vector3d::UnitY()));
+			for (int j = 0; j < jointCount; j++) {
+				const OSVR_PoseState& pose = poses[j];
+				if (fabs(pose.translation.data[0] - timestamp) > 1e-6 || fabs(pose.translation.data[1] - 2.0 * timestamp) > 1e-6 ||
+					fabs(pose.translation.data[2] - (timestamp + j)) > 1e-6 ||
+					fabs(osvrQuatGetW(&pose.rotation) - q.w()) > 1e-6 || fabs(osvrQuatGetY(&pose.rotation) - q.y()) > 1e-6) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		void historyChecks(std::vector<Check>& checks) {
+			const int Joints = V2Joint::Count;
+			std::vector<OSVR_PoseState> poses(Joints);
+			std::vector<OSVR_PoseState> sampled(Joints);
+
+			{
+				// Frames 1 ms apart turning a radian a second, so halfway is half a milliradian on
+				PoseHistory history(Joints, 8);
+				for (int64_t t = 1000; t <= 5000; t += 1000) {
+					historyPoses(t, poses);
+					history.push(t, &poses[0]);
+				}
+				bool exact = history.sample(3000, &sampled[0]) && poseAt(&sampled[0], Joints, 3000);
+				bool between = history.sample(3250, &sampled[0]) && poseAt(&sampled[0], Joints, 3250);
+				bool held = history.sample(9000, &sampled[0]) && poseAt(&sampled[0], Joints, 5000);
+				OSVR_PoseState one;
+				bool joint = history.sample(4500, 7, one) && fabs(one.translation.data[0] - 4500) < 1e-6 && fabs(one.translation.data[2] - 4507) < 1e-6;
+				Check check = { "history: interpolation", exact && between && held && joint,
+					std::string("on a push ") + (exact ? "exact" : "wrong") + ", a quarter way between " + (between ? "blended" : "wrong") +
+					", past the newest " + (held ? "held" : "wrong") + ", one joint " + (joint ? "blended" : "wrong") };
+				checks.push_back(check);
+
+				OSVR_PoseState pose;
+				bool early = !history.sample(999, 0, pose);
+				for (int64_t t = 6000; t <= 12000; t += 1000) {
+					historyPoses(t, poses);
+					history.push(t, &poses[0]);
+				}
+				// Eight slots keep seven poses, the next one may be mid-write
+				int64_t oldest = 0, newest = 0;
+				bool covered = history.range(oldest, newest) && oldest == 6000 && newest == 12000;
+				bool dropped = !history.sample(5500, 0, pose) && history.sample(6000, 0, pose);
+				Check before = { "history: before the oldest", early && covered && dropped,
+					std::string("before the first push ") + (early ? "nothing" : "a pose") + ", after wrapping " + std::to_string(oldest) + " to " +
+					std::to_string(newest) + " covered and overwritten times " + (dropped ? "not found" : "found") + "; expected 6000 to 12000 and nothing before" };
+				checks.push_back(before);
+			}
+
+			{
+				// Many laps of the ring, each slot's sequence telling its writes apart
+				PoseHistory history(Joints, 8);
+				for (int64_t t = 1; t <= 1000; t++) {
+					historyPoses(t, poses);
+					history.push(t, &poses[0]);
+				}
+				int wrong = 0;
+				for (int64_t t = 994; t <= 1000; t++) {
+					if (!history.sample(t, &sampled[0]) || !poseAt(&sampled[0], Joints, (double)t)) wrong++;
+				}
+				historyPoses(999, poses);
+				bool older = !history.push(999, &poses[0]);
+
+				history.restart();
+				int64_t oldest, newest;
+				bool empty = !history.range(oldest, newest) && !history.sample(1000, &sampled[0]);
+				historyPoses(10, poses);
+				bool again = history.push(10, &poses[0]) && history.range(oldest, newest) && oldest == 10 && newest == 10 &&
+					!history.sample(5, &sampled[0]) && history.sample(20, &sampled[0]) && poseAt(&sampled[0], Joints, 10);
+				Check check = { "history: generations and restart", wrong == 0 && older && empty && again,
+					std::to_string(wrong) + " of 7 poses wrong after 125 laps, an older push " + (older ? "refused" : "taken") + ", after a restart " +
+					(empty ? "empty" : "not empty") + " and " + (again ? "starting over from an earlier time" : "not starting over") };
+				checks.push_back(check);
+			}
+
+			{
+				// A writer lapping a three-slot ring as fast as it can while a reader samples halfway between the newest
+				// two pushes, so reads are overwritten under the reader and have to start over
+				PoseHistory history(Joints, 3);
+				std::atomic<bool> stop(false);
+				std::atomic<int64_t> written(0);
+				std::thread writer([&]() {
+					std::vector<OSVR_PoseState> mine(Joints);
+					for (int64_t t = 2; !stop.load(); t += 2) {
+						historyPoses(t, mine);
+						history.push(t, &mine[0]);
+						written.store(t);
+					}
+				});
+
+				Clock::time_point start = Clock::now();
+				long long reads = 0, torn = 0;
+				// On one core a read is only overwritten when the reader is preempted part way through, a few times a second
+				while (milliseconds(start, Clock::now()) < 5000 && (history.retries() < 10 || reads < 100000)) {
+					int64_t t = written.load();
+					if (t < 4) continue;
+					// Nothing when the writer has already moved on past both
+					if (history.sample(t - 1, &sampled[0])) {
+						reads++;
+						if (!poseAt(&sampled[0], Joints, (double)(t - 1))) torn++;
+					}
+				}
+				stop.store(true);
+				writer.join();
+				Check check = { "history: reader retries", torn == 0 && history.retries() > 0,
+					std::to_string(reads) + " reads against a writer at " + std::to_string(written.load()) + " pushes, " +
+					std::to_string(history.retries()) + " retried and " + std::to_string(torn) + " inconsistent, expected some retried and none inconsistent" };
+				checks.push_back(check);
+			}
+		}
+
+		struct Reacquisition {
+			Reacquisition() : occlusions(0), relocked(0), wrong(0), latency(0), framesOnWrong(0) {}
+
+			int occlusions, relocked, wrong;
+			// Frames from the user reappearing to being tracked again, summed over re-locks
+			double latency;
+			int framesOnWrong;
+		};
+
+		// Three people of different builds, the user picked from the config window and then hidden every 10 s for 20 frames
+		// or more. They come back in the next slot with a new tracking ID, every other time 2.5 m from where they were.
+		// With bystanderFirst someone else disappears just before them and comes back first, as someone new.
+		Reacquisition replayOcclusions(const TrackingParams& params, unsigned seed, bool bystanderFirst) {
+			const int Period = 300, Hidden = 150;
+			const uint64_t NewId = 1000000;
+			SyntheticSource::Options sourceOptions;
+			sourceOptions.bodies = 3;
+			sourceOptions.seed = seed;
+			sourceOptions.buildSpread = 0.08;
+			sourceOptions.noise = 0.008;
+			SyntheticSource source(sourceOptions);
+			BodyIdentifier identifier(params);
+
+			SkeletonFrame frame, scripted;
+			uint64_t idOffset[3] = { 0, 0, 0 };
+			int slotOf[3] = { 0, 1, 2 };
+			int person[MaxBodies];
+			Reacquisition result;
+			int backAt = -1;
+			bool waiting = false;
+			for (int i = 0; i < 30 * 600; i++) {
+				source.next(frame);
+				int phase = i % Period;
+				bool userHidden = phase >= Hidden && phase < Hidden + 20 + (i / Period) % 20;
+				bool bystanderHidden = bystanderFirst && phase >= Hidden - 10 && phase < Hidden + 10;
+				if (phase == Hidden) {
+					idOffset[0] += NewId;
+					slotOf[0] = slotOf[0] == 0 ? 3 : slotOf[0] == MaxBodies - 1 ? 0 : slotOf[0] + 1;
+				}
+				if (bystanderFirst && phase == Hidden - 10) idOffset[1] += NewId;
+
+				clearFrame(scripted, frame.jointCount);
+				scripted.timestamp = frame.timestamp;
+				for (int s = 0; s < MaxBodies; s++) person[s] = -1;
+				for (int b = 0; b < 3; b++) {
+					if ((b == 0 && userHidden) || (b == 1 && bystanderHidden)) continue;
+					Skeleton& skeleton = scripted.bodies[slotOf[b]];
+					skeleton = frame.bodies[b];
+					skeleton.trackingId += idOffset[b];
+					person[slotOf[b]] = b;
+					if (b == 0 && ((i + Period - Hidden) / Period) % 2) {
+						skeleton.position[0] += 2.5f;
+						for (int j = 0; j < scripted.jointCount; j++) skeleton.x[j] += 2.5f;
+					}
+				}
+
+				if (phase == 30) identifier.setTrackedBody(slotOf[0]);
+				int body = identifier.identify(scripted);
+				// The first occlusion comes after the user's been picked and their build seen
+				if (i < Period / 5) continue;
+
+				if (phase == Hidden) {
+					waiting = true;
+					result.occlusions++;
+					backAt = -1;
+				}
+				if (waiting && backAt < 0 && !userHidden) backAt = i;
+				if (body >= 0 && waiting && backAt >= 0) {
+					if (person[body] == 0) {
+						result.relocked++;
+						result.latency += i - backAt;
+					}
+					else {
+						result.wrong++;
+					}
+					waiting = false;
+				}
+				if (body >= 0 && person[body] != 0) result.framesOnWrong++;
+			}
+			return result;
+		}
+
+		Reacquisition replaySeeds(const TrackingParams& params, bool bystanderFirst) {
+			Reacquisition total;
+			for (unsigned seed = 1; seed <= 4; seed++) {
+				Reacquisition r = replayOcclusions(params, seed, bystanderFirst);
+				total.occlusions += r.occlusions;
+				total.relocked += r.relocked;
+				total.wrong += r.wrong;
+				total.latency += r.latency;
+				total.framesOnWrong += r.framesOnWrong;
+			}
+			return total;
+		}
+
+		std::string describe(const Reacquisition& r) {
+			char text[160];
+			snprintf(text, sizeof(text), "%d of %d re-locked %.1f frames after reappearing, %d wrong, %d frames on someone else",
+				r.relocked, r.occlusions, r.relocked ? r.latency / r.relocked : 0.0, r.wrong, r.framesOnWrong);
+			return text;
+		}
+
+		// Scripted occlusions with the default tracking parameters, against going by position alone
+		void reacquireChecks(std::vector<Check>& checks) {
+			TrackingParams signatures;
+			TrackingParams positionOnly;
+			positionOnly.signatureTolerance = 0;
+
+			Reacquisition alone = replaySeeds(signatures, false);
+			Reacquisition aloneByPosition = replaySeeds(positionOnly, false);
+			Check aloneCheck = { "reacquire: user alone", alone.relocked == alone.occlusions && alone.wrong == 0 && alone.latency <= 3.0 * alone.relocked,
+				describe(alone) + "; by position alone " + describe(aloneByPosition) + "; expected every one re-locked within 3 frames on average" };
+			checks.push_back(aloneCheck);
+
+			// Bystanders whose build is within the tolerance can still be taken for the user
+			Reacquisition first = replaySeeds(signatures, true);
+			Reacquisition firstByPosition = replaySeeds(positionOnly, true);
+			Check firstCheck = { "reacquire: bystander back first", first.wrong * 2 <= firstByPosition.wrong && first.latency <= 3.0 * first.relocked,
+				describe(first) + "; by position alone " + describe(firstByPosition) + "; expected at most half the wrong locks, re-locking within 3 frames on average" };
+			checks.push_back(firstCheck);
+
+			// The user leaves and someone else is given their slot under a new tracking ID, which is losing the user rather
+			// than carrying on with whoever has the slot and learning their build as the user's
+			{
+				SyntheticSource::Options sourceOptions;
+				sourceOptions.bodies = 2;
+				sourceOptions.buildSpread = 0.08;
+				SyntheticSource source(sourceOptions);
+				BodyIdentifier identifier(signatures);
+				SkeletonFrame frame, scripted;
+				BodySignature before, after;
+				float position[3];
+				int learned = -1;
+				for (int i = 0; i < 120; i++) {
+					source.next(frame);
+					clearFrame(scripted, frame.jointCount);
+					scripted.timestamp = frame.timestamp;
+					scripted.bodies[0] = frame.bodies[i < 60 ? 0 : 1];
+					if (i >= 60) scripted.bodies[0].trackingId += 1000000;
+					if (i == 10) identifier.setTrackedBody(0);
+					if (i == 60) identifier.lastTracked(before, position);
+					identifier.identify(scripted);
+					if (i == 60) {
+						identifier.lastTracked(after, position);
+						learned = after.samples() - before.samples();
+					}
+				}
+				Check takenOver = { "reacquire: slot taken over", learned == 0,
+					std::to_string(learned) + " frames of the newcomer learned as the user's build when they took the slot, expected none" };
+				checks.push_back(takenOver);
+			}
+		}
+
+		// Config windows on four threads pushing as fast as they can while frames go by, each command tagged with who sent
+		// it and how many they'd sent before, drained between frames the way the devices do
+		void controlChecks(std::vector<Check>& checks) {
+			const int Producers = 4;
+			const int PerProducer = 100000000;
+			ControlQueue queue;
+			std::atomic<bool> stop(false);
+			std::atomic<long long> dropped(0);
+			long long sent[Producers] = {};
+			std::vector<std::thread> producers;
+			for (int p = 0; p < Producers; p++) {
+				producers.push_back(std::thread([&, p]() {
+					long long n = 0;
+					while (!stop.load() && n < PerProducer - 1) {
+						ControlCommand command = { n % 3 == 0 ? ControlCommand::Recenter : ControlCommand::SetTrackedBody, (int)(p * PerProducer + n) };
+						if (queue.push(command)) {
+							n++;
+						}
+						else {
+							dropped++;
+							std::this_thread::yield();
+						}
+					}
+					sent[p] = n;
+				}));
+			}
+
+			SyntheticSource::Options sourceOptions;
+			sourceOptions.bodies = MaxBodies;
+			SyntheticSource source(sourceOptions);
+			BodyIdentifier identifier;
+			SkeletonFrame frame;
+			long long last[Producers] = { -1, -1, -1, -1 };
+			long long applied = 0, outOfOrder = 0, unknown = 0, frames = 0, notFollowed = 0;
+			double worstDrain = 0;
+			auto apply = [&](const ControlCommand& command) {
+				int p = command.body / PerProducer;
+				long long n = command.body % PerProducer;
+				if (p < 0 || p >= Producers) {
+					unknown++;
+					return -1;
+				}
+				if (n != last[p] + 1) outOfOrder++;
+				last[p] = n;
+				applied++;
+				if (command.type != ControlCommand::SetTrackedBody) return -1;
+				int body = (int)(n % MaxBodies);
+				identifier.setTrackedBody(body);
+				return body;
+			};
+
+			Clock::time_point start = Clock::now();
+			while (milliseconds(start, Clock::now()) < 1000) {
+				Clock::time_point drainStart = Clock::now();
+				ControlCommand command;
+				int chosen = -1;
+				while (queue.pop(command)) {
+					int body = apply(command);
+					if (body >= 0) chosen = body;
+				}
+				worstDrain = std::max(worstDrain, milliseconds(drainStart, Clock::now()) * 1000.0);
+
+				// Everyone's in view, so the frame goes to whoever was picked last
+				source.next(frame);
+				int tracked = identifier.identify(frame);
+				if (chosen >= 0 && tracked != chosen) notFollowed++;
+				frames++;
+			}
+			stop.store(true);
+			for (size_t p = 0; p < producers.size(); p++) producers[p].join();
+			ControlCommand command;
+			while (queue.pop(command)) apply(command);
+
+			long long pushed = 0;
+			int lost = 0;
+			for (int p = 0; p < Producers; p++) {
+				pushed += sent[p];
+				if (last[p] != sent[p] - 1) lost++;
+			}
+			Check once = { "control: 4 producers", applied == pushed && outOfOrder == 0 && unknown == 0 && lost == 0 && pushed > 0,
+				std::to_string(pushed) + " pushed and " + std::to_string(applied) + " applied over " + std::to_string(frames) + " frames, " + std::to_string(dropped.load()) +
+				" refused while full, " + std::to_string(outOfOrder) + " out of order, " + std::to_string(unknown) + " corrupt, " + std::to_string(lost) +
+				" producers missing commands; expected each pushed one applied once, in order" };
+			checks.push_back(once);
+
+			char worst[32];
+			snprintf(worst, sizeof(worst), "%.1f", worstDrain);
+			Check between = { "control: applied between frames", notFollowed == 0 && frames > 0,
+				std::to_string(notFollowed) + " of " + std::to_string(frames) + " frames not tracking the last body picked before them, draining took " + worst + " us at worst" };
+			checks.push_back(between);
+		}
+
+		// Work that takes real time, for loading a device up
+		void spin(double microseconds) {
+			Clock::time_point start = Clock::now();
+			while (milliseconds(start, Clock::now()) * 1000.0 < microseconds) {
+			}
+		}
+
+		struct BudgetPhase {
+			int frames;
+			int untracked;
+			int headMissing;
+			// Frames that gave up every joint but the head and hands, and of those the ones missing the head or a
+			// hand's confidence, or sending any other joint's
+			int jointsShed;
+			int confidenceWrong;
+			// Frames that gave up each stage
+			uint64_t shed[FrameScheduler::StageCount];
+			uint64_t overruns;
+			// Frames until the last one that gave anything up
+			int lastDegraded;
+		};
+
+		// Six people in front of a device with a 5 ms budget, whose optional orientations take a set time per body: nothing
+		// given up while idle, secondary bodies given up when they'd overrun, orientations too when one body alone would,
+		// the secondary joints when orientations can't be given up and overrun regardless, the head out on every frame
+		// throughout with the head and hands' confidence, and everything back once the load is off. Metrics are read
+		// from another thread all the while.
+		void budgetChecks(std::vector<Check>& checks) {
+			const SkeletonLayout& layout = KinectV2Layout;
+			StandIn::reset(1 << 12);
+			WorkerPool pool(0);
+			SkeletonDevice device(StandIn::context(), "KinectV2", layout, je_nourish_kinectv2_json, pool);
+			device.setFrameBudget(5);
+			double load = 0;
+			SkeletonDevice::OrientationStage loaded = [&load](int, Skeleton&) {
+				spin(load);
+				return true;
+			};
+			device.setOrientationStage(loaded, true);
+
+			SyntheticSource::Options sourceOptions;
+			sourceOptions.bodies = 6;
+			sourceOptions.jointCount = layout.jointCount;
+			SyntheticSource source(sourceOptions);
+			BodyIdentifier identifier;
+			SkeletonFrame frame;
+			int64_t frameIndex = 0;
+
+			std::atomic<bool> stop(false);
+			std::atomic<long long> reads(0), inconsistent(0);
+			std::thread reader([&]() {
+				uint64_t frames = 0;
+				while (!stop.load()) {
+					FrameScheduler::Metrics metrics = device.schedulerMetrics();
+					// Each value is read on its own, so counts can be a frame ahead
+					bool consistent = metrics.frames >= frames && metrics.degraded <= metrics.frames + 1 && metrics.overruns <= metrics.frames + 1;
+					for (int s = 0; s < FrameScheduler::StageCount; s++) consistent = consistent && metrics.shed[s] <= metrics.degraded + 1;
+					if (!consistent) inconsistent++;
+					frames = metrics.frames;
+					reads++;
+					std::this_thread::yield();
+				}
+			});
+
+			auto run = [&](double microseconds, int frames, bool untilRecovered) {
+				load = microseconds;
+				BudgetPhase phase = {};
+				FrameScheduler::Metrics before = device.schedulerMetrics();
+				for (int i = 0; i < frames; i++) {
+					source.next(frame);
+					frame.timestamp = ++frameIndex * 33333LL;
+					OSVR_TimeValue timeValue;
+					timeValue.seconds = frame.timestamp / 1000000;
+					timeValue.microseconds = frame.timestamp % 1000000;
+					int trackedBody = identifier.identify(frame);
+
+					StandIn::clearReports();
+					device.process(frame, trackedBody, timeValue);
+					bool head = false;
+					int confidence = 0, otherConfidence = 0;
+					for (size_t r = 0; r < StandIn::reportCount(); r++) {
+						const StandIn::Report& report = StandIn::report(r);
+						int channel = (int)report.channel;
+						head = head || (report.type == StandIn::TrackerReport && channel == layout.head);
+						if (report.type != StandIn::AnalogReport) continue;
+						if (channel == layout.head || channel == layout.handLeft || channel == layout.handRight) confidence++;
+						else otherConfidence++;
+					}
+					// Until someone's picked there's nobody to report
+					bool tracked = trackedBody >= 0 && frame.bodies[trackedBody].tracking == BodyTracked;
+					if (!tracked) phase.untracked++;
+					else if (!head) phase.headMissing++;
+					if (tracked && (device.schedulerMetrics().lastShed & (1u << FrameScheduler::SecondaryJoints))) {
+						phase.jointsShed++;
+						if (confidence != 3 || otherConfidence != 0) phase.confidenceWrong++;
+					}
+					phase.frames++;
+					if (device.schedulerMetrics().lastShed) phase.lastDegraded = phase.frames;
+					else if (untilRecovered && phase.frames - phase.lastDegraded >= 30) break;
+				}
+				FrameScheduler::Metrics after = device.schedulerMetrics();
+				for (int s = 0; s < FrameScheduler::StageCount; s++) phase.shed[s] = after.shed[s] - before.shed[s];
+				phase.overruns = after.overruns - before.overruns;
+				return phase;
+			};
+			auto shedCount = [](const BudgetPhase& phase) {
+				std::string counts;
+				for (int s = 0; s < FrameScheduler::StageCount; s++) {
+					if (!phase.shed[s]) continue;
+					counts += (counts.empty() ? "" : ", ") + std::string(FrameScheduler::stageName((FrameScheduler::Stage)s)) + " " + std::to_string(phase.shed[s]);
+				}
+				return counts.empty() ? std::string("nothing") : counts;
+			};
+
+			BudgetPhase idle = run(0, 150, false);
+			BudgetPhase bodies = run(1000, 300, false);
+			BudgetPhase heavy = run(6000, 300, false);
+			device.setOrientationStage(loaded, false);
+			BudgetPhase late = run(6000, 150, false);
+			device.setOrientationStage(loaded, true);
+			BudgetPhase recovered = run(0, 600, true);
+			stop.store(true);
+			reader.join();
+
+			uint64_t idleShed = 0;
+			for (int s = 0; s < FrameScheduler::StageCount; s++) idleShed += idle.shed[s];
+			Check idleCheck = { "budget: idle", idleShed == 0 && idle.overruns == 0 && idle.headMissing == 0 && idle.untracked < 30,
+				std::to_string(idle.frames) + " frames, " + std::to_string(idle.untracked) + " before anyone was tracked, gave up " + shedCount(idle) + " with " + std::to_string(idle.overruns) + " overruns and the head missing from " +
+				std::to_string(idle.headMissing) + "; expected nothing given up and the head every frame" };
+			checks.push_back(idleCheck);
+
+			// Given up stages are retried now and then, and a retry that overruns waits longer for the next
+			const uint64_t Retries = 10;
+			using S = FrameScheduler;
+			bool secondary = bodies.shed[S::SecondaryBodies] >= (uint64_t)bodies.frames - Retries && bodies.shed[S::Orientations] <= Retries;
+			Check bodiesCheck = { "budget: 1 ms per body", secondary && bodies.overruns <= Retries && bodies.headMissing == 0,
+				"6 bodies over 300 frames gave up " + shedCount(bodies) + " with " + std::to_string(bodies.overruns) + " overruns and the head missing from " +
+				std::to_string(bodies.headMissing) + "; expected secondary bodies given up, orientations kept and the head every frame" };
+			checks.push_back(bodiesCheck);
+
+			bool both = heavy.shed[S::SecondaryBodies] >= (uint64_t)heavy.frames - Retries && heavy.shed[S::Orientations] >= (uint64_t)heavy.frames - Retries;
+			Check heavyCheck = { "budget: 6 ms per body", both && heavy.overruns <= Retries && heavy.headMissing == 0,
+				"300 frames gave up " + shedCount(heavy) + " with " + std::to_string(heavy.overruns) + " overruns and the head missing from " +
+				std::to_string(heavy.headMissing) + "; expected secondary bodies and orientations given up and the head every frame" };
+			checks.push_back(heavyCheck);
+
+			bool joints = late.jointsShed >= late.frames - late.untracked - (int)Retries;
+			Check lateCheck = { "budget: orientations overrunning", joints && late.confidenceWrong == 0 && heavy.confidenceWrong == 0 && late.headMissing == 0,
+				std::to_string(late.frames) + " frames gave up " + shedCount(late) + ", secondary joints on " + std::to_string(late.jointsShed) + " tracked frames with " +
+				std::to_string(late.confidenceWrong + heavy.confidenceWrong) + " sending the wrong confidence and the head missing from " + std::to_string(late.headMissing) +
+				"; expected secondary joints given up, the head every frame and the confidence of the head and hands alone" };
+			checks.push_back(lateCheck);
+
+			bool back = recovered.lastDegraded < recovered.frames && recovered.frames < 600;
+			Check recoverCheck = { "budget: load off", back && recovered.headMissing == 0,
+				"everything back after " + std::to_string(recovered.lastDegraded) + " frames, expected within " + std::to_string(600 - 30) };
+			checks.push_back(recoverCheck);
+
+			Check metricsCheck = { "budget: metrics from another thread", reads.load() > 0 && inconsistent.load() == 0,
+				std::to_string(reads.load()) + " reads while frames ran, " + std::to_string(inconsistent.load()) + " going backwards or counting more than there were frames" };
+			checks.push_back(metricsCheck);
+			StandIn::reset(16);
+		}
+
+		struct Group {
+			const char* name;
+			std::function<void(std::vector<Check>& checks)> run;
+		};
+
+		int check(const Options& options) {
+			// Devices log who they're tracking, which would otherwise land among the results
+			Log::LogParams logParams;
+			logParams.path = NullDevice;
+			logParams.fileSize = (size_t)-1;
+			Log::Session logSession(logParams);
+
+			Group groups[] = {
+				{ "lifecycle", lifecycleChecks },
+				{ "reports", reportChecks },
+				{ "solver", solverChecks },
+				{ "history", historyChecks },
+				{ "reacquire", reacquireChecks },
+				{ "control", controlChecks },
+				{ "budget", budgetChecks },
+			};
+
+			std::vector<Check> checks;
+			for (size_t g = 0; g < sizeof(groups) / sizeof(groups[0]); g++) {
+				if (options.filter.empty() || std::string(groups[g].name).find(options.filter) != std::string::npos) groups[g].run(checks);
+			}
+
+			int failed = 0;
+			printf("check\tresult\tdetail\n");
+			for (size_t i = 0; i < checks.size(); i++) {
+				printf("%s\t%s\t%s\n", checks[i].name.c_str(), checks[i].passed ? "ok" : "FAILED", checks[i].detail.c_str());
+				if (!checks[i].passed) failed++;
+			}
+			printf("%d of %d checks passed\n", (int)checks.size() - failed, (int)checks.size());
+			return failed == 0 ? 0 : 1;
+		}
+
+		void usage() {
+			std::cerr << "Usage: kinect_device check [--filter TEXT]\n"
+				"  --filter TEXT   Only groups of checks with this in their name: lifecycle, reports, solver, history, reacquire, control, budget" << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace KinectOsvr;
+
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+	std::string command = argv[1];
+
+	Options options;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--filter" && hasValue) options.filter = argv[++i];
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	if (command == "check") return check(options);
+	usage();
+	return 1;
+}
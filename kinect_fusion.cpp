@@ -0,0 +1,380 @@
+// Head fusion: runs the skeleton's head against a stand-in orientation tracker and measures how far the fused
+// head is from the real one, how late it is and how its heading drifts, next to a skeleton head held between
+// frames with a tracker aligned once, as the README's manual alignment gives
+#include "BodyIdentifier.h"
+#include "HeadFusion.h"
+#include "SkeletonRecording.h"
+#include "SyntheticSource.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace KinectOsvr {
+	namespace {
+		const double Degrees = M_PI / 180.0;
+		// Results only count once everything has had time to settle, in seconds
+		const double Warmup = 5.0;
+		// Heading error is reported separately for this last stretch, in seconds
+		const double FinalStretch = 60.0;
+		// Longest output delay searched for, in seconds
+		const double MaxDelay = 0.25;
+
+		typedef std::chrono::steady_clock Clock;
+
+		struct Options {
+			Options() : seconds(300), imuRate(960), latency(60), compensation(-1), drift(1.0), offset(70), seed(1), yawTime(30) {}
+
+			double seconds;
+			double imuRate;
+			// How late skeleton frames arrive after the moment they show, and what the fusion is told, in milliseconds.
+			// Compensation below 0 is told the truth.
+			double latency, compensation;
+			// Tracker heading drift in degrees a minute, and how far its heading starts from the skeleton's
+			double drift, offset;
+			unsigned seed;
+			double yawTime;
+			std::vector<std::string> recordings;
+		};
+
+		// What the skeleton shows of the tracked body at one moment
+		struct Observation {
+			int64_t shown, arrives;
+			Eigen::Vector3d head, neck, shoulderLeft, shoulderRight;
+			bool hasNeck, hasShoulders;
+			// A different body from the last, as the plugin starts the head's position over for
+			bool restart;
+		};
+
+		// The real head at every tracker sample
+		struct Truth {
+			int64_t timestamp;
+			Eigen::Vector3d position;
+			Eigen::Quaterniond orientation;
+		};
+
+		typedef std::vector<Truth, Eigen::aligned_allocator<Truth> > Truths;
+
+		struct Session {
+			Truths truth;
+			std::vector<Observation> observations;
+		};
+
+		OSVR_Vec3 toVec(const Eigen::Vector3d& v) {
+			OSVR_Vec3 result;
+			osvr::util::vecMap(result) = v;
+			return result;
+		}
+
+		Eigen::Vector3d joint(const Skeleton& skeleton, int j) {
+			return Eigen::Vector3d(skeleton.x[j], skeleton.y[j], skeleton.z[j]);
+		}
+
+		// Facing the way the shoulders do, as the fusion assumes the head does on average
+		Eigen::Quaterniond bodyHeading(const Skeleton& skeleton) {
+			Eigen::Vector3d across = joint(skeleton, V2Joint::ShoulderRight) - joint(skeleton, V2Joint::ShoulderLeft);
+			return Eigen::Quaterniond(Eigen::AngleAxisd(atan2(-across.z(), across.x()), Eigen::Vector3d::UnitY()));
+		}
+
+		void observe(const Skeleton& skeleton, int64_t shown, const Eigen::Vector3d& head, bool restart, const Options& options, Session& session) {
+			Observation observation;
+			observation.restart = restart;
+			observation.shown = shown;
+			observation.arrives = shown + (int64_t)(options.latency * 1000.0);
+			observation.head = head;
+			observation.neck = joint(skeleton, V2Joint::Neck);
+			observation.shoulderLeft = joint(skeleton, V2Joint::ShoulderLeft);
+			observation.shoulderRight = joint(skeleton, V2Joint::ShoulderRight);
+			observation.hasNeck = skeleton.jointTracking[V2Joint::Neck] == JointTracked;
+			observation.hasShoulders = skeleton.jointTracking[V2Joint::ShoulderLeft] == JointTracked && skeleton.jointTracking[V2Joint::ShoulderRight] == JointTracked;
+			session.observations.push_back(observation);
+		}
+
+		// One person looking around while walking about, their head turning on their neck
+		void synthetic(const Options& options, Session& session) {
+			SyntheticSource::Options sourceOptions;
+			sourceOptions.seed = options.seed;
+			sourceOptions.frameRate = options.imuRate;
+			SyntheticSource source(sourceOptions);
+
+			std::mt19937 rng(options.seed);
+			std::uniform_real_distribution<double> phase(0.0, 2 * M_PI);
+			double phases[4] = { phase(rng), phase(rng), phase(rng), phase(rng) };
+
+			int perFrame = std::max(1, (int)(options.imuRate / 30.0 + 0.5));
+			long long samples = (long long)(options.seconds * options.imuRate);
+			SkeletonFrame frame;
+			for (long long i = 0; i < samples; i++) {
+				source.next(frame);
+				const Skeleton& real = source.truth().bodies[0];
+				double t = i / options.imuRate;
+
+				// Glances to the side every few seconds on top of slower looking around, with some nodding and tilting
+				double yaw = 0.6 * sin(0.7 * t + phases[0]) + 0.5 * sin(2.3 * t + phases[1]) * std::max(0.0, sin(0.4 * t + phases[2]));
+				double pitch = 0.25 * sin(1.1 * t + phases[3]);
+				double roll = 0.1 * sin(0.9 * t + phases[0]);
+				Eigen::Quaterniond head = bodyHeading(real) *
+					Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitY()) *
+					Eigen::AngleAxisd(pitch, Eigen::Vector3d::UnitX()) *
+					Eigen::AngleAxisd(roll, Eigen::Vector3d::UnitZ());
+
+				double neckLength = (joint(real, V2Joint::Head) - joint(real, V2Joint::Neck)).norm();
+				Truth truth;
+				truth.timestamp = frame.timestamp;
+				truth.position = joint(real, V2Joint::Neck) + head * Eigen::Vector3d(0, neckLength, 0);
+				truth.orientation = head;
+				session.truth.push_back(truth);
+
+				// The skeleton sees the turned head with its usual noise
+				if (i % perFrame == 0 && frame.bodies[0].tracking == BodyTracked) {
+					const Skeleton& seen = frame.bodies[0];
+					observe(seen, frame.timestamp, truth.position + joint(seen, V2Joint::Head) - joint(real, V2Joint::Head), false, options, session);
+				}
+			}
+		}
+
+		// The recorded head is the truth, turned as its neck and shoulders say, and in between frames it's interpolated
+		bool replay(const std::string& path, const Options& options, Session& session) {
+			std::vector<SkeletonFrame> frames;
+			if (!loadRecording(path, frames) || frames.size() < 2) return false;
+
+			BodyIdentifier identifier;
+			Truths keys;
+			uint64_t trackingId = 0;
+			for (size_t i = 0; i < frames.size(); i++) {
+				int body = identifier.identify(frames[i]);
+				if (body < 0 || frames[i].bodies[body].tracking != BodyTracked) continue;
+				const Skeleton& skeleton = frames[i].bodies[body];
+
+				Eigen::Vector3d up = (joint(skeleton, V2Joint::Head) - joint(skeleton, V2Joint::Neck)).normalized();
+				Eigen::Quaterniond heading = bodyHeading(skeleton);
+				Truth key;
+				key.timestamp = frames[i].timestamp;
+				key.position = joint(skeleton, V2Joint::Head);
+				key.orientation = Eigen::Quaterniond::FromTwoVectors(heading * Eigen::Vector3d::UnitY(), up) * heading;
+				keys.push_back(key);
+				observe(skeleton, frames[i].timestamp, key.position, skeleton.trackingId != trackingId, options, session);
+				trackingId = skeleton.trackingId;
+			}
+			if (keys.size() < 2) return false;
+
+			int64_t step = (int64_t)(1e6 / options.imuRate);
+			size_t next = 1;
+			for (int64_t t = keys[0].timestamp; t <= keys.back().timestamp; t += step) {
+				while (keys[next].timestamp < t) next++;
+				const Truth& a = keys[next - 1];
+				const Truth& b = keys[next];
+				double f = b.timestamp > a.timestamp ? (double)(t - a.timestamp) / (b.timestamp - a.timestamp) : 0.0;
+				Truth truth;
+				truth.timestamp = t;
+				truth.position = a.position + (b.position - a.position) * f;
+				truth.orientation = a.orientation.slerp(f, b.orientation);
+				session.truth.push_back(truth);
+			}
+			return true;
+		}
+
+		struct Track {
+			Track() : count(0), positionError(0), headingError(0), finalCount(0), finalHeading(0), worstFinalHeading(0) {}
+
+			// Output and error at each scored tracker sample, and which sample of the truth it was
+			std::vector<Eigen::Vector3d> positions;
+			std::vector<double> errors;
+			std::vector<size_t> samples;
+			long long count;
+			double positionError, headingError;
+			long long finalCount;
+			double finalHeading, worstFinalHeading;
+		};
+
+		double headingOf(const Eigen::Quaterniond& orientation) {
+			Eigen::Vector3d forward = orientation * -Eigen::Vector3d::UnitZ();
+			return atan2(-forward.x(), -forward.z());
+		}
+
+		void score(Track& track, const Truths& truths, size_t sample, const Eigen::Vector3d& position, const Eigen::Quaterniond& orientation, bool final) {
+			const Truth& truth = truths[sample];
+			double error = (position - truth.position).norm();
+			double heading = fabs(atan2(sin(headingOf(orientation) - headingOf(truth.orientation)), cos(headingOf(orientation) - headingOf(truth.orientation))));
+			track.positions.push_back(position);
+			track.errors.push_back(error);
+			track.samples.push_back(sample);
+			track.count++;
+			track.positionError += error;
+			track.headingError += heading;
+			if (final) {
+				track.finalCount++;
+				track.finalHeading += heading;
+				track.worstFinalHeading = std::max(track.worstFinalHeading, heading);
+			}
+		}
+
+		// The delay that best lines the output up with the real head, in seconds
+		double delay(const Track& track, const Truths& truth, double rate) {
+			size_t maxShift = (size_t)(MaxDelay * rate);
+			double bestError = 1e30;
+			size_t best = 0;
+			for (size_t shift = 0; shift <= maxShift; shift++) {
+				double error = 0;
+				size_t count = 0;
+				for (size_t i = 0; i < track.samples.size(); i++) {
+					if (track.samples[i] < shift) continue;
+					error += (track.positions[i] - truth[track.samples[i] - shift].position).norm();
+					count++;
+				}
+				if (count > 0 && error / count < bestError) {
+					bestError = error / count;
+					best = shift;
+				}
+			}
+			return best / rate;
+		}
+
+		void report(const char* name, Track& track, const Truths& truth, double rate) {
+			std::vector<double> errors = track.errors;
+			std::sort(errors.begin(), errors.end());
+			printf("%-22s position %5.1f mm mean %5.1f mm p95, %3.0f ms behind; heading %5.2f deg mean, last minute %5.2f mean %5.2f max\n",
+				name, track.positionError / track.count * 1000.0, errors[errors.size() * 95 / 100] * 1000.0, delay(track, truth, rate) * 1000.0,
+				track.headingError / track.count / Degrees, track.finalCount > 0 ? track.finalHeading / track.finalCount / Degrees : 0.0,
+				track.worstFinalHeading / Degrees);
+		}
+
+		int evaluate(const Options& options, Session& session) {
+			std::mt19937 rng(options.seed + 1);
+			std::normal_distribution<double> gaussian(0.0, 1.0);
+
+			FusionParams params;
+			params.kinectLatency = options.compensation >= 0 ? options.compensation : options.latency;
+			params.yawTime = options.yawTime;
+			HeadFusion fusion(params);
+
+			// Manual alignment: the first frame's heading is matched once, as osvr_reset_yaw does
+			bool snapped = false;
+			Eigen::Quaterniond snap = Eigen::Quaterniond::Identity();
+			Eigen::Vector3d held = Eigen::Vector3d::Zero();
+			bool haveHeld = false;
+
+			Track fused, baseline;
+			size_t next = 0;
+			double cost = 0;
+			long long fuses = 0;
+			int64_t start = session.truth.front().timestamp;
+			double end = (session.truth.back().timestamp - start) / 1e6;
+			for (size_t i = 0; i < session.truth.size(); i++) {
+				const Truth& truth = session.truth[i];
+				double t = (truth.timestamp - start) / 1e6;
+
+				while (next < session.observations.size() && session.observations[next].arrives <= truth.timestamp) {
+					const Observation& o = session.observations[next++];
+					if (o.restart) fusion.resetPosition();
+					OSVR_Vec3 head = toVec(o.head), neck = toVec(o.neck), left = toVec(o.shoulderLeft), right = toVec(o.shoulderRight);
+					fusion.observe(o.arrives, head, o.hasNeck ? &neck : NULL, o.hasShoulders ? &left : NULL, o.hasShoulders ? &right : NULL);
+					held = o.head;
+					haveHeld = true;
+				}
+
+				// The tracker drifts about the vertical and jitters a little
+				double yaw = -(options.offset + options.drift * t / 60.0) * Degrees;
+				Eigen::Quaterniond jitter(Eigen::AngleAxisd(0.05 * Degrees * gaussian(rng), Eigen::Vector3d::UnitX()));
+				Eigen::Quaterniond imu = Eigen::Quaterniond(Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitY())) * truth.orientation * jitter;
+				OSVR_Quaternion sample;
+				osvr::util::toQuat(imu, sample);
+
+				OSVR_PoseState pose;
+				Clock::time_point before = Clock::now();
+				bool ok = fusion.fuse(truth.timestamp, sample, pose);
+				cost += std::chrono::duration<double, std::nano>(Clock::now() - before).count();
+				fuses++;
+
+				if (!snapped && haveHeld) {
+					snap = Eigen::AngleAxisd(headingOf(truth.orientation) - headingOf(imu), Eigen::Vector3d::UnitY());
+					snapped = true;
+				}
+				if (t < Warmup || !ok || !snapped) continue;
+
+				bool final = t > end - FinalStretch;
+				score(fused, session.truth, i, osvr::util::vecMap(pose.translation), osvr::util::fromQuat(pose.rotation), final);
+				score(baseline, session.truth, i, held, snap * imu, final);
+			}
+
+			if (fused.count == 0) {
+				std::cerr << "The fusion never produced a pose" << std::endl;
+				return 1;
+			}
+			printf("%.0f s at %.0f Hz, skeleton %.0f ms late (fusion told %.0f ms), tracker drifting %.1f deg a minute from %.0f deg off\n",
+				end, options.imuRate, options.latency, params.kinectLatency, options.drift, options.offset);
+			report("skeleton held, aligned", baseline, session.truth, options.imuRate);
+			report("fused", fused, session.truth, options.imuRate);
+			printf("fusion %.0f ns a tracker sample\n", cost / fuses);
+			return 0;
+		}
+
+		void usage() {
+			std::cerr << "Usage: kinect_fusion evaluate [options]\n"
+				"       kinect_fusion replay [options] session.skr\n"
+				"evaluate uses a synthetic person looking around, replay a recording's tracked body turned as its\n"
+				"neck and shoulders say, each with a stand-in orientation tracker:\n"
+				"  --seconds S         Session length, for evaluate (300)\n"
+				"  --rate HZ           Orientation tracker rate (960)\n"
+				"  --latency MS        How late skeleton frames arrive (60)\n"
+				"  --compensation MS   Latency the fusion is told, defaults to the real one\n"
+				"  --drift DEG         Tracker heading drift a minute (1)\n"
+				"  --offset DEG        Tracker heading at the start, relative to the skeleton's (70)\n"
+				"  --yaw-time S        Seconds for the heading to be pulled onto the body's (30)\n"
+				"  --seed N            Seed for the session (1)" << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace KinectOsvr;
+
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+	std::string command = argv[1];
+
+	Options options;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--seconds" && hasValue) options.seconds = std::max(Warmup * 2, atof(argv[++i]));
+		else if (arg == "--rate" && hasValue) options.imuRate = std::max(30.0, atof(argv[++i]));
+		else if (arg == "--latency" && hasValue) options.latency = atof(argv[++i]);
+		else if (arg == "--compensation" && hasValue) options.compensation = atof(argv[++i]);
+		else if (arg == "--drift" && hasValue) options.drift = atof(argv[++i]);
+		else if (arg == "--offset" && hasValue) options.offset = atof(argv[++i]);
+		else if (arg == "--yaw-time" && hasValue) options.yawTime = atof(argv[++i]);
+		else if (arg == "--seed" && hasValue) options.seed = (unsigned)atoi(argv[++i]);
+		else if (arg.compare(0, 2, "--") == 0) {
+			usage();
+			return 1;
+		}
+		else options.recordings.push_back(arg);
+	}
+
+	Session session;
+	if (command == "evaluate") {
+		synthetic(options, session);
+	}
+	else if (command == "replay" && options.recordings.size() == 1) {
+		if (!replay(options.recordings[0], options, session)) {
+			std::cerr << "Can't read a tracked body from " << options.recordings[0] << std::endl;
+			return 1;
+		}
+	}
+	else {
+		usage();
+		return 1;
+	}
+	return evaluate(options, session);
+}
@@ -0,0 +1,402 @@
+// Gesture libraries: records templates from recordings or synthetic performers, and measures how well
+// a library recognizes gestures in replayed sessions
+#include "BodyIdentifier.h"
+#include "GestureRecognizer.h"
+#include "SkeletonRecording.h"
+#include "SyntheticSource.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace KinectOsvr {
+	namespace {
+		// A recognition this many frames after the performance ended still counts as that performance
+		const int MaxLatencyFrames = 15;
+		// So does one in the last of it, where the arms blend back into walking and look the same
+		const double BlendOutFraction = 0.15;
+
+		struct Performance {
+			int gesture;
+			int64_t start, end;
+			bool recognized;
+		};
+
+		struct Options {
+			Options() : library("gestures.txt"), button(-1), threshold(0.5f), speed(1.0), variants(1), from(0), to(-1),
+				body(-1), seed(1), sessions(4), seconds(120), rate(0.02), jointCount(V2Joint::Count), band(0.5f), confirm(3), maxTemplates(64) {}
+
+			std::string library;
+			std::string name;
+			int button;
+			float threshold;
+			std::string synthetic;
+			double speed;
+			int variants;
+			std::string recording;
+			int from, to;
+			int body;
+			unsigned seed;
+			int sessions;
+			double seconds;
+			double rate;
+			int jointCount;
+			float band;
+			int confirm;
+			int maxTemplates;
+			std::vector<std::string> recordings;
+		};
+
+		int gestureByName(const std::string& name) {
+			for (int g = 1; g < SyntheticGesture::Count; g++) {
+				if (name == syntheticGestureName(g)) return g;
+			}
+			return -1;
+		}
+
+		// One synthetic performer doing a gesture once, after walking for half a second or more, so variants
+		// catch the arms at different points in their swing
+		bool recordSynthetic(int gesture, double speed, unsigned seed, int leadIn, const Options& options, GestureTemplate& result) {
+			SyntheticSource::Options sourceOptions;
+			sourceOptions.jointCount = options.jointCount;
+			sourceOptions.seed = seed;
+			SyntheticSource source(sourceOptions);
+			GestureRecognizer recognizer(options.jointCount);
+
+			SkeletonFrame frame;
+			for (int i = 0; i < 15 + leadIn; i++) source.next(frame);
+			source.perform(0, gesture, speed);
+
+			float features[GestureRecognizer::FeatureCount];
+			for (source.next(frame); source.performing(0) == gesture; source.next(frame)) {
+				if (recognizer.extract(frame.bodies[0], features)) {
+					result.features.insert(result.features.end(), features, features + GestureRecognizer::FeatureCount);
+				}
+			}
+			return result.frames() >= 2;
+		}
+
+		bool recordFromFile(const Options& options, GestureTemplate& result) {
+			std::vector<SkeletonFrame> frames;
+			if (!loadRecording(options.recording, frames)) {
+				std::cerr << "Can't read recording " << options.recording << std::endl;
+				return false;
+			}
+
+			int to = options.to < 0 ? (int)frames.size() - 1 : std::min(options.to, (int)frames.size() - 1);
+			BodyIdentifier identifier((TrackingParams()));
+			GestureRecognizer recognizer(frames.empty() ? V2Joint::Count : frames[0].jointCount);
+
+			float features[GestureRecognizer::FeatureCount];
+			for (int i = 0; i <= to; i++) {
+				// Identify from the start, so the body picked is the one the plugin would have reported
+				int body = identifier.identify(frames[i]);
+				if (options.body >= 0) body = options.body;
+				if (i < options.from || body < 0 || frames[i].bodies[body].tracking != BodyTracked) continue;
+
+				if (recognizer.extract(frames[i].bodies[body], features)) {
+					result.features.insert(result.features.end(), features, features + GestureRecognizer::FeatureCount);
+				}
+			}
+			if (result.frames() < 2) {
+				std::cerr << "Fewer than two usable frames between " << options.from << " and " << to << std::endl;
+				return false;
+			}
+			return true;
+		}
+
+		int record(const Options& options) {
+			std::vector<GestureTemplate> library;
+			loadGestures(options.library, library);
+
+			std::vector<int> gestures;
+			if (options.synthetic == "all") {
+				for (int g = 1; g < SyntheticGesture::Count; g++) gestures.push_back(g);
+			}
+			else if (!options.synthetic.empty()) {
+				int gesture = gestureByName(options.synthetic);
+				if (gesture < 0) {
+					std::cerr << "No synthetic gesture called " << options.synthetic << std::endl;
+					return 1;
+				}
+				gestures.push_back(gesture);
+			}
+
+			int added = 0;
+			if (gestures.empty()) {
+				GestureTemplate gesture;
+				gesture.name = options.name;
+				gesture.button = options.button < 0 ? 0 : options.button;
+				gesture.threshold = options.threshold;
+				if (gesture.name.empty() || options.recording.empty() || !recordFromFile(options, gesture)) return 1;
+				library.push_back(gesture);
+				added++;
+			}
+
+			// Variants cover a spread of speeds, from a different performer each
+			for (size_t g = 0; g < gestures.size(); g++) {
+				for (int v = 0; v < options.variants; v++) {
+					double speed = options.variants > 1 ? 0.7 + 0.6 * v / (options.variants - 1) : options.speed;
+					GestureTemplate gesture;
+					gesture.name = options.name.empty() || gestures.size() > 1 ? syntheticGestureName(gestures[g]) : options.name;
+					gesture.button = options.button < 0 ? gestures[g] - 1 : options.button;
+					gesture.threshold = options.threshold;
+					if (!recordSynthetic(gestures[g], speed, options.seed + v, v * 7, options, gesture)) return 1;
+					library.push_back(gesture);
+					added++;
+				}
+			}
+
+			if (!saveGestures(options.library, library)) {
+				std::cerr << "Can't write " << options.library << std::endl;
+				return 1;
+			}
+			std::cout << "Added " << added << " templates, " << library.size() << " in " << options.library << std::endl;
+			return 0;
+		}
+
+		struct Timing {
+			std::vector<double> samples;
+
+			void add(double microseconds) {
+				samples.push_back(microseconds);
+			}
+
+			void print(const std::string& label) {
+				if (samples.empty()) return;
+				double total = 0;
+				for (size_t i = 0; i < samples.size(); i++) total += samples[i];
+				std::sort(samples.begin(), samples.end());
+				printf("%s%d frames, %.1f us mean, %.1f us 99th percentile, %.1f us worst\n", label.c_str(), (int)samples.size(),
+					total / samples.size(), samples[samples.size() * 99 / 100], samples.back());
+			}
+		};
+
+		// Synthetic sessions where one performer walks about doing random gestures at random speeds.
+		// A recognition is right if it names a performance that ended shortly before.
+		int evaluate(const Options& options) {
+			std::vector<GestureTemplate> library;
+			if (!loadGestures(options.library, library) || library.empty()) {
+				std::cerr << "Can't read gestures from " << options.library << std::endl;
+				return 1;
+			}
+
+			GestureRecognizer recognizer(options.jointCount, options.band, options.confirm, options.maxTemplates);
+			recognizer.setTemplates(library);
+
+			int kinds = SyntheticGesture::Count;
+			std::vector<int> performed(kinds, 0), recognized(kinds, 0), confused(kinds, 0), spurious(kinds, 0);
+			std::vector<double> latencySum(kinds, 0), latencyWorst(kinds, 0);
+			int falsePositives = 0;
+			double minutes = 0;
+			Timing timing;
+
+			for (int s = 0; s < options.sessions; s++) {
+				SyntheticSource::Options sourceOptions;
+				sourceOptions.jointCount = options.jointCount;
+				sourceOptions.seed = options.seed * 1000 + s;
+				sourceOptions.gestureRate = options.rate;
+				SyntheticSource source(sourceOptions);
+				recognizer.reset();
+
+				std::vector<Performance> performances;
+				// Frame and gesture of each recognition
+				std::vector<std::pair<int64_t, int> > detections;
+				int current = SyntheticGesture::None;
+				SkeletonFrame frame;
+				int64_t frames = (int64_t)(options.seconds * sourceOptions.frameRate);
+				minutes += options.seconds / 60.0;
+
+				for (int64_t f = 0; f < frames; f++) {
+					source.next(frame);
+					int gesture = source.performing(0);
+					if (gesture != current) {
+						if (current != SyntheticGesture::None) performances.back().end = f - 1;
+						if (gesture != SyntheticGesture::None) {
+							Performance performance = { gesture, f, frames, false };
+							performances.push_back(performance);
+							performed[gesture]++;
+						}
+						current = gesture;
+					}
+
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					int match = recognizer.update(frame.bodies[0]);
+					timing.add(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+					if (match >= 0) detections.push_back(std::make_pair(f, gestureByName(recognizer.templates()[match].name)));
+				}
+				if (current != SyntheticGesture::None) performances.back().end = frames - 1;
+
+				// Claimed once the session's over, when every performance's end is known
+				for (size_t d = 0; d < detections.size(); d++) {
+					int64_t f = detections[d].first;
+					int name = detections[d].second;
+
+					// The oldest unclaimed performance that has ended recently, or is blending out
+					Performance* claimed = NULL;
+					for (size_t p = 0; p < performances.size() && claimed == NULL; p++) {
+						Performance& performance = performances[p];
+						int64_t blendOut = (int64_t)((performance.end - performance.start + 1) * BlendOutFraction);
+						if (!performance.recognized && performance.end - blendOut <= f && f - performance.end <= MaxLatencyFrames) {
+							claimed = &performance;
+						}
+					}
+
+					if (claimed == NULL) {
+						falsePositives++;
+						if (name > 0) spurious[name]++;
+					}
+					else if (claimed->gesture != name) {
+						claimed->recognized = true;
+						confused[claimed->gesture]++;
+					}
+					else {
+						claimed->recognized = true;
+						recognized[name]++;
+						double latency = std::max<int64_t>(0, f - claimed->end) * 1000.0 / sourceOptions.frameRate;
+						latencySum[name] += latency;
+						latencyWorst[name] = std::max(latencyWorst[name], latency);
+					}
+				}
+			}
+
+			int totalPerformed = 0, totalRecognized = 0;
+			printf("gesture\tperformed\trecognized\tconfused\trecall\tfalse_positives\tmean_latency_ms\tmax_latency_ms\n");
+			for (int g = 1; g < kinds; g++) {
+				totalPerformed += performed[g];
+				totalRecognized += recognized[g];
+				printf("%s\t%d\t%d\t%d\t%.3f\t%d\t%.0f\t%.0f\n", syntheticGestureName(g), performed[g], recognized[g], confused[g],
+					performed[g] ? (double)recognized[g] / performed[g] : 0.0, spurious[g],
+					recognized[g] ? latencySum[g] / recognized[g] : 0.0, latencyWorst[g]);
+			}
+			printf("\n%d of %d templates tested, %d of %d performances recognized, %d false positives (%.2f per minute)\n",
+				(int)recognizer.templates().size(), (int)library.size(), totalRecognized, totalPerformed, falsePositives, minutes > 0 ? falsePositives / minutes : 0.0);
+			timing.print("Recognition time: ");
+			return 0;
+		}
+
+		// Lists what a library spots in real recordings, which have no record of what was performed
+		int replay(const Options& options) {
+			std::vector<GestureTemplate> library;
+			if (!loadGestures(options.library, library) || library.empty()) {
+				std::cerr << "Can't read gestures from " << options.library << std::endl;
+				return 1;
+			}
+
+			for (size_t r = 0; r < options.recordings.size(); r++) {
+				std::vector<SkeletonFrame> frames;
+				if (!loadRecording(options.recordings[r], frames)) {
+					std::cerr << "Can't read recording " << options.recordings[r] << std::endl;
+					return 1;
+				}
+
+				BodyIdentifier identifier((TrackingParams()));
+				GestureRecognizer recognizer(frames.empty() ? V2Joint::Count : frames[0].jointCount, options.band, options.confirm, options.maxTemplates);
+				recognizer.setTemplates(library);
+				int tracked = -1;
+				Timing timing;
+
+				for (size_t i = 0; i < frames.size(); i++) {
+					int body = identifier.identify(frames[i]);
+					if (body < 0 || frames[i].bodies[body].tracking != BodyTracked) continue;
+					if (body != tracked) {
+						recognizer.reset();
+						tracked = body;
+					}
+
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					int match = recognizer.update(frames[i].bodies[body]);
+					timing.add(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+					if (match >= 0) {
+						printf("%s\tframe %d\t%.2f s\t%s\n", options.recordings[r].c_str(), (int)i,
+							(frames[i].timestamp - frames[0].timestamp) / 1000000.0, recognizer.templates()[match].name.c_str());
+					}
+				}
+				timing.print(options.recordings[r] + ": ");
+			}
+			return 0;
+		}
+
+		void usage() {
+			std::cerr << "Usage: kinect_gesture record [options]\n"
+				"       kinect_gesture evaluate [options]\n"
+				"       kinect_gesture replay [options] recording.skr ...\n"
+				"  --library FILE      Gesture library to add to or test (gestures.txt)\n"
+				"record:\n"
+				"  --name NAME         Gesture name, required when recording from a file\n"
+				"  --button N          Gesture button it presses, 0-7 (0, or by gesture for synthetic ones)\n"
+				"  --threshold T       Mean squared feature distance that still matches (0.5)\n"
+				"  --recording FILE    Take the performance from this recording...\n"
+				"  --from F --to F     ...between these frames (whole recording)\n"
+				"  --body N            ...of this body (the one the plugin would track)\n"
+				"  --synthetic NAME    Or from a synthetic performer: raise-right, raise-left, swipe-left, bow, all\n"
+				"  --speed S           Synthetic performance speed (1)\n"
+				"  --variants N        Synthetic performances per gesture, at speeds from 0.7 to 1.3 (1)\n"
+				"  --v1                Kinect V1 joints for synthetic performances\n"
+				"evaluate:\n"
+				"  --sessions N        Synthetic sessions (4)\n"
+				"  --seconds S         Length of each session (120)\n"
+				"  --rate R            Chance per frame of starting a gesture (0.02)\n"
+				"  --seed N            Seed for sessions and synthetic performers (1)\n"
+				"evaluate and replay:\n"
+				"  --band B            How far a match's length may differ from its template's (0.5)\n"
+				"  --confirm N         Frames a match must stay best before it's reported (3)\n"
+				"  --max-templates N   Templates to test each frame, spread over each gesture's performances (64, 0 for all)" << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace KinectOsvr;
+
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+	std::string command = argv[1];
+
+	Options options;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--library" && hasValue) options.library = argv[++i];
+		else if (arg == "--name" && hasValue) options.name = argv[++i];
+		else if (arg == "--button" && hasValue) options.button = atoi(argv[++i]);
+		else if (arg == "--threshold" && hasValue) options.threshold = (float)atof(argv[++i]);
+		else if (arg == "--recording" && hasValue) options.recording = argv[++i];
+		else if (arg == "--from" && hasValue) options.from = atoi(argv[++i]);
+		else if (arg == "--to" && hasValue) options.to = atoi(argv[++i]);
+		else if (arg == "--body" && hasValue) options.body = atoi(argv[++i]);
+		else if (arg == "--synthetic" && hasValue) options.synthetic = argv[++i];
+		else if (arg == "--speed" && hasValue) options.speed = atof(argv[++i]);
+		else if (arg == "--variants" && hasValue) options.variants = std::max(1, atoi(argv[++i]));
+		else if (arg == "--v1") options.jointCount = V1Joint::Count;
+		else if (arg == "--sessions" && hasValue) options.sessions = atoi(argv[++i]);
+		else if (arg == "--seconds" && hasValue) options.seconds = atof(argv[++i]);
+		else if (arg == "--rate" && hasValue) options.rate = atof(argv[++i]);
+		else if (arg == "--seed" && hasValue) options.seed = (unsigned)atoi(argv[++i]);
+		else if (arg == "--band" && hasValue) options.band = (float)atof(argv[++i]);
+		else if (arg == "--confirm" && hasValue) options.confirm = atoi(argv[++i]);
+		else if (arg == "--max-templates" && hasValue) options.maxTemplates = std::max(0, atoi(argv[++i]));
+		else if (arg.compare(0, 2, "--") == 0) {
+			usage();
+			return 1;
+		}
+		else options.recordings.push_back(arg);
+	}
+
+	if (command == "record") return record(options);
+	if (command == "evaluate") return evaluate(options);
+	if (command == "replay" && !options.recordings.empty()) return replay(options);
+	usage();
+	return 1;
+}
@@ -0,0 +1,240 @@
+// Depth-only head tracking: measures how well the fallback follows the head while the skeleton is lost,
+// on synthetic sessions with known head positions or on recorded skeleton and depth sessions
+#include "BodyIdentifier.h"
+#include "DepthHeadTracker.h"
+#include "DepthRecording.h"
+#include "SkeletonRecording.h"
+#include "SyntheticSource.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace KinectOsvr {
+	namespace {
+		const int DepthWidth = 512;
+		const int DepthHeight = 424;
+		// A depth image this much older than a skeleton frame is too stale to use, in microseconds
+		const int64_t MaxDepthAge = 50000;
+		// Further than this from the true head counts as following the wrong thing, in metres
+		const float WrongDistance = 0.15f;
+
+		struct Options {
+			Options() : bodies(1), seconds(300), seed(1), churn(0.01) {}
+
+			int bodies;
+			double seconds;
+			unsigned seed;
+			double churn;
+			std::string write;
+			std::vector<std::string> recordings;
+		};
+
+		struct Metrics {
+			Metrics() : lostFrames(0), found(0), wrong(0), errorSum(0), recoveries(0), recoverySum(0), cost(0), costFrames(0), confidence(0) {}
+
+			// Frames the skeleton had lost the tracked body, and how many of those the depth image found the head in
+			long long lostFrames, found, wrong;
+			double errorSum;
+			// How far the depth head was from the skeleton's when it came back
+			long long recoveries;
+			double recoverySum;
+			double cost;
+			long long costFrames;
+			double confidence;
+		};
+
+		float distance(const float a[3], const float b[3]) {
+			float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+			return sqrtf(dx * dx + dy * dy + dz * dz);
+		}
+
+		// Follows the plugin: the identified body seeds the tracker, which takes over when it's lost.
+		// Truth, when there is any, is the real head of the body last tracked.
+		class Evaluation {
+		public:
+			Evaluation() : m_body(-1), m_haveHead(false) {}
+
+			void frame(const SkeletonFrame& frame, const DepthImage* depth, const SkeletonFrame* truth) {
+				int body = m_identifier.identify(frame);
+				if (body >= 0 && frame.bodies[body].tracking == BodyTracked) {
+					const Skeleton& skeleton = frame.bodies[body];
+					float head[3] = { skeleton.x[V2Joint::Head], skeleton.y[V2Joint::Head], skeleton.z[V2Joint::Head] };
+					if (m_haveHead) {
+						m_metrics.recoveries++;
+						m_metrics.recoverySum += distance(head, m_head);
+						m_haveHead = false;
+					}
+					m_tracker.seed(head);
+					m_body = body;
+					return;
+				}
+
+				if (m_body < 0) return;
+				m_metrics.lostFrames++;
+				if (depth == NULL || !m_tracker.tracking()) return;
+
+				typedef std::chrono::steady_clock Clock;
+				Clock::time_point start = Clock::now();
+				float confidence;
+				bool found = m_tracker.track(&depth->depth[0], depth->width, depth->height, m_head, confidence);
+				m_metrics.cost += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+				m_metrics.costFrames++;
+				m_haveHead = found;
+				if (!found) return;
+
+				m_metrics.found++;
+				m_metrics.confidence += confidence;
+				if (truth != NULL) {
+					const Skeleton& real = truth->bodies[m_body];
+					float head[3] = { real.x[V2Joint::Head], real.y[V2Joint::Head], real.z[V2Joint::Head] };
+					float error = distance(m_head, head);
+					m_metrics.errorSum += error;
+					if (error > WrongDistance) m_metrics.wrong++;
+				}
+			}
+
+			const Metrics& metrics() const {
+				return m_metrics;
+			}
+
+		private:
+			BodyIdentifier m_identifier;
+			DepthHeadTracker m_tracker;
+			int m_body;
+			bool m_haveHead;
+			float m_head[3];
+			Metrics m_metrics;
+		};
+
+		void report(const Metrics& metrics, bool truth) {
+			double found = metrics.lostFrames > 0 ? 100.0 * metrics.found / metrics.lostFrames : 0.0;
+			printf("skeleton lost for %lld frames, head found in %lld (%.1f%%), mean confidence %.2f\n",
+				metrics.lostFrames, metrics.found, found, metrics.found > 0 ? metrics.confidence / metrics.found : 0.0);
+			if (truth && metrics.found > 0) {
+				printf("error from the real head %.1f mm mean, %lld frames (%.1f%%) over %.0f mm\n",
+					metrics.errorSum / metrics.found * 1000.0, metrics.wrong, 100.0 * metrics.wrong / metrics.found, WrongDistance * 1000.0);
+			}
+			if (metrics.recoveries > 0) {
+				printf("%lld handovers back to the skeleton, %.1f mm apart on average\n",
+					metrics.recoveries, metrics.recoverySum / metrics.recoveries * 1000.0);
+			}
+			if (metrics.costFrames > 0) {
+				double perFrame = metrics.cost / metrics.costFrames;
+				printf("%.1f us per depth frame, %.3f%% of a core at 30 Hz\n", perFrame, perFrame * 30.0 / 10000.0);
+			}
+		}
+
+		int evaluate(const Options& options) {
+			SyntheticSource::Options sourceOptions;
+			sourceOptions.bodies = options.bodies;
+			sourceOptions.seed = options.seed;
+			sourceOptions.churnRate = options.churn;
+			sourceOptions.gestureRate = 0.01;
+			SyntheticSource source(sourceOptions);
+
+			SkeletonRecorder skeletons;
+			DepthRecorder depths;
+			if (!options.write.empty() &&
+				!(skeletons.open(options.write + ".skr", sourceOptions.jointCount) && depths.open(options.write + ".kdp", DepthWidth, DepthHeight))) {
+				std::cerr << "Can't write " << options.write << ".skr and .kdp" << std::endl;
+				return 1;
+			}
+
+			Evaluation evaluation;
+			SkeletonFrame frame;
+			DepthImage depth;
+			depth.width = DepthWidth;
+			depth.height = DepthHeight;
+			depth.depth.resize(DepthWidth * DepthHeight);
+
+			long long frames = (long long)(options.seconds * sourceOptions.frameRate);
+			for (long long i = 0; i < frames; i++) {
+				source.next(frame);
+				depth.timestamp = frame.timestamp;
+				renderSyntheticDepth(source.truth(), KinectV2DepthCamera, DepthWidth, DepthHeight, &depth.depth[0]);
+				skeletons.write(frame);
+				depths.write(depth.timestamp, &depth.depth[0]);
+				evaluation.frame(frame, &depth, &source.truth());
+			}
+
+			report(evaluation.metrics(), true);
+			return 0;
+		}
+
+		int replay(const Options& options) {
+			std::vector<SkeletonFrame> frames;
+			std::vector<DepthImage> depths;
+			if (!loadRecording(options.recordings[0], frames)) {
+				std::cerr << "Can't read skeleton recording " << options.recordings[0] << std::endl;
+				return 1;
+			}
+			if (!loadDepthRecording(options.recordings[1], depths)) {
+				std::cerr << "Can't read depth recording " << options.recordings[1] << std::endl;
+				return 1;
+			}
+
+			// The newest depth image at or before each skeleton frame
+			Evaluation evaluation;
+			size_t next = 0;
+			for (size_t i = 0; i < frames.size(); i++) {
+				while (next < depths.size() && depths[next].timestamp <= frames[i].timestamp) next++;
+				const DepthImage* depth = next > 0 ? &depths[next - 1] : NULL;
+				if (depth != NULL && frames[i].timestamp - depth->timestamp > MaxDepthAge) depth = NULL;
+				evaluation.frame(frames[i], depth, NULL);
+			}
+
+			report(evaluation.metrics(), false);
+			return 0;
+		}
+
+		void usage() {
+			std::cerr << "Usage: kinect_headtrack evaluate [options]\n"
+				"       kinect_headtrack replay session.skr session.kdp|session.kdc\n"
+				"evaluate runs synthetic sessions, where the real head is known:\n"
+				"  --bodies N          People in view (1)\n"
+				"  --seconds S         Session length (300)\n"
+				"  --churn R           Chance per person per frame of the skeleton losing them (0.01)\n"
+				"  --seed N            Seed for the session (1)\n"
+				"  --write PREFIX      Also save the session as PREFIX.skr and PREFIX.kdp for replaying" << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace KinectOsvr;
+
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+	std::string command = argv[1];
+
+	Options options;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--bodies" && hasValue) options.bodies = std::max(1, std::min(MaxBodies, atoi(argv[++i])));
+		else if (arg == "--seconds" && hasValue) options.seconds = atof(argv[++i]);
+		else if (arg == "--churn" && hasValue) options.churn = atof(argv[++i]);
+		else if (arg == "--seed" && hasValue) options.seed = (unsigned)atoi(argv[++i]);
+		else if (arg == "--write" && hasValue) options.write = argv[++i];
+		else if (arg.compare(0, 2, "--") == 0) {
+			usage();
+			return 1;
+		}
+		else options.recordings.push_back(arg);
+	}
+
+	if (command == "evaluate") return evaluate(options);
+	if (command == "replay" && options.recordings.size() == 2) return replay(options);
+	usage();
+	return 1;
+}
@@ -0,0 +1,275 @@
+// Latency estimation: delays a synthetic skeleton by known amounts against a stand-in reference tracker, either an
+// orientation tracker on the head or another position tracker, and measures what the estimator makes of it
+#include "LatencyEstimator.h"
+#include "SyntheticSource.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace KinectOsvr {
+	namespace {
+		const double Degrees = M_PI / 180.0;
+
+		typedef std::chrono::steady_clock Clock;
+
+		// What evaluate allows of the latency corrected by, in milliseconds
+		const double MaxMeanError = 10.0;
+		const double MaxError = 15.0;
+
+		enum Reference {
+			// Which way is up for the head, from an orientation tracker, against the skeleton's neck to head
+			Orientation,
+			// The head's position from another tracker with its own origin and axes, against the skeleton's head
+			Position
+		};
+
+		struct Options {
+			Options() : seconds(120), rate(960), jitter(1.0), noise(5.0), seed(1), still(false) {
+				double defaults[] = { 0, 20, 40, 60, 80, 100, 150, 200 };
+				delays.assign(defaults, defaults + sizeof(defaults) / sizeof(defaults[0]));
+			}
+
+			double seconds;
+			// Reference tracker rate
+			double rate;
+			// Skeleton timestamps wander this far either way from the delay, in milliseconds
+			double jitter;
+			// Skeleton joint noise, in millimetres
+			double noise;
+			unsigned seed;
+			// The person keeps still, so nothing should be confident
+			bool still;
+			std::vector<double> delays;
+			LatencyParams params;
+		};
+
+		Eigen::Vector3d joint(const Skeleton& skeleton, int j) {
+			return Eigen::Vector3d(skeleton.x[j], skeleton.y[j], skeleton.z[j]);
+		}
+
+		OSVR_Vec3 toVec(const Eigen::Vector3d& v) {
+			OSVR_Vec3 result;
+			osvr::util::vecMap(result) = v;
+			return result;
+		}
+
+		// Facing the way the shoulders do
+		Eigen::Quaterniond bodyHeading(const Skeleton& skeleton) {
+			Eigen::Vector3d across = joint(skeleton, V2Joint::ShoulderRight) - joint(skeleton, V2Joint::ShoulderLeft);
+			return Eigen::Quaterniond(Eigen::AngleAxisd(atan2(-across.z(), across.x()), Eigen::Vector3d::UnitY()));
+		}
+
+		struct Result {
+			Result() : windows(0), confident(0), published(0), error(0), worst(0), finalLatency(0), applied(0), firstApplied(0),
+				appliedError(0), appliedWorst(0), appliedLatency(0), confidence(0), cost(0) {}
+
+			int windows, confident, published;
+			// Of the published latency after each window, in milliseconds
+			double error, worst, finalLatency;
+			// Of the stable latency head fusion would correct by after each window, and the window it's first there
+			int applied, firstApplied;
+			double appliedError, appliedWorst, appliedLatency;
+			double confidence;
+			// Per window, in microseconds
+			double cost;
+		};
+
+		// One person looking around while walking about, seen by the skeleton delay late and by the reference on time
+		Result run(const Options& options, Reference reference, double delay) {
+			SyntheticSource::Options sourceOptions;
+			sourceOptions.seed = options.seed;
+			sourceOptions.frameRate = options.rate;
+			sourceOptions.noise = options.noise / 1000.0;
+			SyntheticSource source(sourceOptions);
+
+			std::mt19937 rng(options.seed);
+			std::uniform_real_distribution<double> phase(0.0, 2 * M_PI);
+			std::uniform_real_distribution<double> jitter(-options.jitter, options.jitter);
+			std::normal_distribution<double> gaussian(0.0, 1.0);
+			double phases[4] = { phase(rng), phase(rng), phase(rng), phase(rng) };
+
+			// The reference tracker's axes are turned from the skeleton's, and for position it has its own origin
+			Eigen::Quaterniond turn(Eigen::AngleAxisd(70 * Degrees, Eigen::Vector3d::UnitY()));
+			if (reference == Position) turn = turn * Eigen::AngleAxisd(30 * Degrees, Eigen::Vector3d(1, 0, 1).normalized());
+			Eigen::Vector3d origin(0.4, -1.2, 2.0);
+
+			LatencyEstimator estimator(options.params, false);
+			Result result;
+			int lastWindows = 0;
+			int perFrame = std::max(1, (int)(options.rate / 30.0 + 0.5));
+			long long samples = (long long)(options.seconds * options.rate);
+			SkeletonFrame frame;
+			Eigen::Vector3d stillHead = Eigen::Vector3d::Zero(), stillUp = Eigen::Vector3d::UnitY();
+			for (long long i = 0; i < samples; i++) {
+				source.next(frame);
+				const Skeleton& real = source.truth().bodies[0];
+				double t = i / options.rate;
+
+				// Glances to the side every few seconds on top of slower looking around, with some nodding and tilting
+				double yaw = 0.6 * sin(0.7 * t + phases[0]) + 0.5 * sin(2.3 * t + phases[1]) * std::max(0.0, sin(0.4 * t + phases[2]));
+				double pitch = 0.25 * sin(1.1 * t + phases[3]);
+				double roll = 0.1 * sin(0.9 * t + phases[0]);
+				Eigen::Quaterniond head = bodyHeading(real) *
+					Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitY()) *
+					Eigen::AngleAxisd(pitch, Eigen::Vector3d::UnitX()) *
+					Eigen::AngleAxisd(roll, Eigen::Vector3d::UnitZ());
+				double neckLength = (joint(real, V2Joint::Head) - joint(real, V2Joint::Neck)).norm();
+				Eigen::Vector3d neck = joint(real, V2Joint::Neck);
+				Eigen::Vector3d up = head * Eigen::Vector3d::UnitY();
+				if (i == 0) {
+					stillHead = neck + up * neckLength;
+					stillUp = up;
+				}
+				if (options.still) {
+					neck = stillHead - stillUp * neckLength;
+					up = stillUp;
+				}
+				Eigen::Vector3d headPosition = neck + up * neckLength;
+
+				Eigen::Vector3d value = reference == Orientation ?
+					Eigen::Vector3d(turn * up) :
+					Eigen::Vector3d(turn * headPosition + origin + Eigen::Vector3d(gaussian(rng), gaussian(rng), gaussian(rng)) * 0.0005);
+
+				Clock::time_point before = Clock::now();
+				estimator.addReference(frame.timestamp, toVec(value));
+
+				// The skeleton sees the head and neck with its usual noise
+				if (i % perFrame == 0 && frame.bodies[0].tracking == BodyTracked) {
+					const Skeleton& seen = frame.bodies[0];
+					Eigen::Vector3d seenHead = headPosition + joint(seen, V2Joint::Head) - joint(real, V2Joint::Head);
+					Eigen::Vector3d seenNeck = neck + joint(seen, V2Joint::Neck) - joint(real, V2Joint::Neck);
+					int64_t stamped = frame.timestamp + (int64_t)((delay + jitter(rng)) * 1000.0);
+					if (reference == Position) estimator.addMeasured(stamped, toVec(seenHead));
+					else if (seen.jointTracking[V2Joint::Head] == JointTracked && seen.jointTracking[V2Joint::Neck] == JointTracked) {
+						estimator.addMeasured(stamped, toVec((seenHead - seenNeck).normalized()));
+					}
+				}
+				double cost = std::chrono::duration<double, std::micro>(Clock::now() - before).count();
+
+				LatencyEstimate estimate = estimator.estimate();
+				if (estimate.windows == lastWindows) continue;
+				lastWindows = estimate.windows;
+				result.windows++;
+				result.cost += cost;
+				result.confidence += estimate.confidence;
+				if (estimate.confidence >= options.params.minConfidence) result.confident++;
+				if (estimate.stable) {
+					double error = fabs(estimate.stableLatency - delay);
+					if (result.applied++ == 0) result.firstApplied = result.windows;
+					result.appliedError += error;
+					result.appliedWorst = std::max(result.appliedWorst, error);
+					result.appliedLatency = estimate.stableLatency;
+				}
+				if (!estimate.valid) continue;
+
+				double error = fabs(estimate.latency - delay);
+				result.published++;
+				result.error += error;
+				result.worst = std::max(result.worst, error);
+				result.finalLatency = estimate.latency;
+			}
+			return result;
+		}
+
+		int evaluate(const Options& options) {
+			printf("%.0f s sessions%s, reference at %.0f Hz, skeleton with %.1f mm noise and timestamps jittering %.1f ms, %.0f s windows every %.0f s\n",
+				options.seconds, options.still ? " keeping still" : "", options.rate, options.noise, options.jitter, options.params.window, options.params.interval);
+			printf("reference\tdelay_ms\twindows\tconfident\tmean_confidence\tfinal_ms\tmean_error_ms\tmax_error_ms\t"
+				"first_applied\tapplied_ms\tapplied_mean_error_ms\tapplied_max_error_ms\tus_per_window\n");
+
+			const char* names[] = { "orientation", "position" };
+			bool passed = true;
+			for (int reference = Orientation; reference <= Position; reference++) {
+				for (size_t d = 0; d < options.delays.size(); d++) {
+					Result result = run(options, (Reference)reference, options.delays[d]);
+					printf("%s\t%.0f\t%d\t%d\t%.2f\t", names[reference], options.delays[d], result.windows, result.confident,
+						result.windows > 0 ? result.confidence / result.windows : 0.0);
+					if (result.published > 0) printf("%.1f\t%.1f\t%.1f\t", result.finalLatency, result.error / result.published, result.worst);
+					else printf("-\t-\t-\t");
+					if (result.applied > 0) {
+						printf("%d\t%.1f\t%.1f\t%.1f\t", result.firstApplied, result.appliedLatency, result.appliedError / result.applied,
+							result.appliedWorst);
+					}
+					else printf("-\t-\t-\t-\t");
+					printf("%.0f\n", result.windows > 0 ? result.cost / result.windows : 0.0);
+
+					// Keeping still gives nothing to line up, so anything published is a false alarm. Otherwise what's
+					// corrected by has to settle close and never be far off on the way.
+					if (options.still) passed = passed && result.published == 0 && result.applied == 0;
+					else {
+						passed = passed && result.applied > 0 && fabs(result.appliedLatency - options.delays[d]) < 10.0 &&
+							result.appliedError / result.applied < MaxMeanError && result.appliedWorst < MaxError;
+					}
+				}
+			}
+			return passed ? 0 : 1;
+		}
+
+		void usage() {
+			std::cerr << "Usage: kinect_latency evaluate [options]\n"
+				"  --seconds S         Session length (120)\n"
+				"  --rate HZ           Reference tracker rate (960)\n"
+				"  --delays MS,...     Skeleton delays to try (0,20,40,60,80,100,150,200)\n"
+				"  --jitter MS         Skeleton timestamp jitter either way (1)\n"
+				"  --noise MM          Skeleton joint noise (5)\n"
+				"  --window S          Seconds compared for each estimate (20)\n"
+				"  --interval S        Seconds between estimates (2)\n"
+				"  --memory S          Seconds over which windows are pooled (60)\n"
+				"  --min-confidence C  Confidence an estimate needs to count (0.3)\n"
+				"  --max-latency MS    Furthest either way searched (250)\n"
+				"  --stable-windows N  Estimates in a row that must agree before one's corrected by (10)\n"
+				"  --stable-spread MS  How far apart they may be (5)\n"
+				"  --still             The person keeps still\n"
+				"  --seed N            Seed for the session (1)" << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace KinectOsvr;
+
+	if (argc < 2 || std::string(argv[1]) != "evaluate") {
+		usage();
+		return 1;
+	}
+
+	Options options;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--seconds" && hasValue) options.seconds = std::max(1.0, atof(argv[++i]));
+		else if (arg == "--rate" && hasValue) options.rate = std::max(30.0, atof(argv[++i]));
+		else if (arg == "--jitter" && hasValue) options.jitter = fabs(atof(argv[++i]));
+		else if (arg == "--noise" && hasValue) options.noise = fabs(atof(argv[++i]));
+		else if (arg == "--window" && hasValue) options.params.window = std::max(1.0, atof(argv[++i]));
+		else if (arg == "--interval" && hasValue) options.params.interval = std::max(0.1, atof(argv[++i]));
+		else if (arg == "--memory" && hasValue) options.params.memory = std::max(0.0, atof(argv[++i]));
+		else if (arg == "--min-confidence" && hasValue) options.params.minConfidence = atof(argv[++i]);
+		else if (arg == "--max-latency" && hasValue) options.params.maxLatency = std::max(10.0, atof(argv[++i]));
+		else if (arg == "--stable-windows" && hasValue) options.params.stableWindows = std::max(1, atoi(argv[++i]));
+		else if (arg == "--stable-spread" && hasValue) options.params.stableSpread = fabs(atof(argv[++i]));
+		else if (arg == "--seed" && hasValue) options.seed = (unsigned)atoi(argv[++i]);
+		else if (arg == "--still") options.still = true;
+		else if (arg == "--delays" && hasValue) {
+			options.delays.clear();
+			std::stringstream list(argv[++i]);
+			std::string delay;
+			while (std::getline(list, delay, ',')) options.delays.push_back(atof(delay.c_str()));
+		}
+		else {
+			usage();
+			return 1;
+		}
+	}
+	return evaluate(options);
+}
@@ -0,0 +1,402 @@
+// Diagnostic logger: checks that lines are written whole and in order, that each call site is rate-limited on its own,
+// that a full queue drops rather than waits and that files rotate, and times what a log call costs its caller
+#include "Log.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace KinectOsvr {
+	namespace {
+		typedef std::chrono::steady_clock Clock;
+
+		struct Options {
+			Options() : path("kinect_log_check.log"), calls(200000) {}
+
+			std::string path;
+			int calls;
+		};
+
+		struct Check {
+			std::string name;
+			bool passed;
+			std::string detail;
+		};
+
+		std::vector<std::string> readLines(const std::string& path) {
+			std::vector<std::string> lines;
+			FILE* file = fopen(path.c_str(), "r");
+			if (file == NULL) return lines;
+			char buffer[1024];
+			while (fgets(buffer, sizeof(buffer), file) != NULL) {
+				size_t length = strlen(buffer);
+				if (length > 0 && buffer[length - 1] == '\n') buffer[length - 1] = '\0';
+				lines.push_back(buffer);
+			}
+			fclose(file);
+			return lines;
+		}
+
+		int countContaining(const std::vector<std::string>& lines, const std::string& text) {
+			int count = 0;
+			for (size_t i = 0; i < lines.size(); i++) {
+				if (lines[i].find(text) != std::string::npos) count++;
+			}
+			return count;
+		}
+
+		void removeLogs(const std::string& path, int files) {
+			remove(path.c_str());
+			for (int i = 1; i <= files + 1; i++) remove((path + "." + std::to_string(i)).c_str());
+		}
+
+		bool fileExists(const std::string& path) {
+			FILE* file = fopen(path.c_str(), "r");
+			if (file != NULL) fclose(file);
+			return file != NULL;
+		}
+
+		Log::LogParams scratch(const Options& options) {
+			Log::LogParams params;
+			params.path = options.path;
+			return params;
+		}
+
+		// Arguments come out as they went in, and strings are copied when posted
+		void formatChecks(const Options& options, std::vector<Check>& checks) {
+			removeLogs(options.path, 3);
+			Log::start(scratch(options));
+
+			std::string name = "KinectV2";
+			KINECT_LOG(Warning, "{}: frame {} took {} ms, {} of {} bodies", name, -42, 7.25, 3u, 6);
+			name = "changed after posting";
+			std::string longName(200, 'x');
+			KINECT_LOG(Error, "[{}]", longName);
+			KINECT_LOG(Info, "{} {} left as it is", 1);
+			Log::stop();
+
+			std::vector<std::string> lines = readLines(options.path);
+			Check check;
+			check.name = "arguments";
+			check.passed = lines.size() == 3 && lines[0].find("warning") != std::string::npos &&
+				lines[0].find("KinectV2: frame -42 took 7.25 ms, 3 of 6 bodies") != std::string::npos;
+			check.detail = lines.empty() ? "no lines" : lines[0];
+			checks.push_back(check);
+
+			check.name = "long strings";
+			check.passed = lines.size() == 3 && lines[1].find("[" + std::string(Log::Detail::MaxText, 'x') + "]") != std::string::npos;
+			check.detail = "cut to " + std::to_string(Log::Detail::MaxText) + " characters";
+			checks.push_back(check);
+
+			check.name = "missing arguments";
+			check.passed = lines.size() == 3 && lines[2].find("1 {} left as it is") != std::string::npos;
+			check.detail = lines.size() == 3 ? lines[2] : "";
+			checks.push_back(check);
+		}
+
+		// A site failing every frame is cut off after its burst and summed up once its window is over, without
+		// holding anyone else back
+		void rateChecks(const Options& options, std::vector<Check>& checks) {
+			removeLogs(options.path, 3);
+			Log::LogParams params = scratch(options);
+			params.burst = 5;
+			params.window = 0.3;
+			Log::start(params);
+			Log::Stats before = Log::stats();
+
+			const int Failures = 10000;
+			for (int i = 0; i < Failures; i++) {
+				KINECT_LOG(Warning, "failing {}", i);
+				if (i % 1000 == 0) KINECT_LOG(Info, "healthy {}", i);
+				// Give the logger a moment to mute the failing site
+				if (i == 100) Log::flush();
+			}
+			Log::Stats queued = Log::stats();
+			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			Log::flush();
+			Log::Stats after = Log::stats();
+			Log::stop();
+
+			std::vector<std::string> lines = readLines(options.path);
+			int failing = countContaining(lines, "] failing");
+			int healthy = countContaining(lines, "] healthy");
+			int summaries = countContaining(lines, " more of ");
+			std::string summary = std::to_string(Failures - params.burst) + " more of \"failing {}\"";
+
+			Check check;
+			check.name = "noisy site limited";
+			check.passed = failing == params.burst && countContaining(lines, summary) == 1;
+			check.detail = std::to_string(failing) + " lines and " + (countContaining(lines, summary) ? "a summary" : "no summary");
+			checks.push_back(check);
+
+			check.name = "muted site stops queueing";
+			uint64_t posted = queued.posted - before.posted;
+			check.passed = posted < 200;
+			check.detail = std::to_string(posted) + " of " + std::to_string(Failures + Failures / 1000) + " calls queued";
+			checks.push_back(check);
+
+			check.name = "other sites unaffected";
+			check.passed = healthy == params.burst;
+			check.detail = std::to_string(healthy) + " of 10 lines, the first " + std::to_string(params.burst) + " expected";
+			checks.push_back(check);
+
+			check.name = "everything accounted for";
+			uint64_t accounted = (after.written - before.written) + (after.suppressed - before.suppressed) - summaries;
+			check.passed = accounted == (uint64_t)(Failures + Failures / 1000);
+			check.detail = std::to_string(after.written - before.written) + " lines written, " + std::to_string(after.suppressed - before.suppressed) + " suppressed";
+			checks.push_back(check);
+		}
+
+		// Callers never wait on a full queue, what doesn't fit is counted and said so
+		void queueChecks(const Options& options, std::vector<Check>& checks) {
+			removeLogs(options.path, 3);
+			Log::LogParams params = scratch(options);
+			params.burst = 0;
+			params.capacity = 64;
+			params.window = 0.1;
+			Log::start(params);
+			Log::Stats before = Log::stats();
+
+			const int Posts = 20000;
+			Clock::time_point start = Clock::now();
+			for (int i = 0; i < Posts; i++) KINECT_LOG(Info, "burst {}", i);
+			double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			Log::flush();
+			Log::Stats after = Log::stats();
+			Log::stop();
+
+			std::vector<std::string> lines = readLines(options.path);
+			uint64_t dropped = after.dropped - before.dropped;
+			uint64_t written = after.written - before.written;
+
+			Check check;
+			check.name = "full queue drops";
+			check.passed = dropped > 0 && (int)(countContaining(lines, "burst") + dropped) == Posts;
+			check.detail = std::to_string(dropped) + " of " + std::to_string(Posts) + " dropped in " + std::to_string(elapsed).substr(0, 5) + " ms";
+			checks.push_back(check);
+
+			check.name = "drops reported";
+			check.passed = countContaining(lines, std::to_string(dropped) + " log records dropped") == 1 && written == (uint64_t)lines.size();
+			check.detail = countContaining(lines, "records dropped") ? "once" : "not reported";
+			checks.push_back(check);
+		}
+
+		// Several threads at once, every line whole and each thread's in order
+		void threadChecks(const Options& options, std::vector<Check>& checks) {
+			removeLogs(options.path, 3);
+			Log::LogParams params = scratch(options);
+			params.burst = 0;
+			params.capacity = 1 << 16;
+			params.fileSize = 16 << 20;
+			Log::start(params);
+			Log::Stats before = Log::stats();
+
+			const int Threads = 4;
+			const int Posts = 5000;
+			std::vector<std::thread> threads;
+			for (int t = 0; t < Threads; t++) {
+				threads.push_back(std::thread([t]() {
+					for (int i = 0; i < Posts; i++) KINECT_LOG(Info, "thread {} line {} end", t, i);
+				}));
+			}
+			for (int t = 0; t < Threads; t++) threads[t].join();
+			Log::flush();
+			Log::Stats stats = Log::stats();
+			Log::stop();
+
+			std::vector<std::string> lines = readLines(options.path);
+			std::vector<int> next(Threads, 0);
+			bool ordered = true;
+			for (size_t i = 0; i < lines.size(); i++) {
+				size_t at = lines[i].find("] thread ");
+				int t, line;
+				char end[8];
+				if (at == std::string::npos || sscanf(lines[i].c_str() + at, "] thread %d line %d %7s", &t, &line, end) != 3 ||
+					t < 0 || t >= Threads || line != next[t] || strcmp(end, "end") != 0) {
+					ordered = false;
+					break;
+				}
+				next[t]++;
+			}
+
+			Check check;
+			check.name = "threads";
+			check.passed = ordered && (int)lines.size() == Threads * Posts && stats.dropped == before.dropped;
+			check.detail = std::to_string(lines.size()) + " lines from " + std::to_string(Threads) + " threads" + (ordered ? ", each in order" : ", out of order");
+			checks.push_back(check);
+		}
+
+		void rotationChecks(const Options& options, std::vector<Check>& checks) {
+			removeLogs(options.path, 3);
+			Log::LogParams params = scratch(options);
+			params.burst = 0;
+			params.fileSize = 4096;
+			params.files = 2;
+			params.capacity = 1 << 12;
+			Log::start(params);
+			for (int i = 0; i < 1000; i++) KINECT_LOG(Info, "rotating {}", i);
+			Log::flush();
+			Log::stop();
+
+			std::vector<std::string> current = readLines(options.path);
+			std::vector<std::string> newest = readLines(options.path + ".1");
+			std::vector<std::string> oldest = readLines(options.path + ".2");
+			bool kept = !current.empty() && current.back().find("rotating 999") != std::string::npos &&
+				!newest.empty() && !oldest.empty() && !fileExists(options.path + ".3");
+			// The old files follow on from each other
+			bool continuous = kept && newest[0].find("rotating " + std::to_string(atoi(oldest.back().substr(oldest.back().rfind(' ') + 1).c_str()) + 1)) != std::string::npos;
+
+			Check check;
+			check.name = "rotation";
+			check.passed = kept && continuous;
+			check.detail = std::to_string(current.size()) + " + " + std::to_string(newest.size()) + " + " + std::to_string(oldest.size()) + " lines in 3 files";
+			checks.push_back(check);
+		}
+
+		// Without the logger running calls write their own lines, as tools that never start it expect
+		void consoleChecks(std::vector<Check>& checks) {
+			Log::Stats before = Log::stats();
+			KINECT_LOG(Info, "written by the caller");
+			Log::Stats after = Log::stats();
+
+			Check check;
+			check.name = "not started";
+			check.passed = after.written == before.written + 1 && after.posted == before.posted;
+			check.detail = "written straight to the console";
+			checks.push_back(check);
+		}
+
+		// Per call averages over chunks of calls, with the logger writing what they post in between
+		std::vector<double> timeCalls(const Options& options, int chunk, void (*call)(int)) {
+			std::vector<double> chunks;
+			for (int done = 0; done < options.calls; done += chunk) {
+				Clock::time_point start = Clock::now();
+				for (int i = 0; i < chunk; i++) call(done + i);
+				chunks.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / chunk);
+				Log::flush();
+			}
+			std::sort(chunks.begin(), chunks.end());
+			return chunks;
+		}
+
+		std::string g_name = "KinectV2";
+
+		void typicalCall(int i) {
+			KINECT_LOG(Warning, "{}: failed to acquire a body frame (error {})", g_name, i);
+		}
+
+		void noisyCall(int i) {
+			KINECT_LOG(Warning, "{}: failed to read joints of body {}", g_name, i);
+		}
+
+		void printTiming(const char* name, const std::vector<double>& chunks) {
+			printf("%s\t%.1f\t%.1f\t%.1f\n", name, chunks[chunks.size() / 2], chunks[chunks.size() * 9 / 10], chunks.back());
+		}
+
+		void timings(const Options& options) {
+			printf("call\tmedian_ns\tp90_ns\tmax_ns\n");
+
+			Log::LogParams params = scratch(options);
+			params.burst = 0;
+			params.capacity = 1 << 12;
+			removeLogs(options.path, params.files);
+			Log::start(params);
+			printTiming("queued", timeCalls(options, 1000, typicalCall));
+			Log::stop();
+
+			params.burst = 1;
+			params.window = 3600;
+			removeLogs(options.path, params.files);
+			Log::start(params);
+			noisyCall(0);
+			Log::flush();
+			printTiming("muted site", timeCalls(options, 1000, noisyCall));
+			Log::stop();
+
+			// What each call would cost if it wrote its own line, as it did before
+			FILE* file = fopen(options.path.c_str(), "w");
+			if (file == NULL) return;
+			std::vector<double> chunks;
+			for (int done = 0; done < options.calls / 10; done += 100) {
+				Clock::time_point start = Clock::now();
+				for (int i = 0; i < 100; i++) {
+					fprintf(file, "%s: failed to acquire a body frame (error %d)\n", g_name.c_str(), done + i);
+					fflush(file);
+				}
+				chunks.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / 100);
+			}
+			fclose(file);
+			std::sort(chunks.begin(), chunks.end());
+			printTiming("written by the caller", chunks);
+		}
+
+		int check(const Options& options) {
+			std::vector<Check> checks;
+			formatChecks(options, checks);
+			rateChecks(options, checks);
+			queueChecks(options, checks);
+			threadChecks(options, checks);
+			rotationChecks(options, checks);
+			consoleChecks(checks);
+
+			int failed = 0;
+			printf("check\tresult\tdetail\n");
+			for (size_t i = 0; i < checks.size(); i++) {
+				printf("%s\t%s\t%s\n", checks[i].name.c_str(), checks[i].passed ? "ok" : "FAILED", checks[i].detail.c_str());
+				if (!checks[i].passed) failed++;
+			}
+			printf("%d of %d checks passed\n", (int)checks.size() - failed, (int)checks.size());
+			removeLogs(options.path, 3);
+			return failed == 0 ? 0 : 1;
+		}
+
+		int bench(const Options& options) {
+			timings(options);
+			removeLogs(options.path, 3);
+			return 0;
+		}
+
+		void usage() {
+			std::cerr << "Usage: kinect_log check [--path FILE]\n"
+				"       kinect_log bench [--path FILE] [--calls N]\n"
+				"  --path FILE   Scratch log the checks write (kinect_log_check.log)\n"
+				"  --calls N     Log calls timed for each case (200000)" << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace KinectOsvr;
+
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+	std::string command = argv[1];
+
+	Options options;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--path" && hasValue) options.path = argv[++i];
+		else if (arg == "--calls" && hasValue) options.calls = std::max(1000, atoi(argv[++i]));
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	if (command == "check") return check(options);
+	if (command == "bench") return bench(options);
+	usage();
+	return 1;
+}
@@ -0,0 +1,430 @@
+// Warm-start snapshots: checks that state survives a save and load, that damaged, mismatched and stale snapshots
+// are turned away and when changes get written, and summarizes snapshots written with OSVR_KINECT_SNAPSHOT
+#include "BodyIdentifier.h"
+#include "SyntheticSource.h"
+#include "WarmStart.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace KinectOsvr {
+	namespace {
+		typedef std::chrono::steady_clock Clock;
+		typedef std::vector<unsigned char> Bytes;
+
+		// Where WarmStart keeps these in its header
+		const size_t VersionOffset = 4;
+		const size_t StateSizeOffset = 8;
+		const size_t ChecksumOffset = 24;
+		const size_t HeaderSize = 32;
+
+		const double MaxAge = 3600;
+
+		struct Options {
+			Options() : path("kinect_snapshot_check.kws"), seed(1) {}
+
+			std::string path;
+			unsigned seed;
+			std::vector<std::string> files;
+		};
+
+		bool readFile(const std::string& path, Bytes& bytes) {
+			FILE* file = fopen(path.c_str(), "rb");
+			if (file == NULL) return false;
+			bytes.clear();
+			unsigned char buffer[4096];
+			size_t read;
+			while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) bytes.insert(bytes.end(), buffer, buffer + read);
+			fclose(file);
+			return true;
+		}
+
+		bool writeFile(const std::string& path, const Bytes& bytes) {
+			FILE* file = fopen(path.c_str(), "wb");
+			if (file == NULL) return false;
+			bool written = bytes.empty() || fwrite(&bytes[0], bytes.size(), 1, file) == 1;
+			return fclose(file) == 0 && written;
+		}
+
+		// Someone recentered, with a build learned from a few seconds of frames and a measured latency
+		WarmStartState example(unsigned seed) {
+			SyntheticSource::Options sourceOptions;
+			sourceOptions.seed = seed;
+			SyntheticSource source(sourceOptions);
+			SkeletonFrame frame;
+
+			WarmStartState state;
+			for (int i = 0; i < 90; i++) {
+				source.next(frame);
+				state.signature.add(frame.bodies[0]);
+			}
+			const Skeleton& skeleton = frame.bodies[0];
+
+			state.calibrated = 1;
+			float floor[4] = { 0.0f, 0.9945f, 0.1045f, 1.1f };
+			memcpy(state.floor, floor, sizeof(floor));
+			state.offset.translation.data[0] = skeleton.x[V2Joint::Head];
+			state.offset.translation.data[1] = skeleton.y[V2Joint::Head];
+			state.offset.translation.data[2] = skeleton.z[V2Joint::Head];
+			state.offset.rotation.data[0] = cos(0.3);
+			state.offset.rotation.data[2] = sin(0.3);
+			for (int i = 0; i < 3; i++) state.kinectPose.translation.data[i] = -state.offset.translation.data[i];
+
+			state.hasPerson = 1;
+			memcpy(state.lastPosition, skeleton.position, sizeof(state.lastPosition));
+			state.neckLength = 0.12;
+			state.hasLatency = 1;
+			state.latency = 63.5;
+			return state;
+		}
+
+		struct Check {
+			std::string name;
+			bool passed;
+			std::string detail;
+		};
+
+		// Saves the example, breaks the file in some way, and loads it back expecting the given result
+		Check loadCheck(const Options& options, const std::string& name, WarmStart::LoadResult expected,
+			std::function<void(Bytes& bytes)> damage, int64_t savedAt, int64_t now, int jointCount = V2Joint::Count) {
+			WarmStartState state = example(options.seed);
+			WarmStart writer;
+			writer.open(options.path, V2Joint::Count, MaxAge);
+			writer.flush(state, savedAt);
+
+			Bytes bytes;
+			readFile(options.path, bytes);
+			if (damage) {
+				damage(bytes);
+				writeFile(options.path, bytes);
+			}
+
+			WarmStart reader;
+			reader.open(options.path, jointCount, MaxAge);
+			WarmStartState loaded;
+			WarmStart::LoadResult result = reader.load(loaded, now);
+
+			Check check;
+			check.name = name;
+			check.passed = result == expected;
+			if (result == WarmStart::Loaded && expected == WarmStart::Loaded) check.passed = memcmp(&loaded, &state, sizeof(state)) == 0;
+			check.detail = std::string(WarmStart::describe(result)) + ", expected " + WarmStart::describe(expected);
+			return check;
+		}
+
+		Check flag(const std::string& name, bool actual, bool expected, const char* yes, const char* no) {
+			Check check;
+			check.name = name;
+			check.passed = actual == expected;
+			check.detail = std::string(actual ? yes : no) + ", expected " + (expected ? yes : no);
+			return check;
+		}
+
+		void loadChecks(const Options& options, std::vector<Check>& checks) {
+			int64_t now = (int64_t)time(NULL);
+
+			checks.push_back(loadCheck(options, "round trip", WarmStart::Loaded, NULL, now, now));
+			remove(options.path.c_str());
+			{
+				WarmStart reader;
+				reader.open(options.path, V2Joint::Count, MaxAge);
+				WarmStartState state;
+				WarmStart::LoadResult result = reader.load(state, now);
+				Check check = { "no snapshot yet", result == WarmStart::Missing, std::string(WarmStart::describe(result)) + ", expected missing" };
+				checks.push_back(check);
+			}
+
+			checks.push_back(loadCheck(options, "empty file", WarmStart::Corrupt, [](Bytes& bytes) { bytes.clear(); }, now, now));
+			checks.push_back(loadCheck(options, "cut short in the header", WarmStart::Corrupt, [](Bytes& bytes) { bytes.resize(HeaderSize / 2); }, now, now));
+			checks.push_back(loadCheck(options, "cut short in the state", WarmStart::Corrupt, [](Bytes& bytes) { bytes.resize(bytes.size() - 7); }, now, now));
+			checks.push_back(loadCheck(options, "trailing bytes", WarmStart::Corrupt, [](Bytes& bytes) { bytes.push_back(0); }, now, now));
+			checks.push_back(loadCheck(options, "not a snapshot", WarmStart::Corrupt, [](Bytes& bytes) { memcpy(&bytes[0], "KSKR", 4); }, now, now));
+			checks.push_back(loadCheck(options, "flipped bit in the state", WarmStart::Corrupt, [](Bytes& bytes) { bytes[HeaderSize + 100] ^= 0x10; }, now, now));
+			checks.push_back(loadCheck(options, "flipped bit in the checksum", WarmStart::Corrupt, [](Bytes& bytes) { bytes[ChecksumOffset] ^= 0x01; }, now, now));
+			checks.push_back(loadCheck(options, "newer version", WarmStart::Incompatible, [](Bytes& bytes) { bytes[VersionOffset] += 1; }, now, now));
+			checks.push_back(loadCheck(options, "different state layout", WarmStart::Incompatible, [](Bytes& bytes) { bytes[StateSizeOffset] += 8; }, now, now));
+			checks.push_back(loadCheck(options, "other sensor's snapshot", WarmStart::Incompatible, NULL, now, now, V1Joint::Count));
+			checks.push_back(loadCheck(options, "just within the age limit", WarmStart::Loaded, NULL, now - (int64_t)MaxAge + 5, now));
+			checks.push_back(loadCheck(options, "older than the age limit", WarmStart::Stale, NULL, now - (int64_t)MaxAge - 5, now));
+			checks.push_back(loadCheck(options, "saved by a clock since set back", WarmStart::Stale, NULL, now + 3600, now));
+
+			// The checksum can't catch a snapshot written from bad values in the first place
+			{
+				WarmStartState state = example(options.seed);
+				state.offset.rotation.data[0] = 2.0;
+				WarmStart writer;
+				writer.open(options.path, V2Joint::Count, MaxAge);
+				writer.flush(state, now);
+				WarmStartState loaded;
+				WarmStart::LoadResult result = writer.load(loaded, now);
+				Check check = { "rotation not a unit quaternion", result == WarmStart::Corrupt, std::string(WarmStart::describe(result)) + ", expected corrupt" };
+				checks.push_back(check);
+
+				state = example(options.seed);
+				state.lastPosition[1] = (float)sqrt(-1.0);
+				writer.flush(state, now);
+				result = writer.load(loaded, now);
+				Check nan = { "position not a number", result == WarmStart::Corrupt, std::string(WarmStart::describe(result)) + ", expected corrupt" };
+				checks.push_back(nan);
+			}
+
+			// A save that died part way leaves its temporary file, the snapshot it was replacing is still whole
+			{
+				WarmStartState state = example(options.seed);
+				WarmStart writer;
+				writer.open(options.path, V2Joint::Count, MaxAge);
+				writer.flush(state, now);
+				Bytes partial(HeaderSize + 10, 0xCD);
+				writeFile(options.path + ".tmp", partial);
+				WarmStartState loaded;
+				WarmStart::LoadResult result = writer.load(loaded, now);
+				Check check = { "interrupted save", result == WarmStart::Loaded && memcmp(&loaded, &state, sizeof(state)) == 0,
+					std::string(WarmStart::describe(result)) + ", expected loaded" };
+				checks.push_back(check);
+				remove((options.path + ".tmp").c_str());
+			}
+		}
+
+		void saveChecks(const Options& options, std::vector<Check>& checks) {
+			int64_t now = (int64_t)time(NULL);
+			WarmStartState state = example(options.seed);
+			WarmStart writer;
+			writer.open(options.path, V2Joint::Count, MaxAge);
+
+			checks.push_back(flag("first update", writer.update(state, now), true, "saved", "not saved"));
+			checks.push_back(flag("nothing changed", writer.update(state, now + 20), false, "saved", "not saved"));
+			state.lastPosition[0] += 0.5f;
+			checks.push_back(flag("person moved, 1 s later", writer.update(state, now + 1), false, "saved", "not saved"));
+			checks.push_back(flag("person moved, 10 s later", writer.update(state, now + 10), true, "saved", "not saved"));
+			state.offset.translation.data[0] += 0.1;
+			checks.push_back(flag("recentered, 1 s later", writer.update(state, now + 11), true, "saved", "not saved"));
+			checks.push_back(flag("shutdown, nothing changed", writer.flush(state, now + 12), true, "saved", "not saved"));
+			remove(options.path.c_str());
+
+			// Nothing waits for an update, the writer picks the state up on its own
+			WarmStart background;
+			background.open(options.path, V2Joint::Count, MaxAge);
+			Clock::time_point start = Clock::now();
+			bool handed = background.update(state, now);
+			double handOff = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+			WarmStartState loaded;
+			bool written = false;
+			while (!written && Clock::now() - start < std::chrono::seconds(2)) {
+				written = background.load(loaded, now) == WarmStart::Loaded && memcmp(&loaded, &state, sizeof(state)) == 0;
+				if (!written) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			char detail[96];
+			snprintf(detail, sizeof(detail), "handed over in %.1f us, on disk %.0f ms later", handOff,
+				std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+			Check check = { "written in the background", handed && written, detail };
+			checks.push_back(check);
+		}
+
+		void floorChecks(std::vector<Check>& checks) {
+			const double Degrees = 3.14159265358979 / 180.0;
+			float floor[4] = { 0.0f, (float)cos(6 * Degrees), (float)sin(6 * Degrees), 1.1f };
+			float tilted[4] = { 0.0f, (float)cos(7 * Degrees), (float)sin(7 * Degrees), 1.12f };
+			float turned[4] = { (float)sin(5 * Degrees), (float)cos(5 * Degrees), 0.0f, 1.1f };
+			float lower[4] = { floor[0], floor[1], floor[2], 1.2f };
+			float scaled[4] = { floor[0] * 2, floor[1] * 2, floor[2] * 2, floor[3] * 2 };
+			float unknown[4] = { 0, 0, 0, 0 };
+
+			checks.push_back(flag("floor unchanged", WarmStart::sameFloor(floor, floor), true, "same", "moved"));
+			checks.push_back(flag("floor 1 degree and 2 cm off", WarmStart::sameFloor(floor, tilted), true, "same", "moved"));
+			checks.push_back(flag("floor as a longer normal", WarmStart::sameFloor(floor, scaled), true, "same", "moved"));
+			checks.push_back(flag("sensor tilted 8 degrees", WarmStart::sameFloor(floor, turned), false, "same", "moved"));
+			checks.push_back(flag("sensor 10 cm higher", WarmStart::sameFloor(floor, lower), false, "same", "moved"));
+			checks.push_back(flag("floor not found", WarmStart::sameFloor(floor, unknown), false, "same", "moved"));
+		}
+
+		// Who a fresh identifier picks first, some way into a session
+		int firstPick(const SyntheticSource::Options& sourceOptions, int skip, BodyIdentifier& identifier, int& frames) {
+			SyntheticSource source(sourceOptions);
+			SkeletonFrame frame;
+			for (int i = 0; i < skip; i++) source.next(frame);
+			int picked = -1;
+			for (frames = 1; frames <= 90; frames++) {
+				source.next(frame);
+				picked = identifier.identify(frame);
+				if (picked >= 0) break;
+			}
+			return picked;
+		}
+
+		// The person someone picked by hand before a restart is picked again, rather than whoever is nearest
+		void identityChecks(const Options& options, std::vector<Check>& checks) {
+			SyntheticSource::Options sourceOptions;
+			sourceOptions.bodies = 3;
+			sourceOptions.seed = options.seed;
+			sourceOptions.buildSpread = 0.15;
+			// The same people after the restart, wherever they've got to by then
+			const int Restart = 900;
+
+			BodyIdentifier fresh;
+			int freshFrames;
+			int freshPick = firstPick(sourceOptions, Restart, fresh, freshFrames);
+			int chosen = (freshPick + 1) % sourceOptions.bodies;
+
+			SyntheticSource before(sourceOptions);
+			SkeletonFrame frame;
+			BodyIdentifier session;
+			for (int i = 0; i < 60; i++) {
+				before.next(frame);
+				session.identify(frame);
+			}
+			session.setTrackedBody(chosen);
+			for (int i = 0; i < 300; i++) {
+				before.next(frame);
+				session.identify(frame);
+			}
+			BodySignature signature;
+			float position[3];
+			bool remembered = session.lastTracked(signature, position);
+
+			BodyIdentifier resumed;
+			resumed.resume(signature, position);
+			int frames;
+			int resumedPick = firstPick(sourceOptions, Restart, resumed, frames);
+
+			Check check;
+			check.name = "picked person after a restart";
+			check.passed = remembered && resumedPick == chosen;
+			check.detail = "slot " + std::to_string(resumedPick) + " after " + std::to_string(frames) + " frames, expected " + std::to_string(chosen) +
+				"; without the snapshot slot " + std::to_string(freshPick);
+			checks.push_back(check);
+		}
+
+		void timings(const Options& options) {
+			int64_t now = (int64_t)time(NULL);
+			WarmStartState state = example(options.seed);
+			WarmStart warmStart;
+			warmStart.open(options.path, V2Joint::Count, MaxAge);
+
+			const int Saves = 200;
+			Clock::time_point start = Clock::now();
+			for (int i = 0; i < Saves; i++) warmStart.flush(state, now);
+			double save = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / Saves;
+
+			const int Loads = 2000;
+			WarmStartState loaded;
+			start = Clock::now();
+			for (int i = 0; i < Loads; i++) warmStart.load(loaded, now);
+			double load = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / Loads;
+
+			// What every frame pays when nothing has changed
+			const int Updates = 1000000;
+			start = Clock::now();
+			for (int i = 0; i < Updates; i++) warmStart.update(state, now);
+			double update = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / Updates;
+
+			// And when it has, recentering every frame so each one is handed to the writer
+			const int Changes = 100000;
+			start = Clock::now();
+			for (int i = 0; i < Changes; i++) {
+				state.offset.translation.data[0] = i * 1e-6;
+				warmStart.update(state, now);
+			}
+			double change = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / Changes;
+
+			printf("%u byte snapshots: load %.1f us, save %.1f us, unchanged update %.0f ns, changed update %.0f ns\n",
+				(unsigned)(HeaderSize + sizeof(WarmStartState)), load, save, update, change);
+		}
+
+		int check(const Options& options) {
+			std::vector<Check> checks;
+			loadChecks(options, checks);
+			saveChecks(options, checks);
+			floorChecks(checks);
+			identityChecks(options, checks);
+
+			int failed = 0;
+			printf("check\tresult\tdetail\n");
+			for (size_t i = 0; i < checks.size(); i++) {
+				printf("%s\t%s\t%s\n", checks[i].name.c_str(), checks[i].passed ? "ok" : "FAILED", checks[i].detail.c_str());
+				if (!checks[i].passed) failed++;
+			}
+			timings(options);
+			remove(options.path.c_str());
+
+			printf("%d of %d checks passed\n", (int)checks.size() - failed, (int)checks.size());
+			return failed == 0 ? 0 : 1;
+		}
+
+		int info(const std::string& path) {
+			int64_t now = (int64_t)time(NULL);
+			const char* sensors[] = { "KinectV1", "KinectV2" };
+			int jointCounts[] = { V1Joint::Count, V2Joint::Count };
+
+			WarmStart::LoadResult result = WarmStart::Missing;
+			for (int s = 0; s < 2; s++) {
+				WarmStart warmStart;
+				warmStart.open(path, jointCounts[s], 0);
+				WarmStartState state;
+				result = warmStart.load(state, now);
+				if (result == WarmStart::Incompatible) continue;
+				if (result != WarmStart::Loaded) break;
+
+				const OSVR_Vec3& t = state.offset.translation;
+				const OSVR_Quaternion& q = state.offset.rotation;
+				printf("%s snapshot\n", sensors[s]);
+				if (state.calibrated) printf("recentered on the head at (%.3f, %.3f, %.3f), rotation (%.3f, %.3f, %.3f, %.3f)\n",
+					t.data[0], t.data[1], t.data[2], q.data[0], q.data[1], q.data[2], q.data[3]);
+				else printf("not recentered\n");
+				printf("floor plane (%.3f, %.3f, %.3f, %.3f)\n", state.floor[0], state.floor[1], state.floor[2], state.floor[3]);
+				if (state.hasPerson) printf("last tracked at (%.2f, %.2f, %.2f), %.2f m tall from %d frames\n",
+					state.lastPosition[0], state.lastPosition[1], state.lastPosition[2], state.signature.height(), state.signature.samples());
+				if (state.neckLength > 0) printf("neck %.3f m\n", state.neckLength);
+				if (state.hasLatency) printf("skeleton latency %.1f ms\n", state.latency);
+				return 0;
+			}
+			std::cerr << path << ": " << WarmStart::describe(result) << std::endl;
+			return 1;
+		}
+
+		void usage() {
+			std::cerr << "Usage: kinect_snapshot check [--path FILE] [--seed N]\n"
+				"       kinect_snapshot info FILE\n"
+				"  --path FILE   Scratch snapshot the checks write (kinect_snapshot_check.kws)\n"
+				"  --seed N      Seed for the synthetic people (1)" << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace KinectOsvr;
+
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+	std::string command = argv[1];
+
+	Options options;
+	for (int i = 2; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--path" && hasValue) options.path = argv[++i];
+		else if (arg == "--seed" && hasValue) options.seed = (unsigned)atoi(argv[++i]);
+		else if (arg.compare(0, 2, "--") == 0) {
+			usage();
+			return 1;
+		}
+		else options.files.push_back(arg);
+	}
+
+	if (command == "check" && options.files.empty()) return check(options);
+	if (command == "info" && options.files.size() == 1) return info(options.files[0]);
+	usage();
+	return 1;
+}
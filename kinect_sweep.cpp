@@ -0,0 +1,431 @@
+// Offline tuning: replays recorded sessions through body identification and joint smoothing
+// under many parameter sets, in parallel, and ranks them
+#include "BodyIdentifier.h"
+#include "Config.h"
+#include "JointFilter.h"
+#include "SkeletonRecording.h"
+#include "SyntheticSource.h"
+#include "WorkerPool.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace KinectOsvr {
+	namespace {
+		// Tracking jumping further than this to a new ID counts as picking up someone else, in metres
+		const float SwitchDistance = 0.5f;
+		// Slower joints say nothing useful about lag, in metres per second
+		const float MinLagSpeed = 0.3f;
+
+		struct Session {
+			std::string name;
+			std::vector<SkeletonFrame> frames;
+		};
+
+		struct Metrics {
+			// RMS frame-to-frame acceleration of the reported joints, in mm
+			double jitter;
+			// How far the reported joints trail the raw ones, in ms
+			double lag;
+			// Jumps to a different person, per minute
+			double switches;
+			// Mean time from someone being visible to them being tracked, in seconds
+			double reacquire;
+			double score;
+		};
+
+		struct Weights {
+			Weights() : jitter(1.0), lag(0.1), switches(10.0), reacquire(2.0) {}
+			double jitter, lag, switches, reacquire;
+		};
+
+		struct Parameter {
+			const char* name;
+			double low, high;
+			int steps;
+			void (*set)(Config& config, double value);
+			double (*get)(const Config& config);
+		};
+
+		Parameter Parameters[] = {
+			{ "acquire-threshold", 0.5, 0.95, 4, [](Config& c, double v) { c.tracking.acquireThreshold = v; },
+				[](const Config& c) { return (double)c.tracking.acquireThreshold; } },
+			{ "playspace-size", 4.0, 10.0, 3, [](Config& c, double v) { c.tracking.playspaceSize = v; },
+				[](const Config& c) { return (double)c.tracking.playspaceSize; } },
+			{ "reacquire-time", 2000.0, 15000.0, 3, [](Config& c, double v) { c.tracking.reacquireTime = v; },
+				[](const Config& c) { return (double)c.tracking.reacquireTime; } },
+			{ "signature-tolerance", 0.0, 0.06, 3, [](Config& c, double v) { c.tracking.signatureTolerance = v; },
+				[](const Config& c) { return (double)c.tracking.signatureTolerance; } },
+			{ "smoothing", 0.0, 0.75, 4, [](Config& c, double v) { c.filter.smoothing = (float)v; },
+				[](const Config& c) { return (double)c.filter.smoothing; } },
+			{ "correction", 0.1, 0.7, 3, [](Config& c, double v) { c.filter.correction = (float)v; },
+				[](const Config& c) { return (double)c.filter.correction; } },
+			{ "prediction", 0.0, 1.0, 2, [](Config& c, double v) { c.filter.prediction = (float)v; },
+				[](const Config& c) { return (double)c.filter.prediction; } },
+			{ "jitter-radius", 0.01, 0.08, 3, [](Config& c, double v) { c.filter.jitterRadius = (float)v; },
+				[](const Config& c) { return (double)c.filter.jitterRadius; } },
+			{ "max-deviation-radius", 0.02, 0.08, 2, [](Config& c, double v) { c.filter.maxDeviationRadius = (float)v; },
+				[](const Config& c) { return (double)c.filter.maxDeviationRadius; } }
+		};
+		const int ParameterCount = sizeof(Parameters) / sizeof(Parameters[0]);
+
+		double gridValue(const Parameter& parameter, int step) {
+			if (parameter.steps <= 1) return parameter.low;
+			return parameter.low + (parameter.high - parameter.low) * step / (parameter.steps - 1);
+		}
+
+		float distance(const float a[3], const float b[3]) {
+			float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+			return sqrtf(dx * dx + dy * dy + dz * dz);
+		}
+
+		// Runs one session as the plugin would and measures what it would have reported
+		Metrics replay(const Session& session, const Config& config, const Weights& weights) {
+			BodyIdentifier identifier(config.tracking);
+			JointFilter filters[MaxBodies];
+			SkeletonFrame frame;
+
+			// The last two reported skeletons, for jitter and lag
+			Skeleton previous[2];
+			int history = 0;
+
+			bool haveLast = false;
+			uint64_t lastId = 0;
+			float lastPosition[3] = { 0, 0, 0 };
+			int64_t lostSince = -1;
+
+			double jitterSum = 0, lagSum = 0, reacquireSum = 0;
+			long long jitterCount = 0, lagCount = 0, reacquireCount = 0, switches = 0;
+
+			for (size_t i = 0; i < session.frames.size(); i++) {
+				const SkeletonFrame& raw = session.frames[i];
+				memcpy(&frame, &raw, sizeof(frame));
+				int joints = frame.jointCount;
+
+				int body = identifier.identify(frame);
+				if (config.filter.enabled()) {
+					for (int b = 0; b < MaxBodies; b++) {
+						if (frame.bodies[b].tracking == BodyTracked) {
+							filters[b].apply(frame.bodies[b], joints, config.filter);
+						}
+					}
+				}
+
+				bool visible = false;
+				for (int b = 0; b < MaxBodies; b++) {
+					visible = visible || frame.bodies[b].tracking != BodyNotTracked;
+				}
+
+				if (body < 0) {
+					history = 0;
+					lostSince = visible ? (lostSince < 0 ? frame.timestamp : lostSince) : -1;
+					continue;
+				}
+
+				if (lostSince >= 0) {
+					reacquireSum += (frame.timestamp - lostSince) / 1000000.0;
+					reacquireCount++;
+					lostSince = -1;
+				}
+
+				const Skeleton& out = frame.bodies[body];
+				if (haveLast && out.trackingId != lastId && distance(out.position, lastPosition) > SwitchDistance) {
+					switches++;
+				}
+				if (haveLast && out.trackingId != lastId) {
+					history = 0;
+				}
+				haveLast = true;
+				lastId = out.trackingId;
+				memcpy(lastPosition, out.position, sizeof(lastPosition));
+
+				if (out.tracking != BodyTracked) {
+					history = 0;
+					continue;
+				}
+
+				if (history >= 2) {
+					for (int j = 0; j < joints; j++) {
+						if (out.jointTracking[j] != JointTracked) continue;
+						float ax = out.x[j] - 2 * previous[1].x[j] + previous[0].x[j];
+						float ay = out.y[j] - 2 * previous[1].y[j] + previous[0].y[j];
+						float az = out.z[j] - 2 * previous[1].z[j] + previous[0].z[j];
+						jitterSum += ax * ax + ay * ay + az * az;
+						jitterCount++;
+					}
+				}
+
+				// Lag is how far behind the raw joint the output is, over how fast the joint moves
+				const SkeletonFrame& rawPrevious = session.frames[i > 0 ? i - 1 : 0];
+				const Skeleton& rawBody = raw.bodies[body];
+				double dt = (raw.timestamp - rawPrevious.timestamp) / 1000000.0;
+				if (i > 0 && dt > 0 && rawPrevious.bodies[body].trackingId == rawBody.trackingId) {
+					for (int j = 0; j < joints; j++) {
+						if (rawBody.jointTracking[j] != JointTracked) continue;
+						float vx = (float)((rawBody.x[j] - rawPrevious.bodies[body].x[j]) / dt);
+						float vy = (float)((rawBody.y[j] - rawPrevious.bodies[body].y[j]) / dt);
+						float vz = (float)((rawBody.z[j] - rawPrevious.bodies[body].z[j]) / dt);
+						float speed2 = vx * vx + vy * vy + vz * vz;
+						if (speed2 < MinLagSpeed * MinLagSpeed) continue;
+
+						float behind = (rawBody.x[j] - out.x[j]) * vx + (rawBody.y[j] - out.y[j]) * vy + (rawBody.z[j] - out.z[j]) * vz;
+						lagSum += behind / speed2;
+						lagCount++;
+					}
+				}
+
+				memcpy(&previous[0], &previous[1], sizeof(Skeleton));
+				memcpy(&previous[1], &out, sizeof(Skeleton));
+				if (history < 2) history++;
+			}
+
+			if (lostSince >= 0 && !session.frames.empty()) {
+				reacquireSum += (session.frames.back().timestamp - lostSince) / 1000000.0;
+				reacquireCount++;
+			}
+
+			double minutes = 0;
+			if (session.frames.size() > 1) {
+				minutes = (session.frames.back().timestamp - session.frames.front().timestamp) / 60000000.0;
+			}
+
+			Metrics metrics;
+			metrics.jitter = jitterCount > 0 ? sqrt(jitterSum / jitterCount) * 1000.0 : 0.0;
+			metrics.lag = lagCount > 0 ? lagSum / lagCount * 1000.0 : 0.0;
+			metrics.switches = minutes > 0 ? switches / minutes : 0.0;
+			metrics.reacquire = reacquireCount > 0 ? reacquireSum / reacquireCount : 0.0;
+			metrics.score = weights.jitter * metrics.jitter + weights.lag * fabs(metrics.lag) +
+				weights.switches * metrics.switches + weights.reacquire * metrics.reacquire;
+			return metrics;
+		}
+
+		Session synthesize(int index, double seconds) {
+			SyntheticSource::Options options;
+			options.bodies = 2 + index % 2;
+			options.seed = index + 1;
+			options.churnRate = 0.002;
+			options.buildSpread = 0.08;
+			SyntheticSource source(options);
+
+			Session session;
+			char name[32];
+			snprintf(name, sizeof(name), "synthetic-%d", index + 1);
+			session.name = name;
+			session.frames.resize((size_t)(seconds * options.frameRate));
+			for (size_t i = 0; i < session.frames.size(); i++) {
+				source.next(session.frames[i]);
+			}
+			return session;
+		}
+
+		bool setRange(const std::string& spec) {
+			// name=low:high:steps
+			size_t equals = spec.find('=');
+			if (equals == std::string::npos) return false;
+
+			std::string name = spec.substr(0, equals);
+			for (int p = 0; p < ParameterCount; p++) {
+				if (name != Parameters[p].name) continue;
+				double low, high;
+				int steps;
+				if (sscanf(spec.c_str() + equals + 1, "%lf:%lf:%d", &low, &high, &steps) != 3 || steps < 1) return false;
+				Parameters[p].low = low;
+				Parameters[p].high = high;
+				Parameters[p].steps = steps;
+				return true;
+			}
+			return false;
+		}
+
+		void usage() {
+			std::cerr << "Usage: kinect_sweep [options] [recording.skr ...]\n"
+				"  --random N          Try N random parameter sets instead of the full grid\n"
+				"  --seed N            Seed for --random (1)\n"
+				"  --range NAME=LOW:HIGH:STEPS\n"
+				"                      Change a parameter's range, STEPS is its grid size\n"
+				"  --synthetic N       Add N synthetic sessions, the default when no recordings are given (4)\n"
+				"  --seconds S         Length of synthetic sessions (60)\n"
+				"  --threads N         Worker threads, -1 for one per core (-1)\n"
+				"  --weights J,L,S,R   Score weights for jitter mm, lag ms, switches per minute,\n"
+				"                      reacquire seconds (1,0.1,10,2)\n"
+				"  --top N             Parameter sets in the report, 0 for all (20)\n"
+				"  --report FILE       Ranked report (sweep_report.txt)\n"
+				"  --best FILE         Best settings as environment variables (sweep_best.env)\n"
+				"Parameters:";
+			for (int p = 0; p < ParameterCount; p++) {
+				std::cerr << " " << Parameters[p].name;
+			}
+			std::cerr << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace KinectOsvr;
+
+	std::vector<std::string> recordings;
+	int randomCount = 0;
+	unsigned seed = 1;
+	int synthetic = -1;
+	double seconds = 60;
+	int threads = -1;
+	int top = 20;
+	Weights weights;
+	std::string reportPath = "sweep_report.txt";
+	std::string bestPath = "sweep_best.env";
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--random" && hasValue) randomCount = atoi(argv[++i]);
+		else if (arg == "--seed" && hasValue) seed = (unsigned)atoi(argv[++i]);
+		else if (arg == "--synthetic" && hasValue) synthetic = atoi(argv[++i]);
+		else if (arg == "--seconds" && hasValue) seconds = atof(argv[++i]);
+		else if (arg == "--threads" && hasValue) threads = atoi(argv[++i]);
+		else if (arg == "--top" && hasValue) top = atoi(argv[++i]);
+		else if (arg == "--report" && hasValue) reportPath = argv[++i];
+		else if (arg == "--best" && hasValue) bestPath = argv[++i];
+		else if (arg == "--weights" && hasValue) {
+			if (sscanf(argv[++i], "%lf,%lf,%lf,%lf", &weights.jitter, &weights.lag, &weights.switches, &weights.reacquire) != 4) {
+				usage();
+				return 1;
+			}
+		}
+		else if (arg == "--range" && hasValue) {
+			if (!setRange(argv[++i])) {
+				usage();
+				return 1;
+			}
+		}
+		else if (arg.compare(0, 2, "--") == 0) {
+			usage();
+			return 1;
+		}
+		else recordings.push_back(arg);
+	}
+
+	std::vector<Session> sessions;
+	for (size_t i = 0; i < recordings.size(); i++) {
+		Session session;
+		session.name = recordings[i];
+		if (!loadRecording(recordings[i], session.frames)) {
+			std::cerr << "Can't read recording " << recordings[i] << std::endl;
+			return 1;
+		}
+		sessions.push_back(session);
+	}
+	if (synthetic < 0) synthetic = recordings.empty() ? 4 : 0;
+	for (int i = 0; i < synthetic; i++) {
+		sessions.push_back(synthesize(i, seconds));
+	}
+	if (sessions.empty()) {
+		usage();
+		return 1;
+	}
+
+	// Parameter sets to try, starting from the defaults so they're always in the ranking
+	std::vector<Config> configs;
+	configs.push_back(Config());
+	if (randomCount > 0) {
+		std::mt19937 rng(seed);
+		for (int n = 0; n < randomCount; n++) {
+			Config config;
+			for (int p = 0; p < ParameterCount; p++) {
+				double unit = rng() / 4294967296.0;
+				Parameters[p].set(config, Parameters[p].low + (Parameters[p].high - Parameters[p].low) * unit);
+			}
+			configs.push_back(config);
+		}
+	}
+	else {
+		long long total = 1;
+		for (int p = 0; p < ParameterCount; p++) total *= Parameters[p].steps;
+		for (long long n = 0; n < total; n++) {
+			Config config;
+			long long rest = n;
+			for (int p = 0; p < ParameterCount; p++) {
+				Parameters[p].set(config, gridValue(Parameters[p], (int)(rest % Parameters[p].steps)));
+				rest /= Parameters[p].steps;
+			}
+			configs.push_back(config);
+		}
+	}
+
+	// One task per parameter set and session, so a few long sessions still spread over every core
+	size_t sessionCount = sessions.size();
+	std::vector<Metrics> results(configs.size() * sessionCount);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	{
+		WorkerPool pool(threads);
+		WorkerPool::TaskGroup group;
+		for (size_t c = 0; c < configs.size(); c++) {
+			for (size_t s = 0; s < sessionCount; s++) {
+				pool.submit(group, [&, c, s]() {
+					results[c * sessionCount + s] = replay(sessions[s], configs[c], weights);
+				});
+			}
+		}
+		pool.wait(group);
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::vector<Metrics> totals(configs.size());
+	std::vector<size_t> ranking(configs.size());
+	for (size_t c = 0; c < configs.size(); c++) {
+		Metrics& total = totals[c];
+		total.jitter = total.lag = total.switches = total.reacquire = total.score = 0;
+		for (size_t s = 0; s < sessionCount; s++) {
+			const Metrics& m = results[c * sessionCount + s];
+			total.jitter += m.jitter / sessionCount;
+			total.lag += m.lag / sessionCount;
+			total.switches += m.switches / sessionCount;
+			total.reacquire += m.reacquire / sessionCount;
+			total.score += m.score / sessionCount;
+		}
+		ranking[c] = c;
+	}
+	std::stable_sort(ranking.begin(), ranking.end(), [&](size_t a, size_t b) { return totals[a].score < totals[b].score; });
+
+	size_t frames = 0;
+	for (size_t s = 0; s < sessionCount; s++) frames += sessions[s].frames.size();
+
+	std::ofstream report(reportPath.c_str());
+	report << "# " << configs.size() << " parameter sets, " << sessionCount << " sessions, " << frames << " frames, "
+		<< elapsed << " s\n";
+	report << "# weights: jitter " << weights.jitter << ", lag " << weights.lag << ", switches " << weights.switches
+		<< ", reacquire " << weights.reacquire << "\n";
+	report << "rank\tscore\tjitter_mm\tlag_ms\tswitches_per_min\treacquire_s";
+	for (int p = 0; p < ParameterCount; p++) report << "\t" << Parameters[p].name;
+	report << "\n";
+
+	size_t shown = top > 0 ? std::min((size_t)top, ranking.size()) : ranking.size();
+	for (size_t r = 0; r < shown; r++) {
+		const Config& config = configs[ranking[r]];
+		const Metrics& m = totals[ranking[r]];
+		report << r + 1 << "\t" << m.score << "\t" << m.jitter << "\t" << m.lag << "\t" << m.switches << "\t" << m.reacquire;
+		// From the same table as the header, so the columns can't drift apart
+		for (int p = 0; p < ParameterCount; p++) report << "\t" << Parameters[p].get(config);
+		report << "\n";
+	}
+
+	std::ofstream best(bestPath.c_str());
+	best << configs[ranking[0]].toEnvironment();
+
+	const Metrics& winner = totals[ranking[0]];
+	std::cout << configs.size() << " parameter sets x " << sessionCount << " sessions in " << elapsed << " s ("
+		<< (configs.size() * frames / (elapsed > 0 ? elapsed : 1)) << " frames/s)" << std::endl;
+	std::cout << "Best score " << winner.score << " (defaults " << totals[0].score << "), written to " << bestPath << std::endl;
+	return 0;
+}
@@ -0,0 +1,561 @@
+#include "PluginKitStandIn.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <utility>
+
+using namespace KinectOsvr::StandIn;
+
+struct OSVR_PluginRegContextObject {
+	int unused;
+};
+
+struct OSVR_DeviceTokenObject {
+	int device;
+};
+
+struct OSVR_TrackerDeviceInterfaceObject {
+	int device;
+};
+
+struct OSVR_AnalogDeviceInterfaceObject {
+	int device;
+	OSVR_ChannelCount channels;
+};
+
+struct OSVR_ButtonDeviceInterfaceObject {
+	int device;
+	OSVR_ChannelCount channels;
+};
+
+struct OSVR_DeviceInitObject {
+	OSVR_TrackerDeviceInterfaceObject* tracker;
+	OSVR_AnalogDeviceInterfaceObject* analog;
+	OSVR_ButtonDeviceInterfaceObject* button;
+};
+
+namespace {
+	// Channel counts and semantic targets pulled out of a device's JSON descriptor
+	struct Descriptor {
+		Descriptor() : parsed(false) {
+			for (int i = 0; i < ReportTypeCount; i++) count[i] = -1;
+		}
+
+		bool parsed;
+		long count[ReportTypeCount];
+		std::set<std::pair<int, OSVR_ChannelCount> > semantic;
+	};
+
+	// Just enough JSON to read descriptors, which OSVR allows to contain comments
+	class DescriptorParser {
+	public:
+		DescriptorParser(const char* json, size_t length, Descriptor& descriptor)
+			: m_p(json), m_end(json + length), m_descriptor(descriptor) {}
+
+		bool parse() {
+			return value("") && (skipSpace(), m_p == m_end);
+		}
+
+	private:
+		void skipSpace() {
+			while (m_p < m_end) {
+				if (*m_p == ' ' || *m_p == '\t' || *m_p == '\r' || *m_p == '\n') {
+					m_p++;
+				}
+				else if (m_p + 1 < m_end && m_p[0] == '/' && m_p[1] == '/') {
+					while (m_p < m_end && *m_p != '\n') m_p++;
+				}
+				else if (m_p + 1 < m_end && m_p[0] == '/' && m_p[1] == '*') {
+					m_p += 2;
+					while (m_p + 1 < m_end && !(m_p[0] == '*' && m_p[1] == '/')) m_p++;
+					m_p += 2;
+				}
+				else {
+					break;
+				}
+			}
+		}
+
+		bool string(std::string& out) {
+			if (m_p >= m_end || *m_p != '"') return false;
+			m_p++;
+			while (m_p < m_end && *m_p != '"') {
+				if (*m_p == '\\' && m_p + 1 < m_end) m_p++;
+				out += *m_p++;
+			}
+			if (m_p >= m_end) return false;
+			m_p++;
+			return true;
+		}
+
+		bool value(const std::string& path) {
+			skipSpace();
+			if (m_p >= m_end) return false;
+
+			if (*m_p == '{') {
+				m_p++;
+				skipSpace();
+				if (m_p < m_end && *m_p == '}') {
+					m_p++;
+					return true;
+				}
+				while (true) {
+					std::string key;
+					skipSpace();
+					if (!string(key)) return false;
+					skipSpace();
+					if (m_p >= m_end || *m_p++ != ':') return false;
+					if (!value(path + "/" + key)) return false;
+					skipSpace();
+					if (m_p < m_end && *m_p == ',') {
+						m_p++;
+						continue;
+					}
+					if (m_p < m_end && *m_p == '}') {
+						m_p++;
+						return true;
+					}
+					return false;
+				}
+			}
+			if (*m_p == '[') {
+				m_p++;
+				skipSpace();
+				if (m_p < m_end && *m_p == ']') {
+					m_p++;
+					return true;
+				}
+				while (true) {
+					if (!value(path + "/[]")) return false;
+					skipSpace();
+					if (m_p < m_end && *m_p == ',') {
+						m_p++;
+						continue;
+					}
+					if (m_p < m_end && *m_p == ']') {
+						m_p++;
+						return true;
+					}
+					return false;
+				}
+			}
+			if (*m_p == '"') {
+				std::string text;
+				if (!string(text)) return false;
+				if (path.compare(0, 10, "/semantic/") == 0) {
+					target(text);
+				}
+				return true;
+			}
+
+			const char* start = m_p;
+			while (m_p < m_end && std::strchr(",}] \t\r\n/", *m_p) == NULL) m_p++;
+			std::string literal(start, m_p);
+			if (literal.empty()) return false;
+
+			static const char* counts[ReportTypeCount] = { "/interfaces/tracker/count", "/interfaces/analog/count", "/interfaces/button/count" };
+			for (int i = 0; i < ReportTypeCount; i++) {
+				if (path == counts[i]) {
+					m_descriptor.count[i] = std::strtol(literal.c_str(), NULL, 10);
+				}
+			}
+			return true;
+		}
+
+		// Semantic entries look like "analog/3"
+		void target(const std::string& text) {
+			static const char* names[ReportTypeCount] = { "tracker/", "analog/", "button/" };
+			for (int i = 0; i < ReportTypeCount; i++) {
+				size_t length = std::strlen(names[i]);
+				if (text.compare(0, length, names[i]) == 0 && text.size() > length) {
+					char* end;
+					unsigned long channel = std::strtoul(text.c_str() + length, &end, 10);
+					if (*end == '\0') {
+						m_descriptor.semantic.insert(std::make_pair(i, (OSVR_ChannelCount)channel));
+					}
+				}
+			}
+		}
+
+		const char* m_p;
+		const char* m_end;
+		Descriptor& m_descriptor;
+	};
+
+	struct Device {
+		DeviceInfo info;
+		OSVR_DeviceUpdateCallback callback;
+		void* userData;
+		Descriptor descriptor;
+	};
+
+	struct Counters {
+		std::atomic<unsigned long long> calls;
+		std::atomic<unsigned long long> rejected;
+		std::atomic<unsigned long long> totalNanoseconds;
+		std::atomic<unsigned long long> maxNanoseconds;
+	};
+
+	struct State {
+		State() : next(0), dropped(0), validation(false) {}
+
+		OSVR_PluginRegContextObject context;
+
+		std::vector<Report> log;
+		std::atomic<size_t> next;
+		std::atomic<size_t> dropped;
+		Counters counters[ReportTypeCount];
+
+		std::deque<Device> devices;
+		std::vector<std::unique_ptr<OSVR_DeviceInitObject> > options;
+		std::vector<std::unique_ptr<OSVR_DeviceTokenObject> > tokens;
+		std::vector<std::unique_ptr<OSVR_TrackerDeviceInterfaceObject> > trackers;
+		std::vector<std::unique_ptr<OSVR_AnalogDeviceInterfaceObject> > analogs;
+		std::vector<std::unique_ptr<OSVR_ButtonDeviceInterfaceObject> > buttons;
+
+		bool validation;
+		std::mutex errorMutex;
+		std::vector<std::string> errors;
+	};
+
+	State& state() {
+		static State s;
+		return s;
+	}
+
+	unsigned long long nowNanoseconds() {
+		return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void addError(int device, const std::string& message) {
+		State& s = state();
+		std::lock_guard<std::mutex> lock(s.errorMutex);
+		std::string name = device >= 0 && device < (int)s.devices.size() ? s.devices[device].info.name : "(no device)";
+		s.errors.push_back(name + ": " + message);
+	}
+
+	const char* typeName(ReportType type) {
+		static const char* names[ReportTypeCount] = { "tracker", "analog", "button" };
+		return names[type];
+	}
+
+	// Returns false if the report doesn't match what the device declared
+	bool validate(ReportType type, int device, OSVR_ChannelCount channel, long configured) {
+		State& s = state();
+		if (!s.validation) return true;
+
+		bool valid = true;
+		if (device < 0) {
+			addError(device, std::string(typeName(type)) + " report through an interface that was never attached to a device");
+			return false;
+		}
+		if (configured >= 0 && (long)channel >= configured) {
+			addError(device, std::string(typeName(type)) + " channel " + std::to_string(channel) + " outside the " + std::to_string(configured) + " configured");
+			valid = false;
+		}
+
+		const Descriptor& descriptor = s.devices[device].descriptor;
+		if (descriptor.parsed) {
+			if (descriptor.count[type] >= 0 && (long)channel >= descriptor.count[type]) {
+				addError(device, std::string(typeName(type)) + " channel " + std::to_string(channel) + " outside the descriptor count of " + std::to_string(descriptor.count[type]));
+				valid = false;
+			}
+			if (descriptor.semantic.find(std::make_pair((int)type, channel)) == descriptor.semantic.end()) {
+				addError(device, std::string(typeName(type)) + "/" + std::to_string(channel) + " has no semantic path in the descriptor");
+				valid = false;
+			}
+		}
+		return valid;
+	}
+
+	Report* claim(ReportType type, int device, OSVR_ChannelCount channel, OSVR_TimeValue const* timestamp) {
+		State& s = state();
+		size_t index = s.next.fetch_add(1, std::memory_order_relaxed);
+		if (index >= s.log.size()) {
+			s.dropped.fetch_add(1, std::memory_order_relaxed);
+			return NULL;
+		}
+
+		Report* report = &s.log[index];
+		report->type = type;
+		report->device = device;
+		report->channel = channel;
+		osvrTimeValueGetNow(&report->sentAt);
+		report->timestamp = timestamp ? *timestamp : report->sentAt;
+		return report;
+	}
+
+	void record(ReportType type, unsigned long long start, bool valid) {
+		Counters& counters = state().counters[type];
+		unsigned long long elapsed = nowNanoseconds() - start;
+
+		counters.calls.fetch_add(1, std::memory_order_relaxed);
+		counters.totalNanoseconds.fetch_add(elapsed, std::memory_order_relaxed);
+		if (!valid) {
+			counters.rejected.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		unsigned long long max = counters.maxNanoseconds.load(std::memory_order_relaxed);
+		while (elapsed > max && !counters.maxNanoseconds.compare_exchange_weak(max, elapsed)) {}
+	}
+}
+
+void osvrTimeValueGetNow(OSVR_TimeValue* dest) {
+	long long us = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	dest->seconds = us / 1000000;
+	dest->microseconds = (OSVR_TimeValue_Microseconds)(us % 1000000);
+}
+
+OSVR_DeviceInitOptions osvrDeviceCreateInitOptions(OSVR_PluginRegContext) {
+	OSVR_DeviceInitObject* options = new OSVR_DeviceInitObject();
+	options->tracker = NULL;
+	options->analog = NULL;
+	options->button = NULL;
+	state().options.push_back(std::unique_ptr<OSVR_DeviceInitObject>(options));
+	return options;
+}
+
+OSVR_ReturnCode osvrDeviceTrackerConfigure(OSVR_DeviceInitOptions opts, OSVR_TrackerDeviceInterface* iface) {
+	OSVR_TrackerDeviceInterfaceObject* tracker = new OSVR_TrackerDeviceInterfaceObject();
+	tracker->device = -1;
+	state().trackers.push_back(std::unique_ptr<OSVR_TrackerDeviceInterfaceObject>(tracker));
+
+	opts->tracker = tracker;
+	*iface = tracker;
+	return OSVR_RETURN_SUCCESS;
+}
+
+OSVR_ReturnCode osvrDeviceAnalogConfigure(OSVR_DeviceInitOptions opts, OSVR_AnalogDeviceInterface* iface, OSVR_ChannelCount numChan) {
+	OSVR_AnalogDeviceInterfaceObject* analog = new OSVR_AnalogDeviceInterfaceObject();
+	analog->device = -1;
+	analog->channels = numChan;
+	state().analogs.push_back(std::unique_ptr<OSVR_AnalogDeviceInterfaceObject>(analog));
+
+	opts->analog = analog;
+	*iface = analog;
+	return OSVR_RETURN_SUCCESS;
+}
+
+OSVR_ReturnCode osvrDeviceButtonConfigure(OSVR_DeviceInitOptions opts, OSVR_ButtonDeviceInterface* iface, OSVR_ChannelCount numChan) {
+	OSVR_ButtonDeviceInterfaceObject* button = new OSVR_ButtonDeviceInterfaceObject();
+	button->device = -1;
+	button->channels = numChan;
+	state().buttons.push_back(std::unique_ptr<OSVR_ButtonDeviceInterfaceObject>(button));
+
+	opts->button = button;
+	*iface = button;
+	return OSVR_RETURN_SUCCESS;
+}
+
+OSVR_ReturnCode osvrDeviceAsyncInitWithOptions(OSVR_PluginRegContext, const char* name, OSVR_DeviceInitOptions options, OSVR_DeviceToken* device) {
+	State& s = state();
+	int index = (int)s.devices.size();
+
+	Device created;
+	created.info.name = name;
+	created.info.tracker = options->tracker != NULL;
+	created.info.analogChannels = options->analog ? options->analog->channels : 0;
+	created.info.buttonChannels = options->button ? options->button->channels : 0;
+	created.info.updates = 0;
+	created.callback = NULL;
+	created.userData = NULL;
+	s.devices.push_back(created);
+
+	if (options->tracker) options->tracker->device = index;
+	if (options->analog) options->analog->device = index;
+	if (options->button) options->button->device = index;
+
+	OSVR_DeviceTokenObject* token = new OSVR_DeviceTokenObject();
+	token->device = index;
+	s.tokens.push_back(std::unique_ptr<OSVR_DeviceTokenObject>(token));
+	*device = token;
+	return OSVR_RETURN_SUCCESS;
+}
+
+OSVR_ReturnCode osvrDeviceSendJsonDescriptor(OSVR_DeviceToken device, const char* json, size_t length) {
+	Device& target = state().devices[device->device];
+	target.info.descriptor.assign(json, length);
+	target.descriptor = Descriptor();
+
+	DescriptorParser parser(json, length, target.descriptor);
+	target.descriptor.parsed = parser.parse();
+	if (!target.descriptor.parsed) {
+		addError(device->device, "JSON descriptor could not be parsed");
+		return OSVR_RETURN_FAILURE;
+	}
+	return OSVR_RETURN_SUCCESS;
+}
+
+OSVR_ReturnCode osvrDeviceRegisterUpdateCallback(OSVR_DeviceToken device, OSVR_DeviceUpdateCallback updateCallback, void* userData) {
+	Device& target = state().devices[device->device];
+	target.callback = updateCallback;
+	target.userData = userData;
+	return OSVR_RETURN_SUCCESS;
+}
+
+OSVR_ReturnCode osvrDeviceTrackerSendPoseTimestamped(OSVR_DeviceToken dev, OSVR_TrackerDeviceInterface iface, OSVR_PoseState const* val, OSVR_ChannelCount sensor, OSVR_TimeValue const* timestamp) {
+	unsigned long long start = nowNanoseconds();
+
+	bool valid = validate(TrackerReport, iface->device, sensor, -1) && dev->device == iface->device;
+	Report* report = claim(TrackerReport, iface->device, sensor, timestamp);
+	if (report) {
+		report->value[0] = osvrVec3GetX(&val->translation);
+		report->value[1] = osvrVec3GetY(&val->translation);
+		report->value[2] = osvrVec3GetZ(&val->translation);
+		report->value[3] = osvrQuatGetW(&val->rotation);
+		report->value[4] = osvrQuatGetX(&val->rotation);
+		report->value[5] = osvrQuatGetY(&val->rotation);
+		report->value[6] = osvrQuatGetZ(&val->rotation);
+	}
+
+	record(TrackerReport, start, valid);
+	return valid ? OSVR_RETURN_SUCCESS : OSVR_RETURN_FAILURE;
+}
+
+OSVR_ReturnCode osvrDeviceAnalogSetValueTimestamped(OSVR_DeviceToken dev, OSVR_AnalogDeviceInterface iface, OSVR_AnalogState val, OSVR_ChannelCount chan, OSVR_TimeValue const* timestamp) {
+	unsigned long long start = nowNanoseconds();
+
+	bool valid = validate(AnalogReport, iface->device, chan, iface->channels) && dev->device == iface->device;
+	Report* report = claim(AnalogReport, iface->device, chan, timestamp);
+	if (report) {
+		report->value[0] = val;
+	}
+
+	record(AnalogReport, start, valid);
+	return valid ? OSVR_RETURN_SUCCESS : OSVR_RETURN_FAILURE;
+}
+
+OSVR_ReturnCode osvrDeviceAnalogSetValuesTimestamped(OSVR_DeviceToken dev, OSVR_AnalogDeviceInterface iface, OSVR_AnalogState val[], OSVR_ChannelCount chans, OSVR_TimeValue const* timestamp) {
+	unsigned long long start = nowNanoseconds();
+
+	bool valid = dev->device == iface->device;
+	for (OSVR_ChannelCount i = 0; i < chans; i++) {
+		valid = validate(AnalogReport, iface->device, i, iface->channels) && valid;
+		Report* report = claim(AnalogReport, iface->device, i, timestamp);
+		if (report) {
+			report->value[0] = val[i];
+		}
+	}
+
+	record(AnalogReport, start, valid);
+	return valid ? OSVR_RETURN_SUCCESS : OSVR_RETURN_FAILURE;
+}
+
+OSVR_ReturnCode osvrDeviceButtonSetValues(OSVR_DeviceToken dev, OSVR_ButtonDeviceInterface iface, OSVR_ButtonState val[], OSVR_ChannelCount chans) {
+	unsigned long long start = nowNanoseconds();
+
+	bool valid = dev->device == iface->device;
+	for (OSVR_ChannelCount i = 0; i < chans; i++) {
+		valid = validate(ButtonReport, iface->device, i, iface->channels) && valid;
+		Report* report = claim(ButtonReport, iface->device, i, NULL);
+		if (report) {
+			report->value[0] = val[i];
+		}
+	}
+
+	record(ButtonReport, start, valid);
+	return valid ? OSVR_RETURN_SUCCESS : OSVR_RETURN_FAILURE;
+}
+
+namespace KinectOsvr {
+	namespace StandIn {
+		void reset(size_t capacity) {
+			State& s = state();
+			s.devices.clear();
+			s.options.clear();
+			s.tokens.clear();
+			s.trackers.clear();
+			s.analogs.clear();
+			s.buttons.clear();
+
+			s.log.assign(capacity, Report());
+			clearReports();
+			for (int i = 0; i < ReportTypeCount; i++) {
+				s.counters[i].calls = 0;
+				s.counters[i].rejected = 0;
+				s.counters[i].totalNanoseconds = 0;
+				s.counters[i].maxNanoseconds = 0;
+			}
+
+			std::lock_guard<std::mutex> lock(s.errorMutex);
+			s.errors.clear();
+		}
+
+		OSVR_PluginRegContext context() {
+			return &state().context;
+		}
+
+		void setValidation(bool enabled) {
+			state().validation = enabled;
+		}
+
+		const std::vector<std::string>& validationErrors() {
+			return state().errors;
+		}
+
+		OSVR_ReturnCode update() {
+			State& s = state();
+			OSVR_ReturnCode result = OSVR_RETURN_SUCCESS;
+			for (size_t i = 0; i < s.devices.size(); i++) {
+				Device& device = s.devices[i];
+				if (device.callback) {
+					device.info.updates++;
+					if (device.callback(device.userData) != OSVR_RETURN_SUCCESS) {
+						result = OSVR_RETURN_FAILURE;
+					}
+				}
+			}
+			return result;
+		}
+
+		size_t reportCount() {
+			State& s = state();
+			size_t count = s.next.load(std::memory_order_acquire);
+			return count < s.log.size() ? count : s.log.size();
+		}
+
+		size_t droppedReports() {
+			return state().dropped.load(std::memory_order_acquire);
+		}
+
+		const Report& report(size_t index) {
+			return state().log[index];
+		}
+
+		void clearReports() {
+			State& s = state();
+			s.next = 0;
+			s.dropped = 0;
+		}
+
+		CallStats stats(ReportType type) {
+			Counters& counters = state().counters[type];
+			CallStats stats;
+			stats.calls = counters.calls.load();
+			stats.rejected = counters.rejected.load();
+			stats.totalNanoseconds = counters.totalNanoseconds.load();
+			stats.maxNanoseconds = counters.maxNanoseconds.load();
+			return stats;
+		}
+
+		int deviceCount() {
+			return (int)state().devices.size();
+		}
+
+		const DeviceInfo& device(int index) {
+			return state().devices[index].info;
+		}
+
+		double latencySeconds(const Report& report) {
+			return osvrTimeValueDurationSeconds(&report.sentAt, &report.timestamp);
+		}
+	}
+}
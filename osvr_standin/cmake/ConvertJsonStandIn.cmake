@@ -0,0 +1,7 @@
+# Embeds a JSON descriptor as a string constant, like osvr_convert_json but
+# without the OSVR tool. Comments are kept, the stand-in parser accepts them.
+function(osvr_convert_json _symbol _input _output)
+	file(READ "${CMAKE_CURRENT_SOURCE_DIR}/${_input}" _json)
+	file(WRITE "${_output}" "#pragma once\n\nstatic const char ${_symbol}[] = R\"osvrjson(${_json})osvrjson\";\n")
+	set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS "${CMAKE_CURRENT_SOURCE_DIR}/${_input}")
+endfunction()
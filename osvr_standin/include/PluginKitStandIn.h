@@ -0,0 +1,76 @@
+#pragma once
+
+#include <osvr/PluginKit/PluginKit.h>
+#include <osvr/PluginKit/TrackerInterfaceC.h>
+#include <osvr/PluginKit/AnalogInterfaceC.h>
+#include <osvr/PluginKit/ButtonInterfaceC.h>
+
+#include <string>
+#include <vector>
+
+// In-process replacement for the parts of the OSVR server a device plugin talks to.
+// Every report lands in a preallocated log so benchmarks and checks can see exactly what was sent.
+namespace KinectOsvr {
+	namespace StandIn {
+		enum ReportType {
+			TrackerReport,
+			AnalogReport,
+			ButtonReport,
+			ReportTypeCount
+		};
+
+		struct Report {
+			ReportType type;
+			int device;
+			OSVR_ChannelCount channel;
+			// Timestamp given by the plugin, and when the call was made
+			OSVR_TimeValue timestamp;
+			OSVR_TimeValue sentAt;
+			// Pose as x, y, z, w, qx, qy, qz, analog and button values in value[0]
+			double value[7];
+		};
+
+		struct CallStats {
+			unsigned long long calls;
+			unsigned long long rejected;
+			// Time spent inside the stand-in, so it can be subtracted from end-to-end numbers
+			unsigned long long totalNanoseconds;
+			unsigned long long maxNanoseconds;
+		};
+
+		struct DeviceInfo {
+			std::string name;
+			bool tracker;
+			OSVR_ChannelCount analogChannels;
+			OSVR_ChannelCount buttonChannels;
+			std::string descriptor;
+			unsigned long long updates;
+		};
+
+		// Clears devices, reports and statistics, and preallocates room for this many reports
+		void reset(size_t capacity = 1 << 20);
+
+		// Registration context to hand to device constructors
+		OSVR_PluginRegContext context();
+
+		// Checks each report against the device's configured channels and JSON descriptor
+		void setValidation(bool enabled);
+		const std::vector<std::string>& validationErrors();
+
+		// Runs every registered update callback once, as one server loop iteration would
+		OSVR_ReturnCode update();
+
+		size_t reportCount();
+		size_t droppedReports();
+		const Report& report(size_t index);
+		void clearReports();
+
+		CallStats stats(ReportType type);
+
+		int deviceCount();
+		const DeviceInfo& device(int index);
+
+		// Capture-to-send latency of a report
+		double latencySeconds(const Report& report);
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// Stand-in for the OSVR header of the same name, used when building without OSVR
+
+#include <osvr/PluginKit/DeviceInterfaceC.h>
+#include <osvr/Util/ChannelCountC.h>
+#include <osvr/Util/ClientReportTypesC.h>
+#include <osvr/Util/TimeValueC.h>
+
+typedef struct OSVR_AnalogDeviceInterfaceObject* OSVR_AnalogDeviceInterface;
+
+OSVR_ReturnCode osvrDeviceAnalogConfigure(OSVR_DeviceInitOptions opts, OSVR_AnalogDeviceInterface* iface, OSVR_ChannelCount numChan);
+
+OSVR_ReturnCode osvrDeviceAnalogSetValueTimestamped(OSVR_DeviceToken dev, OSVR_AnalogDeviceInterface iface, OSVR_AnalogState val, OSVR_ChannelCount chan, OSVR_TimeValue const* timestamp);
+
+OSVR_ReturnCode osvrDeviceAnalogSetValuesTimestamped(OSVR_DeviceToken dev, OSVR_AnalogDeviceInterface iface, OSVR_AnalogState val[], OSVR_ChannelCount chans, OSVR_TimeValue const* timestamp);
@@ -0,0 +1,15 @@
+#pragma once
+
+// Stand-in for the OSVR header of the same name, used when building without OSVR
+
+#include <osvr/PluginKit/DeviceInterfaceC.h>
+#include <osvr/Util/ChannelCountC.h>
+#include <osvr/Util/ClientReportTypesC.h>
+#include <osvr/Util/TimeValueC.h>
+
+typedef struct OSVR_ButtonDeviceInterfaceObject* OSVR_ButtonDeviceInterface;
+
+OSVR_ReturnCode osvrDeviceButtonConfigure(OSVR_DeviceInitOptions opts, OSVR_ButtonDeviceInterface* iface, OSVR_ChannelCount numChan);
+
+// Like OSVR, values are stamped with the time of the call
+OSVR_ReturnCode osvrDeviceButtonSetValues(OSVR_DeviceToken dev, OSVR_ButtonDeviceInterface iface, OSVR_ButtonState val[], OSVR_ChannelCount chans);
@@ -0,0 +1,21 @@
+#pragma once
+
+// Stand-in for the OSVR header of the same name, used when building without OSVR
+
+#include <osvr/PluginKit/PluginRegistrationC.h>
+#include <osvr/Util/ReturnCodesC.h>
+
+#include <stddef.h>
+
+typedef struct OSVR_DeviceTokenObject* OSVR_DeviceToken;
+typedef struct OSVR_DeviceInitObject* OSVR_DeviceInitOptions;
+
+typedef OSVR_ReturnCode (*OSVR_DeviceUpdateCallback)(void* userData);
+
+OSVR_DeviceInitOptions osvrDeviceCreateInitOptions(OSVR_PluginRegContext ctx);
+
+OSVR_ReturnCode osvrDeviceAsyncInitWithOptions(OSVR_PluginRegContext ctx, const char* name, OSVR_DeviceInitOptions options, OSVR_DeviceToken* device);
+
+OSVR_ReturnCode osvrDeviceSendJsonDescriptor(OSVR_DeviceToken device, const char* json, size_t length);
+
+OSVR_ReturnCode osvrDeviceRegisterUpdateCallback(OSVR_DeviceToken device, OSVR_DeviceUpdateCallback updateCallback, void* userData);
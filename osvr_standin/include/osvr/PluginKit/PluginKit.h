@@ -0,0 +1,44 @@
+#pragma once
+
+// Stand-in for the OSVR header of the same name, used when building without OSVR
+
+#include <osvr/PluginKit/DeviceInterfaceC.h>
+
+#include <string>
+
+namespace osvr {
+namespace pluginkit {
+	class DeviceToken {
+	public:
+		DeviceToken() : m_device(NULL) {}
+
+		void initAsync(OSVR_PluginRegContext ctx, const char* name, OSVR_DeviceInitOptions options) {
+			osvrDeviceAsyncInitWithOptions(ctx, name, options, &m_device);
+		}
+
+		void sendJsonDescriptor(const char* json, size_t length) {
+			osvrDeviceSendJsonDescriptor(m_device, json, length);
+		}
+
+		void sendJsonDescriptor(std::string const& json) {
+			sendJsonDescriptor(json.c_str(), json.size());
+		}
+
+		template <typename DeviceObjectType>
+		void registerUpdateCallback(DeviceObjectType* object) {
+			osvrDeviceRegisterUpdateCallback(m_device, &DeviceToken::update<DeviceObjectType>, object);
+		}
+
+		OSVR_DeviceToken device() const { return m_device; }
+		operator OSVR_DeviceToken() const { return m_device; }
+
+	private:
+		template <typename DeviceObjectType>
+		static OSVR_ReturnCode update(void* userData) {
+			return static_cast<DeviceObjectType*>(userData)->update();
+		}
+
+		OSVR_DeviceToken m_device;
+	};
+}
+}
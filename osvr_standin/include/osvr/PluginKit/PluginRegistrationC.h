@@ -0,0 +1,5 @@
+#pragma once
+
+// Stand-in for the OSVR header of the same name, used when building without OSVR
+
+typedef struct OSVR_PluginRegContextObject* OSVR_PluginRegContext;
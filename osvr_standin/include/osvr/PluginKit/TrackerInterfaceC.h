@@ -0,0 +1,14 @@
+#pragma once
+
+// Stand-in for the OSVR header of the same name, used when building without OSVR
+
+#include <osvr/PluginKit/DeviceInterfaceC.h>
+#include <osvr/Util/ChannelCountC.h>
+#include <osvr/Util/Pose3C.h>
+#include <osvr/Util/TimeValueC.h>
+
+typedef struct OSVR_TrackerDeviceInterfaceObject* OSVR_TrackerDeviceInterface;
+
+OSVR_ReturnCode osvrDeviceTrackerConfigure(OSVR_DeviceInitOptions opts, OSVR_TrackerDeviceInterface* iface);
+
+OSVR_ReturnCode osvrDeviceTrackerSendPoseTimestamped(OSVR_DeviceToken dev, OSVR_TrackerDeviceInterface iface, OSVR_PoseState const* val, OSVR_ChannelCount sensor, OSVR_TimeValue const* timestamp);
@@ -0,0 +1,7 @@
+#pragma once
+
+// Stand-in for the OSVR header of the same name, used when building without OSVR
+
+#include <stdint.h>
+
+typedef uint32_t OSVR_ChannelCount;
@@ -0,0 +1,11 @@
+#pragma once
+
+// Stand-in for the OSVR header of the same name, used when building without OSVR
+
+#include <stdint.h>
+
+typedef double OSVR_AnalogState;
+typedef uint8_t OSVR_ButtonState;
+
+#define OSVR_BUTTON_PRESSED (1)
+#define OSVR_BUTTON_NOT_PRESSED (0)
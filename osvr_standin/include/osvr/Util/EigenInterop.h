@@ -0,0 +1,32 @@
+#pragma once
+
+// Stand-in for the OSVR header of the same name, used when building without OSVR
+
+#include <osvr/Util/Pose3C.h>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+namespace osvr {
+namespace util {
+	inline Eigen::Quaterniond fromQuat(OSVR_Quaternion const& q) {
+		return Eigen::Quaterniond(osvrQuatGetW(&q), osvrQuatGetX(&q), osvrQuatGetY(&q), osvrQuatGetZ(&q));
+	}
+
+	template <typename Derived>
+	inline void toQuat(Eigen::QuaternionBase<Derived> const& src, OSVR_Quaternion& q) {
+		osvrQuatSetW(&q, src.w());
+		osvrQuatSetX(&q, src.x());
+		osvrQuatSetY(&q, src.y());
+		osvrQuatSetZ(&q, src.z());
+	}
+
+	inline Eigen::Map<Eigen::Vector3d> vecMap(OSVR_Vec3& vec) {
+		return Eigen::Map<Eigen::Vector3d>(vec.data);
+	}
+
+	inline Eigen::Map<const Eigen::Vector3d> vecMap(OSVR_Vec3 const& vec) {
+		return Eigen::Map<const Eigen::Vector3d>(vec.data);
+	}
+}
+}
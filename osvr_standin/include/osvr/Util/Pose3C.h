@@ -0,0 +1,18 @@
+#pragma once
+
+// Stand-in for the OSVR header of the same name, used when building without OSVR
+
+#include <osvr/Util/Vec3C.h>
+#include <osvr/Util/QuaternionC.h>
+
+typedef struct OSVR_Pose3 {
+	OSVR_Vec3 translation;
+	OSVR_Quaternion rotation;
+} OSVR_Pose3;
+
+typedef OSVR_Pose3 OSVR_PoseState;
+
+inline void osvrPose3SetIdentity(OSVR_Pose3* pose) {
+	osvrVec3Zero(&pose->translation);
+	osvrQuatSetIdentity(&pose->rotation);
+}
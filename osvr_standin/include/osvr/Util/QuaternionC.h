@@ -0,0 +1,23 @@
+#pragma once
+
+// Stand-in for the OSVR header of the same name, used when building without OSVR
+
+// Stored w, x, y, z like OSVR
+typedef struct OSVR_Quaternion {
+	double data[4];
+} OSVR_Quaternion;
+
+inline double osvrQuatGetW(OSVR_Quaternion const* q) { return q->data[0]; }
+inline double osvrQuatGetX(OSVR_Quaternion const* q) { return q->data[1]; }
+inline double osvrQuatGetY(OSVR_Quaternion const* q) { return q->data[2]; }
+inline double osvrQuatGetZ(OSVR_Quaternion const* q) { return q->data[3]; }
+
+inline void osvrQuatSetW(OSVR_Quaternion* q, double val) { q->data[0] = val; }
+inline void osvrQuatSetX(OSVR_Quaternion* q, double val) { q->data[1] = val; }
+inline void osvrQuatSetY(OSVR_Quaternion* q, double val) { q->data[2] = val; }
+inline void osvrQuatSetZ(OSVR_Quaternion* q, double val) { q->data[3] = val; }
+
+inline void osvrQuatSetIdentity(OSVR_Quaternion* q) {
+	q->data[0] = 1;
+	q->data[1] = q->data[2] = q->data[3] = 0;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// Stand-in for the OSVR header of the same name, used when building without OSVR
+
+typedef char OSVR_ReturnCode;
+
+#define OSVR_RETURN_SUCCESS (0)
+#define OSVR_RETURN_FAILURE (1)
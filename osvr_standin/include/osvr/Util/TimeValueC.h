@@ -0,0 +1,45 @@
+#pragma once
+
+// Stand-in for the OSVR header of the same name, used when building without OSVR
+
+#include <stdint.h>
+
+typedef int64_t OSVR_TimeValue_Seconds;
+typedef int32_t OSVR_TimeValue_Microseconds;
+
+typedef struct OSVR_TimeValue {
+	OSVR_TimeValue_Seconds seconds;
+	OSVR_TimeValue_Microseconds microseconds;
+} OSVR_TimeValue;
+
+void osvrTimeValueGetNow(OSVR_TimeValue* dest);
+
+inline void osvrTimeValueNormalize(OSVR_TimeValue* tv) {
+	const OSVR_TimeValue_Microseconds perSecond = 1000000;
+	tv->seconds += tv->microseconds / perSecond;
+	tv->microseconds %= perSecond;
+	if (tv->seconds > 0 && tv->microseconds < 0) {
+		tv->seconds--;
+		tv->microseconds += perSecond;
+	}
+	else if (tv->seconds < 0 && tv->microseconds > 0) {
+		tv->seconds++;
+		tv->microseconds -= perSecond;
+	}
+}
+
+inline void osvrTimeValueSum(OSVR_TimeValue* tvA, OSVR_TimeValue const* tvB) {
+	tvA->seconds += tvB->seconds;
+	tvA->microseconds += tvB->microseconds;
+	osvrTimeValueNormalize(tvA);
+}
+
+inline void osvrTimeValueDifference(OSVR_TimeValue* tvA, OSVR_TimeValue const* tvB) {
+	tvA->seconds -= tvB->seconds;
+	tvA->microseconds -= tvB->microseconds;
+	osvrTimeValueNormalize(tvA);
+}
+
+inline double osvrTimeValueDurationSeconds(OSVR_TimeValue const* tvA, OSVR_TimeValue const* tvB) {
+	return double(tvA->seconds - tvB->seconds) + double(tvA->microseconds - tvB->microseconds) / 1000000.0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// Stand-in for the OSVR header of the same name, used when building without OSVR
+
+typedef struct OSVR_Vec3 {
+	double data[3];
+} OSVR_Vec3;
+
+inline double osvrVec3GetX(OSVR_Vec3 const* v) { return v->data[0]; }
+inline double osvrVec3GetY(OSVR_Vec3 const* v) { return v->data[1]; }
+inline double osvrVec3GetZ(OSVR_Vec3 const* v) { return v->data[2]; }
+
+inline void osvrVec3SetX(OSVR_Vec3* v, double val) { v->data[0] = val; }
+inline void osvrVec3SetY(OSVR_Vec3* v, double val) { v->data[1] = val; }
+inline void osvrVec3SetZ(OSVR_Vec3* v, double val) { v->data[2] = val; }
+
+inline void osvrVec3Zero(OSVR_Vec3* v) {
+	v->data[0] = v->data[1] = v->data[2] = 0;
+}
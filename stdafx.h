@@ -9,6 +9,7 @@
 #include <thread>
 #include <mutex>
 #include <map>
+#include <memory>
 
 #include <Windows.h>
 #include <windowsx.h>